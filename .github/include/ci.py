@@ -333,6 +333,19 @@ async def run_tests():
         no_capture=True,
     )
 
+    # Again with the compact rbtree node layout
+    await run_command(
+        ["cargo", "build", "-p", "scx_arena_selftests", "--features", "rb_compact"],
+        no_capture=True,
+    )
+    await run_command_in_vm(
+        "sched_ext/for-next",
+        ["target/debug/scx_arena_selftests"],
+        memory=2 * 1024 * 1024 * 1024,
+        cpus=cpu_count,
+        no_capture=True,
+    )
+
     print("✓ Tests completed successfully", flush=True)
 
 
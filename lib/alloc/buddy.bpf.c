@@ -481,6 +481,8 @@ __hidden int buddy_init(struct buddy			 *buddy,
 	int ret;
 
 	buddy->lock = lock;
+	buddy->mags = NULL;
+	buddy->nr_mags = 0;
 
 	/* 
 	 * Reserve enough address space to ensure allocations are aligned.
@@ -544,6 +546,14 @@ __weak int buddy_destroy(struct buddy *buddy)
 	/* Free up any part of the address space that did not get used. */
 	buddy_unreserve_arena_vaddr(buddy);
 
+	/* Cached blocks went away with their chunks. */
+	if (buddy->mags)
+		bpf_arena_free_pages(&arena, buddy->mags,
+				     div_round_up((u64)buddy->nr_mags * sizeof(*buddy->mags), PAGE_SIZE));
+
+	buddy->mags = NULL;
+	buddy->nr_mags = 0;
+
 	/* Clear all fields. */
 	buddy->first_chunk = NULL;
 
@@ -625,29 +635,21 @@ __weak u64 buddy_chunk_alloc(buddy_chunk_t __arg_arena *chunk,
 	return address;
 }
 
-__weak u64 buddy_alloc_internal(struct buddy *buddy, size_t size)
+/*
+ * Allocate a block of the given order. Called with the lock held. Returns
+ * with the lock still held on success, and with the lock released on failure
+ * because growing the allocator may have to drop it.
+ */
+static __always_inline u64 buddy_alloc_order(struct buddy *buddy, int order)
 {
 	buddy_chunk_t *chunk;
 	u64 address;
-	int order;
-
-	if (!buddy)
-		return (u64)NULL;
-
-	order = size_to_order(size);
-	if (order >= BUDDY_CHUNK_NUM_ORDERS || order < 0) {
-		arena_stderr("invalid order %d (sz %lu)\n", order, size);
-		return (u64)NULL;
-	}
-
-	if (buddy_lock(buddy))
-		return (u64)NULL;
 
 	for (chunk = buddy->first_chunk; chunk != NULL && can_loop;
 	     chunk = chunk->next) {
 		address = buddy_chunk_alloc(chunk, order);
 		if (address)
-			goto done;
+			return address;
 	}
 
 	/* Get a new chunk. */
@@ -661,14 +663,185 @@ __weak u64 buddy_alloc_internal(struct buddy *buddy, size_t size)
 	buddy->first_chunk = chunk;
 
 	address = buddy_chunk_alloc(buddy->first_chunk, order);
+	if (!address)
+		buddy_unlock(buddy);
+
+	return address;
+}
 
-done:
+static __always_inline int buddy_free_unlocked(struct buddy *buddy, u64 addr);
 
-	if (!address) {
+static buddy_mag_t *buddy_mag_get(struct buddy *buddy)
+{
+	u32 cpu = bpf_get_smp_processor_id();
+
+	if (!buddy->mags || cpu >= buddy->nr_mags)
+		return NULL;
+
+	return &buddy->mags[cpu];
+}
+
+/*
+ * Refill an empty magazine with half its depth worth of blocks, taking
+ * the lock only once for the whole batch.
+ */
+static int buddy_mag_refill(struct buddy *buddy, buddy_mag_t *mag, u64 order)
+{
+	bool locked = true;
+	u64 address;
+	u32 nr = 0;
+	int ret;
+
+	if ((ret = buddy_lock(buddy)))
+		return ret;
+
+	while (nr < BUDDY_MAG_BATCH && can_loop) {
+		address = buddy_alloc_order(buddy, order);
+		if (!address) {
+			/* buddy_alloc_order() drops the lock on failure. */
+			locked = false;
+			break;
+		}
+
+		/* Blocks stay fully poisoned while cached. */
+		asan_poison((u8 __arena *)address, BUDDY_POISONED,
+			    BUDDY_MIN_ALLOC_BYTES << order);
+		mag->blocks[order][nr++] = address;
+	}
+
+	if (locked)
 		buddy_unlock(buddy);
+
+	mag->nr[order] = nr;
+
+	return nr ? 0 : -ENOMEM;
+}
+
+static u64 buddy_mag_alloc(struct buddy *buddy, buddy_mag_t *mag,
+			   size_t size, u64 order)
+{
+	u64 address;
+	u32 nr;
+
+	nr = mag->nr[order];
+	if (nr) {
+		mag->stats.hits += 1;
+	} else {
+		mag->stats.misses += 1;
+		if (buddy_mag_refill(buddy, mag, order))
+			return (u64)NULL;
+
+		nr = mag->nr[order];
+	}
+
+	if (unlikely(!nr || nr > BUDDY_MAG_DEPTH))
+		return (u64)NULL;
+
+	nr -= 1;
+	address = mag->blocks[order][nr];
+	mag->nr[order] = nr;
+
+	asan_unpoison((u8 __arena *)address, size);
+
+	return address;
+}
+
+/*
+ * Return the older half of a full magazine to the allocator and slide
+ * the recently freed, likely cache-hot, blocks down to the bottom.
+ */
+static int buddy_mag_flush(struct buddy *buddy, buddy_mag_t *mag, u64 order)
+{
+	u32 i;
+	int ret;
+
+	if ((ret = buddy_lock(buddy)))
+		return ret;
+
+	for (i = 0; i < BUDDY_MAG_BATCH && can_loop; i++)
+		buddy_free_unlocked(buddy, mag->blocks[order][i]);
+
+	buddy_unlock(buddy);
+
+	for (i = BUDDY_MAG_BATCH; i < BUDDY_MAG_DEPTH && can_loop; i++)
+		mag->blocks[order][i - BUDDY_MAG_BATCH] = mag->blocks[order][i];
+
+	mag->nr[order] = BUDDY_MAG_DEPTH - BUDDY_MAG_BATCH;
+	mag->stats.flushes += 1;
+
+	return 0;
+}
+
+/*
+ * Try to absorb a free into the local magazine. Returns -ENOENT if the block
+ * is not cacheable and must go through the locked path.
+ */
+static int buddy_mag_free(struct buddy *buddy, buddy_mag_t *mag, u64 addr)
+{
+	buddy_chunk_t *chunk;
+	u64 idx;
+	u8 order;
+	u32 nr;
+	int ret;
+
+	/* Let the locked path report bad addresses. */
+	if (addr & (BUDDY_MIN_ALLOC_BYTES - 1))
+		return -ENOENT;
+
+	/*
+	 * The order of an allocated block only changes when the block
+	 * itself is freed, so it is safe to read without the lock.
+	 */
+	chunk = (void __arena *)(addr & ~BUDDY_CHUNK_OFFSET_MASK);
+	idx = (addr & BUDDY_CHUNK_OFFSET_MASK) / BUDDY_MIN_ALLOC_BYTES;
+	order = idx_get_order(chunk, idx);
+	if (order >= BUDDY_MAG_NR_CLASSES)
+		return -ENOENT;
+
+	if (mag->nr[order] >= BUDDY_MAG_DEPTH) {
+		if ((ret = buddy_mag_flush(buddy, mag, order)))
+			return ret;
+	}
+
+	nr = mag->nr[order];
+	if (unlikely(nr >= BUDDY_MAG_DEPTH))
+		return -ENOENT;
+
+	asan_poison((u8 __arena *)addr, BUDDY_POISONED,
+		    BUDDY_MIN_ALLOC_BYTES << order);
+
+	mag->blocks[order][nr] = addr;
+	mag->nr[order] = nr + 1;
+	mag->stats.frees += 1;
+
+	return 0;
+}
+
+__weak u64 buddy_alloc_internal(struct buddy *buddy, size_t size)
+{
+	buddy_mag_t *mag;
+	u64 address;
+	int order;
+
+	if (!buddy)
+		return (u64)NULL;
+
+	order = size_to_order(size);
+	if (order >= BUDDY_CHUNK_NUM_ORDERS || order < 0) {
+		arena_stderr("invalid order %d (sz %lu)\n", order, size);
 		return (u64)NULL;
 	}
 
+	if (order < BUDDY_MAG_NR_CLASSES && (mag = buddy_mag_get(buddy)))
+		return buddy_mag_alloc(buddy, mag, size, order);
+
+	if (buddy_lock(buddy))
+		return (u64)NULL;
+
+	address = buddy_alloc_order(buddy, order);
+	if (!address)
+		return (u64)NULL;
+
 	/* 
 	 * Unpoison exactly the amount of bytes requested. If the
 	 * data is smaller than the header, we must poison any
@@ -765,11 +938,15 @@ static __always_inline int buddy_free_unlocked(struct buddy *buddy, u64 addr)
 
 __weak int buddy_free_internal(struct buddy *buddy, u64 addr)
 {
+	buddy_mag_t *mag;
 	int ret;
 
 	if (!buddy)
 		return -EINVAL;
 
+	if ((mag = buddy_mag_get(buddy)) && !buddy_mag_free(buddy, mag, addr))
+		return 0;
+
 	if ((ret = buddy_lock(buddy)))
 		return ret;
 
@@ -779,3 +956,96 @@ __weak int buddy_free_internal(struct buddy *buddy, u64 addr)
 
 	return 0;
 }
+
+/*
+ * Set up per-CPU magazines for CPUs [0, nr_cpus). Must be called after
+ * buddy_init() and before the allocator is shared. A magazine is only ever
+ * touched by its own CPU, so callers must not reenter the allocator on the
+ * same CPU, e.g., from a program that can preempt another allocating one.
+ *
+ * Blocks cached in a magazine still count as allocated, so they cannot
+ * coalesce until they are flushed and double frees into a magazine are not
+ * detected.
+ */
+__weak int buddy_mag_init(struct buddy *buddy, u32 nr_cpus)
+{
+	buddy_mag_t *mags;
+	u64 pages;
+
+	if (!buddy || !nr_cpus || buddy->mags)
+		return -EINVAL;
+
+	pages = div_round_up((u64)nr_cpus * sizeof(*mags), PAGE_SIZE);
+	mags = bpf_arena_alloc_pages(&arena, NULL, pages, NUMA_NO_NODE, 0);
+	if (!mags)
+		return -ENOMEM;
+
+	buddy->nr_mags = nr_cpus;
+	buddy->mags = mags;
+
+	return 0;
+}
+
+/*
+ * Return every cached block to the allocator. Like buddy_destroy() this
+ * touches the magazines of all CPUs and must only be called while nobody
+ * else is using the allocator.
+ */
+__weak int buddy_mag_drain(struct buddy *buddy)
+{
+	buddy_mag_t *mag;
+	u32 cpu, i, nr;
+	u64 order;
+	int ret;
+
+	if (!buddy)
+		return -EINVAL;
+
+	if (!buddy->mags)
+		return 0;
+
+	if ((ret = buddy_lock(buddy)))
+		return ret;
+
+	for (cpu = 0; cpu < buddy->nr_mags && can_loop; cpu++) {
+		mag = &buddy->mags[cpu];
+
+		for (order = 0; order < BUDDY_MAG_NR_CLASSES && can_loop; order++) {
+			nr = mag->nr[order];
+			for (i = 0; i < nr && i < BUDDY_MAG_DEPTH && can_loop; i++)
+				buddy_free_unlocked(buddy, mag->blocks[order][i]);
+
+			mag->nr[order] = 0;
+		}
+	}
+
+	buddy_unlock(buddy);
+
+	return 0;
+}
+
+/* Sum up the magazine counters of all CPUs. */
+__weak int buddy_mag_stats(struct buddy *buddy, struct buddy_mag_stats *stats)
+{
+	buddy_mag_t *mag;
+	u32 cpu;
+
+	if (!buddy || !stats)
+		return -EINVAL;
+
+	stats->hits = stats->misses = stats->frees = stats->flushes = 0;
+
+	if (!buddy->mags)
+		return 0;
+
+	for (cpu = 0; cpu < buddy->nr_mags && can_loop; cpu++) {
+		mag = &buddy->mags[cpu];
+
+		stats->hits += mag->stats.hits;
+		stats->misses += mag->stats.misses;
+		stats->frees += mag->stats.frees;
+		stats->flushes += mag->stats.flushes;
+	}
+
+	return 0;
+}
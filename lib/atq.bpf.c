@@ -3,6 +3,7 @@
 #include <lib/sdt_task.h>
 
 #include <lib/atq.h>
+#include <lib/cpumask.h>
 
 /*
  * Arena task queue implementation.
@@ -17,7 +18,7 @@ int scx_atq_init(void)
 }
 
 __weak
-u64 scx_atq_create_internal(bool fifo, size_t capacity)
+u64 scx_atq_create_internal(bool fifo, size_t capacity, u64 flags)
 {
 	struct sdt_data __arena *data = NULL;
 	scx_atq_t *atq;
@@ -30,14 +31,35 @@ u64 scx_atq_create_internal(bool fifo, size_t capacity)
 	atq = (scx_atq_t *)data->payload;
 	atq->tid = data->tid;
 
-	atq->tree = rb_create(RB_NOALLOC, RB_DUPLICATE);
-	if (!atq->tree) {
-		scx_alloc_free_idx(&scx_atq_allocator, atq->tid.idx);
-		return (u64)NULL;
+	if (flags & SCX_ATQ_F_CALENDAR) {
+		/* FIFO sequence numbers are dense, use single-key buckets. */
+		atq->calq = scx_calq_create(fifo ? 0 : SCX_CALQ_VTIME_SHIFT);
+		if (!atq->calq) {
+			scx_alloc_free_idx(&scx_atq_allocator, atq->tid.idx);
+			return (u64)NULL;
+		}
+	} else {
+		atq->tree = rb_create(RB_NOALLOC, RB_DUPLICATE);
+		if (!atq->tree) {
+			scx_alloc_free_idx(&scx_atq_allocator, atq->tid.idx);
+			return (u64)NULL;
+		}
+	}
+
+	if (flags & SCX_ATQ_F_PERCPU) {
+		/* XXX Leaked on destroy, like all static allocations. */
+		atq->pcpu = scx_static_alloc(nr_cpu_ids * sizeof(*atq->pcpu), 64);
+		if (!atq->pcpu) {
+			if (atq->tree)
+				rb_destroy(atq->tree);
+			scx_alloc_free_idx(&scx_atq_allocator, atq->tid.idx);
+			return (u64)NULL;
+		}
 	}
 
 	atq->fifo = fifo;
 	atq->capacity = capacity;
+	atq->flags = flags;
 
 	return (u64)atq;
 }
@@ -50,19 +72,85 @@ int scx_atq_destroy(scx_atq_t __arg_arena *atq)
 	while (scx_atq_pop(atq) && can_loop) {
 		/* Do nothing. Just drain all the queued tasks. */
 	}
-	rb_destroy(atq->tree);
+
+	if (atq->calq)
+		scx_calq_destroy(atq->calq);
+	else
+		rb_destroy(atq->tree);
 
 	scx_alloc_free_idx(&scx_atq_allocator, atq->tid.idx);
 	return 0;
 }
 
+/*
+ * Backend dispatch between the rbtree and the calendar queue. Both take
+ * the embedded rbnode, so the rest of the ATQ code is backend-agnostic.
+ */
+static __always_inline
+int scx_atq_backend_insert(scx_atq_t *atq, rbnode_t *node)
+{
+	if (atq->calq)
+		return scx_calq_insert_node(atq->calq, node);
+
+	return rb_insert_node(atq->tree, node);
+}
+
+static __always_inline
+int scx_atq_backend_remove(scx_atq_t *atq, rbnode_t *node)
+{
+	if (atq->calq)
+		return scx_calq_remove_node(atq->calq, node);
+
+	return rb_remove_node(atq->tree, node);
+}
+
+static __always_inline
+int scx_atq_backend_pop(scx_atq_t *atq, u64 *key, u64 *value)
+{
+	if (atq->calq)
+		return scx_calq_pop(atq->calq, key, value);
+
+	return rb_pop(atq->tree, key, value);
+}
+
+static __always_inline
+int scx_atq_backend_least(scx_atq_t *atq, u64 *key, u64 *value)
+{
+	if (atq->calq)
+		return scx_calq_least(atq->calq, key, value);
+
+	return rb_least(atq->tree, key, value);
+}
+
+/*
+ * Lockless producers in SCX_ATQ_F_PERCPU mode update the size and the FIFO
+ * sequence number concurrently with the lock holder, so use atomics there.
+ */
+static __always_inline
+void scx_atq_size_add(scx_atq_t *atq, s64 delta)
+{
+	if (atq->flags & SCX_ATQ_F_PERCPU)
+		__sync_fetch_and_add(&atq->size, delta);
+	else
+		atq->size += delta;
+}
+
+static __always_inline
+u64 scx_atq_next_seq(scx_atq_t *atq)
+{
+	if (atq->flags & SCX_ATQ_F_PERCPU)
+		return __sync_fetch_and_add(&atq->seq, 1);
+
+	return atq->seq++;
+}
+
 __hidden __inline
 int scx_atq_insert_vtime_unlocked(scx_atq_t __arg_arena *atq, scx_task_common __arg_arena *taskc, u64 vtime)
 {
 	rbnode_t *node = &taskc->node;
 	int ret;
 
-	if (unlikely(atq->size == atq->capacity))
+	if (unlikely(atq->size >= atq->capacity))
 		return -ENOSPC;
 
 	if ((vtime == SCX_ATQ_FIFO) != atq->fifo)
@@ -73,15 +161,174 @@ int scx_atq_insert_vtime_unlocked(scx_atq_t __arg_arena *atq, scx_task_common __
 	 * sequence numbers to be monotonic, not
 	 * consecutive.
 	 */
-	node->key = (vtime == SCX_ATQ_FIFO) ? atq->seq++ : vtime;
+	node->key = (vtime == SCX_ATQ_FIFO) ? scx_atq_next_seq(atq) : vtime;
 	node->value = (u64)taskc;
 
-	ret = rb_insert_node(atq->tree, node);
+	ret = scx_atq_backend_insert(atq, node);
 	if (ret)
 		return ret;
 
 	taskc->atq = atq;
-	atq->size += 1;
+	scx_atq_size_add(atq, 1);
+
+	return 0;
+}
+
+/*
+ * Append the task to the CPU's staging ring without taking the ATQ lock.
+ * Returns -EAGAIN if the ring is full or we lost the race for the slot, in
+ * which case the caller falls back to the locked path.
+ */
+static __always_inline
+int scx_atq_stage(scx_atq_t *atq, scx_task_common *taskc, u64 vtime, s32 cpu)
+{
+	rbnode_t *node = &taskc->node;
+	scx_atq_pcpu_t *pcpu;
+	u64 head, tail;
+
+	if (unlikely(cpu < 0 || cpu >= nr_cpu_ids))
+		return -EINVAL;
+
+	/* Racy, but the capacity is only a soft limit for lockless inserts. */
+	if (unlikely(READ_ONCE(atq->size) >= atq->capacity))
+		return -ENOSPC;
+
+	pcpu = &atq->pcpu[cpu];
+
+	tail = READ_ONCE(pcpu->tail);
+	head = smp_load_acquire(&pcpu->head);
+	if (tail - head >= SCX_ATQ_PCPU_RING_SIZE)
+		return -EAGAIN;
+
+	if (cmpxchg(&pcpu->tail, tail, tail + 1) != tail)
+		return -EAGAIN;
+
+	/*
+	 * The slot is ours. Fill in the node before publishing it, and record
+	 * the slot so that a remove can cancel it before it is published.
+	 */
+	node->key = (vtime == SCX_ATQ_FIFO) ? scx_atq_next_seq(atq) : vtime;
+	node->value = (u64)taskc;
+	taskc->staged_cpu = cpu;
+	taskc->staged_pos = tail;
+	smp_store_release(&taskc->atq, atq);
+
+	__sync_fetch_and_add(&atq->size, 1);
+
+	/*
+	 * If the task was removed in the meantime the slot is already marked
+	 * cancelled and the drain will skip it, so there is nothing to undo.
+	 */
+	cmpxchg((u64 __arena *)&pcpu->ring[tail % SCX_ATQ_PCPU_RING_SIZE],
+		0, (u64)taskc);
+	__sync_fetch_and_add(&atq->nr_staged, 1);
+
+	return 0;
+}
+
+/*
+ * Mark the staging ring slot of a task that has not been drained yet as
+ * cancelled. The caller holds the ATQ lock, so the slot cannot be consumed
+ * under us, but its producer may still be about to publish it.
+ */
+static __always_inline
+int scx_atq_stage_cancel(scx_atq_t *atq, scx_task_common *taskc)
+{
+	scx_atq_pcpu_t *pcpu;
+	u64 __arena *slot;
+	u64 pos = taskc->staged_pos;
+	s32 cpu = taskc->staged_cpu;
+	u64 old;
+
+	if (!(atq->flags & SCX_ATQ_F_PERCPU) || !atq->pcpu)
+		return -ENOENT;
+
+	if (unlikely(cpu < 0 || cpu >= nr_cpu_ids))
+		return -ENOENT;
+
+	pcpu = &atq->pcpu[cpu];
+
+	/* Already drained, so the task is not staged anymore. */
+	if (pos < pcpu->head || pos >= smp_load_acquire(&pcpu->tail))
+		return -ENOENT;
+
+	slot = (u64 __arena *)&pcpu->ring[pos % SCX_ATQ_PCPU_RING_SIZE];
+
+	/* Claimed but not published yet. */
+	old = cmpxchg(slot, 0, SCX_ATQ_SLOT_CANCELLED);
+	if (!old)
+		return 0;
+
+	/* Published but left in the ring by a failed drain. */
+	if (old == (u64)taskc) {
+		WRITE_ONCE(*slot, SCX_ATQ_SLOT_CANCELLED);
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * Move all staged tasks into the rbtree in one batch. The caller must hold
+ * the ATQ lock, which makes it the only consumer of the staging rings.
+ */
+__hidden
+int scx_atq_drain_unlocked(scx_atq_t __arg_arena *atq)
+{
+	scx_task_common *taskc;
+	scx_atq_pcpu_t *pcpu;
+	u64 head, tail;
+	s64 drained = 0;
+	u32 ind;
+	int ret;
+	s32 cpu;
+
+	if (!(atq->flags & SCX_ATQ_F_PERCPU) || !atq->pcpu)
+		return 0;
+
+	/* Fast path, nobody staged anything since the last drain. */
+	if (!READ_ONCE(atq->nr_staged))
+		return 0;
+
+	bpf_for(cpu, 0, nr_cpu_ids) {
+		pcpu = &atq->pcpu[cpu];
+
+		head = pcpu->head;
+		tail = smp_load_acquire(&pcpu->tail);
+
+		while (head != tail && can_loop) {
+			ind = head % SCX_ATQ_PCPU_RING_SIZE;
+
+			/*
+			 * The producer claimed the slot but has not published
+			 * the task yet. Leave it and anything after it for the
+			 * next drain.
+			 */
+			taskc = smp_load_acquire(&pcpu->ring[ind]);
+			if (!taskc)
+				break;
+
+			/*
+			 * Leave a task we failed to insert at the head of the
+			 * ring and retry on the next drain rather than losing
+			 * it. The producers fall back to the locked path once
+			 * the ring fills up behind it.
+			 */
+			if ((u64)taskc != SCX_ATQ_SLOT_CANCELLED) {
+				ret = scx_atq_backend_insert(atq, &taskc->node);
+				if (unlikely(ret))
+					break;
+			}
+
+			pcpu->ring[ind] = NULL;
+			head += 1;
+			drained += 1;
+		}
+
+		smp_store_release(&pcpu->head, head);
+	}
+
+	__sync_fetch_and_add(&atq->nr_staged, -drained);
 
 	return 0;
 }
@@ -93,10 +340,21 @@ int scx_atq_insert_vtime_unlocked(scx_atq_t __arg_arena *atq, scx_task_common __
  */
 
 __hidden
-int scx_atq_insert_vtime(scx_atq_t __arg_arena *atq, scx_task_common __arg_arena *taskc, u64 vtime)
+int scx_atq_insert_vtime_cpu(scx_atq_t __arg_arena *atq, scx_task_common __arg_arena *taskc, u64 vtime, s32 cpu)
 {
 	int ret;
 
+	if (atq->flags & SCX_ATQ_F_PERCPU) {
+		if ((vtime == SCX_ATQ_FIFO) != atq->fifo)
+			return -EINVAL;
+
+		ret = scx_atq_stage(atq, taskc, vtime, cpu);
+		if (ret != -EAGAIN)
+			return ret;
+
+		/* The staging ring is full, go through the lock. */
+	}
+
 	ret = arena_spin_lock(&atq->lock);
 	if (ret)
 		return ret;
@@ -108,6 +366,12 @@ int scx_atq_insert_vtime(scx_atq_t __arg_arena *atq, scx_task_common __arg_arena
 	return ret;
 }
 
+__hidden
+int scx_atq_insert_vtime(scx_atq_t __arg_arena *atq, scx_task_common __arg_arena *taskc, u64 vtime)
+{
+	return scx_atq_insert_vtime_cpu(atq, taskc, vtime, bpf_get_smp_processor_id());
+}
+
 __hidden
 int scx_atq_insert_unlocked(scx_atq_t *atq, scx_task_common __arg_arena *taskc)
 {
@@ -129,7 +393,19 @@ int scx_atq_remove_unlocked(scx_atq_t *atq, scx_task_common __arg_arena *taskc)
        if (taskc->atq != atq)
 	       return -EINVAL;
 
-       ret = rb_remove_node(atq->tree, &taskc->node);
+       /* The task may still be sitting in a staging ring. */
+       scx_atq_drain_unlocked(atq);
+
+       /*
+        * If the drain did not get to it, its producer has not published
+        * it yet or the drain failed to insert it. Cancel the slot instead
+        * so that it never reaches the backend.
+        */
+       ret = scx_atq_backend_remove(atq, &taskc->node);
+       if (ret)
+	       ret = scx_atq_stage_cancel(atq, taskc);
+       if (!ret)
+	       scx_atq_size_add(atq, -1);
        taskc->atq = NULL;
 
        return ret;
@@ -162,17 +438,20 @@ u64 scx_atq_pop(scx_atq_t *atq)
 	if (ret)
 		return (u64)NULL;
 
+	scx_atq_drain_unlocked(atq);
+
 	if (!scx_atq_nr_queued(atq)) {
 		arena_spin_unlock(&atq->lock);
 		return (u64)NULL;
 	}
 
-	ret = rb_pop(atq->tree, &vtime, &taskc_ptr);
-	if (!ret)
-		atq->size -= 1;
+	ret = scx_atq_backend_pop(atq, &vtime, &taskc_ptr);
+	if (!ret) {
+		scx_atq_size_add(atq, -1);
 
-	taskc = (scx_task_common *)taskc_ptr;
-	taskc->atq = NULL;
+		taskc = (scx_task_common *)taskc_ptr;
+		taskc->atq = NULL;
+	}
 
 	arena_spin_unlock(&atq->lock);
 
@@ -185,6 +464,47 @@ u64 scx_atq_pop(scx_atq_t *atq)
 	return taskc_ptr;
 }
 
+/*
+ * Pop up to @max tasks into @out while holding the lock once. Returns the
+ * number of tasks popped, in the same order as repeated scx_atq_pop() calls.
+ */
+__hidden
+int scx_atq_pop_batch(scx_atq_t *atq, u64 __arena *out, u32 max)
+{
+	scx_task_common *taskc;
+	u64 vtime, taskc_ptr;
+	int ret, i;
+
+	ret = arena_spin_lock(&atq->lock);
+	if (ret)
+		return ret;
+
+	scx_atq_drain_unlocked(atq);
+
+	for (i = 0; i < max && can_loop; i++) {
+		if (!scx_atq_nr_queued(atq))
+			break;
+
+		ret = scx_atq_backend_pop(atq, &vtime, &taskc_ptr);
+		if (ret) {
+			if (ret != -ENOENT)
+				bpf_printk("%s: error %d", __func__, ret);
+			break;
+		}
+
+		scx_atq_size_add(atq, -1);
+
+		taskc = (scx_task_common *)taskc_ptr;
+		taskc->atq = NULL;
+
+		out[i] = taskc_ptr;
+	}
+
+	arena_spin_unlock(&atq->lock);
+
+	return i;
+}
+
 __hidden
 u64 scx_atq_peek(scx_atq_t *atq)
 {
@@ -195,15 +515,20 @@ u64 scx_atq_peek(scx_atq_t *atq)
 	if (ret)
 		return (u64)NULL;
 
+	scx_atq_drain_unlocked(atq);
+
 	if (!scx_atq_nr_queued(atq)) {
 		arena_spin_unlock(&atq->lock);
 		return (u64)NULL;
 	}
 
-	ret = rb_least(atq->tree, &vtime, &taskc_ptr);
+	ret = scx_atq_backend_least(atq, &vtime, &taskc_ptr);
 
 	arena_spin_unlock(&atq->lock);
 
+	if (ret)
+		return (u64)NULL;
+
 	return taskc_ptr;
 }
 
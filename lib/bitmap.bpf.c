@@ -9,6 +9,117 @@ const volatile u32 nr_cpu_ids = NR_CPU_IDS_UNINIT;
 static struct scx_allocator scx_bitmap_allocator;
 size_t mask_size;
 
+/*
+ * Bitmaps are mask_size words long. Hosts with up to 64, 128 or 256 CPUs
+ * need 1, 2 or 4 words, so the operations below are instantiated for those
+ * widths with a constant word count, which the compiler fully unrolls into
+ * a few loads and stores. Other widths go through the same code with the
+ * runtime word count.
+ */
+#define SCX_BITMAP_DISPATCH(fn, ...)					\
+	do {								\
+		switch (mask_size) {					\
+		case 1:							\
+			return fn(1, __VA_ARGS__);			\
+		case 2:							\
+			return fn(2, __VA_ARGS__);			\
+		case 4:							\
+			return fn(4, __VA_ARGS__);			\
+		default:						\
+			return fn(mask_size, __VA_ARGS__);		\
+		}							\
+	} while (0)
+
+/* The second bound only matters for runtime word counts. */
+#define scx_bitmap_for_each_word(i, nlong) \
+	for ((i) = 0; (i) < (nlong) && (i) < SCXMASK_NLONG; (i)++)
+
+static __always_inline int
+scx_bitmap_clear_n(const u32 nlong, scx_bitmap_t __arg_arena mask)
+{
+	u32 i;
+
+	scx_bitmap_for_each_word(i, nlong)
+		mask->bits[i] = 0;
+
+	return 0;
+}
+
+static __always_inline int
+scx_bitmap_and_n(const u32 nlong, scx_bitmap_t __arg_arena dst,
+		 scx_bitmap_t __arg_arena src1, scx_bitmap_t __arg_arena src2)
+{
+	u32 i;
+
+	scx_bitmap_for_each_word(i, nlong)
+		dst->bits[i] = src1->bits[i] & src2->bits[i];
+
+	return 0;
+}
+
+static __always_inline int
+scx_bitmap_or_n(const u32 nlong, scx_bitmap_t __arg_arena dst,
+		scx_bitmap_t __arg_arena src1, scx_bitmap_t __arg_arena src2)
+{
+	u32 i;
+
+	scx_bitmap_for_each_word(i, nlong)
+		dst->bits[i] = src1->bits[i] | src2->bits[i];
+
+	return 0;
+}
+
+static __always_inline bool
+scx_bitmap_empty_n(const u32 nlong, scx_bitmap_t __arg_arena mask)
+{
+	u64 acc = 0;
+	u32 i;
+
+	/* Branch once at the end, the common case is reading every word. */
+	scx_bitmap_for_each_word(i, nlong)
+		acc |= mask->bits[i];
+
+	return !acc;
+}
+
+static __always_inline int
+scx_bitmap_copy_n(const u32 nlong, scx_bitmap_t __arg_arena dst,
+		  scx_bitmap_t __arg_arena src)
+{
+	u32 i;
+
+	scx_bitmap_for_each_word(i, nlong)
+		dst->bits[i] = src->bits[i];
+
+	return 0;
+}
+
+static __always_inline bool
+scx_bitmap_subset_n(const u32 nlong, scx_bitmap_t __arg_arena big,
+		    scx_bitmap_t __arg_arena small)
+{
+	u64 acc = 0;
+	u32 i;
+
+	scx_bitmap_for_each_word(i, nlong)
+		acc |= ~big->bits[i] & small->bits[i];
+
+	return !acc;
+}
+
+static __always_inline bool
+scx_bitmap_intersects_n(const u32 nlong, scx_bitmap_t __arg_arena arg1,
+			scx_bitmap_t __arg_arena arg2)
+{
+	u64 acc = 0;
+	u32 i;
+
+	scx_bitmap_for_each_word(i, nlong)
+		acc |= arg1->bits[i] & arg2->bits[i];
+
+	return !!acc;
+}
+
 __weak
 int scx_bitmap_init(__u64 total_mask_size)
 {
@@ -22,7 +133,6 @@ u64 scx_bitmap_alloc_internal(void)
 {
 	struct sdt_data __arena *data = NULL;
 	scx_bitmap_t mask;
-	int i;
 
 	data = scx_alloc(&scx_bitmap_allocator);
 	if (unlikely(!data))
@@ -30,9 +140,7 @@ u64 scx_bitmap_alloc_internal(void)
 
 	mask = (scx_bitmap_t)data->payload;
 	mask->tid = data->tid;
-	bpf_for(i, 0, mask_size) {
-		mask->bits[i] = 0ULL;
-	}
+	scx_bitmap_clear(mask);
 
 	return (u64)mask;
 }
@@ -54,18 +162,15 @@ int scx_bitmap_free(scx_bitmap_t __arg_arena mask)
 __weak
 int scx_bitmap_copy_to_stack(struct scx_bitmap *dst, scx_bitmap_t __arg_arena src)
 {
-	int i;
+	u32 i;
 
 	if (unlikely(!src || !dst)) {
 		bpf_printk("invalid pointer args to pointer copy");
 		return -EINVAL;
 	}
 
-	bpf_for(i, 0, mask_size) {
-		if (i >= SCXMASK_NLONG || i < 0)
-			return 0;
+	scx_bitmap_for_each_word(i, mask_size)
 		dst->bits[i] = src->bits[i];
-	}
 
 	return 0;
 }
@@ -117,62 +222,31 @@ bool scx_bitmap_test_and_clear_cpu(u32 cpu, scx_bitmap_t __arg_arena mask)
 __weak
 int scx_bitmap_clear(scx_bitmap_t __arg_arena mask)
 {
-	int i;
-
-	bpf_for(i, 0, mask_size) {
-		mask->bits[i] = 0;
-	}
-
-	return 0;
+	SCX_BITMAP_DISPATCH(scx_bitmap_clear_n, mask);
 }
 
 __weak
 int scx_bitmap_and(scx_bitmap_t __arg_arena dst, scx_bitmap_t __arg_arena src1, scx_bitmap_t __arg_arena src2)
 {
-	int i;
-
-	bpf_for(i, 0, mask_size) {
-		dst->bits[i] = src1->bits[i] & src2->bits[i];
-	}
-
-	return 0;
+	SCX_BITMAP_DISPATCH(scx_bitmap_and_n, dst, src1, src2);
 }
 
 __weak
 int scx_bitmap_or(scx_bitmap_t __arg_arena dst, scx_bitmap_t __arg_arena src1, scx_bitmap_t __arg_arena src2)
 {
-	int i;
-
-	bpf_for(i, 0, mask_size) {
-		dst->bits[i] = src1->bits[i] | src2->bits[i];
-	}
-
-	return 0;
+	SCX_BITMAP_DISPATCH(scx_bitmap_or_n, dst, src1, src2);
 }
 
 __weak
 bool scx_bitmap_empty(scx_bitmap_t __arg_arena mask)
 {
-	int i;
-
-	bpf_for(i, 0, mask_size) {
-		if (mask->bits[i])
-			return false;
-	}
-
-	return true;
+	SCX_BITMAP_DISPATCH(scx_bitmap_empty_n, mask);
 }
 
 __weak
 int scx_bitmap_copy(scx_bitmap_t __arg_arena dst, scx_bitmap_t __arg_arena src)
 {
-	int i;
-
-	bpf_for(i, 0, mask_size) {
-		dst->bits[i] = src->bits[i];
-	}
-
-	return 0;
+	SCX_BITMAP_DISPATCH(scx_bitmap_copy_n, dst, src);
 }
 
 __weak int
@@ -192,27 +266,104 @@ scx_bitmap_from_bpf(scx_bitmap_t __arg_arena scx_bitmap, const cpumask_t *bpfmas
 __weak
 bool scx_bitmap_subset(scx_bitmap_t __arg_arena big, scx_bitmap_t __arg_arena small)
 {
-	int i;
+	SCX_BITMAP_DISPATCH(scx_bitmap_subset_n, big, small);
+}
 
-	bpf_for(i, 0, mask_size) {
-		if (~big->bits[i] & small->bits[i])
-			return false;
+__weak
+bool scx_bitmap_intersects(scx_bitmap_t __arg_arena arg1, scx_bitmap_t __arg_arena arg2)
+{
+	SCX_BITMAP_DISPATCH(scx_bitmap_intersects_n, arg1, arg2);
+}
+
+/*
+ * Word-at-a-time search for the first bit set in @mask, ANDed with @and if
+ * it is not NULL, starting from bit @start and wrapping around. The word
+ * holding @start is visited twice: first for the bits at or above @start,
+ * and last for the ones below it.
+ */
+static __always_inline s32
+scx_bitmap_find_wrap(scx_bitmap_t __arg_arena mask, scx_bitmap_t __arg_arena and, u32 start)
+{
+	u64 word;
+	u32 i, off, ind;
+
+	if (unlikely(!mask_size || mask_size > SCXMASK_NLONG))
+		return -EINVAL;
+
+	if (start >= mask_size * 64)
+		start = 0;
+
+	off = start / 64;
+
+	bpf_for(i, 0, mask_size + 1) {
+		ind = (off + i) % mask_size;
+
+		word = mask->bits[ind];
+		if (and)
+			word &= and->bits[ind];
+
+		if (i == 0)
+			word &= ~0ULL << (start % 64);
+		else if (i == mask_size)
+			word &= (1ULL << (start % 64)) - 1;
+
+		if (word)
+			return ind * 64 + scx_ffs(word);
 	}
 
-	return true;
+	return -ENOENT;
 }
 
+/* Returns the first CPU set in @mask, or -ENOENT if it is empty. */
 __weak
-bool scx_bitmap_intersects(scx_bitmap_t __arg_arena arg1, scx_bitmap_t __arg_arena arg2)
+s32 scx_bitmap_ffs(scx_bitmap_t __arg_arena mask)
 {
-	int i;
+	return scx_bitmap_find_wrap(mask, NULL, 0);
+}
 
-	bpf_for(i, 0, mask_size) {
-		if (arg1->bits[i] & arg2->bits[i])
-			return true;
+/* Returns the first CPU set in both @arg1 and @arg2, or -ENOENT. */
+__weak
+s32 scx_bitmap_ffs_and(scx_bitmap_t __arg_arena arg1, scx_bitmap_t __arg_arena arg2)
+{
+	return scx_bitmap_find_wrap(arg1, arg2, 0);
+}
+
+/* Returns the first CPU set in @mask at or after @start, wrapping around. */
+__weak
+s32 scx_bitmap_find_from(scx_bitmap_t __arg_arena mask, u32 start)
+{
+	return scx_bitmap_find_wrap(mask, NULL, start);
+}
+
+__weak
+s32 scx_bitmap_find_and_from(scx_bitmap_t __arg_arena arg1, scx_bitmap_t __arg_arena arg2, u32 start)
+{
+	return scx_bitmap_find_wrap(arg1, arg2, start);
+}
+
+/*
+ * Atomically clear and return the first CPU set in both @claim and @mask,
+ * searching from @start. Concurrent callers never get the same CPU. Returns
+ * -ENOENT if there is no CPU to claim.
+ */
+__weak
+s32 scx_bitmap_claim_and_from(scx_bitmap_t __arg_arena claim, scx_bitmap_t __arg_arena mask, u32 start)
+{
+	s32 cpu;
+
+	while (can_loop) {
+		cpu = scx_bitmap_find_wrap(claim, mask, start);
+		if (cpu < 0)
+			return cpu;
+
+		if (scx_bitmap_test_and_clear_cpu(cpu, claim))
+			return cpu;
+
+		/* Somebody else got it first, keep looking past it. */
+		start = cpu;
 	}
 
-	return false;
+	return -EAGAIN;
 }
 
 __weak
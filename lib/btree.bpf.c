@@ -55,14 +55,19 @@ static bt_node *btnode_alloc(btree_t *btree, bt_node __arg_arena *parent, u64 fl
 	} while (cmpxchg(&btree->freelist, btn, btn->parent) != btn && can_loop);
 
 	if (!btn)
-		btn = scx_static_alloc(sizeof(*btn), 1);
+		btn = scx_static_alloc(sizeof(*btn), BT_CACHELINE);
 	if (!btn)
 		return NULL;
 
-	arrzero(&btn->keys[0], BT_LEAFSZ);
+	/* Nodes come off the freelist with stale contents. */
+	arrzero(&btn->keys[0], BT_MAXFANOUT);
+	arrzero(&btn->values[0], BT_MAXFANOUT);
 
+	btn->numkeys = 0;
 	btn->flags = flags;
 	btn->parent = parent;
+	btn->prev = NULL;
+	btn->next = NULL;
 
 	return btn;
 }
@@ -88,14 +93,21 @@ static inline bool btnode_isleaf(bt_node *btn)
 }
 
 __weak
-u64 bt_create_internal(void)
+u64 bt_create_internal(u64 fanout)
 {
 	btree_t __arg_arena *btree;
 
+	if (fanout < BT_MINFANOUT || fanout > BT_MAXFANOUT) {
+		bpf_printk("invalid btree fanout %ld", fanout);
+		return (u64)NULL;
+	}
+
 	btree = scx_static_alloc(sizeof(*btree), 1);
 	if (!btree)
 		return (u64)NULL;
 
+	btree->fanout = fanout;
+
 	btree->root = btnode_alloc(btree, NULL, BT_F_LEAF);
 	if (!btree->root) {
 		/* XXX Fix once we use the buddy allocator. */
@@ -106,22 +118,33 @@ u64 bt_create_internal(void)
 	return (u64)btree;
 }
 
+/*
+ * In-node searches scan the whole key array instead of stopping at the
+ * first match. The keys are sorted, so counting the keys on the left of
+ * @key gives the same index, and the loop has no data-dependent branches
+ * for the CPU to mispredict. Nodes are small enough that the extra
+ * comparisons are cheaper than the mispredictions.
+ */
 __weak
 u64 btn_node_index_by_key(bt_node __arg_arena *btn, u64 key)
 {
+	u64 numkeys = btn->numkeys;
+	u64 ind = 0;
 	int i;
 
-	for (i = 0; i < btn->numkeys && can_loop; i++) {
-		/*
-		 * It's strict inequality because we
-		 * want nodes equal to the key to be to
-		 * the _right_ of the key.
-		 */
-		if (key < btn->keys[i])
-			return i;
+	/*
+	 * It's a non-strict inequality because we
+	 * want nodes equal to the key to be to
+	 * the _right_ of the key.
+	 */
+	for (i = 0; i < BT_MAXFANOUT; i++) {
+		if (i >= numkeys)
+			break;
+
+		ind += (u64)(btn->keys[i] <= key);
 	}
 
-	return btn->numkeys;
+	return ind;
 }
 
 static
@@ -139,14 +162,19 @@ u64 btn_node_index_by_val(bt_node *btn, bt_node *val)
 
 __weak u64 btn_leaf_index(bt_node __arg_arena *btn, u64 key)
 {
+	u64 numkeys = btn->numkeys;
+	u64 ind = 0;
 	int i;
 
-	for (i = 0; i < btn->numkeys && can_loop; i++) {
-		if (key <= btn->keys[i])
+	/* Branch-free like btn_node_index_by_key(), finds the first key >= @key. */
+	for (i = 0; i < BT_MAXFANOUT; i++) {
+		if (i >= numkeys)
 			break;
+
+		ind += (u64)(btn->keys[i] < key);
 	}
 
-	return i;
+	return ind;
 }
 
 static bt_node *bt_find_leaf(btree_t __arg_arena *btree, u64 key)
@@ -198,12 +226,12 @@ int btnode_remove_internal(bt_node __arg_arena *btn, u64 ind)
 
 /* The variable "lower" denotes whether the key is the upper or the lower bound for the value. 1*/
 __weak
-int btnode_add_internal(bt_node __arg_arena *btn, u64 ind, u64 key, bt_node __arg_arena *value, bool lower)
+int btnode_add_internal(bt_node __arg_arena *btn, u64 ind, u64 key, bt_node __arg_arena *value, bool lower, u64 fanout)
 {
 	u64 nelems;
 
-	/* We can have up to BT_LEAFSZ - 1 keys and BT_LEAFSZ values.*/
-	if (unlikely(ind > btn->numkeys || btn->numkeys >= BT_LEAFSZ - 1))  {
+	/* We can have up to fanout - 1 keys and fanout values.*/
+	if (unlikely(ind > btn->numkeys || btn->numkeys >= fanout - 1))  {
 		bpf_printk("internal add overflow (%ld, %ld)", ind, btn->numkeys);
 		btnode_print_path(btn);
 		return -EINVAL;
@@ -277,13 +305,13 @@ static int btnode_add_leaf(bt_node *btn, u64 ind, u64 key, u64 value)
 	return 0;
 }
 
-u64 btnode_split_leaf(bt_node __arg_arena *btn_new, bt_node __arg_arena *btn_old)
+u64 btnode_split_leaf(bt_node __arg_arena *btn_new, bt_node __arg_arena *btn_old, u64 fanout)
 {
 	u64 off, nelems;
 	u64 key;
 
-	off = (BT_LEAFSZ / 2);
-	nelems = BT_LEAFSZ - off;
+	off = (fanout / 2);
+	nelems = fanout - off;
 
 	key = btn_old->keys[off];
 
@@ -296,11 +324,18 @@ u64 btnode_split_leaf(bt_node __arg_arena *btn_new, bt_node __arg_arena *btn_old
 	arrzero(&btn_old->values[off], nelems);
 	btn_old->numkeys = off;
 
+	/* The new leaf goes to the right of the old one. */
+	btn_new->prev = btn_old;
+	btn_new->next = btn_old->next;
+	if (btn_old->next)
+		btn_old->next->prev = btn_new;
+	btn_old->next = btn_new;
+
 	return key;
 }
 
 __weak
-u64 btnode_split_internal(bt_node __arg_arena *btn_new, bt_node __arg_arena *btn_old)
+u64 btnode_split_internal(bt_node __arg_arena *btn_new, bt_node __arg_arena *btn_old, u64 fanout)
 {
 	bt_node *btn_child;
 	u64 keycopies;
@@ -308,17 +343,21 @@ u64 btnode_split_internal(bt_node __arg_arena *btn_new, bt_node __arg_arena *btn
 	u64 key;
 	int i;
 
-	off = BT_LEAFSZ / 2;
+	off = fanout / 2;
 	key = btn_old->keys[off];
-	keycopies = BT_LEAFSZ - off - 1;
+	keycopies = fanout - off - 1;
 
-	/* We have numkeys + 1 values. */
-	arrcpy(&btn_new->keys[0], &btn_old->keys[off + 1], keycopies);
-	arrcpy(&btn_new->values[0], &btn_old->values[off + 1], keycopies + 1);
+	/*
+	 * The full node has fanout - 1 keys and fanout values. The key at
+	 * off moves up to the parent, the new node gets the keycopies - 1
+	 * keys and keycopies values to its right.
+	 */
+	arrcpy(&btn_new->keys[0], &btn_old->keys[off + 1], keycopies - 1);
+	arrcpy(&btn_new->values[0], &btn_old->values[off + 1], keycopies);
 	btn_new->numkeys = keycopies - 1;
 
 	/* Update the parent pointer for the children of the new node. */
-	for (i = 0; i <= keycopies && can_loop; i++) {
+	for (i = 0; i < keycopies && can_loop; i++) {
 		btn_child = (bt_node *)btn_new->values[i];
 		btn_child->parent = btn_new;
 	}
@@ -348,9 +387,9 @@ int bt_split(btree_t __arg_arena *btree, bt_node __arg_arena *btn_old)
 			return -ENOMEM;
 
 		if (btn_old->flags & BT_F_LEAF)
-			key = btnode_split_leaf(btn_new, btn_old);
+			key = btnode_split_leaf(btn_new, btn_old, btree->fanout);
 		else
-			key = btnode_split_internal(btn_new, btn_old);
+			key = btnode_split_internal(btn_new, btn_old, btree->fanout);
 
 		if (btnode_isroot(btn_old)) {
 			btn_root = btnode_alloc(btree, NULL, 0);
@@ -374,18 +413,18 @@ int bt_split(btree_t __arg_arena *btree, bt_node __arg_arena *btn_old)
 
 		ind = btn_node_index_by_key(btn_parent, key);
 
-		ret = btnode_add_internal(btn_parent, ind, key, btn_new, true);
+		ret = btnode_add_internal(btn_parent, ind, key, btn_new, true, btree->fanout);
 		if (ret) {
 			btnode_free(btree, btn_new);
 			return ret;
 		}
 
 		btn_old = btn_old->parent;
-		if (btn_old->numkeys < BT_LEAFSZ - 1)
+		if (btn_old->numkeys < btree->fanout - 1)
 			break;
 	}
 
-	if (btn_old->numkeys >= BT_LEAFSZ - 1) {
+	if (btn_old->numkeys >= btree->fanout - 1) {
 		bpf_printk("POST SPLIT NODE IS FULL");
 		return -E2BIG;
 	}
@@ -416,7 +455,7 @@ int bt_insert(btree_t __arg_arena *btree, u64 key, u64 value, bool update)
 	}
 
 	/* Integrity check, node splitting should prevent this. */
-	if (unlikely(btn->numkeys >= BT_LEAFSZ)) {
+	if (unlikely(btn->numkeys >= btree->fanout)) {
 		bpf_printk("node overflow");
 		return -EINVAL;
 	}
@@ -425,13 +464,13 @@ int bt_insert(btree_t __arg_arena *btree, u64 key, u64 value, bool update)
 	if (ret)
 		return ret;
 
-	if (btn->numkeys < BT_LEAFSZ)
+	if (btn->numkeys < btree->fanout)
 		return 0;
 
 	return bt_split(btree, btn);
 }
 
-static inline int bt_balance_left(bt_node *parent, int ind, bt_node *left, bt_node *right)
+static inline int bt_balance_left(bt_node *parent, int ind, bt_node *left, bt_node *right, u64 fanout)
 {
 	u64 key = left->keys[left->numkeys - 1];
 	bt_node *value = (bt_node *)left->values[left->numkeys];
@@ -441,7 +480,7 @@ static inline int bt_balance_left(bt_node *parent, int ind, bt_node *left, bt_no
 	if (unlikely(ret))
 		return ret;
 
-	ret = btnode_add_internal(right, 0, parent->keys[ind], value, false);
+	ret = btnode_add_internal(right, 0, parent->keys[ind], value, false, fanout);
 	if (unlikely(ret))
 		return ret;
 
@@ -451,7 +490,7 @@ static inline int bt_balance_left(bt_node *parent, int ind, bt_node *left, bt_no
 	return 0;
 }
 
-static inline int bt_balance_right(bt_node *parent, int ind, bt_node *left, bt_node *right)
+static inline int bt_balance_right(bt_node *parent, int ind, bt_node *left, bt_node *right, u64 fanout)
 {
 	u64 key = right->keys[0];
 	bt_node *value = (bt_node *)right->values[0];
@@ -461,7 +500,7 @@ static inline int bt_balance_right(bt_node *parent, int ind, bt_node *left, bt_n
 	if (unlikely(ret))
 		return ret;
 
-	ret = btnode_add_internal(left, left->numkeys, parent->keys[ind], value, true);
+	ret = btnode_add_internal(left, left->numkeys, parent->keys[ind], value, true, fanout);
 	if (unlikely(ret))
 		return ret;
 
@@ -471,8 +510,9 @@ static inline int bt_balance_right(bt_node *parent, int ind, bt_node *left, bt_n
 	return 0;
 }
 
-static inline bool bt_balance(bt_node __arg_arena *btn, bt_node __arg_arena *parent, int ind)
+static inline bool bt_balance(btree_t *btree, bt_node __arg_arena *btn, bt_node __arg_arena *parent, int ind)
 {
+	u64 fanout = btree->fanout;
 	volatile bt_node **tmp;
 	bt_node *sibling;
 	int ret;
@@ -483,11 +523,11 @@ static inline bool bt_balance(bt_node __arg_arena *btn, bt_node __arg_arena *par
 		goto steal_right;
 
 	sibling = (bt_node *)parent->values[ind - 1];
-	if (sibling->numkeys - 1 < BT_LEAFSZ / 2)
+	if (sibling->numkeys - 1 < fanout / 2)
 		goto steal_right;
 
-	if (!bt_balance_left(parent, ind - 1, sibling, btn)) {
-		if (unlikely(sibling->numkeys >= BT_LEAFSZ - 1 || btn->numkeys >= BT_LEAFSZ - 1))
+	if (!bt_balance_left(parent, ind - 1, sibling, btn, fanout)) {
+		if (unlikely(sibling->numkeys >= fanout - 1 || btn->numkeys >= fanout - 1))
 			bpf_printk("BTREE ERROR: FULL NODE AFTER LEFT BALANCING");
 
 		return true;
@@ -501,11 +541,11 @@ steal_right:
 
 	tmp = (volatile bt_node **)parent->values;
 	sibling = (bt_node *)tmp[ind + 1];
-	if (sibling->numkeys - 1 < BT_LEAFSZ / 2)
+	if (sibling->numkeys - 1 < fanout / 2)
 		return false;
 
-	ret = bt_balance_right(parent, ind, btn, sibling);
-	if (unlikely(sibling->numkeys >= BT_LEAFSZ - 1 || btn->numkeys >= BT_LEAFSZ - 1))
+	ret = bt_balance_right(parent, ind, btn, sibling, fanout);
+	if (unlikely(sibling->numkeys >= fanout - 1 || btn->numkeys >= fanout - 1))
 		bpf_printk("BTREE ERROR: FULL NODE AFTER LEFT BALANCING");
 
 	return ret == 0;
@@ -531,7 +571,7 @@ static inline int bt_merge(btree_t *btree, bt_node *btn, bt_node *parent, int in
 	key = parent->keys[ind];
 
 	/* We need the internal node to still have available keys. */
-	if (left->numkeys + right->numkeys + 1 >= BT_LEAFSZ - 1)
+	if (left->numkeys + right->numkeys + 1 >= btree->fanout - 1)
 		return 0;
 
 	left->keys[left->numkeys] = key;
@@ -550,7 +590,7 @@ static inline int bt_merge(btree_t *btree, bt_node *btn, bt_node *parent, int in
 	btnode_remove_internal(parent, ind + 1);
 	btnode_free(btree, right);
 
-	if (unlikely(left->numkeys == BT_LEAFSZ - 1))
+	if (unlikely(left->numkeys == btree->fanout - 1))
 		bpf_printk("BTREE ERROR: FULL NODE AFTER MERGING");
 
 	return 0;
@@ -567,43 +607,30 @@ int bt_rebalance(btree_t __arg_arena *btree, bt_node __arg_arena *parent, bt_nod
 		return -EINVAL;
 
 	/* Try to avoid merging. */
-	if (bt_balance(btn, parent, ind))
+	if (bt_balance(btree, btn, parent, ind))
 		return 0;
 
 	ret = bt_merge(btree, btn, parent, ind);
 	if (ret)
 		return ret;
 
-	if (unlikely(btn->numkeys >= BT_LEAFSZ - 1))
+	if (unlikely(btn->numkeys >= btree->fanout - 1))
 		bpf_printk("BTREE ERROR: FULL INTERNAL NODE AFTER REBALANCE");
 
 	return 0;
 }
 
-__weak
-int bt_remove(btree_t __arg_arena *btree, u64 key)
+/*
+ * Unlink an empty, non-root leaf from the tree and rebalance the internal
+ * nodes above it. Leaves themselves are never rebalanced, so the sibling
+ * links of the remaining leaves stay valid.
+ */
+static int bt_remove_empty_leaf(btree_t *btree, bt_node *btn)
 {
-	bt_node *btn, *parent;
+	bt_node *parent;
 	u64 ind;
 	int ret;
 
-	btn = bt_find_leaf(btree, key);
-	if (!btn)
-		return -EINVAL;
-
-	/* Update in place. */
-	ind = btn_leaf_index(btn, key);
-	if (unlikely(ind >= btn->numkeys))
-		return -ENOENT;
-
-	ret = btnode_remove_leaf(btn, ind);
-	if (ret)
-		return ret;
-
-	/* Do not load balance leaves. */
-	if (btn->numkeys || btnode_isroot(btn))
-		return 0;
-
 	parent = btn->parent;
 	ind = btn_node_index_by_val(parent, btn);
 	if (unlikely(ind > parent->numkeys || parent->values[ind] != (u64)btn))
@@ -613,11 +640,16 @@ int bt_remove(btree_t __arg_arena *btree, u64 key)
 	if (unlikely(ret))
 		return ret;
 
+	if (btn->prev)
+		btn->prev->next = btn->next;
+	if (btn->next)
+		btn->next->prev = btn->prev;
+
 	btnode_free(btree, btn);
 
 	btn = parent;
 
-	while (!btnode_isroot(btn) && btn->numkeys < BT_LEAFSZ / 2 && can_loop) {
+	while (!btnode_isroot(btn) && btn->numkeys < btree->fanout / 2 && can_loop) {
 		parent = btn->parent;
 
 		ret = bt_rebalance(btree, parent, btn);
@@ -638,6 +670,33 @@ int bt_remove(btree_t __arg_arena *btree, u64 key)
 	return 0;
 }
 
+__weak
+int bt_remove(btree_t __arg_arena *btree, u64 key)
+{
+	bt_node *btn;
+	u64 ind;
+	int ret;
+
+	btn = bt_find_leaf(btree, key);
+	if (!btn)
+		return -EINVAL;
+
+	/* Update in place. */
+	ind = btn_leaf_index(btn, key);
+	if (unlikely(ind >= btn->numkeys || btn->keys[ind] != key))
+		return -ENOENT;
+
+	ret = btnode_remove_leaf(btn, ind);
+	if (ret)
+		return ret;
+
+	/* Do not load balance leaves. */
+	if (btn->numkeys || btnode_isroot(btn))
+		return 0;
+
+	return bt_remove_empty_leaf(btree, btn);
+}
+
 __weak
 int bt_find(btree_t __arg_arena *btree, u64 key, u64 *value)
 {
@@ -656,6 +715,192 @@ int bt_find(btree_t __arg_arena *btree, u64 key, u64 *value)
 	return 0;
 }
 
+/*
+ * Skip over leaves that have no keys at the cursor position. Only the
+ * root can be an empty leaf, but the cursor may also sit past the end of
+ * a leaf after a seek.
+ */
+static int bt_cursor_settle(struct bt_cursor *cur)
+{
+	bt_node *leaf = cur->leaf;
+
+	while (leaf && cur->ind >= leaf->numkeys && can_loop) {
+		leaf = leaf->next;
+		cur->ind = 0;
+	}
+
+	cur->leaf = leaf;
+
+	return leaf ? 0 : -ENOENT;
+}
+
+__weak
+int bt_cursor_seek(btree_t __arg_arena *btree, struct bt_cursor *cur, u64 key)
+{
+	bt_node *btn;
+
+	if (unlikely(!cur))
+		return -EINVAL;
+
+	btn = bt_find_leaf(btree, key);
+	if (!btn)
+		return -EINVAL;
+
+	cur->leaf = btn;
+	cur->ind = btn_leaf_index(btn, key);
+
+	return bt_cursor_settle(cur);
+}
+
+__weak
+int bt_cursor_first(btree_t __arg_arena *btree, struct bt_cursor *cur)
+{
+	bt_node *btn = btree->root;
+
+	if (unlikely(!cur))
+		return -EINVAL;
+
+	while (!btnode_isleaf(btn) && can_loop)
+		btn = (bt_node *)btn->values[0];
+
+	cur->leaf = btn;
+	cur->ind = 0;
+
+	return bt_cursor_settle(cur);
+}
+
+__weak
+int bt_cursor_get(struct bt_cursor *cur, u64 *key, u64 *value)
+{
+	bt_node *btn;
+	u64 ind;
+
+	if (unlikely(!cur))
+		return -EINVAL;
+
+	btn = cur->leaf;
+	ind = cur->ind;
+	if (!btn || ind >= btn->numkeys || ind >= BT_MAXFANOUT)
+		return -ENOENT;
+
+	if (key)
+		*key = btn->keys[ind];
+	if (value)
+		*value = btn->values[ind];
+
+	return 0;
+}
+
+__weak
+int bt_cursor_next(struct bt_cursor *cur)
+{
+	if (unlikely(!cur))
+		return -EINVAL;
+
+	if (!cur->leaf)
+		return -ENOENT;
+
+	cur->ind += 1;
+
+	return bt_cursor_settle(cur);
+}
+
+__weak
+int bt_cursor_prev(struct bt_cursor *cur)
+{
+	bt_node *leaf;
+
+	if (unlikely(!cur))
+		return -EINVAL;
+
+	leaf = cur->leaf;
+	if (!leaf)
+		return -ENOENT;
+
+	if (cur->ind > 0) {
+		cur->ind -= 1;
+		return 0;
+	}
+
+	/* Walk left, past any empty leaves. */
+	do {
+		leaf = leaf->prev;
+	} while (leaf && !leaf->numkeys && can_loop);
+
+	cur->leaf = leaf;
+	cur->ind = leaf ? leaf->numkeys - 1 : 0;
+
+	return leaf ? 0 : -ENOENT;
+}
+
+/*
+ * Remove up to @max pairs with keys in [@start, @end), walking the leaves
+ * left to right. Each leaf is compacted once for its whole run of matching
+ * keys, instead of once per key. Returns the number of pairs removed, or a
+ * negative error. @keys may be NULL if the caller only needs the values.
+ */
+__weak
+int bt_range_pop(btree_t __arg_arena *btree, u64 start, u64 end,
+		 u64 __arg_arena __arena *keys, u64 __arg_arena __arena *values, u32 max)
+{
+	bt_node *btn, *next;
+	u64 i, j, numkeys;
+	u32 popped = 0;
+	int ret;
+
+	if (unlikely(!values))
+		return -EINVAL;
+
+	if (start >= end || !max)
+		return 0;
+
+	btn = bt_find_leaf(btree, start);
+	if (!btn)
+		return -EINVAL;
+
+	i = btn_leaf_index(btn, start);
+
+	while (btn && popped < max && can_loop) {
+		numkeys = btn->numkeys;
+
+		for (j = i; j < numkeys && j < BT_MAXFANOUT && popped < max && can_loop; j++) {
+			if (btn->keys[j] >= end)
+				break;
+
+			if (keys)
+				keys[popped] = btn->keys[j];
+			values[popped] = btn->values[j];
+			popped += 1;
+		}
+
+		/* Close the gap left by the run [i, j). */
+		if (j > i) {
+			arrcpy(&btn->keys[i], &btn->keys[j], numkeys - j);
+			arrcpy(&btn->values[i], &btn->values[j], numkeys - j);
+			arrzero(&btn->keys[numkeys - (j - i)], j - i);
+			arrzero(&btn->values[numkeys - (j - i)], j - i);
+			btn->numkeys = numkeys - (j - i);
+		}
+
+		next = btn->next;
+
+		if (!btn->numkeys && !btnode_isroot(btn)) {
+			ret = bt_remove_empty_leaf(btree, btn);
+			if (ret)
+				return ret;
+		}
+
+		/* We stopped before the end of the leaf, so we are done. */
+		if (j < numkeys)
+			break;
+
+		btn = next;
+		i = 0;
+	}
+
+	return popped;
+}
+
 __weak
 int bt_destroy(btree_t __arg_arena *btree)
 {
@@ -670,31 +915,44 @@ int btnode_print(u64 depth, u64 ind, bt_node __arg_arena *btn)
 	bpf_printk("==== [%ld/%ld] BTREE %s %p PARENT %p====", depth, ind,
 			isleaf ? "LEAF" : "NODE", btn, btn->parent);
 
-	/* Hardcode it for now make it nicer once we use streams. */
-	_Static_assert(BT_LEAFSZ == 10, "Unexpected btree fanout");
+	/*
+	 * Hardcode it for now make it nicer once we use streams. Print in
+	 * rows of 8 to stay within the bpf_printk argument limit.
+	 */
+	_Static_assert(BT_MAXFANOUT == 16, "Unexpected btree fanout");
 
-	bpf_printk("[KEY] %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld",
+	bpf_printk("[KEY] %ld %ld %ld %ld %ld %ld %ld %ld",
 			btn->keys[0], btn->keys[1], btn->keys[2],
 			btn->keys[3], btn->keys[4], btn->keys[5],
-			btn->keys[6], btn->keys[7], btn->keys[8],
-			btn->keys[9]);
+			btn->keys[6], btn->keys[7]);
+	bpf_printk("[KEY] %ld %ld %ld %ld %ld %ld %ld %ld",
+			btn->keys[8], btn->keys[9], btn->keys[10],
+			btn->keys[11], btn->keys[12], btn->keys[13],
+			btn->keys[14], btn->keys[15]);
 	if (isleaf) {
-		bpf_printk("[VAL] %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld",
+		bpf_printk("[VAL] %ld %ld %ld %ld %ld %ld %ld %ld",
 				btn->values[0], btn->values[1], btn->values[2],
 				btn->values[3], btn->values[4], btn->values[5],
-				btn->values[6], btn->values[7], btn->values[8],
-				btn->values[9]);
+				btn->values[6], btn->values[7]);
+		bpf_printk("[VAL] %ld %ld %ld %ld %ld %ld %ld %ld",
+				btn->values[8], btn->values[9], btn->values[10],
+				btn->values[11], btn->values[12], btn->values[13],
+				btn->values[14], btn->values[15]);
 	} else {
 		/*
 		 * We're typecasting to pointers to actually get the value we
 		 * see during execution.
 		 */
-		bpf_printk("[VAL] 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p",
+		bpf_printk("[VAL] 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p",
 				(bt_node *)btn->values[0], (bt_node *)btn->values[1],
 				(bt_node *)btn->values[2], (bt_node *)btn->values[3],
 				(bt_node *)btn->values[4], (bt_node *)btn->values[5],
-				(bt_node *)btn->values[6], (bt_node *)btn->values[7],
-				(bt_node *)btn->values[8], (bt_node *)btn->values[9]);
+				(bt_node *)btn->values[6], (bt_node *)btn->values[7]);
+		bpf_printk("[VAL] 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p 0x%p",
+				(bt_node *)btn->values[8], (bt_node *)btn->values[9],
+				(bt_node *)btn->values[10], (bt_node *)btn->values[11],
+				(bt_node *)btn->values[12], (bt_node *)btn->values[13],
+				(bt_node *)btn->values[14], (bt_node *)btn->values[15]);
 	}
 
 	bpf_printk("");
@@ -0,0 +1,342 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ * Copyright (c) 2025 Meta Platforms, Inc. and affiliates.
+ */
+
+#include <scx/common.bpf.h>
+
+#include <lib/sdt_task.h>
+#include <lib/calq.h>
+
+/*
+ * Calendar queue implementation. See lib/calq.h for the design.
+ *
+ * The window of the calendar is [base, limit) in slot units, where a
+ * node's slot is its key shifted right by the bucket width. The limit only
+ * moves when the calendar is empty, which guarantees that every node in the
+ * overflow tree is larger than every node on the calendar.
+ */
+
+static __always_inline
+u64 calq_slot(scx_calq_t *calq, u64 key)
+{
+	return key >> calq->shift;
+}
+
+__weak
+u64 scx_calq_create_internal(u64 shift)
+{
+	scx_calq_t *calq;
+
+	if (shift >= 64)
+		return (u64)NULL;
+
+	/* XXX Leaked on destroy, like all static allocations. */
+	calq = scx_static_alloc(sizeof(*calq), 8);
+	if (!calq)
+		return (u64)NULL;
+
+	calq->overflow = rb_create(RB_NOALLOC, RB_DUPLICATE);
+	if (!calq->overflow)
+		return (u64)NULL;
+
+	calq->shift = shift;
+	calq->base = 0;
+	calq->limit = SCX_CALQ_NR_BUCKETS;
+
+	return (u64)calq;
+}
+
+__weak
+int scx_calq_destroy(scx_calq_t __arg_arena *calq)
+{
+	u64 key, value;
+
+	scx_arena_subprog_init();
+
+	while (!scx_calq_pop(calq, &key, &value) && can_loop) {
+		/* Drain, nodes are owned by the caller. */
+	}
+
+	return rb_destroy(calq->overflow);
+}
+
+static __always_inline
+void calq_bucket_append(scx_calq_t *calq, u32 idx, rbnode_t *node, bool front)
+{
+	struct scx_calq_bucket __arena *bucket = &calq->buckets[idx & SCX_CALQ_BUCKET_MASK];
+
+	node->tid.idx = idx & SCX_CALQ_BUCKET_MASK;
+	rbnode_set_parent(node, NULL);
+
+	if (!bucket->head) {
+		rbnode_set_left(node, NULL);
+		rbnode_set_right(node, NULL);
+		bucket->head = bucket->tail = node;
+		calq->bitmap[(idx & SCX_CALQ_BUCKET_MASK) / 64] |= 1ULL << (idx % 64);
+	} else if (front) {
+		rbnode_set_left(node, NULL);
+		rbnode_set_right(node, bucket->head);
+		rbnode_set_left(bucket->head, node);
+		bucket->head = node;
+	} else {
+		rbnode_set_left(node, bucket->tail);
+		rbnode_set_right(node, NULL);
+		rbnode_set_right(bucket->tail, node);
+		bucket->tail = node;
+	}
+
+	calq->nr_calendar += 1;
+}
+
+static __always_inline
+void calq_bucket_unlink(scx_calq_t *calq, rbnode_t *node)
+{
+	u32 idx = node->tid.idx & SCX_CALQ_BUCKET_MASK;
+	struct scx_calq_bucket __arena *bucket = &calq->buckets[idx];
+	rbnode_t *left = rbnode_left(node);
+	rbnode_t *right = rbnode_right(node);
+
+	if (left)
+		rbnode_set_right(left, right);
+	else
+		bucket->head = right;
+
+	if (right)
+		rbnode_set_left(right, left);
+	else
+		bucket->tail = left;
+
+	if (!bucket->head)
+		calq->bitmap[idx / 64] &= ~(1ULL << (idx % 64));
+
+	rbnode_set_left(node, NULL);
+	rbnode_set_right(node, NULL);
+	calq->nr_calendar -= 1;
+}
+
+/*
+ * Insert a key that is below the window into the first bucket. Such keys
+ * form a prefix of the bucket that is kept sorted, so they pop next and
+ * in key order. Every other key in the bucket is in the window and thus
+ * larger, so the walk never goes past the prefix. Equal keys keep their
+ * insertion order.
+ */
+static __always_inline
+void calq_bucket_insert_sorted(scx_calq_t *calq, u32 idx, rbnode_t *node)
+{
+	struct scx_calq_bucket __arena *bucket = &calq->buckets[idx & SCX_CALQ_BUCKET_MASK];
+	rbnode_t *next = bucket->head, *prev;
+
+	while (next && next->key <= node->key && can_loop)
+		next = rbnode_right(next);
+
+	if (!next) {
+		calq_bucket_append(calq, idx, node, false);
+		return;
+	}
+
+	if (next == bucket->head) {
+		calq_bucket_append(calq, idx, node, true);
+		return;
+	}
+
+	prev = rbnode_left(next);
+
+	node->tid.idx = idx & SCX_CALQ_BUCKET_MASK;
+	rbnode_set_parent(node, NULL);
+	rbnode_set_left(node, prev);
+	rbnode_set_right(node, next);
+	rbnode_set_right(prev, node);
+	rbnode_set_left(next, node);
+
+	calq->nr_calendar += 1;
+}
+
+static __always_inline
+void calq_calendar_insert(scx_calq_t *calq, rbnode_t *node)
+{
+	u64 slot = calq_slot(calq, node->key);
+
+	/*
+	 * Keys below the window go to the sorted front of the first bucket
+	 * so they are popped next.
+	 */
+	if (slot < calq->base) {
+		calq_bucket_insert_sorted(calq, calq->base, node);
+		return;
+	}
+
+	calq_bucket_append(calq, slot, node, false);
+}
+
+__weak
+int scx_calq_insert_node(scx_calq_t __arg_arena *calq, rbnode_t __arg_arena *node)
+{
+	u64 slot = calq_slot(calq, node->key);
+	int ret;
+
+	/* Recenter the window on the first insert into an empty queue. */
+	if (!calq->nr_calendar && !calq->nr_overflow) {
+		calq->base = slot;
+		calq->limit = slot + SCX_CALQ_NR_BUCKETS;
+	}
+
+	if (slot < calq->limit) {
+		calq_calendar_insert(calq, node);
+		return 0;
+	}
+
+	ret = rb_insert_node(calq->overflow, node);
+	if (ret)
+		return ret;
+
+	node->tid.idx = SCX_CALQ_IDX_OVERFLOW;
+	calq->nr_overflow += 1;
+
+	return 0;
+}
+
+__weak
+int scx_calq_remove_node(scx_calq_t __arg_arena *calq, rbnode_t __arg_arena *node)
+{
+	int ret;
+
+	if (node->tid.idx != SCX_CALQ_IDX_OVERFLOW) {
+		calq_bucket_unlink(calq, node);
+		return 0;
+	}
+
+	ret = rb_remove_node(calq->overflow, node);
+	if (ret)
+		return ret;
+
+	calq->nr_overflow -= 1;
+
+	return 0;
+}
+
+/*
+ * The calendar is empty, move the window up to the smallest overflow key
+ * and pull everything that now fits back in. Each node is moved at most
+ * once per trip through the overflow tree, so this amortizes to O(log n)
+ * per overflowed node.
+ */
+static int calq_refill(scx_calq_t *calq)
+{
+	rbnode_t *node;
+	int ret;
+
+	node = rb_least_node(calq->overflow);
+	if (!node)
+		return -ENOENT;
+
+	calq->base = calq_slot(calq, node->key);
+	calq->limit = calq->base + SCX_CALQ_NR_BUCKETS;
+
+	while (node && can_loop) {
+		if (calq_slot(calq, node->key) >= calq->limit)
+			break;
+
+		ret = rb_remove_node(calq->overflow, node);
+		if (ret)
+			return ret;
+
+		calq->nr_overflow -= 1;
+		calq_calendar_insert(calq, node);
+
+		node = rb_least_node(calq->overflow);
+	}
+
+	return 0;
+}
+
+/*
+ * Find the first non-empty bucket at or after physical index @start,
+ * wrapping around once.
+ */
+static __always_inline
+int calq_find_next(scx_calq_t *calq, u32 start)
+{
+	u32 word = start / 64, bit = start % 64;
+	u32 i, w;
+	u64 bits;
+
+	for (i = 0; i <= SCX_CALQ_BITMAP_WORDS && can_loop; i++) {
+		w = (word + i) % SCX_CALQ_BITMAP_WORDS;
+		bits = calq->bitmap[w];
+
+		if (i == 0)
+			bits &= ~0ULL << bit;
+		else if (i == SCX_CALQ_BITMAP_WORDS)
+			bits &= (1ULL << bit) - 1;
+
+		if (bits)
+			return w * 64 + scx_ffs(bits);
+	}
+
+	return -ENOENT;
+}
+
+static
+rbnode_t *calq_least(scx_calq_t *calq)
+{
+	u32 start;
+	int idx;
+
+	if (!calq->nr_calendar && calq_refill(calq))
+		return NULL;
+
+	start = calq->base & SCX_CALQ_BUCKET_MASK;
+
+	idx = calq_find_next(calq, start);
+	if (idx < 0)
+		return NULL;
+
+	/* Advance the window start, nothing is left below this bucket. */
+	calq->base += ((u32)idx - start) & SCX_CALQ_BUCKET_MASK;
+
+	return calq->buckets[idx & SCX_CALQ_BUCKET_MASK].head;
+}
+
+__weak
+int scx_calq_least(scx_calq_t __arg_arena *calq, u64 *key, u64 *value)
+{
+	rbnode_t *node;
+
+	node = calq_least(calq);
+	if (!node)
+		return -ENOENT;
+
+	if (key)
+		*key = node->key;
+	if (value)
+		*value = node->value;
+
+	return 0;
+}
+
+__weak
+int scx_calq_pop(scx_calq_t __arg_arena *calq, u64 *key, u64 *value)
+{
+	rbnode_t *node;
+
+	node = calq_least(calq);
+	if (!node)
+		return -ENOENT;
+
+	if (key)
+		*key = node->key;
+	if (value)
+		*value = node->value;
+
+	calq_bucket_unlink(calq, node);
+
+	return 0;
+}
+
+__weak
+u64 scx_calq_nr_queued(scx_calq_t __arg_arena *calq)
+{
+	return calq->nr_calendar + calq->nr_overflow;
+}
@@ -6,6 +6,8 @@
 
 #include <scx/common.bpf.h>
 #include <bpf_arena_common.bpf.h>
+#include <lib/arena_map.h>
+#include <lib/sdt_task.h>
 #include <lib/topology.h>
 #include <lib/cgroup.h>
 #include <lib/atq.h>
@@ -19,10 +21,12 @@ enum scx_cgroup_consts {
 	CBW_CLOCK_BOOTTIME		= 7,
 	/* normalized period in nsec: 100 msec */
 	CBW_NPERIOD			= (100ULL * 1000ULL * 1000ULL),
-	/* maximum number of cgroups */
-	CBW_NR_CGRP_MAX			= 2048,
-	/* maximum number of scx_cgroup_llc_ctx: 2048 cgroups * 32 LLCs */
-	CBW_NR_CGRP_LLC_MAX		= (CBW_NR_CGRP_MAX * 32),
+	/* initial number of cgroups the cgroup tables can hold, doubled on demand */
+	CBW_NR_CGRP_INIT		= 512,
+	/* keep enough spare LLC contexts for 4 cgroups to spread over all LLCs */
+	CBW_LLCX_RESERVE_CGRPS		= 4,
+	/* refill the reserve once it cannot cover 2 such cgroups anymore */
+	CBW_LLCX_RESERVE_LOW_CGRPS	= 2,
 	/* The maximum height of a cgroup tree. */
 	CBW_CGRP_TREE_HEIGHT_MAX	= 16,
 	/* unlimited quota ("max") from scx_cgroup_init_args and scx_cgroup_bw_set() */
@@ -36,7 +40,19 @@ enum scx_cgroup_consts {
 	/* maximum budget transfer is (nquota_ub / 2**2) */
 	CBW_BUDGET_XFER_MAX_SHIFT	= 2,
 	/* maximum number of re-enqueue tasks in one dispatch */
-	CBW_REENQ_MAX_BATCH		= 2,
+	CBW_REENQ_MAX_BATCH		= 64,
+	/* dispatch slots left to the caller of scx_cgroup_bw_reenqueue() */
+	CBW_REENQ_SLOTS_RESERVED	= 1,
+	/* lower bound of the estimated runtime of a reenqueued task (0.5 msec) */
+	CBW_REENQ_RUN_MIN		= (500ULL * 1000ULL),
+	/* walk the whole cgroup tree once every 10 periods (1 sec) */
+	CBW_REPLENISH_FULL_INTERVAL	= 10,
+	/* weight of the last period in the per-LLC runtime average (1/2**2) */
+	CBW_RUNTIME_AVG_SHIFT		= 2,
+	/* share of the quota kept at the cgroup level when pre-distributing (1/2**3) */
+	CBW_PREDIST_RESERVE_SHIFT	= 3,
+	/* minimum budget worth taking from another LLC in nsec (1 msec) */
+	CBW_BUDGET_STEAL_MIN		= (1ULL * 1000ULL * 1000ULL),
 };
 
 /**
@@ -119,12 +135,32 @@ struct scx_cgroup_ctx {
 	 */
 	bool		has_llcx;
 
+	/*
+	 * The LLC contexts of the cgroup, indexed by LLC id. NULL if the
+	 * cgroup cannot have tasks (!@has_llcx).
+	 */
+	struct cbw_llc_table __arena *llcxs;
+
 	/*
 	 * A boolean flag indicating whether the cgroup is throttled or not.
 	 * Note that the cgroup can be throttled before reaching the upper
 	 * bound (nquota_nb) if the subrooot cgroup runs out of the time.
 	 */
 	bool		is_throttled;
+
+	/*
+	 * The replenish generation in which the cgroup was last added to
+	 * the dirty cgroup table (@dirty_gen), and the one in which an
+	 * incremental replenishment last folded runtime into the cgroup
+	 * (@touched_gen).
+	 */
+	u64		dirty_gen;
+	u64		touched_gen;
+
+	/*
+	 * Counts of budget transfers into the cgroup and its LLC contexts.
+	 */
+	struct scx_cgroup_bw_xfer_stats xfer;
 };
 
 
@@ -157,6 +193,20 @@ struct scx_cgroup_llc_ctx {
 	 */
 	s64		runtime_total;
 
+	/*
+	 * Running average of @runtime_total per period. It is only kept up
+	 * to date in the predictive mode, where the quota is pre-distributed
+	 * across LLCs by this average.
+	 */
+	s64		runtime_avg;
+
+	/*
+	 * Running average of the runtime of a task execution on the LLC. It
+	 * is used to estimate how many backlogged tasks the LLC's budget can
+	 * run when reenqueuing them.
+	 */
+	s64		run_avg;
+
 	/*
 	 * Tasks that can not be enqueued when the cgroup is running out
 	 * of time (i.e., throttled). In this case, tasks will be enqueued
@@ -171,8 +221,23 @@ struct scx_cgroup_llc_ctx {
 	 * backend of BTQ.
 	 */
 	scx_atq_t	*btq;
+
+	/*
+	 * The next context in the reserve of unused LLC contexts.
+	 */
+	struct scx_cgroup_llc_ctx __arena *next;
 } __attribute__((aligned(SCX_CACHELINE_SIZE)));
 
+/*
+ * Per-cgroup table of LLC contexts, sized by the number of LLCs. An entry
+ * stays NULL until the cgroup first runs on that LLC, so a cgroup that
+ * only ever runs on a couple of LLCs only has a couple of LLC contexts.
+ */
+struct cbw_llc_table {
+	union sdt_id				tid;
+	struct scx_cgroup_llc_ctx __arena	*llcx[];
+};
+
 /*
  * Library-wide configuration for CPU bandwidth control.
  */
@@ -189,21 +254,35 @@ struct {
 } cbw_cgrp_map SEC(".maps");
 
 /*
- * A map to store scx_cgroup_llc_ctx. It is accessed through a pair of
- * cgroup id and LLC id (struct cgroup_llc_id).
+ * The per-cgroup LLC tables are allocated from the arena.
  */
-struct cgroup_llc_id {
-	u64		cgrp_id;
-	int		llc_id;
-};
+static struct scx_allocator cbw_llc_table_allocator;
 
-struct {
-	__uint(type, BPF_MAP_TYPE_HASH);
-	__type(key, struct cgroup_llc_id);
-	__type(value, struct scx_cgroup_llc_ctx);
-	__uint(map_flags, BPF_F_NO_PREALLOC);
-	__uint(max_entries, CBW_NR_CGRP_LLC_MAX);
-} cbw_cgrp_llc_map SEC(".maps");
+/*
+ * LLC contexts are allocated from the arena in sleepable contexts and kept
+ * in a reserve. The scheduling paths take a context from the reserve when a
+ * cgroup first runs on an LLC, and contexts go back to the reserve when the
+ * cgroup can no longer have tasks. Contexts are never freed.
+ *
+ * The reserve is topped up at cgroup creation and by the scx_cgroup_bw_refill
+ * syscall program, which the scheduler runs periodically from userspace.
+ */
+private(CBW_LLCX) struct bpf_spin_lock cbw_llcx_reserve_lock;
+static struct scx_cgroup_llc_ctx __arena *cbw_llcx_reserve;
+
+/*
+ * Contexts whose BTQ could not be created. Static allocations cannot be
+ * freed, so they are kept here for the next refill instead of being leaked.
+ * Protected by cbw_llcx_reserve_lock as well.
+ */
+static struct scx_cgroup_llc_ctx __arena *cbw_llcx_spare;
+
+/*
+ * Tasks left in the BTQ of an LLC context that is going back to the reserve.
+ * They cannot be dispatched from the sleepable cgroup callbacks, so they wait
+ * here until the next scx_cgroup_bw_reenqueue() reenqueues them.
+ */
+static scx_atq_t *cbw_orphan_btq;
 
 /*
  * A per-CPU map to store levels in traversing a cgroup hierarchy while
@@ -222,17 +301,76 @@ struct {
 } tree_levels_map SEC(".maps");
 
 /*
- * An array of cgroups that can have tasks. This is necessary to iterate
- * cgroups without holding an RCU lock.
+ * Tables of cgroup ids, all with the same capacity, allocated together from
+ * the arena. The capacity starts at CBW_NR_CGRP_INIT and doubles whenever
+ * the number of cgroups outgrows it (cbw_grow_cgroup_tables).
+ *
+ * Readers load @cbw_tables once and check indices against the capacity of
+ * that copy, so they never mix up two generations of tables. A copy replaced
+ * by a growth is retired, and only freed once it is no longer the copy of the
+ * current replenishment and two more replenish generations went by, so that
+ * neither the bottom half nor a scheduling path can still hold it
+ * (cbw_free_retired_tables).
  */
+struct cbw_cgroup_tables {
+	u64		cap;
+	u64		nr_pages;
+
+	/* The replenish generation when retired, and the next retired copy. */
+	u64		retired_gen;
+	struct cbw_cgroup_tables __arena *next;
+
+	/* Set before a growth starts copying out of this copy. */
+	bool		moving;
+
+	/*
+	 * An array of cgroups that can have tasks. This is necessary to
+	 * iterate cgroups without holding an RCU lock.
+	 */
+	u64 __arena	*taskable;
+
+	/*
+	 * An array of throttled cgroups that need to be reenqueued.
+	 */
+	u64 __arena	*throttled;
+
+	/*
+	 * Dirty cgroups of the even and odd replenish generations.
+	 */
+	u64 __arena	*dirty[2];
+
+	u64		ids[];
+};
+
+static struct cbw_cgroup_tables __arena *cbw_tables;
+
+private(CBW_TABLES) struct bpf_spin_lock cbw_tables_retired_lock;
+static struct cbw_cgroup_tables __arena *cbw_tables_retired;
+
+/* The copy of the tables the current replenishment works on. */
+static struct cbw_cgroup_tables __arena *cbw_replenish_tables;
+
+static u64		cbw_nr_cgroups;
 static u64		cbw_nr_taskable_cgroups;
-static u64		cbw_taskable_cgroup_ids[CBW_NR_CGRP_MAX];
+static u64		cbw_nr_throttled_cgroups;
 
 /*
- * An array of throttled cgroups that need to be reenqueued.
+ * Double-buffered tables of cgroups that consumed budget or were throttled
+ * during a period (dirty cgroups). Cgroups are added to the table of the
+ * current replenish generation (@cbw_replenish_gen & 1). The replenish timer
+ * bumps the generation, so new additions go to the other table, and then
+ * replenishes only the cgroups in the closed table and their ancestors.
+ *
+ * If a table overflows, the next replenishment walks the whole cgroup tree
+ * instead. The whole tree is also walked every CBW_REPLENISH_FULL_INTERVAL
+ * periods as a consistency pass.
  */
-static u64		cbw_nr_throttled_cgroups;
-static u64		cbw_throttled_cgroup_ids[CBW_NR_CGRP_MAX];
+static u64		cbw_replenish_gen = 1;
+static u64		cbw_last_full_replenish_gen;
+static u64		cbw_nr_dirty_cgroups[2];
+static bool		cbw_dirty_overflow[2];
+
+static struct scx_cgroup_bw_stats cbw_stats;
 
 /*
  * Timer to replenish time budget for all cgroups periodically.
@@ -253,6 +391,17 @@ static u64		cbw_last_replenish_at;
 static
 int replenish_timerfn(void *map, int *key, struct bpf_timer *timer);
 
+static
+int cbw_grow_cgroup_tables(u64 nr_cgroups);
+
+static
+int cbw_refill_llcx_reserve(void);
+
+static
+int cbw_get_current_llc_id(void);
+
+static bool		cbw_lib_ready;
+
 /*
  * The replenish timer running status. The replenish timer is split into two
  * parts: the top half and the bottom half. The top half -- the actual BPF
@@ -286,6 +435,22 @@ struct replenish_stat {
 
 static struct replenish_stat cbw_replenish_stat;
 
+/*
+ * Per-LLC state of the bottom half. The top half marks the LLCs holding
+ * backlogged tasks of throttled cgroups, and ops.dispatch() on a CPU of such
+ * an LLC reenqueues them. This spreads the work over the LLCs that own the
+ * backlog instead of piling it on whichever CPU dispatches first.
+ */
+struct cbw_llc_reenq {
+	/* Only one CPU of the LLC reenqueues at a time. */
+	u64		lock;
+	/* The LLC may have backlogged tasks to reenqueue. */
+	u64		backlogged;
+} __attribute__((aligned(SCX_CACHELINE_SIZE)));
+
+static struct cbw_llc_reenq __arena *cbw_llc_reenqs;
+static u64		cbw_nr_backlogged_llcs;
+
 /*
  * Debug macros.
  */
@@ -373,6 +538,12 @@ static struct replenish_stat cbw_replenish_stat;
 #define clamp(val, lo, hi) min(max(val, lo), hi)
 #endif
 
+static
+s64 cbw_calc_avg(s64 avg, s64 cur)
+{
+	return avg + ((cur - avg) >> CBW_RUNTIME_AVG_SHIFT);
+}
+
 /*
  * Check if the kernel support cpu.max for scx schedulers.
  */
@@ -409,6 +580,40 @@ int scx_cgroup_bw_lib_init(struct scx_cgroup_bw_config *config)
 		return -EINVAL;
 	cbw_config = *config;
 
+	/*
+	 * Size the tables from the topology. A cgroup's LLC table has a slot
+	 * for every LLC, but the LLC contexts themselves are only attached to
+	 * the LLCs the cgroup actually runs on.
+	 */
+	ret = scx_alloc_init(&cbw_llc_table_allocator,
+			     sizeof(struct cbw_llc_table) +
+			     TOPO_NR(LLC) * sizeof(struct scx_cgroup_llc_ctx __arena *));
+	if (ret) {
+		cbw_err("Failed to initialize the LLC table allocator");
+		return ret;
+	}
+
+	ret = cbw_grow_cgroup_tables(CBW_NR_CGRP_INIT);
+	if (ret)
+		return ret;
+
+	ret = cbw_refill_llcx_reserve();
+	if (ret)
+		return ret;
+
+	cbw_orphan_btq = (scx_atq_t *)scx_atq_create(true);
+	if (!cbw_orphan_btq) {
+		cbw_err("Failed to allocate the orphan BTQ");
+		return -ENOMEM;
+	}
+
+	cbw_llc_reenqs = scx_static_alloc(TOPO_NR(LLC) * sizeof(struct cbw_llc_reenq),
+					  SCX_CACHELINE_SIZE);
+	if (!cbw_llc_reenqs) {
+		cbw_err("Failed to allocate the per-LLC reenqueue states");
+		return -ENOMEM;
+	}
+
 	/* Initialize the replenish timer. */
 	timer = bpf_map_lookup_elem(&replenish_timer, &key);
 	if (!timer) {
@@ -424,6 +629,7 @@ int scx_cgroup_bw_lib_init(struct scx_cgroup_bw_config *config)
 		return ret;
 	}
 
+	WRITE_ONCE(cbw_lib_ready, true);
 	return 0;
 }
 
@@ -450,126 +656,399 @@ long cbw_del_cgroup_ctx(struct cgroup *cgrp)
 	return bpf_cgrp_storage_delete(&cbw_cgrp_map, cgrp);
 }
 
+/*
+ * Free the retired copies of the cgroup tables that no reader can hold
+ * anymore. The replenishment switches to the latest copy at its next run,
+ * and the scheduling paths only hold a copy for the duration of an operation,
+ * so a copy retired two generations ago is safe to free. Should only be
+ * called from a sleepable context.
+ */
 static
-struct scx_cgroup_llc_ctx *cbw_alloc_llc_ctx(struct cgroup *cgrp,
-					     struct scx_cgroup_ctx *cgx,
-					     int llc_id)
-{
-	static const struct scx_cgroup_llc_ctx llcx0;
-	struct scx_cgroup_llc_ctx *llcx;
-	struct cgroup_llc_id key = {
-		.cgrp_id = cgroup_get_id(cgrp),
-		.llc_id = llc_id,
-	};
-
-	/* Allocate an LLC context on the map. */
-	if (bpf_map_update_elem(&cbw_cgrp_llc_map, &key, &llcx0, BPF_NOEXIST))
-		return NULL;
+void cbw_free_retired_tables(void)
+{
+	struct cbw_cgroup_tables __arena *t, *next;
+	u64 gen;
+
+	bpf_spin_lock(&cbw_tables_retired_lock);
+	t = cbw_tables_retired;
+	cbw_tables_retired = NULL;
+	bpf_spin_unlock(&cbw_tables_retired_lock);
+
+	gen = READ_ONCE(cbw_replenish_gen);
+	while (t && can_loop) {
+		next = t->next;
+
+		if (gen < t->retired_gen + 2 ||
+		    t == READ_ONCE(cbw_replenish_tables)) {
+			/* Still in use, keep it on the list. */
+			bpf_spin_lock(&cbw_tables_retired_lock);
+			t->next = cbw_tables_retired;
+			cbw_tables_retired = t;
+			bpf_spin_unlock(&cbw_tables_retired_lock);
+		} else {
+			bpf_arena_free_pages(&arena, t, t->nr_pages);
+		}
 
-	llcx = bpf_map_lookup_elem(&cbw_cgrp_llc_map, &key);
-	if (!llcx)
-		return NULL;
-	llcx->id = cgroup_get_id(cgrp);
+		t = next;
+	}
+}
 
-	/* Create an associated BTQ. */
-	llcx->btq = (scx_atq_t *)scx_atq_create(false);
-	if (!llcx->btq) {
-		cbw_err("Fail to allocate a BTQ");
-		bpf_map_delete_elem(&cbw_cgrp_llc_map, &key);
-		return NULL;
+/*
+ * Make the cgroup tables hold at least @nr_cgroups cgroups. The cgroup ids
+ * already in the tables are carried over. This allocates, so it should only
+ * be called from a sleepable context.
+ */
+static
+int cbw_grow_cgroup_tables(u64 nr_cgroups)
+{
+	struct cbw_cgroup_tables __arena *old, *new;
+	u64 cap, nr_pages, i;
+
+	old = cbw_tables;
+	if (old && nr_cgroups <= old->cap)
+		return 0;
+
+	cap = old ? old->cap : CBW_NR_CGRP_INIT;
+	while (cap < nr_cgroups && can_loop)
+		cap *= 2;
+
+	nr_pages = div_round_up(sizeof(*new) + 4 * cap * sizeof(u64), PAGE_SIZE);
+	new = bpf_arena_alloc_pages(&arena, NULL, nr_pages, NUMA_NO_NODE, 0);
+	if (!new) {
+		cbw_err("Failed to allocate cgroup tables for %llu cgroups", cap);
+		return -ENOMEM;
+	}
+
+	new->cap = cap;
+	new->nr_pages = nr_pages;
+	new->taskable = &new->ids[0];
+	new->throttled = &new->ids[cap];
+	new->dirty[0] = &new->ids[2 * cap];
+	new->dirty[1] = &new->ids[3 * cap];
+
+	if (old) {
+		/*
+		 * Pairs with smp_mb() in cbw_mark_dirty(). A dirty mark that
+		 * lands in @old after its slot was copied sees @moving.
+		 */
+		WRITE_ONCE(old->moving, true);
+		smp_mb();
+
+		bpf_for(i, 0, old->cap) {
+			new->taskable[i] = old->taskable[i];
+			new->throttled[i] = READ_ONCE(old->throttled[i]);
+			new->dirty[0][i] = READ_ONCE(old->dirty[0][i]);
+			new->dirty[1][i] = READ_ONCE(old->dirty[1][i]);
+		}
+	}
+
+	WRITE_ONCE(cbw_tables, new);
+
+	if (old) {
+		old->retired_gen = READ_ONCE(cbw_replenish_gen);
+		bpf_spin_lock(&cbw_tables_retired_lock);
+		old->next = cbw_tables_retired;
+		cbw_tables_retired = old;
+		bpf_spin_unlock(&cbw_tables_retired_lock);
+	}
+	cbw_free_retired_tables();
+
+	cbw_stats.table_bytes = nr_pages * PAGE_SIZE;
+	return 0;
+}
+
+/*
+ * Add a cgroup to the dirty cgroup table of the current replenish generation
+ * so the next replenishment visits it. A cgroup is added at most once per
+ * generation, so this is cheap enough for the budget consumption path.
+ */
+static
+void cbw_mark_dirty(struct scx_cgroup_ctx *cgx)
+{
+	struct cbw_cgroup_tables __arena *tables;
+	u64 gen, old, idx;
+	int set;
+
+	gen = READ_ONCE(cbw_replenish_gen);
+	old = READ_ONCE(cgx->dirty_gen);
+	if (old == gen ||
+	    !__sync_bool_compare_and_swap(&cgx->dirty_gen, old, gen))
+		return;
+
+	set = gen & 1;
+	idx = __sync_fetch_and_add(&cbw_nr_dirty_cgroups[set], 1);
+	tables = READ_ONCE(cbw_tables);
+	if (!tables || idx >= tables->cap) {
+		/* Fall back to walking the whole tree at the next period. */
+		WRITE_ONCE(cbw_dirty_overflow[set], true);
+		return;
 	}
+	WRITE_ONCE(tables->dirty[set][idx], cgx->id);
 
 	/*
-	 * Set budget to infinity in advance if there is no upper bound.
+	 * A growth may have copied the slot before the store above, in which
+	 * case the mark is lost with the retired copy. Either the growth
+	 * copies our store, or we see @moving here, so walk the whole tree
+	 * at the next period when in doubt.
 	 */
-	if (cgx->nquota_ub == CBW_RUNTUME_INF)
-		llcx->budget_remaining = CBW_RUNTUME_INF;
+	smp_mb();
+	if (READ_ONCE(tables->moving))
+		WRITE_ONCE(cbw_dirty_overflow[set], true);
+}
+
+static
+void cbw_put_llcx_reserve(struct scx_cgroup_llc_ctx __arena *llcx)
+{
+	bpf_spin_lock(&cbw_llcx_reserve_lock);
+	llcx->next = cbw_llcx_reserve;
+	cbw_llcx_reserve = llcx;
+	cbw_stats.nr_llcx_free++;
+	bpf_spin_unlock(&cbw_llcx_reserve_lock);
+}
+
+static
+struct scx_cgroup_llc_ctx __arena *cbw_get_llcx_reserve(void)
+{
+	struct scx_cgroup_llc_ctx __arena *llcx;
+
+	bpf_spin_lock(&cbw_llcx_reserve_lock);
+	llcx = cbw_llcx_reserve;
+	if (llcx) {
+		cbw_llcx_reserve = llcx->next;
+		cbw_stats.nr_llcx_free--;
+	}
+	bpf_spin_unlock(&cbw_llcx_reserve_lock);
 
 	return llcx;
 }
 
+/*
+ * Top up the reserve of LLC contexts so that the scheduling paths do not run
+ * out of them. Nothing is done until the reserve drops below the low
+ * watermark, and then it is filled up in one go. This allocates, so it should
+ * only be called from a sleepable context.
+ */
+static
+int cbw_refill_llcx_reserve(void)
+{
+	struct scx_cgroup_llc_ctx __arena *llcx;
+	u64 target;
+
+	if (READ_ONCE(cbw_stats.nr_llcx_free) >=
+	    TOPO_NR(LLC) * CBW_LLCX_RESERVE_LOW_CGRPS)
+		return 0;
+
+	target = TOPO_NR(LLC) * CBW_LLCX_RESERVE_CGRPS;
+	while (READ_ONCE(cbw_stats.nr_llcx_free) < target && can_loop) {
+		bpf_spin_lock(&cbw_llcx_reserve_lock);
+		llcx = cbw_llcx_spare;
+		if (llcx)
+			cbw_llcx_spare = llcx->next;
+		bpf_spin_unlock(&cbw_llcx_reserve_lock);
+
+		if (!llcx) {
+			llcx = scx_static_alloc(sizeof(*llcx), SCX_CACHELINE_SIZE);
+			if (!llcx) {
+				cbw_err("Fail to allocate an LLC context");
+				return -ENOMEM;
+			}
+		}
+
+		/* Create an associated BTQ. */
+		llcx->btq = (scx_atq_t *)scx_atq_create(false);
+		if (!llcx->btq) {
+			bpf_spin_lock(&cbw_llcx_reserve_lock);
+			llcx->next = cbw_llcx_spare;
+			cbw_llcx_spare = llcx;
+			bpf_spin_unlock(&cbw_llcx_reserve_lock);
+
+			cbw_err("Fail to allocate a BTQ");
+			return -ENOMEM;
+		}
+
+		cbw_put_llcx_reserve(llcx);
+	}
+
+	return 0;
+}
+
 static
-struct scx_cgroup_llc_ctx *cbw_get_llc_ctx_with_id(u64 cgrp_id, int llc_id)
+struct scx_cgroup_llc_ctx __arena *cbw_get_llc_ctx(struct scx_cgroup_ctx *cgx,
+						   int llc_id)
 {
-	struct cgroup_llc_id key = {
-		.cgrp_id = cgrp_id,
-		.llc_id = llc_id,
-	};
+	struct cbw_llc_table __arena *table = cgx->llcxs;
+
+	if (!table || llc_id < 0 || llc_id >= TOPO_NR(LLC))
+		return NULL;
 
-	return bpf_map_lookup_elem(&cbw_cgrp_llc_map, &key);
+	return table->llcx[llc_id];
 }
 
+/*
+ * Borrow another LLC context of @cgx when the one for @llc_id cannot be
+ * attached. The cgroup then keeps being charged and throttled through one of
+ * its own LLC contexts until the reserve is refilled, rather than running
+ * unlimited. A taskable cgroup always has at least one (cbw_init_llc_ctx).
+ */
 static
-struct scx_cgroup_llc_ctx *cbw_get_llc_ctx(struct cgroup *cgrp, int llc_id)
+struct scx_cgroup_llc_ctx __arena *cbw_borrow_llc_ctx(struct cbw_llc_table __arena *table,
+						      int llc_id)
 {
-	return cbw_get_llc_ctx_with_id(cgroup_get_id(cgrp), llc_id);
+	struct scx_cgroup_llc_ctx __arena *llcx;
+	int i;
+
+	bpf_for(i, 1, TOPO_NR(LLC)) {
+		llcx = READ_ONCE(table->llcx[(llc_id + i) % TOPO_NR(LLC)]);
+		if (llcx)
+			return llcx;
+	}
+
+	return NULL;
 }
 
+/*
+ * Get the LLC context of @cgx for @llc_id, attaching one from the reserve if
+ * the cgroup has never run on the LLC before. This does not allocate, so it
+ * is safe to call from the scheduling paths. If the reserve ran dry, return
+ * another LLC context of the cgroup instead. Return NULL only if the cgroup
+ * cannot have tasks (yet).
+ */
 static
-long cbw_del_llc_ctx(struct cgroup *cgrp, int llc_id)
+struct scx_cgroup_llc_ctx __arena *cbw_get_or_attach_llc_ctx(struct scx_cgroup_ctx *cgx,
+							     int llc_id)
 {
-	struct cgroup_llc_id key = {
-		.cgrp_id = cgroup_get_id(cgrp),
-		.llc_id = llc_id,
-	};
+	struct scx_cgroup_llc_ctx __arena *llcx;
+	struct cbw_llc_table __arena *table = cgx->llcxs;
+
+	if (!table || llc_id < 0 || llc_id >= TOPO_NR(LLC))
+		return NULL;
+
+	llcx = READ_ONCE(table->llcx[llc_id]);
+	if (llcx)
+		return llcx;
 
-	return bpf_map_delete_elem(&cbw_cgrp_llc_map, &key);
+	llcx = cbw_get_llcx_reserve();
+	if (!llcx) {
+		__sync_fetch_and_add(&cbw_stats.nr_llcx_miss, 1);
+		return cbw_borrow_llc_ctx(table, llc_id);
+	}
+	__sync_fetch_and_add(&cbw_stats.nr_llcx, 1);
+
+	llcx->id = cgx->id;
+	llcx->next = NULL;
+	llcx->runtime_total = 0;
+	llcx->runtime_avg = 0;
+	llcx->run_avg = 0;
+
+	/*
+	 * Set budget to infinity in advance if there is no upper bound.
+	 */
+	llcx->budget_remaining = (cgx->nquota_ub == CBW_RUNTUME_INF) ?
+				 CBW_RUNTUME_INF : 0;
+
+	/* Another CPU of the LLC may have beaten us to it. */
+	if (!__sync_bool_compare_and_swap(&table->llcx[llc_id], NULL, llcx)) {
+		cbw_put_llcx_reserve(llcx);
+		__sync_fetch_and_sub(&cbw_stats.nr_llcx, 1);
+
+		llcx = READ_ONCE(table->llcx[llc_id]);
+	}
+
+	return llcx;
 }
 
 static
 int cbw_init_llc_ctx(struct cgroup *cgrp, struct scx_cgroup_ctx *cgx)
 {
-	int i;
+	struct sdt_data __arena *data;
+	struct cbw_llc_table __arena *table;
+	int ret;
 
 	if (!cgx || !cgrp)
 		return -EINVAL;
 
-	bpf_for(i, 0, TOPO_NR(LLC)) {
-		struct scx_cgroup_llc_ctx *llcx;
+	if (cgx->has_llcx)
+		return 0;
 
-		llcx = cbw_alloc_llc_ctx(cgrp, cgx, i);
-		if (!llcx)
-			return -ENOMEM;
+	/*
+	 * Allocate an empty LLC table. LLC contexts are attached lazily, once
+	 * the cgroup runs on an LLC (cbw_get_or_attach_llc_ctx). Make sure the
+	 * reserve can cover that while we are still in a sleepable context.
+	 */
+	ret = cbw_refill_llcx_reserve();
+	if (ret)
+		return ret;
+
+	/* Note that scx_alloc() returns a zero-initialized memory. */
+	data = scx_alloc(&cbw_llc_table_allocator);
+	if (!data) {
+		cbw_err("Fail to allocate an LLC table");
+		return -ENOMEM;
 	}
+
+	table = (struct cbw_llc_table __arena *)data->payload;
+	table->tid = data->tid;
+
+	cgx->llcxs = table;
 	cgx->has_llcx = true;
 
+	/*
+	 * Attach the LLC context of the current LLC right away, so that the
+	 * cgroup has one to fall back on if the reserve runs dry later.
+	 */
+	if (!cbw_get_or_attach_llc_ctx(cgx, cbw_get_current_llc_id())) {
+		cbw_err("Fail to attach an LLC context");
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
 static
 void cbw_free_llc_ctx(struct cgroup *cgrp, struct scx_cgroup_ctx *cgx)
 {
-	struct scx_cgroup_llc_ctx *llcx;
-	scx_atq_t *btq;
+	struct scx_cgroup_llc_ctx __arena *llcx;
+	struct cbw_llc_table __arena *table;
+	scx_task_common *taskc;
 	int i;
 
-	if (!cgrp)
+	if (!cgrp || !cgx || !cgx->has_llcx)
 		return;
 
-	if (cgx) {
-		if (!cgx->has_llcx)
-			return;
-		cgx->has_llcx = false;
-	}
+	table = cgx->llcxs;
+	cgx->has_llcx = false;
+	cgx->llcxs = NULL;
+	if (!table)
+		return;
 
+	/*
+	 * Return the LLC contexts the cgroup ran on to the reserve. Their
+	 * BTQs go along with them, so they should be empty by now. If not,
+	 * hand the tasks over to the orphan BTQ, so the next
+	 * scx_cgroup_bw_reenqueue() runs them instead of losing them.
+	 */
 	bpf_for(i, 0, TOPO_NR(LLC)) {
-		llcx = cbw_get_llc_ctx(cgrp, i);
-		if (!llcx || !(btq = llcx->btq))
-			break;
+		llcx = table->llcx[i];
+		if (!llcx)
+			continue;
 
-		if (scx_atq_nr_queued(btq)) {
-			cbw_err("Throttled tasks should not be in an existing cgroup: [%llu/%d]",
+		if (scx_atq_nr_queued(llcx->btq)) {
+			cbw_dbg("Throttled tasks left in a cgroup being freed: [%llu/%d]",
 				cgroup_get_id(cgrp), i);
+			while ((taskc = (scx_task_common *)scx_atq_pop(llcx->btq)) &&
+			       can_loop) {
+				if (scx_atq_insert(cbw_orphan_btq, taskc))
+					cbw_err("Failed to hand over a throttled task");
+			}
 		}
 
-		if (cbw_del_llc_ctx(cgrp, i)) {
-			cbw_err("Failed to delete an LLC context: [%llu/%d]",
-				cgroup_get_id(cgrp), i);
-			continue;
-		}
+		table->llcx[i] = NULL;
 
-		scx_atq_destroy(btq);
+		cbw_put_llcx_reserve(llcx);
+		__sync_fetch_and_sub(&cbw_stats.nr_llcx, 1);
 	}
+
+	scx_alloc_free_idx(&cbw_llc_table_allocator, table->tid.idx);
 }
 
 static
@@ -647,7 +1126,7 @@ int cbw_update_nquota_ub(struct cgroup *cgrp __arg_trusted, struct scx_cgroup_ct
 {
 	struct scx_cgroup_ctx *parentx, *subroot_cgx;
 	struct cgroup *parent, *subroot_cgrp;
-	struct scx_cgroup_llc_ctx *llcx;
+	struct scx_cgroup_llc_ctx __arena *llcx;
 	int i;
 
 	if (!cgx || !cgrp)
@@ -703,9 +1182,9 @@ int cbw_update_nquota_ub(struct cgroup *cgrp __arg_trusted, struct scx_cgroup_ct
 		goto out;
 
 	bpf_for(i, 0, TOPO_NR(LLC)) {
-		llcx = cbw_get_llc_ctx(cgrp, i);
+		llcx = cbw_get_llc_ctx(cgx, i);
 		if (!llcx)
-			break;
+			continue;
 
 		if (cgx->nquota_ub == CBW_RUNTUME_INF) {
 			WRITE_ONCE(llcx->budget_remaining, CBW_RUNTUME_INF);
@@ -813,6 +1292,17 @@ int scx_cgroup_bw_init(struct cgroup *cgrp __arg_trusted, struct scx_cgroup_init
 		return -ENOMEM;
 	}
 
+	/*
+	 * Make room for the new cgroup in the cgroup tables. The tables are
+	 * sized by the number of cgroups, so grow them while we can block.
+	 */
+	ret = cbw_grow_cgroup_tables(__sync_add_and_fetch(&cbw_nr_cgroups, 1));
+	if (ret) {
+		__sync_fetch_and_sub(&cbw_nr_cgroups, 1);
+		cbw_del_cgroup_ctx(cgrp);
+		return ret;
+	}
+
 	cgx->id = cgroup_get_id(cgrp);
 	cbw_set_bandwidth(cgrp, cgx, args->bw_period_us, args->bw_quota_us,
 			  args->bw_burst_us);
@@ -820,6 +1310,7 @@ int scx_cgroup_bw_init(struct cgroup *cgrp __arg_trusted, struct scx_cgroup_init
 	cgx->runtime_total_sloppy = 0;
 	cgx->budget_remaining = (cgrp->level == 1)? cgx->nquota : 0;
 	cgx->is_throttled = false;
+	cbw_mark_dirty(cgx);
 
 	/*
 	 * The parent of @cgrp becomes non-leaf. If the parent is not
@@ -868,14 +1359,20 @@ int scx_cgroup_bw_init(struct cgroup *cgrp __arg_trusted, struct scx_cgroup_init
 __hidden
 int scx_cgroup_bw_exit(struct cgroup *cgrp __arg_trusted)
 {
+	struct scx_cgroup_ctx *cgx;
 	int ret = 0;
 
 	cbw_dbg_cgrp();
 	if (cgrp->level > 1)
 		ret = cbw_update_nr_taskable_descendents(cgrp, -1);
 
+	cgx = cbw_get_cgroup_ctx(cgrp);
+	if (cgx) {
+		cbw_free_llc_ctx(cgrp, cgx);
+		__sync_fetch_and_sub(&cbw_nr_cgroups, 1);
+	}
+
 	cbw_del_cgroup_ctx(cgrp);
-	cbw_free_llc_ctx(cgrp, NULL);
 	return ret;
 }
 
@@ -942,6 +1439,7 @@ int scx_cgroup_bw_set(struct cgroup *cgrp __arg_trusted, u64 period_us, u64 quot
 		}
 
 		ret = cbw_update_nquota_ub(cur_cgrp_trusted, cur_cgx);
+		cbw_mark_dirty(cur_cgx);
 		bpf_cgroup_release(cur_cgrp_trusted);
 		if (ret)
 			goto unlock_out;
@@ -960,7 +1458,7 @@ bool is_llc_id_valid(int llc_id)
 static
 s64 cbw_sum_rumtime_total_llcx(struct cgroup *cgrp, struct scx_cgroup_ctx *cgx)
 {
-	struct scx_cgroup_llc_ctx *llcx;
+	struct scx_cgroup_llc_ctx __arena *llcx;
 	s64 sum;
 	int i;
 
@@ -969,9 +1467,9 @@ s64 cbw_sum_rumtime_total_llcx(struct cgroup *cgrp, struct scx_cgroup_ctx *cgx)
 
 	sum = 0;
 	bpf_for(i, 0, TOPO_NR(LLC)) {
-		llcx = cbw_get_llc_ctx(cgrp, i);
+		llcx = cbw_get_llc_ctx(cgx, i);
 		if (!llcx)
-			break;
+			continue;
 		sum += READ_ONCE(llcx->runtime_total);
 	}
 	return sum;
@@ -1126,7 +1624,7 @@ int cbw_update_runtime_total_sloppy(struct cgroup *cgrp)
 
 static
 s64 cbw_transfer_budget_c2l(struct scx_cgroup_ctx *src_cgx, int src_level,
-			    struct scx_cgroup_llc_ctx *tgt_llcx)
+			    struct scx_cgroup_llc_ctx __arena *tgt_llcx)
 {
 	s64 remaining, debt, b, tgt_br = 0;
 
@@ -1148,6 +1646,7 @@ s64 cbw_transfer_budget_c2l(struct scx_cgroup_ctx *src_cgx, int src_level,
 
 		__sync_fetch_and_sub(&src_cgx->budget_remaining, b);
 		__sync_fetch_and_add(&tgt_llcx->budget_remaining, b);
+		__sync_fetch_and_add(&src_cgx->xfer.nr_c2l, 1);
 	} while ( ((tgt_br = (READ_ONCE(tgt_llcx->budget_remaining))) <= 0) &&
 		  (READ_ONCE(src_cgx->budget_remaining) > 0) && can_loop);
 
@@ -1205,6 +1704,7 @@ s64 cbw_transfer_budget_p2c(struct scx_cgroup_ctx *subroot_cgx,
 
 			__sync_fetch_and_sub(&subroot_cgx->budget_remaining, b);
 			__sync_fetch_and_add(&tgt_cgx->budget_remaining, b);
+			__sync_fetch_and_add(&tgt_cgx->xfer.nr_p2c, 1);
 		}
 	} while ( ((tgt_br = READ_ONCE(tgt_cgx->budget_remaining)) <= 0) &&
 		  (READ_ONCE(subroot_cgx->budget_remaining) > 0) && can_loop);
@@ -1227,24 +1727,63 @@ s64 cbw_transfer_budget_p2c(struct scx_cgroup_ctx *subroot_cgx,
 	return tgt_br;
 }
 
+/*
+ * Take budget left over in the other LLC contexts of @cgx until @tgt_llcx
+ * has some. This is only used in the predictive mode, where the quota was
+ * handed out to the LLCs in advance, so an LLC that runs dry first looks
+ * for leftovers in its siblings before asking the subroot cgroup.
+ */
 static
-s64 cbw_transfer_budget_p2l(struct scx_cgroup_ctx *subroot_cgx,
-			    struct scx_cgroup_ctx *tgt_cgx,
-			    int tgt_level,
-			    struct scx_cgroup_llc_ctx *tgt_llcx)
+s64 cbw_transfer_budget_l2l(struct scx_cgroup_ctx *cgx, int tgt_llc_id,
+			    struct scx_cgroup_llc_ctx __arena *tgt_llcx)
 {
-	s64 remaining;
+	struct scx_cgroup_llc_ctx __arena *src_llcx;
+	s64 remaining, b;
+	int i;
 
-	if (READ_ONCE(subroot_cgx->budget_remaining) <= 0)
-		return READ_ONCE(tgt_llcx->budget_remaining);
+	bpf_for(i, 1, TOPO_NR(LLC)) {
+		remaining = READ_ONCE(tgt_llcx->budget_remaining);
+		if (remaining > 0)
+			return remaining;
 
-	/*
-	 * We move the budget from the subroot cgroup to the target cgroup,
-	 * then finally to the target LLC context.
-	 */
-	do {
-		remaining = cbw_transfer_budget_p2c(subroot_cgx, tgt_cgx);
-		if (remaining <= 0) {
+		src_llcx = cbw_get_llc_ctx(cgx, (tgt_llc_id + i) % TOPO_NR(LLC));
+		if (!src_llcx)
+			continue;
+
+		/*
+		 * Take half of what is left, so the source LLC does not run
+		 * dry right away either.
+		 */
+		b = READ_ONCE(src_llcx->budget_remaining) / 2;
+		if (b < CBW_BUDGET_STEAL_MIN)
+			continue;
+
+		__sync_fetch_and_sub(&src_llcx->budget_remaining, b);
+		__sync_fetch_and_add(&tgt_llcx->budget_remaining, b);
+		__sync_fetch_and_add(&cgx->xfer.nr_l2l, 1);
+	}
+
+	return READ_ONCE(tgt_llcx->budget_remaining);
+}
+
+static
+s64 cbw_transfer_budget_p2l(struct scx_cgroup_ctx *subroot_cgx,
+			    struct scx_cgroup_ctx *tgt_cgx,
+			    int tgt_level,
+			    struct scx_cgroup_llc_ctx __arena *tgt_llcx)
+{
+	s64 remaining;
+
+	if (READ_ONCE(subroot_cgx->budget_remaining) <= 0)
+		return READ_ONCE(tgt_llcx->budget_remaining);
+
+	/*
+	 * We move the budget from the subroot cgroup to the target cgroup,
+	 * then finally to the target LLC context.
+	 */
+	do {
+		remaining = cbw_transfer_budget_p2c(subroot_cgx, tgt_cgx);
+		if (remaining <= 0) {
 			/*
 			 * If there is no remaining budget in the subroot
 			 * cgroup, we should throttle the cgroup.
@@ -1261,7 +1800,7 @@ s64 cbw_transfer_budget_p2l(struct scx_cgroup_ctx *subroot_cgx,
 
 static 
 void cbw_consume_budget(struct scx_cgroup_ctx *cgx,
-			struct scx_cgroup_llc_ctx *llcx, u64 consumed_ns)
+			struct scx_cgroup_llc_ctx __arena *llcx, u64 consumed_ns)
 {
 	s64 period_duration;
 
@@ -1285,11 +1824,16 @@ void cbw_consume_budget(struct scx_cgroup_ctx *cgx,
 		consumed_ns = period_duration;
 	}
 
+	llcx->run_avg = cbw_calc_avg(llcx->run_avg, consumed_ns);
+
 	/* Decrease the budget budget_remaining */
 	__sync_fetch_and_sub(&llcx->budget_remaining, consumed_ns);
 
 	/* Increase the total runtime */
 	__sync_fetch_and_add(&llcx->runtime_total, consumed_ns);
+
+	/* The next replenishment should account for this consumption. */
+	cbw_mark_dirty(cgx);
 }
 
 static
@@ -1302,7 +1846,7 @@ int cbw_get_current_llc_id(void)
 int cbw_cgroup_bw_throttled(struct cgroup *cgrp __arg_trusted, int llc_id)
 {
 	struct scx_cgroup_ctx *cgx, *subroot_cgx;
-	struct scx_cgroup_llc_ctx *llcx;
+	struct scx_cgroup_llc_ctx __arena *llcx;
 	struct cgroup *subroot_cgrp;
 	int ret;
 
@@ -1325,8 +1869,12 @@ int cbw_cgroup_bw_throttled(struct cgroup *cgrp __arg_trusted, int llc_id)
 	 * quota won't be fully consumed, and the remaining time won't be
 	 * accumulated. On the other hand, if overbooked, the cgroup's quota
 	 * will be fully utilized, and its debt will be charged over time.
+	 *
+	 * LLC contexts are attached the first time the cgroup runs on the
+	 * LLC, so a missing one is not an error by itself.
 	 */
-	llcx = cbw_get_llc_ctx(cgrp, llc_id);
+	cgx = cbw_get_cgroup_ctx(cgrp);
+	llcx = cgx ? cbw_get_or_attach_llc_ctx(cgx, llc_id) : NULL;
 	if (!llcx) {
 		/*
 		 * This can happen when a new cgroup is created and a task of
@@ -1334,7 +1882,8 @@ int cbw_cgroup_bw_throttled(struct cgroup *cgrp __arg_trusted, int llc_id)
 		 * is finished in scx. This can happen, for example, when
 		 * opening a new terminal session, etc. In this case, let the
 		 * task proceed instead of waiting for cgroup initialization
-		 * to finish.
+		 * to finish. Note that running out of the LLC context
+		 * reserve does not end up here, see cbw_borrow_llc_ctx().
 		 */
 		cbw_dbg("Failed to lookup an LLC ctx: [%llu/%d]",
 			cgroup_get_id(cgrp), llc_id);
@@ -1350,12 +1899,13 @@ int cbw_cgroup_bw_throttled(struct cgroup *cgrp __arg_trusted, int llc_id)
 	 * If the budget remains at the cgroup level, transfer the cgroup's
 	 * budget to the LLC level by budget_c2l.
 	 */
-	cgx = cbw_get_cgroup_ctx(cgrp);
-	if (!cgx) {
-		cbw_err("Failed to lookup a cgroup ctx: %llu",
-			cgroup_get_id(cgrp));
-		return -ESRCH;
-	}
+
+	/*
+	 * The LLC ran out of budget, so the cgroup either secures more
+	 * budget or gets throttled. Either way, the next replenishment
+	 * should visit it.
+	 */
+	cbw_mark_dirty(cgx);
 
 	if (READ_ONCE(cgx->is_throttled)) {
 		dbg_cgx(cgx, "throttled: ");
@@ -1368,6 +1918,17 @@ int cbw_cgroup_bw_throttled(struct cgroup *cgrp __arg_trusted, int llc_id)
 		return 0;
 	}
 
+	/*
+	 * In the predictive mode, most of the budget was handed out to the
+	 * LLCs in advance. Look for leftovers in the other LLCs before going
+	 * up the hierarchy.
+	 */
+	if (cbw_config.predictive &&
+	    cbw_transfer_budget_l2l(cgx, llc_id, llcx) > 0) {
+		dbg_llcx(llcx, "budget-transfer-from-llcx: ");
+		return 0;
+	}
+
 	/*
 	 * There is no budget remaining at the cgroup level. Before asking
 	 * more budget to its subroot cgroup, let's first check whether the
@@ -1461,7 +2022,7 @@ int scx_cgroup_bw_throttled(struct cgroup *cgrp __arg_trusted)
 __hidden
 int scx_cgroup_bw_consume(struct cgroup *cgrp __arg_trusted, u64 consumed_ns)
 {
-	struct scx_cgroup_llc_ctx *llcx;
+	struct scx_cgroup_llc_ctx __arena *llcx;
 	struct scx_cgroup_ctx *cgx;
 	int llc_id;
 
@@ -1484,7 +2045,7 @@ int scx_cgroup_bw_consume(struct cgroup *cgrp __arg_trusted, u64 consumed_ns)
 	 * at reservation.
 	 */
 	cgx = cbw_get_cgroup_ctx(cgrp);
-	llcx = cbw_get_llc_ctx(cgrp, llc_id);
+	llcx = cgx ? cbw_get_or_attach_llc_ctx(cgx, llc_id) : NULL;
 	if (!cgx || !llcx) {
 		/*
 		 * When exiting a scx scheduler, the sched_ext kernel shuts
@@ -1522,7 +2083,8 @@ __hidden
 int scx_cgroup_bw_put_aside(struct task_struct *p __arg_trusted, u64 ctx, u64 vtime, struct cgroup *cgrp __arg_trusted)
 {
 	scx_task_common *taskc = (scx_task_common *)ctx;
-	struct scx_cgroup_llc_ctx *llcx;
+	struct scx_cgroup_llc_ctx __arena *llcx;
+	struct scx_cgroup_ctx *cgx;
 	int llc_id, ret;
 
 	cbw_dbg_cgrp(" [%s/%d]", p->comm, p->pid);
@@ -1536,7 +2098,8 @@ int scx_cgroup_bw_put_aside(struct task_struct *p __arg_trusted, u64 ctx, u64 vt
 	/*
 	 * Put aside the task to the BTQ of the LLC context.
 	 */
-	llcx = cbw_get_llc_ctx(cgrp, llc_id);
+	cgx = cbw_get_cgroup_ctx(cgrp);
+	llcx = cgx ? cbw_get_or_attach_llc_ctx(cgx, llc_id) : NULL;
 	if (!llcx) {
 		cbw_err("Failed to lookup an LLC ctx: [%llu/%d]",
 			cgroup_get_id(cgrp), llc_id);
@@ -1567,6 +2130,7 @@ int scx_cgroup_bw_put_aside(struct task_struct *p __arg_trusted, u64 ctx, u64 vt
 		return 0;
 	}
 
+	taskc->throttled_at = scx_bpf_now();
 	ret = scx_atq_insert_vtime_unlocked(llcx->btq, taskc, vtime);
 	if (ret)
 		cbw_err("Failed to insert a task to BTQ: %d", ret);
@@ -1579,16 +2143,16 @@ int scx_cgroup_bw_put_aside(struct task_struct *p __arg_trusted, u64 ctx, u64 vt
 static
 bool cbw_has_backlogged_tasks(struct scx_cgroup_ctx *cgx)
 {
-	struct scx_cgroup_llc_ctx *llcx;
+	struct scx_cgroup_llc_ctx __arena *llcx;
 	int i;
 
 	if (!cgx || !cgx->has_llcx)
 		return false;
 
 	bpf_for(i, 0, TOPO_NR(LLC)) {
-		llcx = cbw_get_llc_ctx_with_id(cgx->id, i);
+		llcx = cbw_get_llc_ctx(cgx, i);
 		if (!llcx)
-			break;
+			continue;
 
 		if (scx_atq_nr_queued(llcx->btq))
 			return true;
@@ -1597,11 +2161,125 @@ bool cbw_has_backlogged_tasks(struct scx_cgroup_ctx *cgx)
 	return false;
 }
 
+/*
+ * Hand out the budget of @cgx to its LLC contexts in proportion to how much
+ * the cgroup ran on each LLC in the recent periods. A hot cgroup spread over
+ * many LLCs then mostly consumes its LLC-local budget instead of pulling
+ * budget_c2l at a time from the shared cgroup context.
+ *
+ * The shares replace whatever the LLCs had left, which is already accounted
+ * for in the cgroup's budget through its debt or burst. A part of the budget
+ * stays at the cgroup level for LLCs that have no history yet.
+ *
+ * The scheduling paths keep charging the LLC budgets meanwhile, so each LLC
+ * budget is moved to its share by an atomic add of the difference. A charge
+ * that lands between the read and the add is then kept rather than lost.
+ */
+static
+void cbw_predistribute_budget(struct scx_cgroup_ctx *cgx)
+{
+	struct scx_cgroup_llc_ctx __arena *llcx;
+	s64 budget, share, left, sum = 0;
+	u64 weight;
+	int i;
+
+	if (!cgx->has_llcx)
+		return;
+
+	budget = READ_ONCE(cgx->budget_remaining);
+	if (budget <= 0 || budget == CBW_RUNTUME_INF)
+		return;
+
+	bpf_for(i, 0, TOPO_NR(LLC)) {
+		llcx = cbw_get_llc_ctx(cgx, i);
+		if (llcx && llcx->runtime_avg > 0)
+			sum += llcx->runtime_avg;
+	}
+	if (sum <= 0)
+		return;
+
+	budget -= budget >> CBW_PREDIST_RESERVE_SHIFT;
+
+	bpf_for(i, 0, TOPO_NR(LLC)) {
+		llcx = cbw_get_llc_ctx(cgx, i);
+		if (!llcx || llcx->runtime_avg <= 0)
+			continue;
+
+		/* Scale to 1/1024 first so the product cannot overflow. */
+		weight = ((u64)llcx->runtime_avg << 10) / (u64)sum;
+		share = (budget * weight) >> 10;
+
+		left = READ_ONCE(llcx->budget_remaining);
+		if (left == CBW_RUNTUME_INF)
+			continue;
+
+		__sync_fetch_and_add(&llcx->budget_remaining, share - left);
+		__sync_fetch_and_sub(&cgx->budget_remaining, share);
+		cgx->xfer.nr_predist++;
+	}
+
+	dbg_cgx(cgx, "predistributed: ");
+}
+
+static
+void cbw_mark_llc_backlogged(int llc_id)
+{
+	struct cbw_llc_reenq __arena *reenq;
+
+	if (llc_id < 0 || llc_id >= TOPO_NR(LLC))
+		return;
+
+	reenq = &cbw_llc_reenqs[llc_id];
+	if (!READ_ONCE(reenq->backlogged) &&
+	    __sync_bool_compare_and_swap(&reenq->backlogged, 0, 1))
+		__sync_fetch_and_add(&cbw_nr_backlogged_llcs, 1);
+}
+
+static
+void cbw_clear_llc_backlogged(int llc_id)
+{
+	struct cbw_llc_reenq __arena *reenq;
+
+	if (llc_id < 0 || llc_id >= TOPO_NR(LLC))
+		return;
+
+	reenq = &cbw_llc_reenqs[llc_id];
+	if (READ_ONCE(reenq->backlogged) &&
+	    __sync_bool_compare_and_swap(&reenq->backlogged, 1, 0))
+		__sync_fetch_and_sub(&cbw_nr_backlogged_llcs, 1);
+}
+
+/*
+ * Mark the LLCs where @cgx has backlogged tasks for the bottom half. Return
+ * true if there is any.
+ */
+static
+bool cbw_mark_backlogged_llcs(struct scx_cgroup_ctx *cgx)
+{
+	struct scx_cgroup_llc_ctx __arena *llcx;
+	bool backlogged = false;
+	int i;
+
+	if (!cgx || !cgx->has_llcx)
+		return false;
+
+	bpf_for(i, 0, TOPO_NR(LLC)) {
+		llcx = cbw_get_llc_ctx(cgx, i);
+		if (!llcx || !scx_atq_nr_queued(llcx->btq))
+			continue;
+
+		cbw_mark_llc_backlogged(i);
+		backlogged = true;
+	}
+
+	return backlogged;
+}
+
 static
 bool cbw_replenish_taskable_cgroup(struct scx_cgroup_ctx *subroot_cgx,
 				   struct scx_cgroup_ctx *cgx, u64 now)
 {
-	struct scx_cgroup_llc_ctx *llcx;
+	struct scx_cgroup_llc_ctx __arena *llcx;
 	s64 burst = 0, debt = 0, base, budget;
 	bool period_end;
 	int i;
@@ -1646,7 +2324,7 @@ bool cbw_replenish_taskable_cgroup(struct scx_cgroup_ctx *subroot_cgx,
 	 */
 	dbg_cgx(cgx, "replenishing: ");
 	bpf_for(i, 0, TOPO_NR(LLC)) {
-		llcx = cbw_get_llc_ctx_with_id(cgx->id, i);
+		llcx = cbw_get_llc_ctx(cgx, i);
 		if (llcx && (READ_ONCE(llcx->budget_remaining) < 0))
 			WRITE_ONCE(llcx->budget_remaining, 0);
 	}
@@ -1657,6 +2335,15 @@ bool cbw_replenish_taskable_cgroup(struct scx_cgroup_ctx *subroot_cgx,
 	budget = base + ((debt > 0) ? -debt : burst);
 	WRITE_ONCE(cgx->budget_remaining, budget);
 
+	/*
+	 * A subroot cgroup with taskable descendants hands its budget out on
+	 * demand, so only pre-distribute the budget of a cgroup whose LLCs
+	 * are the only consumers.
+	 */
+	if (cbw_config.predictive &&
+	    ((subroot_cgx != cgx) || (cgx->nr_taskable_descendents <= 1)))
+		cbw_predistribute_budget(cgx);
+
 	dbg_cgx(cgx, "replenished: ");
 
 out_no_replenish:
@@ -1667,7 +2354,7 @@ out_no_replenish:
 	 * them could not finish within one replenish period.
 	 */
 	WRITE_ONCE(cgx->is_throttled, false);
-	return READ_ONCE(cgx->is_throttled) || cbw_has_backlogged_tasks(cgx);
+	return READ_ONCE(cgx->is_throttled) || cbw_mark_backlogged_llcs(cgx);
 }
 
 static
@@ -1707,48 +2394,58 @@ int scx_cgroup_bw_cancel(u64 ctx)
 	return scx_atq_cancel((scx_task_common *)ctx);
 }
 
+static
+void cbw_reset_runtime_total_llcx(struct cgroup *cgrp, struct scx_cgroup_ctx *cgx)
+{
+	struct scx_cgroup_llc_ctx __arena *llcx;
+	int i;
+
+	if (!cgx->has_llcx)
+		return;
+
+	bpf_for(i, 0, TOPO_NR(LLC)) {
+		llcx = cbw_get_llc_ctx(cgx, i);
+		if (!llcx)
+			continue;
+
+		if (cbw_config.predictive)
+			llcx->runtime_avg = cbw_calc_avg(llcx->runtime_avg,
+							 READ_ONCE(llcx->runtime_total));
+		WRITE_ONCE(llcx->runtime_total, 0);
+	}
+}
+
 /*
- * A handler function for the replenish timer.
+ * Add a cgroup to the taskable cgroup table of @tables.
  */
 static
-int replenish_timerfn(void *map, int *key, struct bpf_timer *timer)
+void cbw_add_taskable_cgroup(struct cbw_cgroup_tables __arena *tables, u64 cgid)
 {
-	struct cgroup *root_cgrp, *cur_cgrp, *subroot_cgrp;
-	struct cgroup_subsys_state *subroot_css, *pos;
-	struct scx_cgroup_ctx *cur_cgx, *subroot_cgx;
-	struct scx_cgroup_llc_ctx *cur_llcx;
-	const struct cpumask *online_mask;
-	s64 interval, jitter, period;
-	u64 *ids, now;
-	s32 idle_cpu;
-	int i, ret;
+	u64 idx = cbw_nr_taskable_cgroups;
 
-	/* Attach the timer function to the BPF area context. */
-	scx_arena_subprog_init();
+	if (idx >= tables->cap) {
+		cbw_err("Failed to fetch a taskable cgroup table.");
+		return;
+	}
 
-	/*
-	 * Get the current time to calculate when to re-arm the timer.
-	 */
-	now = scx_bpf_now();
+	tables->taskable[idx] = cgid;
+	cbw_nr_taskable_cgroups++;
+}
 
-	/*
-	 * Let's start running the top half.
-	 *
-	 * The bottom half may still be running (BOTTOM_HALF_RUNNING) when the
-	 * new timer expires. In such a case, it is appropriate to proceed to
-	 * refill the time budget. Hence, we allow the transition from
-	 * {BOTTOM_HALF_RUNNING, IDLE} to TOP_HALF_RUNNING.
-	 */
-	if (!cbw_transit_replenish_stat(CBW_REPLENISH_STAT_IDLE,
-					CBW_REPLENISH_STAT_TOP_HALF_RUNNING) &&
-	    !cbw_transit_replenish_stat(CBW_REPLENISH_STAT_BOTTOM_HALF_RUNNING,
-					CBW_REPLENISH_STAT_TOP_HALF_RUNNING)) {
-		cbw_err("Incorrect replenish state: %d -- %d => %d",
-			cbw_replenish_stat.s, CBW_REPLENISH_STAT_IDLE,
-			CBW_REPLENISH_STAT_TOP_HALF_RUNNING);
-		return 0;
-	}
-	cbw_dbg("at %llu", now);
+/*
+ * Collect all the taskable cgroups into the taskable cgroup table by walking
+ * the whole cgroup tree, and fold the runtime of the period into every
+ * cgroup. Return the number of cgroups visited.
+ */
+static
+u64 cbw_collect_all_cgroups(struct cbw_cgroup_tables __arena *tables)
+{
+	struct cgroup_subsys_state *subroot_css, *pos;
+	struct cgroup *root_cgrp, *cur_cgrp;
+	struct scx_cgroup_ctx *cur_cgx;
+	u64 nr_touched = 0;
+
+	cbw_nr_taskable_cgroups = 0;
 
 	/*
 	 * Update the runtime total before replenishing budgets.
@@ -1756,7 +2453,7 @@ int replenish_timerfn(void *map, int *key, struct bpf_timer *timer)
 	root_cgrp = bpf_cgroup_from_id(1);
 	if (!root_cgrp) {
 		cbw_err("Failed to fetch the root cgroup pointer.");
-		goto idle_out;
+		return 0;
 	}
 	cbw_update_runtime_total_sloppy(root_cgrp);
 
@@ -1782,28 +2479,22 @@ int replenish_timerfn(void *map, int *key, struct bpf_timer *timer)
 			continue;
 		}
 
-		if (cur_cgx->has_llcx) {
-			bpf_for(i, 0, TOPO_NR(LLC)) {
-				cur_llcx = cbw_get_llc_ctx(cur_cgrp, i);
-				if (cur_llcx)
-					WRITE_ONCE(cur_llcx->runtime_total, 0);
-			}
-		}
+		cbw_reset_runtime_total_llcx(cur_cgrp, cur_cgx);
 		WRITE_ONCE(cur_cgx->runtime_total_last,
 			   READ_ONCE(cur_cgx->runtime_total_sloppy));
 		WRITE_ONCE(cur_cgx->runtime_total_sloppy, 0);
+		nr_touched++;
 	}
 	bpf_rcu_read_unlock();
 
 	/*
 	 * Update the array of taskable or subroot-level (level == 1) cgroup
-	 * IDs (cbw_taskable_cgroup_ids) in a pre order (i.e., top-down
+	 * IDs (tables->taskable) in a pre order (i.e., top-down
 	 * manner), so we can replenish cgroups in a pre order. This avoids
 	 * the case such that a lower-level cgroup is throttled before
 	 * upper-lever cgroups are replenished.
 	 */
 	bpf_rcu_read_lock();
-	cbw_nr_taskable_cgroups = 0;
 	subroot_css = &root_cgrp->self;
 	bpf_for_each(css, pos, subroot_css, BPF_CGROUP_ITER_DESCENDANTS_PRE) {
 		cur_cgrp = pos->cgroup;
@@ -1816,20 +2507,196 @@ int replenish_timerfn(void *map, int *key, struct bpf_timer *timer)
 			continue;
 		}
 
-		if (cur_cgx->has_llcx || cur_cgrp->level == 1) {
-			ids = MEMBER_VPTR(cbw_taskable_cgroup_ids,
-					  [cbw_nr_taskable_cgroups]);
-			if (!ids) {
-				cbw_err("Failed to fetch a taskable cgroup table.");
-				continue;
-			}
-			*ids = cgroup_get_id(cur_cgrp);
-			cbw_nr_taskable_cgroups++;
-		}
+		if (cur_cgx->has_llcx || cur_cgrp->level == 1)
+			cbw_add_taskable_cgroup(tables, cgroup_get_id(cur_cgrp));
 	}
 	bpf_rcu_read_unlock();
 	bpf_cgroup_release(root_cgrp);
 
+	return nr_touched;
+}
+
+/*
+ * Fold @runtime of a dirty cgroup into @cgx, which is either the dirty
+ * cgroup itself or one of its ancestors. The first time a cgroup is touched
+ * in generation @gen, its runtime of the period is reset and the cgroup is
+ * queued for replenishment if it is taskable or a subroot. Return true if
+ * this is the first touch.
+ */
+static
+bool cbw_touch_cgroup(struct cbw_cgroup_tables __arena *tables,
+		      struct cgroup *cgrp, struct scx_cgroup_ctx *cgx,
+		      u64 gen, s64 runtime)
+{
+	bool first = false;
+
+	if (cgx->touched_gen != gen) {
+		cgx->touched_gen = gen;
+		WRITE_ONCE(cgx->runtime_total_last, 0);
+		WRITE_ONCE(cgx->runtime_total_sloppy, 0);
+		first = true;
+
+		if (cgx->has_llcx || cgrp->level == 1)
+			cbw_add_taskable_cgroup(tables, cgx->id);
+	}
+
+	cgx->runtime_total_last += runtime;
+	return first;
+}
+
+/*
+ * Collect the dirty cgroups of generation @gen and their ancestors into
+ * the taskable cgroup table, and fold the runtime of the period into them.
+ * Return the number of cgroups touched.
+ *
+ * Cgroups that did not run during the period have no runtime to fold, and
+ * they were already replenished to their steady state at an earlier period
+ * (see replenish_timerfn), so skipping them changes nothing.
+ *
+ * The ancestors of a dirty cgroup are touched before the cgroup itself.
+ * Hence, a cgroup always shows up in the taskable cgroup table after all its
+ * ancestors, which preserves the pre order of the full walk.
+ */
+static
+u64 cbw_collect_dirty_cgroups(struct cbw_cgroup_tables __arena *tables, u64 gen)
+{
+	struct scx_cgroup_ctx *cgx, *cur_cgx;
+	struct cgroup *cgrp, *cur_cgrp;
+	u64 nr_dirty, nr_touched = 0;
+	u64 __arena *ids;
+	int set = gen & 1;
+	s64 rt_llcx;
+	int i, level;
+
+	cbw_nr_taskable_cgroups = 0;
+	nr_dirty = min(READ_ONCE(cbw_nr_dirty_cgroups[set]), tables->cap);
+	ids = tables->dirty[set];
+	bpf_for(i, 0, nr_dirty) {
+		/*
+		 * The cgroup may have been destroyed since it was marked
+		 * dirty. Also, a racing cbw_mark_dirty() may not have filled
+		 * in its slot yet. Either way, there is nothing to do; the
+		 * latter cgroup will be marked again when it runs next.
+		 */
+		cgrp = bpf_cgroup_from_id(READ_ONCE(ids[i]));
+		if (!cgrp)
+			continue;
+
+		cgx = cbw_get_cgroup_ctx(cgrp);
+		if (!cgx) {
+			bpf_cgroup_release(cgrp);
+			continue;
+		}
+
+		rt_llcx = cbw_sum_rumtime_total_llcx(cgrp, cgx);
+		cbw_reset_runtime_total_llcx(cgrp, cgx);
+
+		/* Ancestors first, skipping the root cgroup. */
+		bpf_for(level, 1, cgrp->level) {
+			cur_cgrp = bpf_cgroup_ancestor(cgrp, level);
+			if (!cur_cgrp)
+				continue;
+
+			cur_cgx = cbw_get_cgroup_ctx(cur_cgrp);
+			if (cur_cgx &&
+			    cbw_touch_cgroup(tables, cur_cgrp, cur_cgx, gen, rt_llcx))
+				nr_touched++;
+			bpf_cgroup_release(cur_cgrp);
+		}
+
+		if (cbw_touch_cgroup(tables, cgrp, cgx, gen, rt_llcx))
+			nr_touched++;
+		bpf_cgroup_release(cgrp);
+	}
+
+	return nr_touched;
+}
+
+/*
+ * A handler function for the replenish timer.
+ */
+static
+int replenish_timerfn(void *map, int *key, struct bpf_timer *timer)
+{
+	struct scx_cgroup_ctx *cur_cgx, *subroot_cgx;
+	struct cgroup *cur_cgrp, *subroot_cgrp;
+	struct cbw_cgroup_tables __arena *tables;
+	const struct cpumask *online_mask;
+	s64 interval, jitter, period;
+	topo_ptr llc_topo;
+	u64 now, gen, nr_touched, cgid, start_ns, ns;
+	bool full, throttled;
+	s32 idle_cpu;
+	int i, ret, set;
+
+	/* Attach the timer function to the BPF area context. */
+	scx_arena_subprog_init();
+
+	/*
+	 * Get the current time to calculate when to re-arm the timer.
+	 */
+	now = scx_bpf_now();
+
+	/*
+	 * Let's start running the top half.
+	 *
+	 * The bottom half may still be running (BOTTOM_HALF_RUNNING) when the
+	 * new timer expires. In such a case, it is appropriate to proceed to
+	 * refill the time budget. Hence, we allow the transition from
+	 * {BOTTOM_HALF_RUNNING, IDLE} to TOP_HALF_RUNNING.
+	 */
+	if (!cbw_transit_replenish_stat(CBW_REPLENISH_STAT_IDLE,
+					CBW_REPLENISH_STAT_TOP_HALF_RUNNING) &&
+	    !cbw_transit_replenish_stat(CBW_REPLENISH_STAT_BOTTOM_HALF_RUNNING,
+					CBW_REPLENISH_STAT_TOP_HALF_RUNNING)) {
+		cbw_err("Incorrect replenish state: %d -- %d => %d",
+			cbw_replenish_stat.s, CBW_REPLENISH_STAT_IDLE,
+			CBW_REPLENISH_STAT_TOP_HALF_RUNNING);
+		return 0;
+	}
+	cbw_dbg("at %llu", now);
+	start_ns = bpf_ktime_get_ns();
+
+	/*
+	 * Take a snapshot of the cgroup tables for this round. The bottom
+	 * half works on the same copy, even if the tables grow meanwhile.
+	 * The tables are allocated before the timer is armed.
+	 */
+	tables = READ_ONCE(cbw_tables);
+	cbw_replenish_tables = tables;
+
+	/*
+	 * Close the dirty cgroup table of this generation. From now on,
+	 * cgroups are marked dirty in the other table.
+	 *
+	 * Walk the whole cgroup tree if the table overflowed or if it is
+	 * time for a consistency pass. Otherwise, visit only the cgroups
+	 * that ran or were throttled during the period, plus their
+	 * ancestors.
+	 */
+	gen = READ_ONCE(cbw_replenish_gen);
+	set = gen & 1;
+	full = !cbw_last_full_replenish_gen ||
+	       READ_ONCE(cbw_dirty_overflow[set]) ||
+	       (gen - cbw_last_full_replenish_gen >= CBW_REPLENISH_FULL_INTERVAL);
+	WRITE_ONCE(cbw_replenish_gen, gen + 1);
+
+	if (full) {
+		nr_touched = cbw_collect_all_cgroups(tables);
+		cbw_last_full_replenish_gen = gen;
+		cbw_stats.nr_full_replenish++;
+	} else {
+		nr_touched = cbw_collect_dirty_cgroups(tables, gen);
+	}
+
+	/* The closed table is reused two generations later. */
+	WRITE_ONCE(cbw_nr_dirty_cgroups[set], 0);
+	WRITE_ONCE(cbw_dirty_overflow[set], false);
+
+	cbw_stats.nr_replenish++;
+	cbw_stats.nr_touched_last = nr_touched;
+	cbw_stats.nr_touched_total += nr_touched;
+
 	/*
 	 * Replenish all the taskable cgroups in a pre order.
 	 *
@@ -1845,17 +2712,13 @@ int replenish_timerfn(void *map, int *key, struct bpf_timer *timer)
 	 */
 	cbw_dbg("Start replenish %llu taskable cgroups.", cbw_nr_taskable_cgroups);
 	cbw_nr_throttled_cgroups = 0;
-	bpf_for(i, 0, cbw_nr_taskable_cgroups) {
-		ids = MEMBER_VPTR(cbw_taskable_cgroup_ids, [i]);
-		if (!ids) {
-			cbw_err("Failed to fetch a taskable cgroup table.");
-			continue;
-		}
+	bpf_for(i, 0, min(cbw_nr_taskable_cgroups, tables->cap)) {
+		cgid = tables->taskable[i];
 
 		/*
 		 * Fetch contexts of taskable cgroup and its subroot cgroup.
 		 */
-		cur_cgrp = bpf_cgroup_from_id(ids[0]);
+		cur_cgrp = bpf_cgroup_from_id(cgid);
 		if (!cur_cgrp) {
 			/*
 			 * This can happen when a new cgroup is destroyed
@@ -1863,13 +2726,13 @@ int replenish_timerfn(void *map, int *key, struct bpf_timer *timer)
 			 * when closing a new terminal session, etc. So we can
 			 * safely ignore the lookup failure.
 			 */
-			cbw_dbg("Failed to fetch a cgroup pointer: cgid%llu", ids[0]);
+			cbw_dbg("Failed to fetch a cgroup pointer: cgid%llu", cgid);
 			continue;
 		}
 
 		cur_cgx = cbw_get_cgroup_ctx(cur_cgrp);
 		if (!cur_cgx) {
-			cbw_err("Failed to lookup a cgroup ctx: cgid%llu", ids[0]);
+			cbw_err("Failed to lookup a cgroup ctx: cgid%llu", cgid);
 			bpf_cgroup_release(cur_cgrp);
 			continue;
 		}
@@ -1900,18 +2763,32 @@ int replenish_timerfn(void *map, int *key, struct bpf_timer *timer)
 		 * Replenish a taskable cgroup. If it was throttled,
 		 * add it to the throttled cgroup table.
 		 */
-		if (cbw_replenish_taskable_cgroup(subroot_cgx, cur_cgx, now)) {
-			ids = MEMBER_VPTR(cbw_throttled_cgroup_ids,
-					  [cbw_nr_throttled_cgroups]);
-			if (!ids) {
+		throttled = cbw_replenish_taskable_cgroup(subroot_cgx, cur_cgx, now);
+
+		/*
+		 * A cgroup that ran during the period is replenished with its
+		 * debt or burst taken into account, so it only settles at the
+		 * next replenishment. Keep it, and a cgroup with backlogged
+		 * tasks, in the dirty cgroup table for one more period.
+		 */
+		if (throttled || READ_ONCE(cur_cgx->runtime_total_last))
+			cbw_mark_dirty(cur_cgx);
+
+		if (throttled) {
+			if (cbw_nr_throttled_cgroups >= tables->cap) {
 				cbw_err("Failed to fetch a throttled cgroup table.");
 				continue;
 			}
-			WRITE_ONCE(ids[0], cur_cgx->id);
+			WRITE_ONCE(tables->throttled[cbw_nr_throttled_cgroups],
+				   cur_cgx->id);
 			cbw_nr_throttled_cgroups++;
 		}
 	}
 
+	ns = bpf_ktime_get_ns() - start_ns;
+	cbw_stats.replenish_ns_last = ns;
+	cbw_stats.replenish_ns_max = max(cbw_stats.replenish_ns_max, ns);
+
 	/*
 	 * If there are thtottled cgroups, transit from a top-half running
 	 * to a bottom-half ready. After this, the bottom half can start.
@@ -1941,12 +2818,30 @@ int replenish_timerfn(void *map, int *key, struct bpf_timer *timer)
 		if (idle_cpu >= 0)
 			scx_bpf_kick_cpu(idle_cpu, SCX_KICK_IDLE);
 		scx_bpf_put_cpumask(online_mask);
+
+		/*
+		 * Also poke a CPU of each LLC with backlogged tasks, so the
+		 * LLCs that own the backlog reenqueue it themselves. This is
+		 * a no-op if the CPU is busy, in which case it will dispatch
+		 * soon anyway.
+		 */
+		bpf_for(i, 0, TOPO_NR(LLC)) {
+			if (!READ_ONCE(cbw_llc_reenqs[i].backlogged))
+				continue;
+
+			llc_topo = (topo_ptr)topo_nodes[TOPO_LLC][i];
+			if (!llc_topo)
+				continue;
+
+			idle_cpu = scx_bitmap_any_distribute(llc_topo->mask);
+			if (idle_cpu >= 0 && idle_cpu < nr_cpu_ids)
+				scx_bpf_kick_cpu(idle_cpu, SCX_KICK_IDLE);
+		}
 	}
 	/*
 	 * If there is no thtottled cgroup, let's return to the idle state.
 	 */
 	else {
-idle_out:
 		if (!cbw_transit_replenish_stat(
 				CBW_REPLENISH_STAT_TOP_HALF_RUNNING,
 				CBW_REPLENISH_STAT_IDLE)) {
@@ -1968,17 +2863,34 @@ idle_out:
 	return 0;
 }
 
+static
+void cbw_account_reenq_lat(scx_task_common *taskc, u64 now)
+{
+	u64 lat_us;
+	u32 b;
+
+	lat_us = time_delta(now, taskc->throttled_at) / 1000;
+	b = log2_u64(lat_us) - 1;
+	if (b >= SCX_CGROUP_BW_LAT_BUCKETS)
+		b = SCX_CGROUP_BW_LAT_BUCKETS - 1;
+
+	__sync_fetch_and_add(&cbw_stats.reenq_lat_hist[b], 1);
+	__sync_fetch_and_add(&cbw_stats.nr_reenq, 1);
+}
+
 static
 int cbw_drain_btq_until_throttled(struct scx_cgroup_ctx *cgx,
-				  struct scx_cgroup_llc_ctx *llcx)
+				  struct scx_cgroup_llc_ctx __arena *llcx,
+				  u32 nr)
 {
 	scx_task_common *taskc;
+	u64 now = scx_bpf_now();
 	int i;
 
 	/*
 	 * Pop the tasks in the BTQ and ask the BPF scheduler to enqueue
-	 * them to a DSQ for execution until the BTQ becomes empty or
-	 * the cgroup is throttled.
+	 * them to a DSQ for execution until @nr tasks are reenqueued, the
+	 * BTQ becomes empty, or the cgroup is throttled.
 	 *
 	 * The .pop() operation is concurrency-safe because all ATQ operations
 	 * serialize on its lock. The task we retrieve with it is guaranteed
@@ -1986,7 +2898,7 @@ int cbw_drain_btq_until_throttled(struct scx_cgroup_ctx *cgx,
 	 * the main problem is that because a .dequeue() callback can happen
 	 * at any point.
 	 */
-	for (i = 0; i < CBW_REENQ_MAX_BATCH &&
+	for (i = 0; i < nr &&
 		    !READ_ONCE(cgx->is_throttled) &&
 		    (taskc = (scx_task_common *)scx_atq_pop(llcx->btq)) &&
 		    can_loop; i++) {
@@ -1995,6 +2907,7 @@ int cbw_drain_btq_until_throttled(struct scx_cgroup_ctx *cgx,
 		 * because even if we do, the callback's insert_vtime call will
 		 * fail silently in the scx core. 
 		 */
+		cbw_account_reenq_lat(taskc, now);
 
 		scx_cgroup_bw_enqueue_cb((u64)taskc);
 		cbw_dbg("cgid%llu", cgx->id);
@@ -2003,52 +2916,133 @@ int cbw_drain_btq_until_throttled(struct scx_cgroup_ctx *cgx,
 	return i;
 }
 
+/*
+ * Decide how many backlogged tasks of @llcx to reenqueue, at most @limit.
+ * Reenqueue as many tasks as the LLC's budget can run, going by the average
+ * runtime of the cgroup's tasks on the LLC, but at least one so that the
+ * backlog always makes progress.
+ */
+static
+u32 cbw_reenq_batch(struct scx_cgroup_llc_ctx __arena *llcx, u32 limit)
+{
+	s64 budget, run;
+	u64 nr_queued, nr;
+
+	nr_queued = scx_atq_nr_queued(llcx->btq);
+	budget = READ_ONCE(llcx->budget_remaining);
+
+	if (budget == CBW_RUNTUME_INF) {
+		nr = nr_queued;
+	} else {
+		run = max(READ_ONCE(llcx->run_avg), CBW_REENQ_RUN_MIN);
+		nr = (budget > run) ? (u64)budget / (u64)run : 1;
+	}
+
+	return min(min(nr, nr_queued), limit);
+}
+
 static
 int cbw_reenqueue_cgroup(struct cgroup *cgrp, struct scx_cgroup_ctx *cgx,
-			 u64 cgrp_id, u64 nuance)
+			 int llc_id, u32 limit)
 {
-	struct scx_cgroup_llc_ctx *llcx;
-	int i, idx, nr_enq = 0;
+	struct scx_cgroup_llc_ctx __arena *llcx;
+
+	/* Only LLCs the cgroup has run on can have backlogged tasks. */
+	llcx = cbw_get_llc_ctx(cgx, llc_id);
+	if (!llcx || !scx_atq_nr_queued(llcx->btq))
+		return 0;
+	cbw_dbg("cgid%llu -- llc_id: %d", cgx->id, llc_id);
 
 	/*
-	 * Drain BTQ of each LLC level until the BTQ becomes empty or
-	 * the cgroup is throttled.
-	 *
-	 * Note that we start with a random LLC to give each LLC a fair
-	 * chance to be reenqueued.
+	 * Update cgx->is_throttled and secure budget for the LLC before
+	 * draining BTQ. When the cgroup is already throttled, bail out early.
 	 */
-	if (!cgx->has_llcx)
-		return false;
-	cbw_dbg("cgid%llu", cgrp_id);
+	if (cbw_cgroup_bw_throttled(cgrp, llc_id) == -EAGAIN) {
+		cbw_dbg("Give up on re-enqueueing tasks since cgroup "
+			"is already throttled: cgid%llu", cgx->id);
+		return 0;
+	}
 
-	bpf_for(i, 0, TOPO_NR(LLC)) {
-		idx = (nuance + i) % TOPO_NR(LLC);
-		llcx = cbw_get_llc_ctx_with_id(cgrp_id, idx);
-		if (!llcx) {
-			cbw_err("Failed to lookup an LLC context: cgid%llu", cgrp_id);
+	return cbw_drain_btq_until_throttled(cgx, llcx,
+					     cbw_reenq_batch(llcx, limit));
+}
+
+/*
+ * Reenqueue backlogged tasks of the throttled cgroups on LLC @llc_id, at
+ * most @limit of them. Return the number of tasks reenqueued.
+ */
+static
+u32 cbw_reenqueue_llc(struct cbw_cgroup_tables __arena *tables, int llc_id,
+		      u32 limit)
+{
+	struct scx_cgroup_llc_ctx __arena *llcx;
+	struct scx_cgroup_ctx *cur_cgx;
+	struct cgroup *cur_cgrp;
+	u64 nuance, nr_tcgs, cur_cgrp_id;
+	u64 __arena *ids;
+	u32 nr_enq = 0;
+	int i, idx;
+
+	/*
+	 * Note that we start from a randomly chosen cgroup to give a fair
+	 * chance to reenqueue throttled tasks, especially when extremely
+	 * throttled.
+	 */
+	nuance = bpf_get_prandom_u32();
+	nr_tcgs = min(READ_ONCE(cbw_nr_throttled_cgroups), tables->cap);
+	bpf_for(i, 0, nr_tcgs) {
+		if (nr_enq >= limit)
+			break;
+
+		idx = (nuance + i) % nr_tcgs;
+		ids = &tables->throttled[idx];
+
+		/*
+		 * If the cgroup at this spot was purged (cgid == 0),
+		 * there are no backlogged tasks on that cgroup. So skip it.
+		 */
+		cur_cgrp_id = READ_ONCE(ids[0]);
+		if (cur_cgrp_id == 0)
+			continue;
+
+		cur_cgrp = bpf_cgroup_from_id(cur_cgrp_id);
+		if (!cur_cgrp) {
+			cbw_err("Failed to fetch a cgroup pointer: %llu", cur_cgrp_id);
 			continue;
 		}
 
+		cur_cgx = cbw_get_cgroup_ctx(cur_cgrp);
+		if (!cur_cgx) {
+			cbw_err("Failed to lookup a cgroup ctx");
+			bpf_cgroup_release(cur_cgrp);
+			continue;
+		}
+
+		/* Reqneueue backlogged tasks. */
+		nr_enq += cbw_reenqueue_cgroup(cur_cgrp, cur_cgx, llc_id,
+					       limit - nr_enq);
+
 		/*
-		 * Update cgx->is_throttled before draining BTQ.
-		 * When the cgroup is already throttled, bail out early.
+		 * Once the cgroup has no backlogged tasks on any LLC, purge
+		 * it from the throttled cgroup table.
+		 *
+		 * The CAS might fail if the replenish timer is running and
+		 * updating the throttled cgroup table. Even if it happens,
+		 * we don't care since it does not break the correctness.
 		 */
-		if (cbw_cgroup_bw_throttled(cgrp, idx) == -EAGAIN) {
-			cbw_dbg("Give up on re-enqueueing tasks since cgroup "
-				"is already throttled: cgid%llu", cgrp_id);
-			break;
-		}
+		llcx = cbw_get_llc_ctx(cur_cgx, llc_id);
+		if ((!llcx || !scx_atq_nr_queued(llcx->btq)) &&
+		    !cbw_has_backlogged_tasks(cur_cgx))
+			__sync_bool_compare_and_swap(ids, cur_cgrp_id, 0);
 
-		nr_enq += cbw_drain_btq_until_throttled(cgx, llcx);
-		if (nr_enq >= CBW_REENQ_MAX_BATCH)
-			break;
+		bpf_cgroup_release(cur_cgrp);
 	}
 
 	return nr_enq;
 }
 
 static
-bool cbw_try_lock(u64 *lock)
+bool cbw_try_lock(u64 __arena *lock)
 {
 	if (READ_ONCE(*lock) == 1)
 		return false;
@@ -2056,11 +3050,49 @@ bool cbw_try_lock(u64 *lock)
 }
 
 static
-void cbw_unlock(u64 *lock)
+void cbw_unlock(u64 __arena *lock)
 {
 	WRITE_ONCE(*lock, 0);
 }
 
+/*
+ * The number of tasks one scx_cgroup_bw_reenqueue() call may reenqueue. Each
+ * reenqueued task takes a dispatch slot, so stay within the free slots to
+ * avoid the "dispatch buffer overflow" error.
+ */
+static
+u32 cbw_reenq_limit(void)
+{
+	u32 slots, limit;
+
+	slots = scx_bpf_dispatch_nr_slots();
+	if (slots <= CBW_REENQ_SLOTS_RESERVED)
+		return 0;
+	slots -= CBW_REENQ_SLOTS_RESERVED;
+
+	limit = cbw_config.reenq_max_batch ? : CBW_REENQ_MAX_BATCH;
+	return min(slots, limit);
+}
+
+/*
+ * Reenqueue at most @limit tasks handed over to the orphan BTQ by
+ * cbw_free_llc_ctx().
+ */
+static
+void cbw_reenqueue_orphans(u32 limit)
+{
+	scx_task_common *taskc;
+	u64 now = scx_bpf_now();
+	u32 i;
+
+	for (i = 0; i < limit &&
+		    (taskc = (scx_task_common *)scx_atq_pop(cbw_orphan_btq)) &&
+		    can_loop; i++) {
+		cbw_account_reenq_lat(taskc, now);
+		scx_cgroup_bw_enqueue_cb((u64)taskc);
+	}
+}
+
 /*
  * scx_cgroup_bw_reenqueue - Reenqueue backlogged tasks.
  *
@@ -2075,13 +3107,17 @@ void cbw_unlock(u64 *lock)
 __hidden
 int scx_cgroup_bw_reenqueue(void)
 {
-	static u64 reenq_lock = 0;
+	struct cbw_cgroup_tables __arena *tables;
+	struct cbw_llc_reenq __arena *reenq;
+	int i, home, llc_id;
+	u32 limit, n;
 
-	struct scx_cgroup_ctx *cur_cgx;
-	struct cgroup *cur_cgrp;
-	int i, idx, n, nr_enq = 0;
-	u64 nuance, nuance2, nr_tcgs;
-	u64 *ids, cur_cgrp_id;
+	/*
+	 * Tasks of cgroups that could no longer have tasks are not throttled
+	 * anymore, so reenqueue them regardless of the replenish state.
+	 */
+	if (cbw_orphan_btq && scx_atq_nr_queued(cbw_orphan_btq))
+		cbw_reenqueue_orphans(cbw_reenq_limit());
 
 	/*
 	 * If it is in the BOTTOM_HALF_RUNNING state, the started bottom half
@@ -2098,101 +3134,62 @@ int scx_cgroup_bw_reenqueue(void)
 		return 0;
 	}
 
+	if ((home = cbw_get_current_llc_id()) < 0) {
+		cbw_err("Invalid LLC id: %d", home);
+		return 0;
+	}
+
+	limit = cbw_reenq_limit();
+	if (!limit)
+		return 0;
+
 	/*
-	 * If another task is already performing the reenqueue operation,
-	 * don't start another concurrent reenqueue operation.
+	 * Reqneueue backlogged tasks of the throttled cgroups on the CPU's
+	 * own LLC. Only when there is nothing left there, help another LLC
+	 * with its backlog.
 	 *
+	 * If another CPU of the LLC is already performing the reenqueue
+	 * operation, don't start another concurrent reenqueue operation.
 	 * That is because the concurrent reenqueue operation has more harm
 	 * than good, especially on a beefy machine, slowing down its caller,
 	 * ops.dispatch().
-	 */
-	if (!cbw_try_lock(&reenq_lock))
-		return 0;
-
-	/*
-	 * Reqneueue backlogged tasks of the throttled cgroups.
-	 *
-	 * Note that we start from a randomly chosen cgroup to give a fair
-	 * chance to reenqueue throttled tasks, especially when extremely
-	 * throttled.
 	 *
 	 * Note that we intentionally ignore the error to reenqueue all the
 	 * tasks, ensuring it always returns 0.
 	 */
 	cbw_dbg();
-	nuance = bpf_get_prandom_u32();
-	nr_tcgs = READ_ONCE(cbw_nr_throttled_cgroups);
-	bpf_for(i, 0, nr_tcgs) {
-		nuance2 = nuance + i;
-		idx = nuance2 % nr_tcgs;
-		ids = MEMBER_VPTR(cbw_throttled_cgroup_ids, [idx]);
-		if (!ids) {
-			cbw_err("Failed to fetch a throttled cgroup table.");
-			continue;
-		}
-
-		/*
-		 * If the cgroup at this spot was purged (cgid == 0),
-		 * there are no backlogged tasks on that cgroup. So skip it.
-		 */
-		cur_cgrp_id = READ_ONCE(ids[0]);
-		if (cur_cgrp_id == 0)
-			continue;
-
-		cur_cgrp = bpf_cgroup_from_id(cur_cgrp_id);
-		if (!cur_cgrp) {
-			cbw_err("Failed to fetch a cgroup pointer: %llu", ids[0]);
+	tables = READ_ONCE(cbw_replenish_tables);
+	bpf_for(i, 0, TOPO_NR(LLC)) {
+		llc_id = (home + i) % TOPO_NR(LLC);
+		reenq = &cbw_llc_reenqs[llc_id];
+		if (!READ_ONCE(reenq->backlogged))
 			continue;
-		}
 
-		cur_cgx = cbw_get_cgroup_ctx(cur_cgrp);
-		if (!cur_cgx) {
-			cbw_err("Failed to lookup a cgroup ctx");
-			bpf_cgroup_release(cur_cgrp);
+		if (!cbw_try_lock(&reenq->lock)) {
+			if (llc_id == home)
+				break;
 			continue;
 		}
 
-		/* Reqneueue backlogged tasks. */
-		n = cbw_reenqueue_cgroup(cur_cgrp, cur_cgx, cur_cgrp_id, nuance2);
-		bpf_cgroup_release(cur_cgrp);
+		n = cbw_reenqueue_llc(tables, llc_id, limit);
 
 		/*
-		 * The reenqueue operation finished before hitting the upper
-		 * bound (CBW_REENQ_MAX_BATCH). That means there are no more
-		 * backlogged tasks under the cgroup. So, let's purge the task
-		 * from the throttled cgroup table.
+		 * The pass over the throttled cgroups finished before hitting
+		 * the limit, so the LLC has nothing left to reenqueue until
+		 * the next replenishment.
 		 */
-		if (n < CBW_REENQ_MAX_BATCH) {
-			/*
-			 * The CAS might fail if the replenish timer is running
-			 * and updating the throttled cgroup table.
-			 * Even if it happens, we don't care since it does not
-			 * break the correctness.
-			 */
-			__sync_bool_compare_and_swap(ids, cur_cgrp_id, 0);
-		}
+		if (n < limit)
+			cbw_clear_llc_backlogged(llc_id);
 
-		/*
-		 * When hitting the upper bound, stop here to avoid the
-		 * "dispatch buffer overflow" error.
-		 */
-		nr_enq += n;
-		if (nr_enq >= CBW_REENQ_MAX_BATCH)
-			break;
+		cbw_unlock(&reenq->lock);
+		break;
 	}
 
 	/*
-	 * Unlock the reenqueue lock so that others can start
-	 * the reqneueue operation.
+	 * If no LLC has backlogged tasks left, transit from a bottom-half
+	 * running to an idle state. After this, the top half can start.
 	 */
-	cbw_unlock(&reenq_lock);
-
-	/*
-	 * If we didn't reach the max reenqueue batch, transit from a
-	 * bottom-half running to an idle state. After this,
-	 * the top half can start.
-	 */
-	if (nr_enq < CBW_REENQ_MAX_BATCH) {
+	if (!READ_ONCE(cbw_nr_backlogged_llcs)) {
 		cbw_transit_replenish_stat(
 			CBW_REPLENISH_STAT_BOTTOM_HALF_RUNNING,
 			CBW_REPLENISH_STAT_IDLE);
@@ -2241,3 +3238,69 @@ int scx_cgroup_bw_is_task_throttled(u64 taskc)
 	return ctx && (ctx->atq != NULL);
 }
 
+/**
+ * scx_cgroup_bw_get_stats - Get the replenishment statistics.
+ * @stats: where to copy the statistics, see the struct definition.
+ *
+ * Return 0 for success, -errno for failure.
+ */
+__hidden
+int scx_cgroup_bw_get_stats(struct scx_cgroup_bw_stats *stats)
+{
+	if (!stats)
+		return -EINVAL;
+
+	*stats = cbw_stats;
+	stats->nr_cgroups = READ_ONCE(cbw_nr_cgroups);
+	return 0;
+}
+
+/**
+ * scx_cgroup_bw_get_xfer_stats - Get the budget transfer counts of a cgroup.
+ * @cgrp_id: cgroup id
+ * @stats: where to copy the counts, see the struct definition.
+ *
+ * Return 0 for success, -errno for failure.
+ */
+__hidden
+int scx_cgroup_bw_get_xfer_stats(u64 cgrp_id, struct scx_cgroup_bw_xfer_stats *stats)
+{
+	struct scx_cgroup_ctx *cgx;
+	struct cgroup *cgrp;
+
+	if (!stats)
+		return -EINVAL;
+
+	cgrp = bpf_cgroup_from_id(cgrp_id);
+	if (!cgrp)
+		return -ENOENT;
+
+	cgx = cbw_get_cgroup_ctx(cgrp);
+	bpf_cgroup_release(cgrp);
+	if (!cgx)
+		return -ENOENT;
+
+	*stats = cgx->xfer;
+	return 0;
+}
+
+/**
+ * scx_cgroup_bw_refill - BPF program to top up the LLC context reserve and
+ * free the retired cgroup tables from userspace. A scheduler using the
+ * library should run it periodically, e.g., from its monitoring loop.
+ */
+SEC("syscall")
+int scx_cgroup_bw_refill(void *ctx)
+{
+	int ret;
+
+	if (!READ_ONCE(cbw_lib_ready))
+		return 0;
+
+	scx_arena_subprog_init();
+
+	ret = cbw_refill_llcx_reserve();
+	cbw_free_retired_tables();
+
+	return ret;
+}
@@ -16,7 +16,7 @@ scx_bitmap_pick_any_cpu_once(scx_bitmap_t __arg_arena mask, u64 __arg_arena *sta
 	u64 ind, i;
 	s32 cpu;
 
-	if (unlikely(mask_size < SCXMASK_NLONG))
+	if (unlikely(mask_size > SCXMASK_NLONG))
 		return -EINVAL;
 
 	bpf_for (i, 0, SCXMASK_NLONG) {
@@ -147,36 +147,132 @@ int scx_bitmap_and_cpumask(scx_bitmap_t dst __arg_arena,
 	return 0;
 }
 
+/*
+ * Arena copy of the idle CPU mask. Schedulers opt in by calling
+ * scx_bitmap_idle_init() and forwarding ops.update_idle to
+ * scx_bitmap_idle_update(), after which scx_bitmap_pick_idle_cpu() claims
+ * CPUs with a few word operations instead of copying the mask into a
+ * bpf_cpumask and back. Schedulers that implement ops.update_idle and still
+ * use the kernel's idle tracking elsewhere need SCX_OPS_KEEP_BUILTIN_IDLE,
+ * and pass @builtin_idle so that claims also clear the kernel's idle state.
+ */
+scx_bitmap_t scx_idle_cpumask;
+static bool scx_idle_builtin;
+
 __weak
-s32 scx_bitmap_pick_idle_cpu(scx_bitmap_t mask __arg_arena, int flags)
+int scx_bitmap_idle_init(bool builtin_idle)
+{
+	const struct cpumask *idle;
+	scx_bitmap_t mask;
+	u32 cpu;
+
+	if (scx_idle_cpumask)
+		return 0;
+
+	mask = scx_bitmap_alloc();
+	if (!mask)
+		return -ENOMEM;
+
+	if (builtin_idle) {
+		idle = scx_bpf_get_idle_cpumask();
+		scx_bitmap_from_bpf(mask, idle);
+		scx_bpf_put_idle_cpumask(idle);
+	} else {
+		/*
+		 * Without the kernel's idle tracking we only hear about CPUs
+		 * when they change state, so start out with every CPU marked
+		 * idle. A busy CPU that gets claimed is just kicked for
+		 * nothing and drops out of the mask until it next goes idle.
+		 */
+		bpf_for(cpu, 0, nr_cpu_ids)
+			scx_bitmap_set_cpu(cpu, mask);
+	}
+
+	scx_idle_builtin = builtin_idle;
+	scx_idle_cpumask = mask;
+
+	return 0;
+}
+
+__weak
+int scx_bitmap_idle_update(s32 cpu, bool idle)
+{
+	scx_bitmap_t mask = scx_idle_cpumask;
+
+	if (unlikely(!mask || cpu < 0 || cpu >= nr_cpu_ids))
+		return -EINVAL;
+
+	if (idle)
+		return scx_bitmap_vacate_cpu(mask, cpu);
+
+	scx_bitmap_test_and_clear_cpu(cpu, mask);
+
+	return 0;
+}
+
+static __always_inline
+s32 scx_bitmap_pick_idle_cpu_bpf(scx_bitmap_t mask __arg_arena, int flags)
 {
 	struct bpf_cpumask __kptr *bpf = scx_percpu_bpfmask();
-	s32 cpu;
 
 	if (!bpf)
 		return -1;
 
 	scx_bitmap_to_bpf(bpf, mask);
-	cpu = scx_bpf_pick_idle_cpu(cast_mask(bpf), flags);
 
-	scx_bitmap_from_bpf(mask, cast_mask(bpf));
+	return scx_bpf_pick_idle_cpu(cast_mask(bpf), flags);
+}
 
-	return cpu;
+__weak
+s32 scx_bitmap_pick_idle_cpu(scx_bitmap_t mask __arg_arena, int flags)
+{
+	s32 cpu;
+
+	/* Whole idle cores are only tracked by the kernel. */
+	if (!scx_idle_cpumask || (flags & SCX_PICK_IDLE_CORE)) {
+		cpu = scx_bitmap_pick_idle_cpu_bpf(mask, flags);
+
+		/* Take the kernel's claim out of our mask as well. */
+		if (scx_idle_cpumask && cpu >= 0 && cpu < nr_cpu_ids)
+			scx_bitmap_test_and_clear_cpu(cpu, scx_idle_cpumask);
+
+		return cpu;
+	}
+
+	/*
+	 * Search from the current CPU, which spreads concurrent callers
+	 * over the mask and tends to pick CPUs close to the waker.
+	 *
+	 * With the kernel's idle tracking kept, the claim must also win the
+	 * kernel's idle bit. Losing it means the CPU was taken through
+	 * scx_bpf_test_and_clear_cpu_idle() or is no longer idle, and it is
+	 * already out of our mask, so just move on to the next one.
+	 */
+	bpf_repeat(SCX_IDLE_CLAIM_RETRIES) {
+		cpu = scx_bitmap_claim_and_from(scx_idle_cpumask, mask,
+						 bpf_get_smp_processor_id());
+		if (cpu < 0)
+			return -EBUSY;
+
+		if (!scx_idle_builtin || scx_bpf_test_and_clear_cpu_idle(cpu))
+			return cpu;
+	}
+
+	return -EBUSY;
 }
 
+/*
+ * Like bpf_cpumask_any_distribute(), returns nr_cpu_ids if the mask
+ * is empty.
+ */
 __weak
 s32 scx_bitmap_any_distribute(scx_bitmap_t mask __arg_arena)
 {
-	struct bpf_cpumask __kptr *bpf = scx_percpu_bpfmask();
 	s32 cpu;
 
-	if (!bpf)
-		return -1;
-
-	scx_bitmap_to_bpf(bpf, mask);
-	cpu = bpf_cpumask_any_distribute(cast_mask(bpf));
+	cpu = scx_bitmap_find_from(mask, bpf_get_prandom_u32() % nr_cpu_ids);
 
-	return cpu;
+	return cpu >= 0 ? cpu : nr_cpu_ids;
 }
 
 __weak
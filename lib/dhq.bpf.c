@@ -6,10 +6,12 @@
 /*
  * Double Helix Queue (DHQ) implementation.
  *
- * Inspired by DNA's double helix structure, this queue maintains two
- * parallel strands that can be accessed independently or in coordinated
- * fashion. Supports multiple dequeue strategies: alternating between
- * strands, priority-based selection, or balanced distribution.
+ * Inspired by DNA's double helix structure, this queue maintains parallel
+ * strands that can be accessed independently or in coordinated fashion.
+ * The classic helix has two strands, one per LLC of a pair, but a queue
+ * can have one strand for every LLC of a NUMA node. Supports multiple
+ * dequeue strategies: round-robin between strands, priority-based
+ * selection, or balanced distribution.
  *
  * Fixed-size implementation: Uses minheap with pre-allocated capacity
  * to avoid sleepable allocations in fast path (enqueue/dequeue). This
@@ -17,84 +19,131 @@
  */
 
 __weak
-u64 scx_dhq_create_internal(bool fifo, size_t capacity, u64 mode, u64 max_imbalance)
+u64 scx_dhq_create_internal(bool fifo, size_t capacity, u64 mode, u64 max_imbalance,
+			    u32 nr_strands)
 {
 	scx_dhq_t *dhq;
 	u64 heap_capacity;
+	u32 i;
+
+	if (nr_strands == 0 || nr_strands > SCX_DHQ_MAX_STRANDS)
+		return (u64)NULL;
 
 	dhq = scx_static_alloc(sizeof(*dhq), 1);
 	if (!dhq)
 		return (u64)NULL;
 
-	/* Split capacity evenly between the two strands */
-	heap_capacity = capacity / 2;
-
-	dhq->strand_a = scx_minheap_alloc(heap_capacity);
-	if (!dhq->strand_a)
-		return (u64)NULL;
+	/* Split capacity evenly between the strands */
+	heap_capacity = capacity / nr_strands;
 
-	dhq->strand_b = scx_minheap_alloc(heap_capacity);
-	if (!dhq->strand_b)
-		return (u64)NULL;
+	bpf_for(i, 0, nr_strands) {
+		dhq->strands[i] = scx_minheap_alloc_indexed(heap_capacity);
+		if (!dhq->strands[i])
+			return (u64)NULL;
+	}
 
 	dhq->fifo = fifo;
 	dhq->capacity = capacity;
 	dhq->mode = mode;
 	dhq->max_imbalance = max_imbalance;
-	dhq->last_strand = SCX_DHQ_STRAND_B;
+	dhq->nr_strands = nr_strands;
+	/* Round-robin starts at strand 0. */
+	dhq->last_strand = nr_strands - 1;
 
-	/* Note: BPF arena memory is zero-initialized, so size_a, size_b, seq_a, seq_b, dequeue_count_* are already 0 */
+	/* Note: BPF arena memory is zero-initialized, so nr_queued, seqs and dequeue_counts are already 0 */
 
 	return (u64)dhq;
 }
 
+static __always_inline
+u64 __scx_dhq_strand_size(scx_dhq_t *dhq, u32 strand)
+{
+	return dhq->strands[strand]->size;
+}
+
+/*
+ * Smallest strand other than @skip, or the smallest strand overall if @skip
+ * is out of range. Ties go to the lowest index.
+ */
 static inline
-int __scx_dhq_insert_strand(scx_dhq_t *dhq, u64 taskc_ptr, u64 strand, u64 key)
+u32 __scx_dhq_min_strand(scx_dhq_t *dhq, u32 skip)
+{
+	u64 size, min_size = (u64)-1;
+	u32 i, min = skip;
+
+	for (i = 0; i < dhq->nr_strands && i < SCX_DHQ_MAX_STRANDS && can_loop; i++) {
+		if (i == skip)
+			continue;
+
+		size = __scx_dhq_strand_size(dhq, i);
+		if (size < min_size) {
+			min_size = size;
+			min = i;
+		}
+	}
+
+	return min;
+}
+
+static inline
+int __scx_dhq_insert_strand(scx_dhq_t *dhq, u64 taskc_ptr, u64 strand, bool fifo, u64 vtime,
+			    scx_minheap_handle_t *handle)
 {
 	scx_minheap_t *heap;
-	u64 my_size, other_size;
+	u64 my_size, other_size, others, key;
 	int ret;
 
-	heap = (strand == SCX_DHQ_STRAND_A) ? dhq->strand_a : dhq->strand_b;
-
 	ret = arena_spin_lock(&dhq->lock);
 	if (ret)
 		return ret;
 
+	/* Auto-select the least full strand, under the lock so the sizes are stable. */
+	if (strand == SCX_DHQ_STRAND_AUTO)
+		strand = __scx_dhq_min_strand(dhq, SCX_DHQ_MAX_STRANDS);
+
+	if (unlikely(strand >= dhq->nr_strands || strand >= SCX_DHQ_MAX_STRANDS)) {
+		ret = -EINVAL;
+		goto error;
+	}
+
+	heap = dhq->strands[strand];
+
 	/* Check total capacity */
-	if (unlikely(dhq->size_a + dhq->size_b == dhq->capacity)) {
+	if (unlikely(dhq->nr_queued == dhq->capacity)) {
 		ret = -ENOSPC;
 		goto error;
 	}
 
 	/* Check strand intertwining constraint for enqueue:
-	 * Prevent one strand from having too many more items than the other.
-	 * This keeps the double helix "complete" - strands must stay paired.
+	 * Prevent one strand from having too many more items than the
+	 * mean of the other strands. This keeps the helix "complete" -
+	 * strands must stay paired. Comparing against the mean rather than
+	 * the least loaded strand keeps one idle strand from capping all
+	 * the others. With two strands, both are the same.
 	 */
-	if (dhq->max_imbalance > 0) {
-		if (strand == SCX_DHQ_STRAND_A) {
-			my_size = dhq->size_a;
-			other_size = dhq->size_b;
-		} else {
-			my_size = dhq->size_b;
-			other_size = dhq->size_a;
-		}
+	if (dhq->max_imbalance > 0 && dhq->nr_strands > 1) {
+		my_size = heap->size;
+		others = dhq->nr_strands - 1;
+		other_size = dhq->nr_queued - my_size;
 
 		/* If enqueueing to this strand would create too large a size imbalance, fail */
-		if (my_size >= other_size + dhq->max_imbalance) {
+		if (my_size * others >= other_size + dhq->max_imbalance * others) {
 			ret = -EAGAIN;  /* Try again later when strands are more balanced */
 			goto error;
 		}
 	}
 
-	ret = scx_minheap_insert(heap, taskc_ptr, key);
+	/* FIFO strands are ordered by their own sequence number. */
+	key = fifo ? dhq->seqs[strand]++ : vtime;
+
+	if (handle)
+		ret = scx_minheap_insert_indexed(heap, taskc_ptr, key, handle);
+	else
+		ret = scx_minheap_insert(heap, taskc_ptr, key);
 	if (ret)
 		goto error;
 
-	if (strand == SCX_DHQ_STRAND_A)
-		dhq->size_a += 1;
-	else
-		dhq->size_b += 1;
+	dhq->nr_queued += 1;
 
 	arena_spin_unlock(&dhq->lock);
 
@@ -109,48 +158,111 @@ error:
 __hidden
 int scx_dhq_insert(scx_dhq_t *dhq, u64 taskc_ptr, u64 strand)
 {
-	u64 key, selected_strand;
-
 	if (!dhq->fifo)
 		return -EINVAL;
 
-	/* Auto-select strand based on balance mode */
-	if (strand == SCX_DHQ_STRAND_AUTO) {
-		/* Choose less full strand */
-		selected_strand = (dhq->size_a <= dhq->size_b) ?
-				  SCX_DHQ_STRAND_A : SCX_DHQ_STRAND_B;
-	} else {
-		selected_strand = strand;
-	}
+	return __scx_dhq_insert_strand(dhq, taskc_ptr, strand, true, 0, NULL);
+}
+
+__hidden
+int scx_dhq_insert_vtime(scx_dhq_t *dhq, u64 taskc_ptr, u64 vtime, u64 strand)
+{
+	if (dhq->fifo)
+		return -EINVAL;
 
-	/* Get sequence number for selected strand */
-	if (selected_strand == SCX_DHQ_STRAND_A) {
-		key = dhq->seq_a++;
-	} else {
-		key = dhq->seq_b++;
+	return __scx_dhq_insert_strand(dhq, taskc_ptr, strand, false, vtime, NULL);
+}
+
+__hidden
+int scx_dhq_insert_indexed(scx_dhq_t *dhq, u64 taskc_ptr, u64 strand,
+			   scx_minheap_handle_t *handle __arg_arena)
+{
+	if (!handle || !dhq->fifo)
+		return -EINVAL;
+
+	return __scx_dhq_insert_strand(dhq, taskc_ptr, strand, true, 0, handle);
+}
+
+__hidden
+int scx_dhq_insert_vtime_indexed(scx_dhq_t *dhq, u64 taskc_ptr, u64 vtime, u64 strand,
+				 scx_minheap_handle_t *handle __arg_arena)
+{
+	if (!handle || dhq->fifo)
+		return -EINVAL;
+
+	return __scx_dhq_insert_strand(dhq, taskc_ptr, strand, false, vtime, handle);
+}
+
+/* Strand whose heap holds @handle, or -ENOENT. Called with the lock held. */
+static inline
+s32 __scx_dhq_handle_strand(scx_dhq_t *dhq, scx_minheap_handle_t *handle)
+{
+	u32 i;
+
+	for (i = 0; i < dhq->nr_strands && i < SCX_DHQ_MAX_STRANDS && can_loop; i++) {
+		if (handle->heap == (u64)dhq->strands[i])
+			return i;
 	}
 
-	return __scx_dhq_insert_strand(dhq, taskc_ptr, selected_strand, key);
+	return -ENOENT;
 }
 
 __hidden
-int scx_dhq_insert_vtime(scx_dhq_t *dhq, u64 taskc_ptr, u64 vtime, u64 strand)
+int scx_dhq_cancel(scx_dhq_t *dhq, scx_minheap_handle_t *handle __arg_arena)
 {
-	u64 selected_strand;
+	s32 strand;
+	int ret;
 
-	if (dhq->fifo)
+	if (!handle)
 		return -EINVAL;
 
-	/* Auto-select strand based on balance mode */
-	if (strand == SCX_DHQ_STRAND_AUTO) {
-		/* Choose less full strand */
-		selected_strand = (dhq->size_a <= dhq->size_b) ?
-				  SCX_DHQ_STRAND_A : SCX_DHQ_STRAND_B;
-	} else {
-		selected_strand = strand;
+	/* Unlocked fast path, only pops and cancels clear the handle. */
+	if (!scx_minheap_handle_queued(handle))
+		return -ENOENT;
+
+	ret = arena_spin_lock(&dhq->lock);
+	if (ret)
+		return ret;
+
+	/* Recheck under the lock, the task may have been popped meanwhile. */
+	strand = __scx_dhq_handle_strand(dhq, handle);
+	if (strand < 0) {
+		ret = strand;
+		goto out;
 	}
 
-	return __scx_dhq_insert_strand(dhq, taskc_ptr, selected_strand, vtime);
+	ret = scx_minheap_remove(dhq->strands[strand], handle);
+	if (!ret)
+		dhq->nr_queued -= 1;
+
+out:
+	arena_spin_unlock(&dhq->lock);
+
+	return ret;
+}
+
+__hidden
+int scx_dhq_update_vtime(scx_dhq_t *dhq, scx_minheap_handle_t *handle __arg_arena, u64 vtime)
+{
+	s32 strand;
+	int ret;
+
+	if (!handle || dhq->fifo)
+		return -EINVAL;
+
+	ret = arena_spin_lock(&dhq->lock);
+	if (ret)
+		return ret;
+
+	strand = __scx_dhq_handle_strand(dhq, handle);
+	if (strand < 0)
+		ret = strand;
+	else
+		ret = scx_minheap_update_weight(dhq->strands[strand], handle, vtime);
+
+	arena_spin_unlock(&dhq->lock);
+
+	return ret;
 }
 
 static inline
@@ -160,11 +272,13 @@ u64 __scx_dhq_pop_strand_nolock(scx_dhq_t *dhq, u64 strand)
 	struct scx_minheap_elem helem;
 	int ret;
 
-	heap = (strand == SCX_DHQ_STRAND_A) ? dhq->strand_a : dhq->strand_b;
+	if (strand >= dhq->nr_strands || strand >= SCX_DHQ_MAX_STRANDS)
+		return (u64)NULL;
+
+	heap = dhq->strands[strand];
 
 	/* Check if strand is empty */
-	if ((strand == SCX_DHQ_STRAND_A && dhq->size_a == 0) ||
-	    (strand == SCX_DHQ_STRAND_B && dhq->size_b == 0))
+	if (heap->size == 0)
 		return (u64)NULL;
 
 	/* NOTE: No dequeue_count imbalance constraint for cross-LLC migration.
@@ -174,18 +288,13 @@ u64 __scx_dhq_pop_strand_nolock(scx_dhq_t *dhq, u64 strand)
 	 */
 
 	ret = scx_minheap_pop(heap, &helem);
-	if (!ret) {
-		if (strand == SCX_DHQ_STRAND_A) {
-			dhq->size_a -= 1;
-			dhq->dequeue_count_a += 1;
-		} else {
-			dhq->size_b -= 1;
-			dhq->dequeue_count_b += 1;
-		}
-		return helem.elem;
-	}
+	if (ret)
+		return (u64)NULL;
 
-	return (u64)NULL;
+	dhq->nr_queued -= 1;
+	dhq->dequeue_counts[strand] += 1;
+
+	return helem.elem;
 }
 
 __hidden
@@ -205,114 +314,148 @@ u64 scx_dhq_pop_strand(scx_dhq_t *dhq, u64 strand)
 	return taskc_ptr;
 }
 
+/*
+ * Pick the strand the next dequeue comes from according to the queue mode.
+ * Every mode picks a non-empty strand, so callers only need to check for
+ * an empty queue. Returns -ENOENT if all strands are empty.
+ */
+static inline
+s32 __scx_dhq_select_strand_nolock(scx_dhq_t *dhq)
+{
+	u64 nr = dhq->nr_strands;
+	u64 best_key = 0, key;
+	s32 best = -ENOENT;
+	u32 i, strand;
+
+	if (dhq->nr_queued == 0)
+		return -ENOENT;
+
+	for (i = 0; i < nr && i < SCX_DHQ_MAX_STRANDS && can_loop; i++) {
+		switch (dhq->mode) {
+		case SCX_DHQ_MODE_ALTERNATING:
+			/*
+			 * Round-robin over the strands, starting after the
+			 * last one dequeued from and skipping empty ones.
+			 */
+			strand = (dhq->last_strand + 1 + i) % nr;
+			if (__scx_dhq_strand_size(dhq, strand))
+				return strand;
+			continue;
+
+		case SCX_DHQ_MODE_PRIORITY:
+			/* Lowest head vtime across all strands, ties to the lowest index. */
+			if (!__scx_dhq_strand_size(dhq, i))
+				continue;
+
+			key = dhq->strands[i]->helems[0].weight;
+			break;
+
+		case SCX_DHQ_MODE_BALANCED:
+			/*
+			 * Maintain balance: prefer the strand with the most
+			 * tasks. This keeps the strands roughly equal in size.
+			 */
+			if (!__scx_dhq_strand_size(dhq, i))
+				continue;
+
+			key = -__scx_dhq_strand_size(dhq, i);
+			break;
+
+		default:
+			return -EINVAL;
+		}
+
+		if (best < 0 || key < best_key) {
+			best = i;
+			best_key = key;
+		}
+	}
+
+	return best;
+}
+
+static inline
+u64 __scx_dhq_pop_nolock(scx_dhq_t *dhq)
+{
+	u64 taskc_ptr;
+	s32 strand;
+
+	strand = __scx_dhq_select_strand_nolock(dhq);
+	if (strand < 0)
+		return (u64)NULL;
+
+	taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, strand);
+	if (taskc_ptr)
+		dhq->last_strand = strand;
+
+	return taskc_ptr;
+}
+
 __hidden
 u64 scx_dhq_pop(scx_dhq_t *dhq)
 {
 	u64 taskc_ptr;
-	u64 vtime_a, vtime_b;
-	u64 strand;
 	int ret;
 
 	ret = arena_spin_lock(&dhq->lock);
 	if (ret)
 		return (u64)NULL;
 
-	/* If empty, return NULL */
-	if (scx_dhq_nr_queued(dhq) == 0) {
-		arena_spin_unlock(&dhq->lock);
-		return (u64)NULL;
+	taskc_ptr = __scx_dhq_pop_nolock(dhq);
+
+	arena_spin_unlock(&dhq->lock);
+
+	return taskc_ptr;
+}
+
+/*
+ * Batched pops take the lock once for up to @max tasks. Tasks come out in
+ * the same order as they would from repeated scx_dhq_pop() calls.
+ */
+__hidden
+int scx_dhq_pop_batch(scx_dhq_t *dhq, u64 __arena *out, u32 max)
+{
+	u64 taskc_ptr;
+	int ret, i;
+
+	ret = arena_spin_lock(&dhq->lock);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < max && can_loop; i++) {
+		taskc_ptr = __scx_dhq_pop_nolock(dhq);
+		if (!taskc_ptr)
+			break;
+
+		out[i] = taskc_ptr;
 	}
 
-	switch (dhq->mode) {
-	case SCX_DHQ_MODE_ALTERNATING:
-		/*
-		 * Alternate between strands. If selected strand is empty,
-		 * try the other strand.
-		 */
-		strand = (dhq->last_strand == SCX_DHQ_STRAND_A) ?
-			 SCX_DHQ_STRAND_B : SCX_DHQ_STRAND_A;
+	arena_spin_unlock(&dhq->lock);
 
-		taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, strand);
-		if (!taskc_ptr) {
-			/* Try other strand */
-			strand = (strand == SCX_DHQ_STRAND_A) ?
-				 SCX_DHQ_STRAND_B : SCX_DHQ_STRAND_A;
-			taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, strand);
-		}
+	return i;
+}
 
-		if (taskc_ptr)
-			dhq->last_strand = strand;
-		break;
-
-	case SCX_DHQ_MODE_PRIORITY:
-		/*
-		 * Select task with lowest vtime from either strand.
-		 * Peek at both strands and compare.
-		 * If the preferred strand is blocked (imbalance), try the other.
-		 */
-		if (dhq->strand_a->size > 0) {
-			vtime_a = dhq->strand_a->helems[0].weight;
-		} else {
-			vtime_a = (u64)-1; /* Max value if strand A empty */
-		}
+__hidden
+int scx_dhq_pop_strand_batch(scx_dhq_t *dhq, u64 strand, u64 __arena *out, u32 max)
+{
+	u64 taskc_ptr;
+	int ret, i;
 
-		if (dhq->strand_b->size > 0) {
-			vtime_b = dhq->strand_b->helems[0].weight;
-		} else {
-			vtime_b = (u64)-1; /* Max value if strand B empty */
-		}
+	ret = arena_spin_lock(&dhq->lock);
+	if (ret)
+		return ret;
 
-		if (vtime_a <= vtime_b) {
-			taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, SCX_DHQ_STRAND_A);
-			if (!taskc_ptr) {
-				/* Strand A blocked by imbalance or empty, try B */
-				taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, SCX_DHQ_STRAND_B);
-				if (taskc_ptr)
-					dhq->last_strand = SCX_DHQ_STRAND_B;
-			} else {
-				dhq->last_strand = SCX_DHQ_STRAND_A;
-			}
-		} else {
-			taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, SCX_DHQ_STRAND_B);
-			if (!taskc_ptr) {
-				/* Strand B blocked by imbalance or empty, try A */
-				taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, SCX_DHQ_STRAND_A);
-				if (taskc_ptr)
-					dhq->last_strand = SCX_DHQ_STRAND_A;
-			} else {
-				dhq->last_strand = SCX_DHQ_STRAND_B;
-			}
-		}
-		break;
-
-	case SCX_DHQ_MODE_BALANCED:
-		/*
-		 * Maintain balance: prefer strand with more tasks.
-		 * This helps keep the strands roughly equal in size.
-		 */
-		if (dhq->size_a >= dhq->size_b) {
-			taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, SCX_DHQ_STRAND_A);
-			if (!taskc_ptr)
-				taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, SCX_DHQ_STRAND_B);
-			else
-				dhq->last_strand = SCX_DHQ_STRAND_A;
-		} else {
-			taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, SCX_DHQ_STRAND_B);
-			if (!taskc_ptr)
-				taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, SCX_DHQ_STRAND_A);
-			else
-				dhq->last_strand = SCX_DHQ_STRAND_B;
-		}
-		break;
+	for (i = 0; i < max && can_loop; i++) {
+		taskc_ptr = __scx_dhq_pop_strand_nolock(dhq, strand);
+		if (!taskc_ptr)
+			break;
 
-	default:
-		taskc_ptr = (u64)NULL;
-		break;
+		out[i] = taskc_ptr;
 	}
 
 	arena_spin_unlock(&dhq->lock);
 
-	return taskc_ptr;
+	return i;
 }
 
 static inline
@@ -320,7 +463,10 @@ u64 __scx_dhq_peek_strand_nolock(scx_dhq_t *dhq, u64 strand)
 {
 	scx_minheap_t *heap;
 
-	heap = (strand == SCX_DHQ_STRAND_A) ? dhq->strand_a : dhq->strand_b;
+	if (strand >= dhq->nr_strands || strand >= SCX_DHQ_MAX_STRANDS)
+		return (u64)NULL;
+
+	heap = dhq->strands[strand];
 
 	if (heap->size == 0)
 		return (u64)NULL;
@@ -348,72 +494,18 @@ u64 scx_dhq_peek_strand(scx_dhq_t *dhq, u64 strand)
 __hidden
 u64 scx_dhq_peek(scx_dhq_t *dhq)
 {
-	u64 taskc_ptr;
-	u64 vtime_a, vtime_b;
-	u64 strand;
+	u64 taskc_ptr = (u64)NULL;
+	s32 strand;
 	int ret;
 
 	ret = arena_spin_lock(&dhq->lock);
 	if (ret)
 		return (u64)NULL;
 
-	if (scx_dhq_nr_queued(dhq) == 0) {
-		arena_spin_unlock(&dhq->lock);
-		return (u64)NULL;
-	}
-
-	switch (dhq->mode) {
-	case SCX_DHQ_MODE_ALTERNATING:
-		/* Peek at next strand in alternation */
-		strand = (dhq->last_strand == SCX_DHQ_STRAND_A) ?
-			 SCX_DHQ_STRAND_B : SCX_DHQ_STRAND_A;
-
+	/* Peek at the strand the next pop would take from. */
+	strand = __scx_dhq_select_strand_nolock(dhq);
+	if (strand >= 0)
 		taskc_ptr = __scx_dhq_peek_strand_nolock(dhq, strand);
-		if (!taskc_ptr) {
-			/* Try other strand */
-			strand = (strand == SCX_DHQ_STRAND_A) ?
-				 SCX_DHQ_STRAND_B : SCX_DHQ_STRAND_A;
-			taskc_ptr = __scx_dhq_peek_strand_nolock(dhq, strand);
-		}
-		break;
-
-	case SCX_DHQ_MODE_PRIORITY:
-		/* Peek at task with lowest vtime */
-		if (dhq->strand_a->size > 0) {
-			vtime_a = dhq->strand_a->helems[0].weight;
-		} else {
-			vtime_a = (u64)-1;
-		}
-
-		if (dhq->strand_b->size > 0) {
-			vtime_b = dhq->strand_b->helems[0].weight;
-		} else {
-			vtime_b = (u64)-1;
-		}
-
-		if (vtime_a <= vtime_b)
-			taskc_ptr = __scx_dhq_peek_strand_nolock(dhq, SCX_DHQ_STRAND_A);
-		else
-			taskc_ptr = __scx_dhq_peek_strand_nolock(dhq, SCX_DHQ_STRAND_B);
-		break;
-
-	case SCX_DHQ_MODE_BALANCED:
-		/* Peek at strand with more tasks */
-		if (dhq->size_a >= dhq->size_b) {
-			taskc_ptr = __scx_dhq_peek_strand_nolock(dhq, SCX_DHQ_STRAND_A);
-			if (!taskc_ptr)
-				taskc_ptr = __scx_dhq_peek_strand_nolock(dhq, SCX_DHQ_STRAND_B);
-		} else {
-			taskc_ptr = __scx_dhq_peek_strand_nolock(dhq, SCX_DHQ_STRAND_B);
-			if (!taskc_ptr)
-				taskc_ptr = __scx_dhq_peek_strand_nolock(dhq, SCX_DHQ_STRAND_A);
-		}
-		break;
-
-	default:
-		taskc_ptr = (u64)NULL;
-		break;
-	}
 
 	arena_spin_unlock(&dhq->lock);
 
@@ -423,11 +515,14 @@ u64 scx_dhq_peek(scx_dhq_t *dhq)
 __hidden
 int scx_dhq_nr_queued(scx_dhq_t *dhq)
 {
-	return dhq->size_a + dhq->size_b;
+	return dhq->nr_queued;
 }
 
 __hidden
 int scx_dhq_nr_queued_strand(scx_dhq_t *dhq, u64 strand)
 {
-	return (strand == SCX_DHQ_STRAND_A) ? dhq->size_a : dhq->size_b;
+	if (strand >= dhq->nr_strands || strand >= SCX_DHQ_MAX_STRANDS)
+		return 0;
+
+	return __scx_dhq_strand_size(dhq, strand);
 }
@@ -87,7 +87,9 @@ int lvq_push(lv_queue_t __arg_arena *lvq, u64 val)
 	}
 
 	lv_arr_put(lvq->cur, b, val);
-	lvq->bottom += 1;
+
+	/* Publish the value before making it visible to thieves. */
+	smp_store_release(&lvq->bottom, b + 1);
 
 	return 0;
 }
@@ -106,8 +108,14 @@ int lvq_pop(lv_queue_t __arg_arena *lvq, u64 *val)
 
 	arr = lvq->cur;
 
-	lvq->bottom -= 1;
-	b = lvq->bottom;
+	b = lvq->bottom - 1;
+	lvq->bottom = b;
+
+	/*
+	 * The bottom store must be visible before we read top, or we can
+	 * race with a thief for the last element without either noticing.
+	 */
+	smp_mb();
 
 	t = lvq->top;
 	sz = b - t;
@@ -123,8 +131,14 @@ int lvq_pop(lv_queue_t __arg_arena *lvq, u64 *val)
 		return 0;
 	}
 
-	if (cmpxchg(&lvq->top, t, t + 1) != t)
-		return -EAGAIN;
+	/*
+	 * Last element, race the thieves for it. Whatever the outcome the
+	 * queue is now empty, so reset bottom either way.
+	 */
+	if (cmpxchg(&lvq->top, t, t + 1) != t) {
+		lvq->bottom = t + 1;
+		return -ENOENT;
+	}
 
 	lvq->bottom = t + 1;
 
@@ -144,8 +158,9 @@ int lvq_steal(lv_queue_t __arg_arena *lvq, u64 *val)
 	if (unlikely(!lvq || !val))
 		return -EINVAL;
 
-	b = lvq->bottom;
-	t = lvq->top;
+	/* Read top before bottom, pairs with the barrier in lvq_pop(). */
+	t = smp_load_acquire(&lvq->top);
+	b = smp_load_acquire(&lvq->bottom);
 	arr = lvq->cur;
 
 	sz = b - t;
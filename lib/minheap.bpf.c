@@ -24,18 +24,74 @@ scx_minheap_swap_elems(struct scx_minheap_elem __arena *a __arg_arena,
         b->weight = tmp_weight;
 }
 
+/* Point the handle of the element in slot @ind back at the slot. */
+static __always_inline void
+scx_minheap_sync_handle(scx_minheap_t *heap, u64 ind)
+{
+	scx_minheap_handle_t *handle;
+
+	if (!heap->handles)
+		return;
+
+	handle = (scx_minheap_handle_t *)heap->handles[ind];
+	if (handle)
+		handle->ind = ind;
+}
+
+static __always_inline void
+scx_minheap_swap(scx_minheap_t *heap, u64 a, u64 b)
+{
+	u64 tmp;
+
+	scx_minheap_swap_elems(&heap->helems[a], &heap->helems[b]);
+
+	if (!heap->handles)
+		return;
+
+	tmp = heap->handles[a];
+	heap->handles[a] = heap->handles[b];
+	heap->handles[b] = tmp;
+
+	scx_minheap_sync_handle(heap, a);
+	scx_minheap_sync_handle(heap, b);
+}
+
 __weak
-u64 scx_minheap_alloc_internal(size_t capacity)
+u64 scx_minheap_alloc_internal(size_t capacity, u64 arity, u64 flags)
 {
 	size_t alloc_size = sizeof(scx_minheap_t);
+	struct scx_minheap_elem __arena *helems;
 	scx_minheap_t *heap;
+	u64 shift;
+
+	switch (arity) {
+	case 2:
+		shift = 1;
+		break;
+	case 4:
+		shift = 2;
+		break;
+	case 8:
+		shift = 3;
+		break;
+	default:
+		bpf_printk("invalid minheap arity %ld", arity);
+		return (u64)NULL;
+	}
 
 	heap = scx_static_alloc(alloc_size, 1);
 	if (!heap)
 		return (u64)NULL;
 
-	heap->helems = scx_static_alloc(capacity * sizeof(*heap->helems), 1);
-	if (!heap->helems) {
+	/*
+	 * The children of slot i are slots [d * i + 1, d * i + d]. Skip the
+	 * first d - 1 elements of a cache line aligned array, so that every
+	 * group of siblings starts on a d-element boundary and, for d = 4, a
+	 * whole group shares one cache line.
+	 */
+	helems = scx_static_alloc((capacity + arity - 1) * sizeof(*helems),
+				  SCX_MINHEAP_CACHELINE);
+	if (!helems) {
 		/* 
 		 * XXXETSAL: Once we move on from the static alloc,
 		 * properly free the initial allocation.
@@ -43,84 +99,178 @@ u64 scx_minheap_alloc_internal(size_t capacity)
 		return (u64)NULL;
 	}
 
+	heap->helems = &helems[arity - 1];
+
+	if (flags & SCX_MINHEAP_F_INDEXED) {
+		heap->handles = scx_static_alloc(capacity * sizeof(*heap->handles), 1);
+		if (!heap->handles)
+			return (u64)NULL;
+	}
+
 	heap->capacity = capacity;
+	heap->arity = arity;
+	heap->shift = shift;
 	heap->size = 0;
 
 	return (u64)heap;
 }
 
-__weak
-int scx_minheap_balance_top_down(void __arena *heap_ptr __arg_arena)
+static inline
+int scx_minheap_sift_down(scx_minheap_t *heap, u64 start)
 {
-	scx_minheap_t *heap = (scx_minheap_t *)heap_ptr;
-	int child, next;
-	int off, ind;
-
-	for (ind = 0; ind < heap->size && can_loop; ind = next) {
-
-		next = ind;
-		for (off = 1; off < 3 && can_loop; off++) {
-			/*
-			 * Correspondence between parent and children is:
-			 * y = 2x + 1, y = 2x + 2
-			 */
-			child = 2 * ind + off;
-
-			if (child >= heap->size)
-				continue;
+	u64 size = heap->size;
+	u64 shift = heap->shift;
+	u64 child, first, last;
+	u64 next, ind;
+	u64 minw, w;
+
+	for (ind = start; ind < size && can_loop; ind = next) {
+		/*
+		 * Correspondence between parent and children is:
+		 * y = d * x + 1, ..., y = d * x + d
+		 */
+		first = (ind << shift) + 1;
+		if (first >= size)
+			break;
 
-			if (heap->helems[next].weight <= heap->helems[child].weight)
-				continue;
+		last = first + heap->arity;
+		if (last > size)
+			last = size;
 
-			next = child;
+		/*
+		 * The siblings are adjacent, so scanning them is a linear
+		 * pass over one or two cache lines. Pick the minimum first
+		 * and compare against the parent once.
+		 */
+		next = first;
+		minw = heap->helems[first].weight;
+		for (child = first + 1; child < last && can_loop; child++) {
+			w = heap->helems[child].weight;
+			next = w < minw ? child : next;
+			minw = w < minw ? w : minw;
 		}
 
-		if (next == ind)
+		if (heap->helems[ind].weight <= minw)
 			break;
 
-		scx_minheap_swap_elems(&heap->helems[next], &heap->helems[ind]);
+		scx_minheap_swap(heap, next, ind);
 	}
 
 	return 0;
 }
 
 static inline
-int scx_minheap_balance_bottom_up(void __arena *heap_ptr __arg_arena)
+int scx_minheap_sift_up(scx_minheap_t *heap, u64 start)
 {
-	scx_minheap_t *heap = (scx_minheap_t *)heap_ptr;
-	int parent;
-	int ind;
+	u64 shift = heap->shift;
+	u64 parent;
+	u64 ind;
 
-	for (ind = heap->size - 1; ind > 0 && can_loop; ind = parent) {
-		parent = (ind - 1) >> 1;
+	for (ind = start; ind > 0 && can_loop; ind = parent) {
+		parent = (ind - 1) >> shift;
 
 		if (heap->helems[parent].weight <= heap->helems[ind].weight)
 			break;
 
-		scx_minheap_swap_elems(&heap->helems[parent], &heap->helems[ind]);
+		scx_minheap_swap(heap, parent, ind);
 	}
 
 	return 0;
 }
 
-__hidden
-int scx_minheap_insert(void __arena *heap_ptr __arg_arena, u64 elem, u64 weight)
+/* Restore the heap property after the weight in slot @ind changed. */
+static inline
+int scx_minheap_fixup(scx_minheap_t *heap, u64 ind)
 {
-	scx_minheap_t *heap = (scx_minheap_t *)heap_ptr;
+	if (ind > 0 && heap->helems[(ind - 1) >> heap->shift].weight > heap->helems[ind].weight)
+		return scx_minheap_sift_up(heap, ind);
+
+	return scx_minheap_sift_down(heap, ind);
+}
 
-	if (heap->size == heap->capacity)
+__weak
+int scx_minheap_balance_top_down(void __arena *heap_ptr __arg_arena)
+{
+	return scx_minheap_sift_down((scx_minheap_t *)heap_ptr, 0);
+}
+
+/*
+ * Remove the element in slot @ind by moving the last element into it. The
+ * caller has already read out the element if it needs it.
+ */
+static inline
+void scx_minheap_delete_slot(scx_minheap_t *heap, u64 ind)
+{
+	scx_minheap_handle_t *handle;
+	u64 last = heap->size - 1;
+
+	if (heap->handles) {
+		handle = (scx_minheap_handle_t *)heap->handles[ind];
+		if (handle)
+			handle->heap = 0;
+
+		heap->handles[ind] = heap->handles[last];
+		heap->handles[last] = 0;
+	}
+
+	heap->helems[ind].elem = heap->helems[last].elem;
+	heap->helems[ind].weight = heap->helems[last].weight;
+
+	heap->size -= 1;
+
+	if (ind == last)
+		return;
+
+	scx_minheap_sync_handle(heap, ind);
+	scx_minheap_fixup(heap, ind);
+}
+
+static inline
+int scx_minheap_insert_handle(scx_minheap_t *heap, u64 elem, u64 weight,
+			      scx_minheap_handle_t *handle)
+{
+	u64 ind = heap->size;
+
+	if (ind == heap->capacity)
 		return -ENOSPC;
 
-	heap->helems[heap->size].elem = elem;
-	heap->helems[heap->size].weight = weight;
+	if (handle && (!heap->handles || handle->heap))
+		return -EINVAL;
+
+	heap->helems[ind].elem = elem;
+	heap->helems[ind].weight = weight;
+
+	if (heap->handles)
+		heap->handles[ind] = (u64)handle;
+
+	if (handle) {
+		handle->heap = (u64)heap;
+		handle->ind = ind;
+	}
 
 	heap->size += 1;
 
-	scx_minheap_balance_bottom_up(heap);
+	scx_minheap_sift_up(heap, ind);
 
 	return 0;
 }
 
+__hidden
+int scx_minheap_insert(void __arena *heap_ptr __arg_arena, u64 elem, u64 weight)
+{
+	return scx_minheap_insert_handle((scx_minheap_t *)heap_ptr, elem, weight, NULL);
+}
+
+__hidden
+int scx_minheap_insert_indexed(void __arena *heap_ptr __arg_arena, u64 elem, u64 weight,
+			       scx_minheap_handle_t *handle __arg_arena)
+{
+	if (!handle)
+		return -EINVAL;
+
+	return scx_minheap_insert_handle((scx_minheap_t *)heap_ptr, elem, weight, handle);
+}
+
 /* Inlined because we are passing a non-arena pointer argument. */
 __hidden
 int scx_minheap_pop(void __arena *heap_ptr __arg_arena, struct scx_minheap_elem *helem __arg_trusted)
@@ -133,12 +283,60 @@ int scx_minheap_pop(void __arena *heap_ptr __arg_arena, struct scx_minheap_elem
 	helem->elem = heap->helems[0].elem;
 	helem->weight = heap->helems[0].weight;
 
-	heap->helems[0].elem = heap->helems[heap->size - 1].elem;
-	heap->helems[0].weight = heap->helems[heap->size - 1].weight;
+	scx_minheap_delete_slot(heap, 0);
 
-	heap->size -= 1;
+	return 0;
+}
+
+/* Find the slot of the element behind @handle, checking it is in @heap. */
+static __always_inline
+s64 scx_minheap_handle_ind(scx_minheap_t *heap, scx_minheap_handle_t *handle)
+{
+	u64 ind = handle->ind;
+
+	if (!heap->handles || handle->heap != (u64)heap)
+		return -ENOENT;
+
+	if (ind >= heap->size || heap->handles[ind] != (u64)handle)
+		return -ENOENT;
+
+	return ind;
+}
+
+__hidden
+int scx_minheap_remove(void __arena *heap_ptr __arg_arena, scx_minheap_handle_t *handle __arg_arena)
+{
+	scx_minheap_t *heap = (scx_minheap_t *)heap_ptr;
+	s64 ind;
+
+	if (!handle)
+		return -EINVAL;
+
+	ind = scx_minheap_handle_ind(heap, handle);
+	if (ind < 0)
+		return ind;
+
+	scx_minheap_delete_slot(heap, ind);
+
+	return 0;
+}
+
+__hidden
+int scx_minheap_update_weight(void __arena *heap_ptr __arg_arena, scx_minheap_handle_t *handle __arg_arena,
+			      u64 weight)
+{
+	scx_minheap_t *heap = (scx_minheap_t *)heap_ptr;
+	s64 ind;
+
+	if (!handle)
+		return -EINVAL;
+
+	ind = scx_minheap_handle_ind(heap, handle);
+	if (ind < 0)
+		return ind;
 
-	scx_minheap_balance_top_down(heap);
+	heap->helems[ind].weight = weight;
+	scx_minheap_fixup(heap, ind);
 
 	return 0;
 }
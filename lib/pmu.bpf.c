@@ -2,13 +2,12 @@
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_tracing.h>
 
+#include <lib/sdt_task.h>
+#include <lib/pmu.h>
+
 char _license[] SEC("license") = "GPL";
 
-/*
- * Only support up to two counters for now.
- */
 #define SCX_PMU_STRIDE 4096
-#define SCX_MAX_PMU_COUNTERS (2)
 
 /* Cannot define an array of per-cpu counters, do so manually. */
 struct {
@@ -19,15 +18,12 @@ struct {
 } scx_pmu_map SEC(".maps");
 
 /*
- * Per-task PMU counter value snapshot. The value for each index
- * corresponds to the last value found for the counter. The generation
- * is used to lazily invalidate values from uninstalled events.
+ * Task storage only points to the arena counter state, which schedulers can
+ * cache in their own task context to skip the lookup.
  */
-struct scx_pmu_counters {
-	u64 start[SCX_MAX_PMU_COUNTERS];
-	u64 agg[SCX_MAX_PMU_COUNTERS];
-	bool switched;
-	u32 gen;
+struct scx_pmu_task_map_val {
+	union sdt_id			tid;
+	struct scx_pmu_task __arena	*ctx;
 };
 
 /* PMU event to index in the perf array. */
@@ -36,98 +32,241 @@ u64 scx_event_idx[SCX_MAX_PMU_COUNTERS];
 /* Start at 1 so that the initial per-task counter vals are invalid at gen 0. */
 u64 scx_pmu_gen = 1;
 
+/* Counter index of each metric source event, -1 if not tracked. */
+s32 scx_pmu_src_idx[SCX_PMU_NR_SRCS] = { -1, -1, -1, -1 };
+
+/* Half-life of the derived metrics, in ns. */
+u32 scx_pmu_half_life = 100 * 1000 * 1000;
+
+/*
+ * Ignore intervals with fewer cycles or instructions than this when updating
+ * the derived metrics, the ratios of tiny samples are mostly noise.
+ */
+#define SCX_PMU_METRIC_MIN_SAMPLE (10000)
+
+static struct scx_allocator scx_pmu_allocator;
+
 struct {
 	__uint(type, BPF_MAP_TYPE_TASK_STORAGE);
 	__uint(map_flags, BPF_F_NO_PREALLOC);
 	__type(key, u32);
-	__type(value, struct scx_pmu_counters);
+	__type(value, struct scx_pmu_task_map_val);
 } scx_pmu_tasks SEC(".maps");
 
-__weak
-int scx_pmu_event_stop(struct task_struct __arg_trusted *p)
+/*
+ * Read all installed counters of the current CPU. Returns the bitmask of the
+ * counters successfully read.
+ */
+static
+u32 scx_pmu_read_cpu(struct bpf_perf_event_value *values)
 {
-	struct scx_pmu_counters *cntrs;
-	struct bpf_perf_event_value value;
-	int idx;
-	int ret;
+	u32 cpu = bpf_get_smp_processor_id();
+	u32 valid = 0;
 	__u32 key;
+	int idx;
 
-	cntrs = bpf_task_storage_get(&scx_pmu_tasks, p, 0, BPF_LOCAL_STORAGE_GET_F_CREATE);
-	if (!cntrs)
-		return -ENOENT;
-
-	#pragma unroll(2)
-	for (idx = 0; idx < SCX_MAX_PMU_COUNTERS; idx++) {
+	bpf_for(idx, 0, SCX_MAX_PMU_COUNTERS) {
 		/* Is the counter even installed? */
 		if (scx_event_idx[idx] == 0ULL)
 			continue;
 
-		/*
-		 * We updated the counters we were using. Invalidate
-		 * previous measurements.
-		 */
-		if (unlikely(cntrs->gen != scx_pmu_gen)) {
-			cntrs->agg[idx] = 0;
+		key = cpu + idx * SCX_PMU_STRIDE;
+		if (bpf_perf_event_read_value(&scx_pmu_map, key, &values[idx],
+					      sizeof(values[idx])))
 			continue;
-		}
 
-		key = bpf_get_smp_processor_id() + idx * SCX_PMU_STRIDE;
-		ret = bpf_perf_event_read_value(&scx_pmu_map, key, &value, sizeof(value));
-		if (ret)
-			return ret;
+		valid |= 1U << idx;
+	}
 
-		if (unlikely(!cntrs->switched && value.enabled != value.running)) {
-			bpf_printk("SWITCHED: %ld vs %ld", value.enabled, value.running);
-			cntrs->switched = true;
-		}
+	return valid;
+}
 
-		/* Add the delta for this scheduling interval. */
-		cntrs->agg[idx] += value.counter - cntrs->start[idx];
+/*
+ * We updated the counters we were using. Invalidate previous measurements.
+ */
+static
+void scx_pmu_task_reset(struct scx_pmu_task __arena *ctx)
+{
+	int idx;
 
+	bpf_for(idx, 0, SCX_MAX_PMU_COUNTERS) {
+		ctx->raw[idx] = 0;
+		ctx->enabled[idx] = 0;
+		ctx->running[idx] = 0;
 	}
 
-	cntrs->gen = scx_pmu_gen;
+	ctx->started = 0;
+	ctx->gen = scx_pmu_gen;
+}
 
-	return 0;
+static
+void scx_pmu_metric_update(struct ravg_data __arena *rd, u64 val, u64 now)
+{
+	struct ravg_data tmp;
+
+	ravg_from_arena(&tmp, rd);
+	ravg_accumulate(&tmp, val, now, scx_pmu_half_life);
+	ravg_to_arena(rd, &tmp);
 }
 
-int scx_pmu_event_start(struct task_struct __arg_trusted *p, bool update)
+/*
+ * Get the scaled delta of a metric source event for the last interval. Fails
+ * if the event is not tracked or was never on a hardware counter.
+ */
+static
+bool scx_pmu_src_delta(enum scx_pmu_src src, u64 *deltas, u32 covered, u64 *delta)
 {
-	struct bpf_perf_event_value value;
-	struct scx_pmu_counters *cntrs;
+	s32 idx = scx_pmu_src_idx[src];
+
+	if (idx < 0 || idx >= SCX_MAX_PMU_COUNTERS || !(covered & (1U << idx)))
+		return false;
+
+	*delta = deltas[idx];
+
+	return true;
+}
+
+/* Fold the ratios of the last interval into the decayed metrics. */
+static
+void scx_pmu_task_update_metrics(struct scx_pmu_task __arena *ctx,
+				 u64 *deltas, u32 covered)
+{
+	u64 insns, cycles, misses, stalls, val;
+	bool has_insns, has_cycles;
+	u64 now;
+
+	has_insns = scx_pmu_src_delta(SCX_PMU_SRC_INSNS, deltas, covered, &insns) &&
+		    insns >= SCX_PMU_METRIC_MIN_SAMPLE;
+	has_cycles = scx_pmu_src_delta(SCX_PMU_SRC_CYCLES, deltas, covered, &cycles) &&
+		     cycles >= SCX_PMU_METRIC_MIN_SAMPLE;
+	if (!has_insns && !has_cycles)
+		return;
+
+	now = bpf_ktime_get_ns();
+
+	if (has_insns && has_cycles)
+		scx_pmu_metric_update(&ctx->ipc, (insns << SCX_PMU_METRIC_SHIFT) / cycles, now);
+
+	if (has_insns && scx_pmu_src_delta(SCX_PMU_SRC_LLC_MISSES, deltas, covered, &misses))
+		scx_pmu_metric_update(&ctx->mpki,
+				      ((misses * 1000) << SCX_PMU_METRIC_SHIFT) / insns, now);
+
+	if (has_cycles && scx_pmu_src_delta(SCX_PMU_SRC_STALLS, deltas, covered, &stalls)) {
+		val = (stalls << SCX_PMU_METRIC_SHIFT) / cycles;
+		if (val > 1ULL << SCX_PMU_METRIC_SHIFT)
+			val = 1ULL << SCX_PMU_METRIC_SHIFT;
+
+		scx_pmu_metric_update(&ctx->mem_bound, val, now);
+	}
+}
+
+/* Add the deltas for this scheduling interval. */
+static
+void scx_pmu_task_account(struct scx_pmu_task __arena *ctx,
+			  struct bpf_perf_event_value *values, u32 valid)
+{
+	u64 deltas[SCX_MAX_PMU_COUNTERS] = {};
+	u64 counter, enabled, running;
+	u32 covered = 0;
 	int idx;
-	int ret;
-	__u32 key;
 
-	cntrs = bpf_task_storage_get(&scx_pmu_tasks, p, 0, BPF_LOCAL_STORAGE_GET_F_CREATE);
-	if (!cntrs)
-		return -ENOENT;
+	if (unlikely(ctx->gen != scx_pmu_gen)) {
+		scx_pmu_task_reset(ctx);
+		return;
+	}
 
-	#pragma unroll(2)
-	for (idx = 0; idx < SCX_MAX_PMU_COUNTERS; idx++) {
-		/* Is the counter even installed? */
-		if (scx_event_idx[idx] == 0ULL)
+	bpf_for(idx, 0, SCX_MAX_PMU_COUNTERS) {
+		if (!(valid & ctx->started & (1U << idx)))
 			continue;
 
-		/* If we modified the installed counters invalidate and continue. */
-		if (unlikely(cntrs->gen != scx_pmu_gen))
-			cntrs->agg[idx] = 0;
+		counter = values[idx].counter - ctx->start[idx];
+		enabled = values[idx].enabled - ctx->start_enabled[idx];
+		running = values[idx].running - ctx->start_running[idx];
+
+		ctx->raw[idx] += counter;
+		ctx->enabled[idx] += enabled;
+		ctx->running[idx] += running;
+
+		/* Multiplexed out for the whole interval, nothing to scale. */
+		if (!running)
+			continue;
+
+		deltas[idx] = scx_pmu_scale(counter, enabled, running);
+		covered |= 1U << idx;
+	}
+
+	ctx->started = 0;
+
+	scx_pmu_task_update_metrics(ctx, deltas, covered);
+}
 
-		key = bpf_get_smp_processor_id() + idx * SCX_PMU_STRIDE;
-		ret = bpf_perf_event_read_value(&scx_pmu_map, key, &value, sizeof(value));
-		if (ret)
-			return ret;
+static
+void scx_pmu_task_begin(struct scx_pmu_task __arena *ctx,
+			struct bpf_perf_event_value *values, u32 valid)
+{
+	int idx;
 
-		if (update) {
-			/* Add the delta for this scheduling interval. */
-			cntrs->agg[idx] += value.counter - cntrs->start[idx];
-		}
+	if (unlikely(ctx->gen != scx_pmu_gen))
+		scx_pmu_task_reset(ctx);
 
-		cntrs->start[idx] = value.counter;
+	bpf_for(idx, 0, SCX_MAX_PMU_COUNTERS) {
+		if (!(valid & (1U << idx)))
+			continue;
 
+		ctx->start[idx] = values[idx].counter;
+		ctx->start_enabled[idx] = values[idx].enabled;
+		ctx->start_running[idx] = values[idx].running;
 	}
 
-	cntrs->gen = scx_pmu_gen;
+	ctx->started = valid;
+}
+
+__weak
+struct scx_pmu_task __arena *scx_pmu_task_ctx(struct task_struct __arg_trusted *p)
+{
+	struct scx_pmu_task_map_val *mval;
+
+	scx_arena_subprog_init();
+
+	mval = bpf_task_storage_get(&scx_pmu_tasks, p, 0, 0);
+	if (!mval)
+		return NULL;
+
+	return mval->ctx;
+}
+
+__weak
+int scx_pmu_event_stop(struct task_struct __arg_trusted *p)
+{
+	struct bpf_perf_event_value values[SCX_MAX_PMU_COUNTERS];
+	struct scx_pmu_task __arena *ctx;
+
+	ctx = scx_pmu_task_ctx(p);
+	if (!ctx)
+		return -ENOENT;
+
+	scx_pmu_task_account(ctx, values, scx_pmu_read_cpu(values));
+
+	return 0;
+}
+
+__weak
+int scx_pmu_event_start(struct task_struct __arg_trusted *p, bool update)
+{
+	struct bpf_perf_event_value values[SCX_MAX_PMU_COUNTERS];
+	struct scx_pmu_task __arena *ctx;
+	u32 valid;
+
+	ctx = scx_pmu_task_ctx(p);
+	if (!ctx)
+		return -ENOENT;
+
+	valid = scx_pmu_read_cpu(values);
+
+	if (update)
+		scx_pmu_task_account(ctx, values, valid);
+
+	scx_pmu_task_begin(ctx, values, valid);
 
 	return 0;
 }
@@ -137,7 +276,7 @@ int scx_pmu_event_to_idx(u64 event)
 {
 	int i;
 
-	#pragma unroll(2)
+	#pragma unroll
 	for (i = 0; i < SCX_MAX_PMU_COUNTERS; i++) {
 		if (scx_event_idx[i] == event)
 			break;
@@ -152,7 +291,7 @@ int scx_pmu_find_free_idx(void)
 {
 	int i;
 
-	#pragma unroll(2)
+	#pragma unroll
 	for (i = 0; i < SCX_MAX_PMU_COUNTERS; i++) {
 		if (scx_event_idx[i] == 0ULL)
 			break;
@@ -162,20 +301,134 @@ int scx_pmu_find_free_idx(void)
 	return i;
 }
 
+/*
+ * Return the index of an installed event in the per-task counter arrays.
+ */
+__weak
+int scx_pmu_event_idx(u64 event)
+{
+	int idx;
+
+	if (!event)
+		return -EINVAL;
+
+	idx = scx_pmu_event_to_idx(event);
+	if (idx >= SCX_MAX_PMU_COUNTERS)
+		return -ENOENT;
+
+	return idx;
+}
+
+static
+int scx_pmu_src_set(enum scx_pmu_src src, u64 event)
+{
+	int idx = -1;
+
+	if (event) {
+		idx = scx_pmu_event_idx(event);
+		if (idx < 0)
+			return idx;
+	}
+
+	scx_pmu_src_idx[src] = idx;
+
+	return 0;
+}
+
+/*
+ * Derive the per-task metrics of struct scx_pmu_metrics from already
+ * installed events. Any event can be 0, which disables the metrics that need
+ * it. A @half_life of 0 keeps the current one.
+ */
+__weak
+int scx_pmu_metrics_init(u64 insns, u64 cycles, u64 llc_misses, u64 stalls, u32 half_life)
+{
+	int ret;
+
+	if ((ret = scx_pmu_src_set(SCX_PMU_SRC_INSNS, insns)))
+		return ret;
+
+	if ((ret = scx_pmu_src_set(SCX_PMU_SRC_CYCLES, cycles)))
+		return ret;
+
+	if ((ret = scx_pmu_src_set(SCX_PMU_SRC_LLC_MISSES, llc_misses)))
+		return ret;
+
+	if ((ret = scx_pmu_src_set(SCX_PMU_SRC_STALLS, stalls)))
+		return ret;
+
+	if (half_life)
+		scx_pmu_half_life = half_life;
+
+	return 0;
+}
+
+/*
+ * Read the decayed metrics of a task, see scx_pmu_task_ctx(). Metrics
+ * without source events read as 0.
+ */
+__weak
+int scx_pmu_task_metrics(struct scx_pmu_task __arena __arg_arena *ctx, struct scx_pmu_metrics *metrics)
+{
+	struct ravg_data rd;
+	u64 now;
+
+	if (!ctx || !metrics)
+		return -EINVAL;
+
+	now = bpf_ktime_get_ns();
+
+	ravg_from_arena(&rd, &ctx->ipc);
+	metrics->ipc = ravg_read(&rd, now, scx_pmu_half_life) >> RAVG_FRAC_BITS;
+
+	ravg_from_arena(&rd, &ctx->mpki);
+	metrics->mpki = ravg_read(&rd, now, scx_pmu_half_life) >> RAVG_FRAC_BITS;
+
+	ravg_from_arena(&rd, &ctx->mem_bound);
+	metrics->mem_bound = ravg_read(&rd, now, scx_pmu_half_life) >> RAVG_FRAC_BITS;
+
+	return 0;
+}
+
+/*
+ * Set up the allocator for the per-task counter state. Must be called from a
+ * sleepable context before any task is registered.
+ */
+__weak
+int scx_pmu_init(void)
+{
+	return scx_alloc_init(&scx_pmu_allocator, sizeof(struct scx_pmu_task));
+}
+
 /*
  * Register a task from the PMU tracker.
  */
 __weak
 int scx_pmu_task_init(struct task_struct __arg_trusted *p)
 {
-	struct scx_pmu_counters *cntrs;
+	struct scx_pmu_task_map_val *mval;
+	struct sdt_data __arena *data;
 
-	cntrs = bpf_task_storage_get(&scx_pmu_tasks, p, 0, BPF_LOCAL_STORAGE_GET_F_CREATE);
-	if (!cntrs)
+	mval = bpf_task_storage_get(&scx_pmu_tasks, p, 0, BPF_LOCAL_STORAGE_GET_F_CREATE);
+	if (!mval)
 		return -ENOMEM;
 
-	/* Mark the values as invalid, will only return valid on first schedule. */
-	cntrs->gen = 0;
+	/* Already registered. */
+	if (mval->ctx)
+		return 0;
+
+	/*
+	 * Note that scx_alloc() returns a zero-initialized memory, so the
+	 * values are invalid at gen 0 and only become valid on first schedule.
+	 */
+	data = scx_alloc(&scx_pmu_allocator);
+	if (!data) {
+		bpf_task_storage_delete(&scx_pmu_tasks, p);
+		return -ENOMEM;
+	}
+
+	mval->tid = data->tid;
+	mval->ctx = (struct scx_pmu_task __arena *)data->payload;
 
 	return 0;
 }
@@ -186,7 +439,15 @@ int scx_pmu_task_init(struct task_struct __arg_trusted *p)
 __weak
 int scx_pmu_task_fini(struct task_struct __arg_trusted *p)
 {
+	struct scx_pmu_task_map_val *mval;
+
+	scx_arena_subprog_init();
 
+	mval = bpf_task_storage_get(&scx_pmu_tasks, p, 0, 0);
+	if (!mval)
+		return 0;
+
+	scx_alloc_free_idx(&scx_pmu_allocator, mval->tid.idx);
 	bpf_task_storage_delete(&scx_pmu_tasks, p);
 
 	return 0;
@@ -219,7 +480,7 @@ int scx_pmu_install(u64 event)
 __weak
 int scx_pmu_uninstall(u64 event)
 {
-	int idx;
+	int idx, src;
 
 	idx = scx_pmu_event_to_idx(event);
 	if (unlikely(idx >= SCX_MAX_PMU_COUNTERS || idx < 0))
@@ -227,24 +488,33 @@ int scx_pmu_uninstall(u64 event)
 
 	scx_event_idx[idx] = 0;
 
+	/* The slot may be reused by another event. */
+	bpf_for(src, 0, SCX_PMU_NR_SRCS) {
+		if (scx_pmu_src_idx[src] == idx)
+			scx_pmu_src_idx[src] = -1;
+	}
+
 	scx_pmu_gen += 1;
 
 	return 0;
 }
 
-
+/*
+ * Read the count of an event for a task, scaled up if the event was
+ * multiplexed with others while the task was running.
+ */
 __weak
 int scx_pmu_read(struct task_struct __arg_trusted *p, u64 event, u64 *value, bool clear)
 {
-	struct scx_pmu_counters *cntrs;
+	struct scx_pmu_task __arena *ctx;
 	int idx;
 
 	idx = scx_pmu_event_to_idx(event);
 	if (idx == SCX_MAX_PMU_COUNTERS)
 		return -EINVAL;
 
-	cntrs = bpf_task_storage_get(&scx_pmu_tasks, p, 0, 0);
-	if (!cntrs)
+	ctx = scx_pmu_task_ctx(p);
+	if (!ctx)
 		return -ENOENT;
 
 	if (unlikely(!value))
@@ -253,10 +523,13 @@ int scx_pmu_read(struct task_struct __arg_trusted *p, u64 event, u64 *value, boo
 	if (unlikely(idx < 0 || idx >= SCX_MAX_PMU_COUNTERS))
 		return -EINVAL;
 
-	*value = cntrs->agg[idx];
+	*value = scx_pmu_task_value(ctx, idx);
 
-	if (clear)
-		cntrs->agg[idx] = 0;
+	if (clear) {
+		ctx->raw[idx] = 0;
+		ctx->enabled[idx] = 0;
+		ctx->running[idx] = 0;
+	}
 
 	return 0;
 }
@@ -264,25 +537,32 @@ int scx_pmu_read(struct task_struct __arg_trusted *p, u64 event, u64 *value, boo
 SEC("?tp_btf/sched_switch")
 int scx_pmu_switch_tc(u64 *ctx)
 {
+	struct bpf_perf_event_value values[SCX_MAX_PMU_COUNTERS];
+	struct scx_pmu_task __arena *pctx;
 	struct task_struct *prev, *next;
-	int ret;
+	u32 valid;
 
 	prev = (struct task_struct *)ctx[1];
 	next = (struct task_struct *)ctx[2];
 
-	if (!prev->pid)
-		goto next;
+	/* Both tasks see the same counter values, only read them once. */
+	valid = scx_pmu_read_cpu(values);
 
-	ret = scx_pmu_event_stop(prev);
-	if (ret)
-		return ret;
+	if (prev->pid) {
+		pctx = scx_pmu_task_ctx(prev);
+		if (pctx)
+			scx_pmu_task_account(pctx, values, valid);
+	}
 
-next:
 	if (!next->pid)
 		return 0;
 
 	/* Skip update when there was no previous task to obtain delta */
-	return scx_pmu_event_start(next, false);
+	pctx = scx_pmu_task_ctx(next);
+	if (pctx)
+		scx_pmu_task_begin(pctx, values, valid);
+
+	return 0;
 }
 
 SEC("?fentry/scx_tick")
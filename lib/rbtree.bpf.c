@@ -74,7 +74,7 @@ int rb_destroy(rbtree_t __arg_arena *rbtree)
 
 	node = rbtree->freelist;
 	while (node && can_loop) {
-		next = node->parent;
+		next = rbnode_parent(node);
 		scx_alloc_free_idx(&scx_rbnode_allocator, node->tid.idx);
 		node = next;
 	}
@@ -85,19 +85,21 @@ int rb_destroy(rbtree_t __arg_arena *rbtree)
 
 static inline int rbnode_dir(rbnode_t *node)
 {
+	rbnode_t *parent = rbnode_parent(node);
+
 	/* Arbitrarily choose a direction for the root. */
-	if (unlikely(!node->parent))
+	if (unlikely(!parent))
 		return 0;
 
-	return (node->parent->left == node) ? 0 : 1;
+	return (rbnode_left(parent) == node) ? 0 : 1;
 }
 
 int rbnode_rotate(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, int dir)
 {
-	rbnode_t *tmp, *parent;
+	rbnode_t *tmp, *parent, *child;
 	int parentdir;
 
-	parent = node->parent;
+	parent = rbnode_parent(node);
 	if (parent)
 		parentdir = rbnode_dir(node);
 
@@ -110,22 +112,23 @@ int rbnode_rotate(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, int
 	 * Note that the new root is on the opposite side of the
 	 * rotation's direction.
 	 */
-	tmp = node->child[1 - dir];
+	tmp = rbnode_child(node, 1 - dir);
 	if (unlikely(!tmp))
 		return -EINVAL;
 
 	/* Steal the closest child of the new root. */
-	node->child[1 - dir] = tmp->child[dir];
-	if (node->child[1 - dir])
-		node->child[1 - dir]->parent = node;
+	child = rbnode_child(tmp, dir);
+	rbnode_set_child(node, 1 - dir, child);
+	if (child)
+		rbnode_set_parent(child, node);
 
 	/* Put the node below the new root.*/
-	tmp->child[dir] = node;
-	node->parent = tmp;
+	rbnode_set_child(tmp, dir, node);
+	rbnode_set_parent(node, tmp);
 
-	tmp->parent = parent;
+	rbnode_set_parent(tmp, parent);
 	if (parent)
-		parent->child[parentdir] = tmp;
+		rbnode_set_child(parent, parentdir, tmp);
 	else
 		rbtree->root = tmp;
 
@@ -135,7 +138,7 @@ int rbnode_rotate(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, int
 static
 rbnode_t *rbnode_find(rbnode_t *subtree, u64 key)
 {
-	rbnode_t *node = subtree;
+	rbnode_t *node = subtree, *next;
 	int dir;
 
 	if (!subtree)
@@ -147,10 +150,11 @@ rbnode_t *rbnode_find(rbnode_t *subtree, u64 key)
 
 		dir = (key < node->key) ? 0 : 1;
 
-		if (!node->child[dir])
+		next = rbnode_child(node, dir);
+		if (!next)
 			break;
 
-		node = node->child[dir];
+		node = next;
 	}
 
 	return node;
@@ -159,7 +163,7 @@ rbnode_t *rbnode_find(rbnode_t *subtree, u64 key)
 static
 rbnode_t *rbnode_least_upper_bound(rbnode_t *subtree, uint64_t key)
 {
-	rbnode_t *node = subtree;
+	rbnode_t *node = subtree, *next;
 	int dir;
 
 	if (!subtree)
@@ -168,10 +172,11 @@ rbnode_t *rbnode_least_upper_bound(rbnode_t *subtree, uint64_t key)
 	while (can_loop) {
 		dir = (key <= node->key) ? 0 : 1;
 
-		if (!node->child[dir])
+		next = rbnode_child(node, dir);
+		if (!next)
 			break;
 
-		node = node->child[dir];
+		node = next;
 	}
 
 	return node;
@@ -209,7 +214,7 @@ static inline rbnode_t *rb_node_alloc_common(rbtree_t __arg_arena *rbtree, u64 k
 		if (!rbnode)
 			break;
 
-	} while (cmpxchg(&rbtree->freelist, rbnode, rbnode->parent) != rbnode && can_loop);
+	} while (cmpxchg(&rbtree->freelist, rbnode, rbnode_parent(rbnode)) != rbnode && can_loop);
 
 	if (!rbnode) {
 		data = scx_alloc(&scx_rbnode_allocator);
@@ -230,9 +235,9 @@ static inline rbnode_t *rb_node_alloc_common(rbtree_t __arg_arena *rbtree, u64 k
 
 	node = (rbnode_t *)rbnode;
 
-	node->left = NULL;
-	node->right = NULL;
-	node->parent = NULL;
+	rbnode_set_left(node, NULL);
+	rbnode_set_right(node, NULL);
+	rbnode_set_parent(node, NULL);
 
 	node->key = key;
 	node->value = value;
@@ -256,7 +261,7 @@ int rb_node_free(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *rbnode)
 
 	do {
 		old = rbtree->freelist;
-		rbnode->parent = old;
+		rbnode_set_parent(rbnode, old);
 	} while (cmpxchg(&rbtree->freelist, old, rbnode) != old && can_loop);
 
 	return 0;
@@ -306,35 +311,35 @@ int rb_node_insert(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node)
 		return -EALREADY;
 	}
 
-	node->parent = parent;
+	rbnode_set_parent(node, parent);
 	/* Also works if key == parent->key. */
 	if (key <= parent->key)
-		parent->left = node;
+		rbnode_set_left(parent, node);
 	else
-		parent->right = node;
+		rbnode_set_right(parent, node);
 
 	while (can_loop) {
-		parent = node->parent;
+		parent = rbnode_parent(node);
 		if (!parent)
 			return 0;
 
 		if (!parent->is_red)
 			return 0;
 
-		grandparent = parent->parent;
+		grandparent = rbnode_parent(parent);
 		if (!grandparent) {
 			parent->is_red = false;
 			return 0;
 		}
 
 		dir = rbnode_dir(parent);
-		uncle = grandparent->child[1 - dir];
+		uncle = rbnode_child(grandparent, 1 - dir);
 
 		if (!uncle || !uncle->is_red) {
-			if (node == parent->child[1 - dir]) {
+			if (node == rbnode_child(parent, 1 - dir)) {
 				rbnode_rotate(rbtree, parent, dir);
 				node = parent;
-				parent = grandparent->child[dir];
+				parent = rbnode_child(grandparent, dir);
 			}
 
 			rbnode_rotate(rbtree, grandparent, 1 - dir);
@@ -373,11 +378,11 @@ int rb_insert_node(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node)
 	 * to the rbnode_t * into a single operation.
 	 */
 
-	node->left = NULL;
+	rbnode_set_left(node, NULL);
 	i += 1;
-	node->right = NULL;
+	rbnode_set_right(node, NULL);
 	i += 1;
-	node->parent = NULL;
+	rbnode_set_parent(node, NULL);
 
 	return rb_node_insert(rbtree, node);
 }
@@ -409,8 +414,10 @@ int rb_insert(rbtree_t __arg_arena *rbtree, u64 key, u64 value)
 
 static inline rbnode_t *rbnode_least(rbnode_t *subtree)
 {
-	while (subtree->left && can_loop)
-		subtree = subtree->left;
+	rbnode_t *left;
+
+	while ((left = rbnode_left(subtree)) && can_loop)
+		subtree = left;
 
 	return subtree;
 }
@@ -431,13 +438,21 @@ __weak int rb_least(rbtree_t __arg_arena *rbtree, u64 *key, u64 *value)
 }
 
 
+__weak u64 rb_least_node_internal(rbtree_t __arg_arena *rbtree)
+{
+	if (!rbtree->root)
+		return (u64)NULL;
+
+	return (u64)rbnode_least(rbtree->root);
+}
+
 /*
  * If we are referencing ourselves, a and b have a parent-child relation,
  * and we should be pointing at the other node instead.
  */
 static inline void rbnode_fixup_pointers(rbnode_t *a, rbnode_t *b)
 {
-#define fixup(n1, n2, member) do { if (n1->member == n1) n1->member = n2; } while (0)
+#define fixup(n1, n2, member) do { if (n1->member == rbnode_pack(n1)) n1->member = rbnode_pack(n2); } while (0)
 	fixup(a, b, left);
 	fixup(a, b, right);
 	fixup(a, b, parent);
@@ -447,7 +462,7 @@ static inline void rbnode_fixup_pointers(rbnode_t *a, rbnode_t *b)
 static inline void rbnode_swap_values(rbnode_t *a, rbnode_t *b)
 {
 #define swap(n1, n2, tmp) do { (tmp) = (n1); (n1) = (n2); (n2) = (tmp); } while (0)
-	rbnode_t *tmpnode;
+	rbptr_t tmpnode;
 	u64 tmp;
 
 	/* Swap the pointers. */
@@ -465,13 +480,17 @@ static inline void rbnode_swap_values(rbnode_t *a, rbnode_t *b)
 
 static inline void rbnode_adjust_neighbors(rbtree_t *rbtree, rbnode_t *node, int dir)
 {
-	if (node->left)
-		node->left->parent = node;
-	if (node->right)
-		node->right->parent = node;
+	rbnode_t *left = rbnode_left(node);
+	rbnode_t *right = rbnode_right(node);
+	rbnode_t *parent = rbnode_parent(node);
 
-	if (node->parent) {
-		node->parent->child[dir] = node;
+	if (left)
+		rbnode_set_parent(left, node);
+	if (right)
+		rbnode_set_parent(right, node);
+
+	if (parent) {
+		rbnode_set_child(parent, dir, node);
 		return;
 	}
 
@@ -493,9 +512,9 @@ static int rbnode_replace(rbtree_t *rbtree, rbnode_t *existing, rbnode_t *replac
 		dir = rbnode_dir(existing);
 
 	replacement->is_red = existing->is_red;
-	replacement->left = existing->left;
-	replacement->right = existing->right;
-	replacement->parent = existing->parent;
+	rbnode_set_left(replacement, rbnode_left(existing));
+	rbnode_set_right(replacement, rbnode_right(existing));
+	rbnode_set_parent(replacement, rbnode_parent(existing));
 
 	/* Fix up the new node's neighbors. */
 	rbnode_adjust_neighbors(rbtree, replacement, dir);
@@ -534,7 +553,7 @@ static void rbnode_switch(rbtree_t *rbtree, rbnode_t *a, rbnode_t *b)
 
 static inline int rbnode_remove_node_single_child(rbtree_t *rbtree, rbnode_t *node, bool free)
 {
-	rbnode_t *child;
+	rbnode_t *child, *parent;
 	int dir;
 
 	if (unlikely(node->is_red)) {
@@ -542,7 +561,7 @@ static inline int rbnode_remove_node_single_child(rbtree_t *rbtree, rbnode_t *no
 		return -EINVAL;
 	}
 
-	child = node->left ? node->left : node->right;
+	child = node->left ? rbnode_left(node) : rbnode_right(node);
 	if (unlikely(!child->is_red)) {
 		bpf_printk("Only child is black");
 		return -EINVAL;
@@ -552,11 +571,12 @@ static inline int rbnode_remove_node_single_child(rbtree_t *rbtree, rbnode_t *no
 	 * Since it's the immediate child, we can just
 	 * remove the parent.
 	 */
-	child->parent = node->parent;
+	parent = rbnode_parent(node);
+	rbnode_set_parent(child, parent);
 
-	if (node->parent) {
+	if (parent) {
 		dir = rbnode_dir(node);
-		node->parent->child[dir] = child;
+		rbnode_set_child(parent, dir, child);
 	} else {
 		rbtree->root = child;
 	}
@@ -573,10 +593,13 @@ static inline int rbnode_remove_node_single_child(rbtree_t *rbtree, rbnode_t *no
 
 static inline bool rbnode_has_red_children(rbnode_t *node)
 {
-	if (node->left && node->left->is_red)
+	rbnode_t *left = rbnode_left(node);
+	rbnode_t *right = rbnode_right(node);
+
+	if (left && left->is_red)
 		return true;
 
-	return node->right && node->right->is_red;
+	return right && right->is_red;
 }
 
 static __attribute__((always_inline))
@@ -595,7 +618,7 @@ int rb_node_remove(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, boo
 		 * in other structs.
 		 */
 
-		replace = rbnode_least(node->right);
+		replace = rbnode_least(rbnode_right(node));
 		rbnode_switch(rbtree, replace, node);
 
 		/*
@@ -613,7 +636,7 @@ int rb_node_remove(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, boo
 
 	/* (!node->left && !node->right) */
 
-	parent = node->parent;
+	parent = rbnode_parent(node);
 	if (!parent) {
 		rbtree->root = NULL;
 		if (free)
@@ -622,7 +645,7 @@ int rb_node_remove(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, boo
 	}
 
 	dir = rbnode_dir(node);
-	parent->child[dir] = NULL;
+	rbnode_set_child(parent, dir, NULL);
 	is_red = node->is_red;
 
 	if (free)
@@ -632,7 +655,7 @@ int rb_node_remove(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, boo
 	if (is_red)
 		return 0;
 
-	sibling = parent->child[1 - dir];
+	sibling = rbnode_child(parent, 1 - dir);
 	if (unlikely(!sibling)) {
 		bpf_printk("rbtree: removed black node has no sibling");
 		return -EINVAL;
@@ -659,7 +682,7 @@ int rb_node_remove(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, boo
 		 * If we have no sibling, the tree was
 		 * already unbalanced.
 		 */
-		sibling = parent->child[1 - dir];
+		sibling = rbnode_child(parent, 1 - dir);
 		if (unlikely(!sibling)) {
 			bpf_printk("rbtree: removed black node has no sibling");
 			return -EINVAL;
@@ -679,7 +702,7 @@ int rb_node_remove(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, boo
 			sibling->is_red = false;
 
 			/* Our new sibling is now the close nephew. */
-			sibling = parent->child[1 - dir];
+			sibling = rbnode_child(parent, 1 - dir);
 			/* If sibling has any red siblings, break out. */
 			if (rbnode_has_red_children(sibling))
 				break;
@@ -712,14 +735,14 @@ int rb_node_remove(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, boo
 		 */
 		sibling->is_red = true;
 		node = parent;
-		parent = node->parent;
+		parent = rbnode_parent(node);
 		dir = rbnode_dir(node);
 	}
 
 	if (node != initial) {
 		dir = rbnode_dir(node);
-		parent = node->parent;
-		sibling = parent->child[1-dir];
+		parent = rbnode_parent(node);
+		sibling = rbnode_child(parent, 1 - dir);
 	}
 	/*
 	 * Almost there. We know between the parent, sibling,
@@ -728,8 +751,8 @@ int rb_node_remove(rbtree_t __arg_arena *rbtree, rbnode_t __arg_arena *node, boo
 	 * paint it black, and paint the previous sibling red.
 	 */
 
-	close_nephew = sibling->child[dir];
-	distant_nephew = sibling->child[1 - dir];
+	close_nephew = rbnode_child(sibling, dir);
+	distant_nephew = rbnode_child(sibling, 1 - dir);
 
 	/*
 	 * If the distant red nephew is not red, rotate
@@ -817,8 +840,8 @@ int rb_pop(rbtree_t __arg_arena *rbtree, u64 *key, u64 *value)
 
 inline void rbnode_print(size_t depth, rbnode_t *rbn)
 {
-	bpf_printk("[DEPTH %d] %p (%s) PARENT %p", depth, rbn, rbn->is_red ? "red" : "black", rbn->parent);
-	bpf_printk("\tKV (%ld, %ld) LEFT %p RIGHT %p]\n", rbn->key, rbn->value, rbn->left, rbn->right);
+	bpf_printk("[DEPTH %d] %p (%s) PARENT %p", depth, rbn, rbn->is_red ? "red" : "black", rbnode_parent(rbn));
+	bpf_printk("\tKV (%ld, %ld) LEFT %p RIGHT %p]\n", rbn->key, rbn->value, rbnode_left(rbn), rbnode_right(rbn));
 }
 
 enum rb_print_state {
@@ -836,7 +859,7 @@ enum rb_print_state rb_print_next_state(rbnode_t __arg_arena *rbnode, enum rb_pr
 	switch (state) {
 	case RB_NONE_VISITED:
 		if (rbnode->left) {
-			*next = rbnode->left;
+			*next = rbnode_left(rbnode);
 			state = RB_LEFT_VISITED;
 			break;
 		}
@@ -845,7 +868,7 @@ enum rb_print_state rb_print_next_state(rbnode_t __arg_arena *rbnode, enum rb_pr
 
 	case RB_LEFT_VISITED:
 		if (rbnode->right) {
-			*next = rbnode->right;
+			*next = rbnode_right(rbnode);
 			state = RB_RIGHT_VISITED;
 			break;
 		}
@@ -890,7 +913,7 @@ int rb_print_pop_up(rbnode_t **rbnode, u8 *depthp, enum rb_print_state (*stack)[
 			break;
 
 		*state = (*stack)[depth % RB_MAXLVL_PRINT];
-		*rbnode = (*rbnode)->parent;
+		*rbnode = rbnode_parent(*rbnode);
 	}
 
 	*depthp = depth;
@@ -959,6 +982,7 @@ int rb_integrity_check(rbtree_t __arg_arena *rbtree)
 {
 	enum rb_print_state stack[RB_MAXLVL_PRINT];
 	rbnode_t *rbnode = rbtree->root;
+	rbnode_t *parent, *left, *right;
 	enum rb_print_state state;
 	rbnode_t *next;
 	u8 depth;
@@ -975,37 +999,41 @@ int rb_integrity_check(rbtree_t __arg_arena *rbtree)
 
 	/* Even with can_loop, the verifier doesn't like infinite loops. */
 	while (can_loop) {
-		if (rbnode->parent && rbnode->parent->left != rbnode
-			&& rbnode->parent->right != rbnode) {
-			bpf_printk("WARNING: Inconsistent tree. Parent %p has no child %p", rbnode->parent, rbnode);
+		parent = rbnode_parent(rbnode);
+		left = rbnode_left(rbnode);
+		right = rbnode_right(rbnode);
+
+		if (parent && rbnode_left(parent) != rbnode
+			&& rbnode_right(parent) != rbnode) {
+			bpf_printk("WARNING: Inconsistent tree. Parent %p has no child %p", parent, rbnode);
 			return -EINVAL;
 		}
 
-		if (rbnode->parent == rbnode) {
+		if (parent == rbnode) {
 			bpf_printk("WARNING: Inconsistent tree, node %p is its own parent", rbnode);
 			return -EINVAL;
 		}
 
-		if (rbnode->left == rbnode) {
+		if (left == rbnode) {
 			bpf_printk("WARNING: Inconsistent tree, node %p is its own left child", rbnode);
 			return -EINVAL;
 		}
 
-		if (rbnode->right == rbnode) {
+		if (right == rbnode) {
 			bpf_printk("WARNING: Inconsistent tree, node %p is its own right child", rbnode);
 			return -EINVAL;
 		}
 
 		if (rbnode->is_red) {
-			if (rbnode->left && rbnode->left->is_red) {
-				bpf_printk("WARNING: Inconsistent tree. Parent has %p has red child %p", rbnode, rbnode->left);
+			if (left && left->is_red) {
+				bpf_printk("WARNING: Inconsistent tree. Parent has %p has red child %p", rbnode, left);
 				return -EINVAL;
 			}
-			if (rbnode->right && rbnode->right->is_red) {
-				bpf_printk("WARNING: Inconsistent tree. Parent has %p has red child %p", rbnode, rbnode->right);
+			if (right && right->is_red) {
+				bpf_printk("WARNING: Inconsistent tree. Parent has %p has red child %p", rbnode, right);
 				return -EINVAL;
 			}
-		} else if (rbnode->parent && rbnode->parent->child[1 - rbnode_dir(rbnode)] == NULL) {
+		} else if (parent && rbnode_child(parent, 1 - rbnode_dir(rbnode)) == NULL) {
 			bpf_printk("WARNING: Inconsistent tree. Black node %p has no sibling", rbnode);
 			return -EINVAL;
 		}
@@ -56,6 +56,17 @@ struct sdt_pool chunk_pool;
 /* Protected by alloc_lock. */
 struct scx_alloc_stats alloc_stats;
 
+/*
+ * How many free slabs scx_alloc_refill() keeps in each pool reserve, and how
+ * many pages above SDT_TASK_ALLOC_STACK_MIN it keeps in the preallocation
+ * stack. Can be set by userspace before loading.
+ */
+__u64 scx_alloc_watermark = 4;
+
+/* Reserves of the data pools, protected by alloc_pool_lock. */
+static struct sdt_reserve __arena sdt_reserves[SDT_MAX_RESERVES];
+static __u64 nr_sdt_reserves;
+
 static
 u64 scx_next_pow2(__u64 n)
 {
@@ -193,28 +204,61 @@ void __arena *scx_alloc_from_pool(struct sdt_pool *pool,
 	return ptr;
 }
 
-/* Allocate element from the pool. Must be called with a then pool lock held. */
+/*
+ * Allocate element from a data pool. If the current slab is spent, take the
+ * next one from the pool's reserve, and only allocate arena pages inline if
+ * the reserve ran dry.
+ */
 static
-void __arena *scx_alloc_from_pool_sleepable(struct sdt_pool *pool)
+void __arena *scx_alloc_from_data_pool(struct sdt_pool *pool)
 {
-	__u64 elem_size, max_elems;
-	void __arena *slab;
+	struct sdt_reserve __arena *reserve = pool->reserve;
+	void __arena *slab = NULL;
+	__u64 nr_pages;
 	void __arena *ptr;
 
-	elem_size = pool->elem_size;
-	max_elems = pool->max_elems;
+	nr_pages = div_round_up(pool->max_elems * pool->elem_size, PAGE_SIZE);
 
-	/* If the chunk is spent, get a new one. */
-	if (pool->idx >= max_elems) {
-		slab = bpf_arena_alloc_pages(&arena, NULL,
-			div_round_up(max_elems * elem_size, PAGE_SIZE), NUMA_NO_NODE, 0);
+	bpf_spin_lock(&alloc_pool_lock);
+
+	if (pool->idx < pool->max_elems)
+		goto out;
+
+	if (reserve && reserve->idx > 0 && reserve->idx <= SDT_POOL_RESERVE_MAX) {
+		reserve->idx -= 1;
+		pool->slab = reserve->slabs[reserve->idx];
+		pool->idx = 0;
+
+		__sync_fetch_and_add(&alloc_stats.reserve_hits, 1);
+		goto out;
+	}
+
+	bpf_spin_unlock(&alloc_pool_lock);
+
+	__sync_fetch_and_add(&alloc_stats.reserve_misses, 1);
+
+	slab = bpf_arena_alloc_pages(&arena, NULL, nr_pages, NUMA_NO_NODE, 0);
+	if (!slab)
+		return NULL;
+
+	bpf_spin_lock(&alloc_pool_lock);
+
+	/* Only install the new slab if nobody beat us to it. */
+	if (pool->idx >= pool->max_elems) {
 		pool->slab = slab;
 		pool->idx = 0;
+		slab = NULL;
 	}
 
-	ptr = (void __arena *)((__u64) pool->slab + elem_size * pool->idx);
+out:
+	ptr = (void __arena *)((__u64) pool->slab + pool->elem_size * pool->idx);
 	pool->idx += 1;
 
+	bpf_spin_unlock(&alloc_pool_lock);
+
+	if (slab)
+		bpf_arena_free_pages(&arena, slab, nr_pages);
+
 	return ptr;
 }
 
@@ -258,6 +302,140 @@ static int pool_set_size(struct sdt_pool *pool, __u64 data_size, __u64 nr_pages)
 	return 0;
 }
 
+/* Give a data pool a reserve of slabs to be kept full by scx_alloc_refill(). */
+static void pool_add_reserve(struct sdt_pool *pool)
+{
+	struct sdt_reserve __arena *reserve;
+	__u64 idx;
+
+	idx = __sync_fetch_and_add(&nr_sdt_reserves, 1);
+	if (idx >= SDT_MAX_RESERVES) {
+		bpf_printk("%s: out of reserves, allocator will grow inline", __func__);
+		return;
+	}
+
+	reserve = &sdt_reserves[idx];
+	reserve->nr_pages = div_round_up(pool->max_elems * pool->elem_size, PAGE_SIZE);
+	reserve->idx = 0;
+
+	pool->reserve = reserve;
+}
+
+/*
+ * Top up the preallocation stack. Returns the number of pages added.
+ */
+static __u64 scx_alloc_refill_stack(struct scx_alloc_stack __arena *stack, __u64 target)
+{
+	void __arena *slab;
+	__u64 added = 0;
+	bool full;
+
+	if (target > SDT_TASK_ALLOC_STACK_MAX)
+		target = SDT_TASK_ALLOC_STACK_MAX;
+
+	while (stack->idx < target && can_loop) {
+		slab = bpf_arena_alloc_pages(&arena, NULL, 1, NUMA_NO_NODE, 0);
+		if (!slab)
+			break;
+
+		bpf_spin_lock(&alloc_lock);
+		full = stack->idx >= SDT_TASK_ALLOC_STACK_MAX;
+		if (!full) {
+			stack->stack[stack->idx] = slab;
+			stack->idx += 1;
+			alloc_stats.arena_pages_used += 1;
+		}
+		bpf_spin_unlock(&alloc_lock);
+
+		if (full) {
+			bpf_arena_free_pages(&arena, slab, 1);
+			break;
+		}
+
+		added += 1;
+	}
+
+	return added;
+}
+
+/*
+ * Top up a data pool reserve. Returns the number of pages added.
+ */
+static __u64 scx_alloc_refill_reserve(struct sdt_reserve __arena *reserve, __u64 target)
+{
+	__u64 nr_pages = reserve->nr_pages;
+	void __arena *slab;
+	__u64 added = 0;
+	bool full;
+
+	if (target > SDT_POOL_RESERVE_MAX)
+		target = SDT_POOL_RESERVE_MAX;
+
+	while (reserve->idx < target && can_loop) {
+		slab = bpf_arena_alloc_pages(&arena, NULL, nr_pages, NUMA_NO_NODE, 0);
+		if (!slab)
+			break;
+
+		bpf_spin_lock(&alloc_pool_lock);
+		full = reserve->idx >= SDT_POOL_RESERVE_MAX;
+		if (!full) {
+			reserve->slabs[reserve->idx] = slab;
+			reserve->idx += 1;
+		}
+		bpf_spin_unlock(&alloc_pool_lock);
+
+		if (full) {
+			bpf_arena_free_pages(&arena, slab, nr_pages);
+			break;
+		}
+
+		added += nr_pages;
+	}
+
+	return added;
+}
+
+/*
+ * Bring the preallocation stack and every data pool reserve back up to the
+ * watermark, so that allocations from non-sleepable contexts do not have to
+ * allocate arena pages inline. Must be called from a sleepable context, e.g.
+ * periodically through the scx_alloc_refill_reserves syscall program.
+ */
+__weak
+int scx_alloc_refill(void)
+{
+	struct scx_alloc_stack __arena *stack = prealloc_stack;
+	__u64 watermark = scx_alloc_watermark;
+	__u64 start, elapsed, added = 0;
+	__u64 i, nr_reserves;
+
+	scx_arena_subprog_init();
+
+	start = bpf_ktime_get_ns();
+
+	if (stack)
+		added += scx_alloc_refill_stack(stack, SDT_TASK_ALLOC_STACK_MIN + watermark);
+
+	nr_reserves = nr_sdt_reserves;
+	if (nr_reserves > SDT_MAX_RESERVES)
+		nr_reserves = SDT_MAX_RESERVES;
+
+	for (i = zero; i < nr_reserves && can_loop; i++)
+		added += scx_alloc_refill_reserve(&sdt_reserves[i], watermark);
+
+	elapsed = bpf_ktime_get_ns() - start;
+
+	bpf_spin_lock(&alloc_lock);
+	alloc_stats.refills += 1;
+	alloc_stats.refill_pages += added;
+	alloc_stats.refill_ns_last = elapsed;
+	if (elapsed > alloc_stats.refill_ns_max)
+		alloc_stats.refill_ns_max = elapsed;
+	bpf_spin_unlock(&alloc_lock);
+
+	return 0;
+}
+
 /* initialize the whole thing, maybe misnomer */
 __hidden int
 scx_alloc_init(struct scx_allocator *alloc, __u64 data_size)
@@ -302,7 +480,9 @@ scx_alloc_init(struct scx_allocator *alloc, __u64 data_size)
 
 	bpf_spin_unlock(&alloc_lock);
 
-	return 0;
+	pool_add_reserve(&alloc->pool);
+
+	return scx_alloc_refill();
 }
 
 static
@@ -531,8 +711,10 @@ u64 scx_alloc_internal(struct scx_allocator *alloc)
 
 	/* On success, call returns with the lock taken. */
 	ret = scx_alloc_attempt(stack);
-	if (ret != 0)
+	if (ret != 0) {
+		__sync_fetch_and_add(&alloc_stats.alloc_failures, 1);
 		return (u64)NULL;
+	}
 
 	/* We unlock if we encounter an error in the function. */
 	desc = desc_find_empty(alloc->root, stack, &idx);
@@ -540,6 +722,7 @@ u64 scx_alloc_internal(struct scx_allocator *alloc)
 	bpf_spin_unlock(&alloc_lock);
 
 	if (unlikely(desc == NULL)) {
+		__sync_fetch_and_add(&alloc_stats.alloc_failures, 1);
 		bpf_printk("%s: failed to find empty tree key", __func__);
 		return (u64)NULL;
 	}
@@ -550,8 +733,9 @@ u64 scx_alloc_internal(struct scx_allocator *alloc)
 	pos = idx & (SDT_TASK_ENTS_PER_CHUNK - 1);
 	data = chunk->data[pos];
 	if (!data) {
-		data = scx_alloc_from_pool_sleepable(&alloc->pool);
+		data = scx_alloc_from_data_pool(&alloc->pool);
 		if (!data) {
+			__sync_fetch_and_add(&alloc_stats.alloc_failures, 1);
 			scx_alloc_free_idx(alloc, idx);
 			bpf_printk("%s: failed to allocate data from pool", __func__);
 			return (u64)NULL;
@@ -1360,6 +1544,29 @@ void scx_buddy_free_internal(struct scx_buddy *buddy, u64 addr)
 	bpf_spin_unlock(&buddy->lock);
 }
 
+/**
+ * scx_alloc_refill_reserves - BPF program to refill the allocator reserves
+ * from userspace, see scx_alloc_refill().
+ */
+SEC("syscall")
+int scx_alloc_refill_reserves(void *ctx)
+{
+	return scx_alloc_refill();
+}
+
+/**
+ * scx_alloc_get_stats - BPF program to copy the allocator statistics out to
+ * userspace.
+ *
+ * @ctx: Where to copy alloc_stats.
+ */
+SEC("syscall")
+int scx_alloc_get_stats(struct scx_alloc_stats *ctx)
+{
+	*ctx = alloc_stats;
+	return 0;
+}
+
 /**
  * scx_userspace_arena_alloc_pages - BPF program to enable allocating arena pages
  * explicitly from userspace.
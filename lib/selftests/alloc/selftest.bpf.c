@@ -26,6 +26,12 @@ int alloc_selftest(void)
 		return ret;
 	}
 
+	ret = buddy_mag_selftest();
+	if (ret) {
+		bpf_printk("buddy_mag_selftest failed with %d", ret);
+		return ret;
+	}
+
 	bpf_printk("Alloc selftests successful.");
 
 	return 0;
@@ -5,9 +5,13 @@
  * GNU General Public License version 2.
  */
 
+#define _GNU_SOURCE
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <bpf/libbpf.h>
@@ -277,6 +281,192 @@ selftest_alloc(selftest *skel)
 }
 
 
+/*
+ * Buddy magazine stress test. Run the same alloc/free bursts from one thread
+ * per CPU, first against the plain allocator and then with per-CPU magazines
+ * in front of it, and compare the throughput of the two.
+ */
+
+#define MAG_STRESS_ITERS (1ULL << 14)
+
+struct mag_stress_thread {
+	pthread_t tid;
+	int cpu;
+	int prog_fd;
+	pthread_barrier_t *barrier;
+	struct buddy_mag_stress_args args;
+	int ret;
+};
+
+static void *mag_stress_thread_fn(void *arg)
+{
+	struct mag_stress_thread *thread = arg;
+	struct bpf_test_run_opts opts;
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(thread->cpu, &cpus);
+	thread->ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+	opts = (struct bpf_test_run_opts) {
+		.sz = sizeof(opts),
+		.ctx_in = &thread->args,
+		.ctx_size_in = sizeof(thread->args),
+	};
+
+	pthread_barrier_wait(thread->barrier);
+
+	if (thread->ret)
+		return NULL;
+
+	thread->ret = bpf_prog_test_run_opts(thread->prog_fd, &opts);
+	if (!thread->ret)
+		thread->ret = opts.retval;
+
+	return NULL;
+}
+
+static int
+mag_stress_run(selftest *skel, bool magazines, struct buddy_mag_stats *stats,
+	       u64 *ops, u64 *failed, u64 *ns)
+{
+	struct buddy_mag_stress_args init_args;
+	struct mag_stress_thread *threads;
+	struct bpf_test_run_opts opts;
+	pthread_barrier_t barrier;
+	struct timespec start, end;
+	int nthreads, nr_cpus;
+	cpu_set_t online;
+	int ret, cpu, i;
+
+	nr_cpus = get_nprocs_conf();
+
+	ret = sched_getaffinity(0, sizeof(online), &online);
+	VALIDATE_PERROR(ret, "sched_getaffinity");
+
+	nthreads = CPU_COUNT(&online);
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!threads)
+		return -ENOMEM;
+
+	init_args = (struct buddy_mag_stress_args) {
+		.magazines = magazines,
+		.nr_cpus = nr_cpus,
+	};
+
+	opts = (struct bpf_test_run_opts) {
+		.sz = sizeof(opts),
+		.ctx_in = &init_args,
+		.ctx_size_in = sizeof(init_args),
+	};
+
+	ret = selftest_fd(bpf_program__fd(skel->progs.buddy_mag_stress_init), &opts);
+	if (ret || opts.retval) {
+		free(threads);
+		return ret ? ret : opts.retval;
+	}
+
+	pthread_barrier_init(&barrier, NULL, nthreads + 1);
+
+	for (cpu = 0, i = 0; cpu < nr_cpus && i < nthreads; cpu++) {
+		if (!CPU_ISSET(cpu, &online))
+			continue;
+
+		threads[i] = (struct mag_stress_thread) {
+			.cpu = cpu,
+			.prog_fd = bpf_program__fd(skel->progs.buddy_mag_stress),
+			.barrier = &barrier,
+			.args = {
+				.magazines = magazines,
+				.iters = MAG_STRESS_ITERS,
+			},
+		};
+
+		ret = pthread_create(&threads[i].tid, NULL, mag_stress_thread_fn, &threads[i]);
+		VALIDATE_PERROR(ret, "pthread_create");
+		i += 1;
+	}
+
+	pthread_barrier_wait(&barrier);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	*ops = *failed = 0;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i].tid, NULL);
+		if (threads[i].ret && !ret)
+			ret = threads[i].ret;
+
+		*ops += threads[i].args.ops;
+		*failed += threads[i].args.failed;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*ns = (end.tv_sec - start.tv_sec) * 1000 * 1000 * 1000ULL +
+	      end.tv_nsec - start.tv_nsec;
+
+	pthread_barrier_destroy(&barrier);
+	free(threads);
+
+	opts = (struct bpf_test_run_opts) {
+		.sz = sizeof(opts),
+		.ctx_in = stats,
+		.ctx_size_in = sizeof(*stats),
+	};
+
+	if (selftest_fd(bpf_program__fd(skel->progs.buddy_mag_stress_fini), &opts) && !ret)
+		ret = -EINVAL;
+
+	return ret;
+}
+
+static int
+selftest_buddy_mag_stress(selftest *skel)
+{
+	struct buddy_mag_stats stats;
+	u64 ops, failed, ns;
+	double plain, mag;
+	u64 lookups;
+	int ret;
+
+	ret = selftest_arena_alloc_reserve(skel);
+	if (ret)
+		return ret;
+
+	ret = selftest_asan_init(skel);
+	if (ret)
+		return ret;
+
+	printf("===START buddy_mag_stress START===\n");
+
+	ret = mag_stress_run(skel, false, &stats, &ops, &failed, &ns);
+	if (ret) {
+		fprintf(stderr, "plain stress run failed with %d\n", ret);
+		return ret;
+	}
+
+	plain = (double)ops * 1000 / ns;
+	printf("plain:     %lu allocs (%lu failed), %.2f Mops/s\n", ops, failed, plain);
+
+	ret = mag_stress_run(skel, true, &stats, &ops, &failed, &ns);
+	if (ret) {
+		fprintf(stderr, "magazine stress run failed with %d\n", ret);
+		return ret;
+	}
+
+	mag = (double)ops * 1000 / ns;
+	lookups = stats.hits + stats.misses;
+	printf("magazines: %lu allocs (%lu failed), %.2f Mops/s, %.2fx\n",
+	       ops, failed, mag, plain > 0 ? mag / plain : 0);
+	printf("magazines: hit rate %.2f%% (%lu hits, %lu misses), %lu frees cached, %lu flushes\n",
+	       lookups ? stats.hits * 100.0 / lookups : 0.0,
+	       stats.hits, stats.misses, stats.frees, stats.flushes);
+
+	printf("====END buddy_mag_stress END=====\n\n");
+
+	return 0;
+}
+
+
 int bump_rlimit(void)
 {
 	int ret;
@@ -334,6 +524,7 @@ int main(int argc, char *argv[])
 	}
 
 	run_test(selftest_alloc);
+	run_test(selftest_buddy_mag_stress);
 
 #ifdef BPF_ARENA_ASAN
 	run_test(selftest_asan);
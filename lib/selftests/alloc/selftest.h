@@ -11,8 +11,17 @@
 
 int bump_selftest(void);
 int buddy_selftest(void);
+int buddy_mag_selftest(void);
 int stack_selftest(void);
 
+struct buddy_mag_stress_args {
+	u64 magazines;	/* Put per-CPU magazines in front of the allocator. */
+	u64 nr_cpus;
+	u64 iters;	/* Alloc/free bursts to run. */
+	u64 ops;	/* Allocations done, returned to userspace. */
+	u64 failed;	/* Failed allocations, returned to userspace. */
+};
+
 #ifndef __BPF__
 
 /* Dummy "definition" for userspace. */
@@ -0,0 +1,235 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ * Copyright (c) 2025 Meta Platforms, Inc. and affiliates.
+ */
+
+#include <alloc/common.h>
+
+#include <alloc/asan.h>
+#include <alloc/buddy.h>
+
+#include "selftest.h"
+
+private(ST_BUDDY_MAG) struct buddy st_mag_buddy;
+static u64 __arena st_mag_buddy_lock;
+
+#define MAG_NR_BLOCKS (2 * BUDDY_MAG_DEPTH + BUDDY_MAG_BATCH)
+static u64 __arena mag_blocks[MAG_NR_BLOCKS];
+
+static int buddy_mag_selftest_setup(void)
+{
+	int ret;
+
+	ret = buddy_init(&st_mag_buddy,
+			 (arena_spinlock_t __arena *)&st_mag_buddy_lock);
+	if (ret)
+		return ret;
+
+	/* The selftests only ever run on the current CPU. */
+	ret = buddy_mag_init(&st_mag_buddy, bpf_get_smp_processor_id() + 1);
+	if (ret)
+		buddy_destroy(&st_mag_buddy);
+
+	return ret;
+}
+
+/* A freed block is handed back out on the next allocation of its class. */
+static int buddy_mag_selftest_reuse()
+{
+	struct buddy_mag_stats stats;
+	u64 first, second;
+	int ret;
+
+	ret = buddy_mag_selftest_setup();
+	if (ret)
+		return ret;
+
+	first = buddy_alloc_internal(&st_mag_buddy, 64);
+	if (!first) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	buddy_free_internal(&st_mag_buddy, first);
+
+	second = buddy_alloc_internal(&st_mag_buddy, 60);
+	if (second != first) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	buddy_free_internal(&st_mag_buddy, second);
+
+	buddy_mag_stats(&st_mag_buddy, &stats);
+	if (stats.misses != 1 || stats.hits != 1 || stats.frees != 2) {
+		bpf_printk("reuse: hits %ld misses %ld frees %ld",
+			   stats.hits, stats.misses, stats.frees);
+		ret = -EINVAL;
+	}
+
+out:
+	buddy_destroy(&st_mag_buddy);
+
+	return ret;
+}
+
+/* Blocks above the cached size classes bypass the magazines. */
+static int buddy_mag_selftest_large()
+{
+	struct buddy_mag_stats stats;
+	u64 mem;
+	int ret;
+
+	ret = buddy_mag_selftest_setup();
+	if (ret)
+		return ret;
+
+	mem = buddy_alloc_internal(&st_mag_buddy,
+				   BUDDY_MIN_ALLOC_BYTES << BUDDY_MAG_NR_CLASSES);
+	if (!mem) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	buddy_free_internal(&st_mag_buddy, mem);
+
+	buddy_mag_stats(&st_mag_buddy, &stats);
+	if (stats.hits || stats.misses || stats.frees)
+		ret = -EINVAL;
+
+out:
+	buddy_destroy(&st_mag_buddy);
+
+	return ret;
+}
+
+/*
+ * Allocate more blocks than a magazine holds and free them all. This goes
+ * through several refills and at least one flush. Every block must be
+ * distinct, which we check by writing its index into it.
+ */
+static int buddy_mag_selftest_overflow()
+{
+	struct buddy_mag_stats stats;
+	u64 __arena *mem;
+	int ret = 0;
+	u32 i;
+
+	ret = buddy_mag_selftest_setup();
+	if (ret)
+		return ret;
+
+	bpf_for(i, 0, MAG_NR_BLOCKS) {
+		mem = (u64 __arena *)buddy_alloc_internal(&st_mag_buddy, 32);
+		if (!mem) {
+			ret = -ENOMEM;
+			goto out;
+		}
+
+		*mem = i;
+		mag_blocks[i] = (u64)mem;
+	}
+
+	bpf_for(i, 0, MAG_NR_BLOCKS) {
+		mem = (u64 __arena *)mag_blocks[i];
+		if (*mem != i) {
+			bpf_printk("overflow: block %u overwritten", i);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		buddy_free_internal(&st_mag_buddy, (u64)mem);
+	}
+
+	buddy_mag_stats(&st_mag_buddy, &stats);
+	if (stats.misses < MAG_NR_BLOCKS / BUDDY_MAG_BATCH || !stats.flushes) {
+		bpf_printk("overflow: misses %ld flushes %ld",
+			   stats.misses, stats.flushes);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = buddy_mag_drain(&st_mag_buddy);
+
+out:
+	buddy_destroy(&st_mag_buddy);
+
+	return ret;
+}
+
+#define BUDDY_MAG_ALLOC_SELFTEST(suffix) ALLOC_SELFTEST(buddy_mag_selftest_##suffix)
+
+__weak int buddy_mag_selftest(void)
+{
+	BUDDY_MAG_ALLOC_SELFTEST(reuse);
+	BUDDY_MAG_ALLOC_SELFTEST(large);
+	BUDDY_MAG_ALLOC_SELFTEST(overflow);
+
+	return 0;
+}
+
+/*
+ * Stress test driven by userspace, which runs buddy_mag_stress() from one
+ * thread per CPU at the same time. Each round allocates a burst of task
+ * context-sized objects and frees them again, as a fork/exit storm would.
+ */
+
+#define MAG_STRESS_BURST (16)
+
+SEC("syscall")
+int buddy_mag_stress_init(struct buddy_mag_stress_args *args)
+{
+	int ret;
+
+	ret = buddy_init(&st_mag_buddy,
+			 (arena_spinlock_t __arena *)&st_mag_buddy_lock);
+	if (ret)
+		return ret;
+
+	if (!args->magazines)
+		return 0;
+
+	ret = buddy_mag_init(&st_mag_buddy, args->nr_cpus);
+	if (ret)
+		buddy_destroy(&st_mag_buddy);
+
+	return ret;
+}
+
+SEC("syscall")
+int buddy_mag_stress(struct buddy_mag_stress_args *args)
+{
+	size_t sizes[] = { 96, 192, 256, 512 };
+	u64 ptrs[MAG_STRESS_BURST];
+	u64 i, j;
+
+	for (i = 0; i < args->iters && can_loop; i++) {
+		for (j = 0; j < MAG_STRESS_BURST && can_loop; j++) {
+			ptrs[j] = buddy_alloc_internal(&st_mag_buddy,
+						       sizes[(i + j) % 4]);
+			if (!ptrs[j]) {
+				args->failed += 1;
+				continue;
+			}
+
+			*(u64 __arena *)ptrs[j] = j;
+		}
+
+		for (j = 0; j < MAG_STRESS_BURST && can_loop; j++) {
+			if (ptrs[j])
+				buddy_free_internal(&st_mag_buddy, ptrs[j]);
+		}
+
+		args->ops += MAG_STRESS_BURST;
+	}
+
+	return 0;
+}
+
+SEC("syscall")
+int buddy_mag_stress_fini(struct buddy_mag_stats *stats)
+{
+	buddy_mag_stats(&st_mag_buddy, stats);
+
+	return buddy_destroy(&st_mag_buddy);
+}
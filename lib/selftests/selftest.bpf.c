@@ -48,6 +48,15 @@ int arena_selftest(void)
 	SELFTEST_RUN(SCX_SELFTEST_ID_TOPOLOGY,
 		     scx_selftest_topology,
 		     "scx_selftest_topology");
+	SELFTEST_RUN(SCX_SELFTEST_ID_CALQ,
+		     scx_selftest_calq,
+		     "scx_selftest_calq");
+	SELFTEST_RUN(SCX_SELFTEST_ID_WSTEAL,
+		     scx_selftest_wsteal,
+		     "scx_selftest_wsteal");
+	SELFTEST_RUN(SCX_SELFTEST_ID_CPUMASK,
+		     scx_selftest_cpumask,
+		     "scx_selftest_cpumask");
 
 	bpf_printk("Selftests successful.");
 
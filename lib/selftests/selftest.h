@@ -25,6 +25,9 @@ enum scx_selftest_id {
 	SCX_SELFTEST_ID_MINHEAP			= 4,
 	SCX_SELFTEST_ID_RBTREE			= 5,
 	SCX_SELFTEST_ID_TOPOLOGY		= 6,
+	SCX_SELFTEST_ID_CALQ			= 7,
+	SCX_SELFTEST_ID_WSTEAL			= 8,
+	SCX_SELFTEST_ID_CPUMASK			= 9,
 };
 
 #define SCX_SELFTEST(func, ...)		\
@@ -52,10 +55,13 @@ int scx_selftest_atq(void);
 int scx_selftest_dhq(void);
 int scx_selftest_bitmap(void);
 int scx_selftest_btree(void);
+int scx_selftest_calq(void);
+int scx_selftest_cpumask(void);
 int scx_selftest_lvqueue(void);
 int scx_selftest_minheap(void);
 int scx_selftest_rbtree(void);
 int scx_selftest_topology(void);
+int scx_selftest_wsteal(void);
 
 #ifndef __BPF__
 
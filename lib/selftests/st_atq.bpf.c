@@ -8,6 +8,7 @@
 
 #include <lib/sdt_task.h>
 #include <lib/atq.h>
+#include <lib/cpumask.h>
 
 #include "selftest.h"
 
@@ -353,6 +354,377 @@ int scx_selftest_atq_sized(u64 unused)
 	return 0;
 }
 
+/*
+ * Batched pops must return tasks in the same order as individual pops,
+ * including when a batch straddles the end of the queue.
+ */
+static inline
+int scx_selftest_atq_pop_batch_common(bool isfifo)
+{
+#define NTASKS_IN_QUEUE (32)
+#define POP_BATCH (5)
+	const unsigned int step = 13;
+	u64 __arena *batch;
+	u64 expected, vtime;
+	unsigned int ind;
+	task_ctx *taskc;
+	int ret, i, j, popped;
+	scx_atq_t *atq;
+
+	atq = isfifo ? fifo : prio;
+
+	batch = scx_static_alloc(POP_BATCH * sizeof(*batch), 1);
+	if (!batch)
+		return -ENOMEM;
+
+	for (i = 0, ind = 0; i < NTASKS_IN_QUEUE && can_loop; i++) {
+		tasks[ind]->pid = i;
+		tasks[ind]->vtime = ind;
+
+		if (isfifo)
+			ret = scx_atq_insert(atq, &tasks[ind]->common);
+		else
+			ret = scx_atq_insert_vtime(atq, &tasks[ind]->common, tasks[ind]->vtime);
+		if (ret) {
+			bpf_printk("atq insert failed with %d", ret);
+			return ret;
+		}
+
+		ind = (ind + step) % NTASKS_IN_QUEUE;
+	}
+
+	expected = 0;
+	vtime = 0;
+	popped = 0;
+
+	while (popped < NTASKS_IN_QUEUE && can_loop) {
+		ret = scx_atq_pop_batch(atq, batch, POP_BATCH);
+		if (ret <= 0 || ret > POP_BATCH) {
+			bpf_printk("atq batch pop returned %d", ret);
+			return -EINVAL;
+		}
+
+		if (ret != POP_BATCH && popped + ret != NTASKS_IN_QUEUE) {
+			bpf_printk("atq short batch pop (%d) with tasks left", ret);
+			return -EINVAL;
+		}
+
+		for (j = 0; j < ret && j < POP_BATCH && can_loop; j++) {
+			taskc = (task_ctx *)batch[j];
+			if (!taskc || taskc->common.atq) {
+				bpf_printk("atq batch pop returned bad task");
+				return -EINVAL;
+			}
+
+			if (isfifo && taskc->pid != expected) {
+				bpf_printk("fifo atq batch popped %ld, expected %ld",
+					   taskc->pid, expected);
+				return -EINVAL;
+			} else if (!isfifo && taskc->vtime < vtime) {
+				bpf_printk("vtime atq batch popped %ld after %ld",
+					   taskc->vtime, vtime);
+				return -EINVAL;
+			}
+
+			expected += 1;
+			vtime = taskc->vtime;
+		}
+
+		popped += ret;
+	}
+
+	if (scx_atq_nr_queued(atq)) {
+		bpf_printk("atq not empty after batch pops");
+		return -EINVAL;
+	}
+
+	if (scx_atq_pop_batch(atq, batch, POP_BATCH)) {
+		bpf_printk("atq batch pop on empty queue returned tasks");
+		return -EINVAL;
+	}
+
+	if (rb_integrity_check(atq->tree))
+		return -EINVAL;
+
+#undef POP_BATCH
+#undef NTASKS_IN_QUEUE
+	return 0;
+}
+
+__weak
+int scx_selftest_atq_pop_batch_fifo(u64 unused)
+{
+	return scx_selftest_atq_pop_batch_common(true);
+}
+
+__weak
+int scx_selftest_atq_pop_batch_vtime(u64 unused)
+{
+	return scx_selftest_atq_pop_batch_common(false);
+}
+
+/*
+ * Per-CPU staging tests. Syscall programs run on a single CPU, so emulate
+ * concurrent producers by staging on behalf of different CPUs and
+ * interleaving pops (which drain the rings) with the inserts.
+ */
+static inline
+int scx_selftest_atq_percpu_common(bool isfifo)
+{
+#define NTASKS_IN_QUEUE (48)
+	const unsigned int step = 13;
+	scx_atq_t *atq;
+	task_ctx *taskc;
+	unsigned int ind;
+	u64 expected, vtime;
+	int ret, i, popped;
+	s32 cpu;
+
+	atq = (scx_atq_t *)scx_atq_create_flags(isfifo, SCX_ATQ_INF_CAPACITY,
+			SCX_ATQ_F_PERCPU);
+	if (!atq)
+		return -ENOMEM;
+
+	popped = 0;
+	expected = 0;
+	vtime = 0;
+
+	for (i = 0, ind = 0; i < NTASKS_IN_QUEUE && can_loop; i++) {
+		tasks[ind]->pid = i;
+		tasks[ind]->vtime = ind;
+
+		/* Spread inserts across every CPU's ring. */
+		cpu = i % nr_cpu_ids;
+
+		ret = scx_atq_insert_vtime_cpu(atq, &tasks[ind]->common,
+				isfifo ? SCX_ATQ_FIFO : tasks[ind]->vtime, cpu);
+		if (ret) {
+			bpf_printk("percpu atq insert failed with %d", ret);
+			return ret;
+		}
+
+		if (scx_atq_nr_queued(atq) != i + 1 - popped) {
+			bpf_printk("percpu atq size %d, expected %d",
+				   scx_atq_nr_queued(atq), i + 1 - popped);
+			return -EINVAL;
+		}
+
+		ind = (ind + step) % NTASKS_IN_QUEUE;
+
+		/* Only pop in FIFO mode, vtime keys are not monotonic. */
+		if (!isfifo || i % 3 != 2)
+			continue;
+
+		taskc = (task_ctx *)scx_atq_pop(atq);
+		if (!taskc || taskc->pid != expected) {
+			bpf_printk("percpu fifo atq popped out of order at %d", i);
+			return -EINVAL;
+		}
+
+		expected += 1;
+		popped += 1;
+	}
+
+	while (scx_atq_nr_queued(atq) && can_loop) {
+		taskc = (task_ctx *)scx_atq_pop(atq);
+		if (!taskc) {
+			bpf_printk("percpu atq pop returned NULL");
+			return -EINVAL;
+		}
+
+		if (isfifo && taskc->pid != expected) {
+			bpf_printk("percpu fifo atq popped %ld, expected %ld",
+				   taskc->pid, expected);
+			return -EINVAL;
+		} else if (!isfifo && taskc->vtime < vtime) {
+			bpf_printk("percpu vtime atq popped %ld after %ld",
+				   taskc->vtime, vtime);
+			return -EINVAL;
+		}
+
+		expected += 1;
+		vtime = taskc->vtime;
+		popped += 1;
+	}
+
+	if (popped != NTASKS_IN_QUEUE || atq->nr_staged) {
+		bpf_printk("percpu atq popped %d tasks, %ld still staged",
+			   popped, atq->nr_staged);
+		return -EINVAL;
+	}
+
+	if (rb_integrity_check(atq->tree))
+		return -EINVAL;
+
+#undef NTASKS_IN_QUEUE
+	return 0;
+}
+
+__weak
+int scx_selftest_atq_percpu_fifo(u64 unused)
+{
+	return scx_selftest_atq_percpu_common(true);
+}
+
+__weak
+int scx_selftest_atq_percpu_vtime(u64 unused)
+{
+	return scx_selftest_atq_percpu_common(false);
+}
+
+/*
+ * Hammer a single CPU's ring past its size so inserts spill into the
+ * locked path, then make sure FIFO order holds across both paths.
+ */
+__weak
+int scx_selftest_atq_percpu_overflow(u64 unused)
+{
+	const int ntasks = 2 * SCX_ATQ_PCPU_RING_SIZE;
+	scx_atq_t *atq;
+	task_ctx *taskc;
+	int ret, i;
+
+	atq = (scx_atq_t *)scx_atq_create_flags(true, SCX_ATQ_INF_CAPACITY,
+			SCX_ATQ_F_PERCPU);
+	if (!atq)
+		return -ENOMEM;
+
+	for (i = 0; i < ntasks && i < NTASKS && can_loop; i++) {
+		tasks[i]->pid = i;
+
+		ret = scx_atq_insert_vtime_cpu(atq, &tasks[i]->common, SCX_ATQ_FIFO, 0);
+		if (ret) {
+			bpf_printk("percpu atq overflow insert failed with %d", ret);
+			return ret;
+		}
+	}
+
+	if (atq->nr_staged != SCX_ATQ_PCPU_RING_SIZE) {
+		bpf_printk("percpu atq staged %ld tasks", atq->nr_staged);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < ntasks && can_loop; i++) {
+		taskc = (task_ctx *)scx_atq_pop(atq);
+		if (!taskc || taskc->pid != i) {
+			bpf_printk("percpu atq overflow popped out of order at %d", i);
+			return -EINVAL;
+		}
+	}
+
+	if (scx_atq_nr_queued(atq)) {
+		bpf_printk("percpu atq not empty after overflow test");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Cancelling a task that is still in a staging ring must find it. */
+__weak
+int scx_selftest_atq_percpu_cancel(u64 unused)
+{
+	scx_atq_t *atq;
+	int ret, i;
+
+	atq = (scx_atq_t *)scx_atq_create_flags(false, SCX_ATQ_INF_CAPACITY,
+			SCX_ATQ_F_PERCPU);
+	if (!atq)
+		return -ENOMEM;
+
+	for (i = 0; i < 4 && can_loop; i++) {
+		ret = scx_atq_insert_vtime_cpu(atq, &tasks[i]->common, i, i % nr_cpu_ids);
+		if (ret)
+			return ret;
+	}
+
+	ret = scx_atq_cancel(&tasks[2]->common);
+	if (ret) {
+		bpf_printk("percpu atq cancel failed with %d", ret);
+		return ret;
+	}
+
+	if (tasks[2]->common.atq || scx_atq_nr_queued(atq) != 3) {
+		bpf_printk("percpu atq cancel left %d tasks", scx_atq_nr_queued(atq));
+		return -EINVAL;
+	}
+
+	for (i = 0; i < 3 && can_loop; i++) {
+		if ((task_ctx *)scx_atq_pop(atq) == tasks[2]) {
+			bpf_printk("percpu atq popped cancelled task");
+			return -EINVAL;
+		}
+	}
+
+	return scx_atq_nr_queued(atq) ? -EINVAL : 0;
+}
+
+/*
+ * Cancel a task whose staging slot is claimed but not yet published, by
+ * replaying what scx_atq_stage() does by hand. The publish must then not
+ * bring the task back, and a later insert must not end up with two nodes.
+ */
+__weak
+int scx_selftest_atq_percpu_cancel_unpublished(u64 unused)
+{
+	scx_task_common *taskc = &tasks[0]->common;
+	scx_atq_pcpu_t *pcpu;
+	scx_atq_t *atq;
+	u64 tail;
+	int ret;
+
+	atq = (scx_atq_t *)scx_atq_create_flags(false, SCX_ATQ_INF_CAPACITY,
+			SCX_ATQ_F_PERCPU);
+	if (!atq)
+		return -ENOMEM;
+
+	pcpu = &atq->pcpu[0];
+	tail = pcpu->tail;
+	pcpu->tail = tail + 1;
+
+	taskc->node.key = 1;
+	taskc->node.value = (u64)taskc;
+	taskc->staged_cpu = 0;
+	taskc->staged_pos = tail;
+	taskc->atq = atq;
+	atq->size += 1;
+
+	ret = scx_atq_cancel(taskc);
+	if (ret) {
+		bpf_printk("percpu atq unpublished cancel failed with %d", ret);
+		return ret;
+	}
+
+	if (taskc->atq || scx_atq_nr_queued(atq)) {
+		bpf_printk("percpu atq unpublished cancel left the task queued");
+		return -EINVAL;
+	}
+
+	/* The late publish loses to the cancellation. */
+	if (!cmpxchg((u64 __arena *)&pcpu->ring[tail % SCX_ATQ_PCPU_RING_SIZE],
+		     0, (u64)taskc)) {
+		bpf_printk("percpu atq unpublished slot was not cancelled");
+		return -EINVAL;
+	}
+	atq->nr_staged += 1;
+
+	ret = scx_atq_insert_vtime(atq, taskc, 2);
+	if (ret)
+		return ret;
+
+	if ((scx_task_common *)scx_atq_pop(atq) != taskc) {
+		bpf_printk("percpu atq lost the reinserted task");
+		return -EINVAL;
+	}
+
+	if (scx_atq_pop(atq) || scx_atq_nr_queued(atq) || atq->nr_staged) {
+		bpf_printk("percpu atq popped the cancelled task");
+		return -EINVAL;
+	}
+
+	return rb_integrity_check(atq->tree) ? -EINVAL : 0;
+}
+
 __weak
 int scx_selftest_atq(void)
 {
@@ -375,6 +747,13 @@ int scx_selftest_atq(void)
 	SCX_ATQ_SELFTEST(peek_nodestruct);
 	SCX_ATQ_SELFTEST(peek_empty);
 	SCX_ATQ_SELFTEST(sized);
+	SCX_ATQ_SELFTEST(pop_batch_fifo);
+	SCX_ATQ_SELFTEST(pop_batch_vtime);
+	SCX_ATQ_SELFTEST(percpu_fifo);
+	SCX_ATQ_SELFTEST(percpu_vtime);
+	SCX_ATQ_SELFTEST(percpu_overflow);
+	SCX_ATQ_SELFTEST(percpu_cancel);
+	SCX_ATQ_SELFTEST(percpu_cancel_unpublished);
 
 	return 0;
 }
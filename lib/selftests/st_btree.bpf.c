@@ -525,6 +525,265 @@ __weak int scx_selftest_btree_add_remove_circular_reverse(btree_t __arg_arena *b
 	return 0;
 }
 
+/* Walk the whole tree in both directions and check the ordering. */
+__weak int scx_selftest_btree_cursor(u64 unused)
+{
+	const size_t numkeys = sizeof(morekeys) / sizeof(morekeys[0]);
+	struct bt_cursor cur;
+	u64 key, value, last;
+	u64 forward, backward;
+	btree_t *btree;
+	int ret, i;
+
+	btree = bt_create_fanout(BT_MINFANOUT);
+	if (!btree)
+		return -ENOMEM;
+
+	if (bt_cursor_first(btree, &cur) != -ENOENT)
+		return 1;
+
+	bpf_for(i, 0, numkeys) {
+		ret = bt_insert(btree, morekeys[i], 2 * morekeys[i], true);
+		if (ret)
+			return 2;
+	}
+
+	ret = bt_cursor_first(btree, &cur);
+	if (ret)
+		return 3;
+
+	forward = 0;
+	last = 0;
+	do {
+		if (bt_cursor_get(&cur, &key, &value))
+			return 4;
+
+		if ((forward && key <= last) || value != 2 * key)
+			return 5;
+
+		last = key;
+		forward += 1;
+	} while (!bt_cursor_next(&cur) && can_loop);
+
+	/* Step back from the end. */
+	ret = bt_cursor_seek(btree, &cur, last);
+	if (ret)
+		return 6;
+
+	backward = 0;
+	do {
+		if (bt_cursor_get(&cur, &key, &value))
+			return 7;
+
+		if ((backward && key >= last) || value != 2 * key)
+			return 8;
+
+		last = key;
+		backward += 1;
+	} while (!bt_cursor_prev(&cur) && can_loop);
+
+	if (forward != backward) {
+		bpf_printk("cursor walked %ld keys forward, %ld backward", forward, backward);
+		return 9;
+	}
+
+	/* Seeking must land on the key itself or the next larger one. */
+	bpf_for(i, 0, numkeys) {
+		if (bt_cursor_seek(btree, &cur, morekeys[i]))
+			return 10;
+
+		if (bt_cursor_get(&cur, &key, NULL) || key != morekeys[i])
+			return 11;
+
+		if (bt_cursor_seek(btree, &cur, morekeys[i] + 1))
+			continue;
+
+		if (bt_cursor_get(&cur, &key, NULL) || key <= morekeys[i])
+			return 12;
+	}
+
+	/* Past the largest key. */
+	if (bt_cursor_seek(btree, &cur, (u64)-1) != -ENOENT)
+		return 13;
+
+	return 0;
+}
+
+/* Pop contiguous ranges, including ones that span and empty many leaves. */
+__weak int scx_selftest_btree_range_pop(u64 unused)
+{
+	const u64 nkeys = 300, max = 128;
+	u64 __arena *keys, __arena *values;
+	struct bt_cursor cur;
+	btree_t *btree;
+	u64 key, value;
+	int ret, i;
+
+	keys = scx_static_alloc(max * sizeof(*keys), 8);
+	values = scx_static_alloc(max * sizeof(*values), 8);
+	if (!keys || !values)
+		return -ENOMEM;
+
+	btree = bt_create_fanout(BT_MINFANOUT);
+	if (!btree)
+		return -ENOMEM;
+
+	for (key = 0; key < nkeys && can_loop; key++) {
+		ret = bt_insert(btree, key, 2 * key, false);
+		if (ret)
+			return 1;
+	}
+
+	/* Bounded by max. */
+	ret = bt_range_pop(btree, 50, 150, keys, values, 30);
+	if (ret != 30)
+		return 2;
+
+	bpf_for(i, 0, 30) {
+		if (keys[i] != 50 + i || values[i] != 2 * (50 + i))
+			return 3;
+	}
+
+	/* Bounded by the end of the range. */
+	ret = bt_range_pop(btree, 50, 150, keys, values, max);
+	if (ret != 70)
+		return 4;
+
+	bpf_for(i, 0, 70) {
+		if (keys[i] != 80 + i)
+			return 5;
+	}
+
+	if (bt_range_pop(btree, 50, 150, keys, values, max))
+		return 6;
+
+	if (bt_find(btree, 49, &value) || !bt_find(btree, 50, &value))
+		return 7;
+
+	if (!bt_find(btree, 149, &value) || bt_find(btree, 150, &value))
+		return 8;
+
+	/* The remaining keys must still be in order. */
+	if (bt_cursor_seek(btree, &cur, 40))
+		return 9;
+
+	for (key = 40; key < 60 && can_loop; key++) {
+		if (bt_cursor_get(&cur, &value, NULL))
+			return 10;
+
+		if (value != (key < 50 ? key : key + 100))
+			return 11;
+
+		bt_cursor_next(&cur);
+	}
+
+	/* Drain everything without caring about the keys. */
+	for (i = 0; i < nkeys && can_loop; i++) {
+		ret = bt_range_pop(btree, 0, (u64)-1, NULL, values, max);
+		if (ret < 0)
+			return 12;
+
+		if (!ret)
+			break;
+	}
+
+	if (bt_cursor_first(btree, &cur) != -ENOENT)
+		return 13;
+
+	/* The tree must still be usable. */
+	ret = bt_insert(btree, 7, 14, false);
+	if (ret || bt_find(btree, 7, &value) || value != 14)
+		return 14;
+
+	return 0;
+}
+
+/* Rerun the insertion and removal tests on trees of the extreme fanouts. */
+__weak int scx_selftest_btree_fanout(u64 unused)
+{
+	const u64 fanouts[] = { BT_MINFANOUT, BT_MAXFANOUT };
+	btree_t *btree;
+	int ret, i;
+
+	if (bt_create_fanout(BT_MINFANOUT - 1) || bt_create_fanout(BT_MAXFANOUT + 1))
+		return 1;
+
+	bpf_for(i, 0, sizeof(fanouts) / sizeof(fanouts[0])) {
+		btree = bt_create_fanout(fanouts[i]);
+		if (!btree)
+			return -ENOMEM;
+
+		ret = scx_selftest_btree_insert_many(btree);
+		if (ret)
+			return ret;
+
+		ret = scx_selftest_btree_remove_many(btree);
+		if (ret)
+			return ret;
+
+		ret = scx_selftest_btree_add_remove_circular(btree);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Microbenchmark: insert a permutation of keys, look them all up and
+ * remove them for a range of fanouts. Reports ns per operation, does not
+ * fail on performance.
+ */
+__weak int scx_selftest_btree_bench(u64 unused)
+{
+	const u64 fanouts[] = { BT_MINFANOUT, BT_DEFAULT_FANOUT, 10, BT_MAXFANOUT };
+	const u32 step = 389, nkeys = 1024;
+	u64 start, insert_ns, find_ns, remove_ns;
+	u64 key, value;
+	btree_t *btree;
+	u32 ind, j;
+	int ret, i;
+
+	bpf_for(i, 0, sizeof(fanouts) / sizeof(fanouts[0])) {
+		btree = bt_create_fanout(fanouts[i]);
+		if (!btree)
+			return -ENOMEM;
+
+		start = bpf_ktime_get_ns();
+		for (j = 0, ind = 0; j < nkeys && can_loop; j++) {
+			if ((ret = bt_insert(btree, ind, ind, false)))
+				return ret;
+
+			ind = (ind + step) % nkeys;
+		}
+		insert_ns = bpf_ktime_get_ns() - start;
+
+		start = bpf_ktime_get_ns();
+		for (j = 0, ind = 0; j < nkeys && can_loop; j++) {
+			if ((ret = bt_find(btree, ind, &value)))
+				return ret;
+
+			if (value != ind)
+				return -EINVAL;
+
+			ind = (ind + step) % nkeys;
+		}
+		find_ns = bpf_ktime_get_ns() - start;
+
+		start = bpf_ktime_get_ns();
+		for (key = 0; key < nkeys && can_loop; key++) {
+			if ((ret = bt_remove(btree, key)))
+				return ret;
+		}
+		remove_ns = bpf_ktime_get_ns() - start;
+
+		bpf_printk("btree bench: fanout %ld, %d keys, insert %ld ns/op, find %ld ns/op, remove %ld ns/op",
+			   fanouts[i], nkeys, insert_ns / nkeys, find_ns / nkeys,
+			   remove_ns / nkeys);
+	}
+
+	return 0;
+}
 
 #define SCX_BTREE_SELFTEST(suffix) SCX_SELFTEST(scx_selftest_btree_ ## suffix, btree)
 
@@ -550,6 +809,10 @@ int scx_selftest_btree(void)
 	SCX_BTREE_SELFTEST(remove_many);
 	SCX_BTREE_SELFTEST(add_remove_circular_reverse);
 	SCX_BTREE_SELFTEST(add_remove_circular);
+	SCX_SELFTEST(scx_selftest_btree_cursor, (u64)NULL);
+	SCX_SELFTEST(scx_selftest_btree_range_pop, (u64)NULL);
+	SCX_SELFTEST(scx_selftest_btree_fanout, (u64)NULL);
+	SCX_SELFTEST(scx_selftest_btree_bench, (u64)NULL);
 
 	return 0;
 }
@@ -0,0 +1,399 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ * Copyright (c) 2025 Meta Platforms, Inc. and affiliates.
+ */
+
+#include <scx/common.bpf.h>
+
+#include <lib/sdt_task.h>
+#include <lib/calq.h>
+#include <lib/atq.h>
+
+#include "selftest.h"
+
+#define CALQ_NODES (1024)
+
+static rbnode_t *calq_nodes;
+
+static int scx_selftest_calq_alloc_nodes(void)
+{
+	if (calq_nodes)
+		return 0;
+
+	calq_nodes = scx_static_alloc(CALQ_NODES * sizeof(*calq_nodes), 8);
+	if (!calq_nodes)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static __always_inline
+rbnode_t *calq_node(u32 i)
+{
+	return &calq_nodes[i % CALQ_NODES];
+}
+
+/* With single-key buckets the calendar queue must sort exactly. */
+__weak
+int scx_selftest_calq_exact(u64 unused)
+{
+	const u32 step = 37, ntests = 256;
+	u64 key, value;
+	scx_calq_t *calq;
+	rbnode_t *node;
+	u32 ind, i;
+	int ret;
+
+	calq = scx_calq_create(0);
+	if (!calq)
+		return -ENOMEM;
+
+	/* Insert a permutation of [1000, 1000 + ntests). */
+	for (i = 0, ind = 0; i < ntests && can_loop; i++) {
+		node = calq_node(i);
+		node->key = 1000 + ind;
+		node->value = ind;
+
+		ret = scx_calq_insert_node(calq, node);
+		if (ret)
+			return ret;
+
+		ind = (ind + step) % ntests;
+	}
+
+	if (scx_calq_nr_queued(calq) != ntests)
+		return -EINVAL;
+
+	for (i = 0; i < ntests && can_loop; i++) {
+		ret = scx_calq_pop(calq, &key, &value);
+		if (ret) {
+			bpf_printk("calq pop %d failed with %d", i, ret);
+			return ret;
+		}
+
+		if (key != 1000 + i || value != i) {
+			bpf_printk("calq popped key %ld, expected %ld", key, 1000 + i);
+			return -EINVAL;
+		}
+	}
+
+	if (scx_calq_pop(calq, &key, &value) != -ENOENT)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Keys that span many windows go through the overflow tree and must still
+ * come out in order at bucket granularity.
+ */
+__weak
+int scx_selftest_calq_overflow(u64 unused)
+{
+	const u32 step = 101, ntests = 512, shift = 4;
+	u64 key, value, last_slot = 0;
+	scx_calq_t *calq;
+	rbnode_t *node;
+	u32 ind, i;
+	int ret;
+
+	calq = scx_calq_create(shift);
+	if (!calq)
+		return -ENOMEM;
+
+	for (i = 0, ind = 0; i < ntests && can_loop; i++) {
+		node = calq_node(i);
+		/* Spread keys over 32 windows' worth of buckets. */
+		node->key = (u64)ind * 16 * 16;
+		node->value = ind;
+
+		ret = scx_calq_insert_node(calq, node);
+		if (ret)
+			return ret;
+
+		ind = (ind + step) % ntests;
+	}
+
+	if (!calq->nr_overflow) {
+		bpf_printk("calq overflow test never overflowed");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < ntests && can_loop; i++) {
+		ret = scx_calq_pop(calq, &key, &value);
+		if (ret)
+			return ret;
+
+		if ((key >> shift) < last_slot) {
+			bpf_printk("calq popped slot %ld after %ld", key >> shift, last_slot);
+			return -EINVAL;
+		}
+
+		last_slot = key >> shift;
+	}
+
+	return scx_calq_nr_queued(calq) ? -EINVAL : 0;
+}
+
+/* Keys below the window must pop before everything already queued. */
+__weak
+int scx_selftest_calq_below_window(u64 unused)
+{
+	u64 key, value;
+	scx_calq_t *calq;
+	int ret, i;
+
+	calq = scx_calq_create(0);
+	if (!calq)
+		return -ENOMEM;
+
+	for (i = 0; i < 4 && can_loop; i++) {
+		calq_node(i)->key = 500 + i;
+		ret = scx_calq_insert_node(calq, calq_node(i));
+		if (ret)
+			return ret;
+	}
+
+	/* Move the window start up. */
+	if (scx_calq_pop(calq, &key, &value) || key != 500)
+		return -EINVAL;
+
+	calq_node(4)->key = 10;
+	ret = scx_calq_insert_node(calq, calq_node(4));
+	if (ret)
+		return ret;
+
+	if (scx_calq_least(calq, &key, &value) || key != 10)
+		return -EINVAL;
+
+	for (i = 0; i < 4 && can_loop; i++) {
+		if (scx_calq_pop(calq, &key, &value))
+			return -EINVAL;
+	}
+
+	return scx_calq_nr_queued(calq) ? -EINVAL : 0;
+}
+
+/* Several keys below the window must still pop in key order. */
+__weak
+int scx_selftest_calq_below_window_order(u64 unused)
+{
+#define NR_BELOW	5
+#define NR_EXPECTED	8
+	const u64 below[NR_BELOW] = { 40, 10, 30, 10, 20 };
+	const u64 expected[NR_EXPECTED] = { 10, 10, 20, 30, 40, 501, 502, 503 };
+	u64 key, value;
+	scx_calq_t *calq;
+	int ret, i;
+
+	calq = scx_calq_create(2);
+	if (!calq)
+		return -ENOMEM;
+
+	for (i = 0; i < 4 && can_loop; i++) {
+		calq_node(i)->key = 500 + i;
+		ret = scx_calq_insert_node(calq, calq_node(i));
+		if (ret)
+			return ret;
+	}
+
+	/* Move the window start up. */
+	if (scx_calq_pop(calq, &key, &value) || key != 500)
+		return -EINVAL;
+
+	for (i = 0; i < NR_BELOW && can_loop; i++) {
+		calq_node(4 + i)->key = below[i];
+		calq_node(4 + i)->value = i;
+		ret = scx_calq_insert_node(calq, calq_node(4 + i));
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < NR_EXPECTED && can_loop; i++) {
+		if (scx_calq_pop(calq, &key, &value)) {
+			bpf_printk("calq below window pop %d failed", i);
+			return -EINVAL;
+		}
+
+		if (key != expected[i]) {
+			bpf_printk("calq below window popped %ld, expected %ld",
+				   key, expected[i]);
+			return -EINVAL;
+		}
+
+		/* Equal keys keep their insertion order. */
+		if (i == 0 && value != 1)
+			return -EINVAL;
+	}
+
+#undef NR_EXPECTED
+#undef NR_BELOW
+	return scx_calq_nr_queued(calq) ? -EINVAL : 0;
+}
+
+/* Removal works for both calendar and overflow nodes. */
+__weak
+int scx_selftest_calq_remove(u64 unused)
+{
+	rbnode_t *near, *far;
+	u64 key, value;
+	scx_calq_t *calq;
+	int ret;
+
+	calq = scx_calq_create(0);
+	if (!calq)
+		return -ENOMEM;
+
+	near = calq_node(0);
+	far = calq_node(1);
+
+	near->key = 5;
+	far->key = 5 + 10 * SCX_CALQ_NR_BUCKETS;
+
+	if ((ret = scx_calq_insert_node(calq, near)))
+		return ret;
+
+	if ((ret = scx_calq_insert_node(calq, far)))
+		return ret;
+
+	if (far->tid.idx != SCX_CALQ_IDX_OVERFLOW)
+		return -EINVAL;
+
+	if ((ret = scx_calq_remove_node(calq, far)))
+		return ret;
+
+	if ((ret = scx_calq_remove_node(calq, near)))
+		return ret;
+
+	if (scx_calq_nr_queued(calq))
+		return -EINVAL;
+
+	if (scx_calq_pop(calq, &key, &value) != -ENOENT)
+		return -EINVAL;
+
+	return 0;
+}
+
+/* The ATQ API must behave the same on top of the calendar queue. */
+__weak
+int scx_selftest_calq_atq(u64 unused)
+{
+	scx_task_common *taskc, *popped;
+	u64 last = 0;
+	scx_atq_t *atq;
+	int ret, i;
+
+	atq = (scx_atq_t *)scx_atq_create_flags(false, SCX_ATQ_INF_CAPACITY,
+			SCX_ATQ_F_CALENDAR);
+	if (!atq)
+		return -ENOMEM;
+
+	for (i = 0; i < 64 && can_loop; i++) {
+		taskc = scx_static_alloc(sizeof(*taskc), 8);
+		if (!taskc)
+			return -ENOMEM;
+
+		/* Vtimes 1ms apart, spread over more than one window. */
+		ret = scx_atq_insert_vtime(atq, taskc, ((i * 7) % 64) * 1000 * 1000);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < 64 && can_loop; i++) {
+		popped = (scx_task_common *)scx_atq_pop(atq);
+		if (!popped || popped->node.key < last)
+			return -EINVAL;
+
+		last = popped->node.key;
+	}
+
+	return scx_atq_nr_queued(atq) ? -EINVAL : 0;
+}
+
+/*
+ * Microbenchmark: insert a batch of clustered keys and pop them all, on
+ * both the rbtree and the calendar queue. Reports ns per operation, does
+ * not fail on performance.
+ */
+__weak
+int scx_selftest_calq_bench(u64 unused)
+{
+	const u32 step = 389, nkeys = CALQ_NODES;
+	u64 key, value, start, rb_ns, calq_ns;
+	scx_calq_t *calq;
+	rbtree_t *rbtree;
+	rbnode_t *node;
+	u32 ind, i;
+	int ret;
+
+	rbtree = rb_create(RB_NOALLOC, RB_DUPLICATE);
+	calq = scx_calq_create(SCX_CALQ_VTIME_SHIFT);
+	if (!rbtree || !calq)
+		return -ENOMEM;
+
+	start = bpf_ktime_get_ns();
+	for (i = 0, ind = 0; i < nkeys && can_loop; i++) {
+		node = calq_node(i);
+		/* 10us apart, the whole set fits in one calendar window. */
+		node->key = (u64)ind * 10 * 1000;
+		node->value = ind;
+
+		if ((ret = rb_insert_node(rbtree, node)))
+			return ret;
+
+		ind = (ind + step) % nkeys;
+	}
+
+	for (i = 0; i < nkeys && can_loop; i++) {
+		if ((ret = rb_pop(rbtree, &key, &value)))
+			return ret;
+	}
+	rb_ns = bpf_ktime_get_ns() - start;
+
+	start = bpf_ktime_get_ns();
+	for (i = 0, ind = 0; i < nkeys && can_loop; i++) {
+		node = calq_node(i);
+		node->key = (u64)ind * 10 * 1000;
+		node->value = ind;
+
+		if ((ret = scx_calq_insert_node(calq, node)))
+			return ret;
+
+		ind = (ind + step) % nkeys;
+	}
+
+	for (i = 0; i < nkeys && can_loop; i++) {
+		if ((ret = scx_calq_pop(calq, &key, &value)))
+			return ret;
+	}
+	calq_ns = bpf_ktime_get_ns() - start;
+
+	bpf_printk("calq bench: %d keys, rbtree %ld ns/op, calq %ld ns/op",
+		   nkeys, rb_ns / (2 * nkeys), calq_ns / (2 * nkeys));
+
+	rb_destroy(rbtree);
+
+	return 0;
+}
+
+#define SCX_CALQ_SELFTEST(suffix) SCX_SELFTEST(scx_selftest_calq_ ## suffix, (u64)NULL)
+
+__weak
+int scx_selftest_calq(void)
+{
+	int ret;
+
+	ret = scx_selftest_calq_alloc_nodes();
+	if (ret)
+		return ret;
+
+	SCX_CALQ_SELFTEST(exact);
+	SCX_CALQ_SELFTEST(overflow);
+	SCX_CALQ_SELFTEST(below_window);
+	SCX_CALQ_SELFTEST(below_window_order);
+	SCX_CALQ_SELFTEST(remove);
+	SCX_CALQ_SELFTEST(atq);
+	SCX_CALQ_SELFTEST(bench);
+
+	return 0;
+}
@@ -0,0 +1,337 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ * Copyright (c) 2025 Meta Platforms, Inc. and affiliates.
+ */
+
+#include <scx/common.bpf.h>
+#include <lib/sdt_task.h>
+
+#include <lib/cpumask.h>
+#include <lib/percpu.h>
+
+#include "selftest.h"
+
+#define ST_CPUMASK_MAX_CPUS (SCXMASK_NLONG * 64)
+
+/* How many times each CPU was handed out by a claim. */
+static u8 __arena st_claims[ST_CPUMASK_MAX_CPUS];
+
+static void st_cpumask_fill(scx_bitmap_t __arg_arena mask)
+{
+	u32 cpu;
+
+	scx_bitmap_clear(mask);
+	bpf_for(cpu, 0, nr_cpu_ids)
+		scx_bitmap_set_cpu(cpu, mask);
+}
+
+/* The first-set kernels must agree with the bit-at-a-time accessors. */
+__weak
+int scx_selftest_cpumask_find(scx_bitmap_t __arg_arena mask, scx_bitmap_t __arg_arena other)
+{
+	u32 last = nr_cpu_ids - 1;
+
+	scx_bitmap_clear(mask);
+	scx_bitmap_clear(other);
+
+	if (scx_bitmap_ffs(mask) != -ENOENT)
+		return 1;
+
+	scx_bitmap_set_cpu(last, mask);
+	if (scx_bitmap_ffs(mask) != last)
+		return 2;
+
+	/* Searches wrap around the end of the mask. */
+	scx_bitmap_set_cpu(0, mask);
+	if (scx_bitmap_find_from(mask, last) != last)
+		return 3;
+
+	if (last > 1 && scx_bitmap_find_from(mask, 1) != last)
+		return 4;
+
+	if (scx_bitmap_find_from(mask, nr_cpu_ids) != 0)
+		return 5;
+
+	/* The AND variants only see the common bits. */
+	if (scx_bitmap_ffs_and(mask, other) != -ENOENT)
+		return 6;
+
+	scx_bitmap_set_cpu(last, other);
+	if (scx_bitmap_ffs_and(mask, other) != last)
+		return 7;
+
+	if (scx_bitmap_find_and_from(mask, other, 0) != last)
+		return 8;
+
+	return 0;
+}
+
+/*
+ * Claims from several emulated CPUs at once must never hand out the same
+ * idle CPU twice, even while CPUs keep going idle again. Selftests run on
+ * a single CPU, so the claimers interleave instead of racing for real.
+ */
+__weak
+int scx_selftest_cpumask_claim(scx_bitmap_t __arg_arena idle, scx_bitmap_t __arg_arena mask)
+{
+	u32 claimer, total = 0;
+	u32 round;
+	s32 cpu;
+	u32 i;
+
+	st_cpumask_fill(idle);
+	st_cpumask_fill(mask);
+
+	bpf_for(i, 0, ST_CPUMASK_MAX_CPUS)
+		st_claims[i] = 0;
+
+	for (round = 0; total < nr_cpu_ids && round < 2 * nr_cpu_ids && can_loop; round++) {
+		claimer = round % nr_cpu_ids;
+
+		cpu = scx_bitmap_claim_and_from(idle, mask, claimer);
+		if (cpu < 0 || cpu >= nr_cpu_ids)
+			return 1;
+
+		if (scx_bitmap_test_cpu(cpu, idle))
+			return 2;
+
+		st_claims[cpu] += 1;
+		total += 1;
+	}
+
+	bpf_for(i, 0, nr_cpu_ids) {
+		if (st_claims[i] != 1)
+			return 3;
+	}
+
+	if (scx_bitmap_claim_and_from(idle, mask, 0) != -ENOENT)
+		return 4;
+
+	/* CPUs going idle become claimable again, within the mask only. */
+	st_cpumask_fill(idle);
+	scx_bitmap_clear(mask);
+	bpf_for(i, 0, nr_cpu_ids) {
+		if (!(i % 2))
+			scx_bitmap_set_cpu(i, mask);
+	}
+
+	for (i = 0; i < nr_cpu_ids && can_loop; i++) {
+		cpu = scx_bitmap_claim_and_from(idle, mask, i);
+		if (cpu == -ENOENT)
+			break;
+
+		if (cpu < 0 || cpu % 2)
+			return 5;
+	}
+
+	if (i != div_round_up(nr_cpu_ids, 2))
+		return 6;
+
+	/* The odd CPUs were never claimed. */
+	if (nr_cpu_ids > 1 && !scx_bitmap_test_cpu(1, idle))
+		return 7;
+
+	return 0;
+}
+
+/* The idle tracking entry points keep scx_idle_cpumask in sync. */
+__weak
+int scx_selftest_cpumask_idle(scx_bitmap_t __arg_arena mask)
+{
+	s32 cpu, again;
+
+	if (scx_bitmap_idle_init(false))
+		return 1;
+
+	st_cpumask_fill(mask);
+
+	cpu = scx_bitmap_pick_idle_cpu(mask, 0);
+	if (cpu < 0 || cpu >= nr_cpu_ids)
+		return 2;
+
+	if (scx_bitmap_test_cpu(cpu, scx_idle_cpumask))
+		return 3;
+
+	/* Only the picked CPU is in the mask, so it cannot be picked again. */
+	scx_bitmap_clear(mask);
+	scx_bitmap_set_cpu(cpu, mask);
+
+	if (scx_bitmap_pick_idle_cpu(mask, 0) != -EBUSY)
+		return 4;
+
+	if (scx_bitmap_idle_update(cpu, true))
+		return 5;
+
+	again = scx_bitmap_pick_idle_cpu(mask, 0);
+	if (again != cpu)
+		return 6;
+
+	scx_bitmap_idle_update(cpu, false);
+	if (scx_bitmap_test_cpu(cpu, scx_idle_cpumask))
+		return 7;
+
+	/* Leave every CPU idle for whoever runs next. */
+	st_cpumask_fill(scx_idle_cpumask);
+
+	return 0;
+}
+
+/*
+ * Run the bitmap operations at every width up to 5 words, which covers the
+ * unrolled 1, 2 and 4 word cases as well as the generic loop. The masks are
+ * full-size so that any width fits, whatever the host's mask_size.
+ */
+__weak
+int scx_selftest_cpumask_widths(void)
+{
+	scx_bitmap_t a, b, dst;
+	size_t saved = mask_size;
+	u32 width, i;
+	int ret = 0;
+
+	a = scx_static_alloc(sizeof(*a), 8);
+	b = scx_static_alloc(sizeof(*b), 8);
+	dst = scx_static_alloc(sizeof(*dst), 8);
+	if (!a || !b || !dst)
+		return -ENOMEM;
+
+	bpf_for(width, 1, 6) {
+		mask_size = width;
+
+		bpf_for(i, 0, SCXMASK_NLONG) {
+			a->bits[i] = 0;
+			b->bits[i] = 0;
+			dst->bits[i] = ~0ULL;
+		}
+
+		/* Only the words past the width are set. */
+		if (width < SCXMASK_NLONG)
+			a->bits[width] = b->bits[width] = 1;
+
+		scx_bitmap_clear(dst);
+		if (!scx_bitmap_empty(a) || !scx_bitmap_empty(dst) ||
+		    scx_bitmap_intersects(a, b)) {
+			ret = 1;
+			break;
+		}
+
+		/* The last word of the width, a superset of it in b. */
+		a->bits[width - 1] = 0x5;
+		b->bits[width - 1] = 0x7;
+
+		if (scx_bitmap_empty(a) || !scx_bitmap_intersects(a, b) ||
+		    !scx_bitmap_subset(b, a) || scx_bitmap_subset(a, b)) {
+			ret = 2;
+			break;
+		}
+
+		scx_bitmap_and(dst, a, b);
+		if (dst->bits[width - 1] != 0x5 || dst->bits[width] != 0) {
+			ret = 3;
+			break;
+		}
+
+		scx_bitmap_or(dst, a, b);
+		if (dst->bits[width - 1] != 0x7) {
+			ret = 4;
+			break;
+		}
+
+		scx_bitmap_copy(dst, b);
+		if (dst->bits[width - 1] != 0x7 || dst->bits[width] != 0) {
+			ret = 5;
+			break;
+		}
+	}
+
+	mask_size = saved;
+
+	return ret;
+}
+
+/*
+ * Compare the word-level paths against the bpf_cpumask round trip that
+ * scx_bitmap_pick_idle_cpu() and scx_bitmap_any_distribute() used to do.
+ * The round trip copies the mask into a bpf_cpumask and back, the claim
+ * just scans and clears words of the arena mask.
+ */
+__weak
+int scx_selftest_cpumask_bench(scx_bitmap_t __arg_arena idle, scx_bitmap_t __arg_arena mask)
+{
+	struct bpf_cpumask __kptr *bpf = scx_percpu_bpfmask();
+	const u32 iters = 4096;
+	u64 start, roundtrip_ns, arena_ns;
+	s32 cpu;
+	u32 i;
+
+	if (!bpf)
+		return 1;
+
+	st_cpumask_fill(mask);
+	st_cpumask_fill(idle);
+
+	start = bpf_ktime_get_ns();
+	bpf_for(i, 0, iters) {
+		scx_bitmap_to_bpf(bpf, mask);
+		cpu = bpf_cpumask_any_distribute(cast_mask(bpf));
+		scx_bitmap_from_bpf(mask, cast_mask(bpf));
+		if (cpu >= nr_cpu_ids)
+			return 2;
+	}
+	roundtrip_ns = bpf_ktime_get_ns() - start;
+
+	start = bpf_ktime_get_ns();
+	bpf_for(i, 0, iters) {
+		cpu = scx_bitmap_claim_and_from(idle, mask, i % nr_cpu_ids);
+		if (cpu < 0 || cpu >= nr_cpu_ids)
+			return 3;
+
+		/* Put it back so that the mask never runs dry. */
+		scx_bitmap_vacate_cpu(idle, cpu);
+	}
+	arena_ns = bpf_ktime_get_ns() - start;
+
+	bpf_printk("cpumask: %d CPUs, round trip %ld ns/op, arena claim %ld ns/op",
+		   nr_cpu_ids, roundtrip_ns / iters, arena_ns / iters);
+
+	start = bpf_ktime_get_ns();
+	bpf_for(i, 0, iters) {
+		cpu = scx_bitmap_any_distribute(mask);
+		if (cpu >= nr_cpu_ids)
+			return 4;
+	}
+	arena_ns = bpf_ktime_get_ns() - start;
+
+	bpf_printk("cpumask: any_distribute %ld ns/op", arena_ns / iters);
+
+	return 0;
+}
+
+#define SCX_CPUMASK_SELFTEST(suffix, ...) SCX_SELFTEST(scx_selftest_cpumask_ ## suffix, __VA_ARGS__)
+
+__weak
+int scx_selftest_cpumask(void)
+{
+	scx_bitmap_t idle, mask;
+
+	idle = scx_bitmap_alloc();
+	if (!idle)
+		return -ENOMEM;
+
+	mask = scx_bitmap_alloc();
+	if (!mask) {
+		scx_bitmap_free(idle);
+		return -ENOMEM;
+	}
+
+	SCX_CPUMASK_SELFTEST(find, idle, mask);
+	SCX_CPUMASK_SELFTEST(claim, idle, mask);
+	SCX_CPUMASK_SELFTEST(idle, mask);
+	SCX_CPUMASK_SELFTEST(widths);
+	SCX_CPUMASK_SELFTEST(bench, idle, mask);
+
+	scx_bitmap_free(mask);
+	scx_bitmap_free(idle);
+
+	return 0;
+}
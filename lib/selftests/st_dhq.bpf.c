@@ -505,6 +505,333 @@ int scx_selftest_dhq_fail_vtime_with_fifo(u64 unused)
 	return 0;
 }
 
+/*
+ * Batched pops must follow the same ordering rules as scx_dhq_pop(): FIFO
+ * order per strand in alternating mode, global vtime order in priority mode.
+ */
+__weak
+int scx_selftest_dhq_pop_batch(u64 unused)
+{
+#define NTASKS_IN_QUEUE (8)
+	u64 __arena *batch;
+	u64 last_vtime = 0;
+	task_ctx *taskc, *task;
+	u64 last_even = 0, last_odd = 0;
+	scx_dhq_t *dhq;
+	int ret, i;
+
+	batch = scx_static_alloc(NTASKS_IN_QUEUE * sizeof(*batch), 1);
+	if (!batch)
+		return -ENOMEM;
+
+	/* Priority mode: batch must come out in global vtime order. */
+	dhq = dhq_prios[1];
+
+	for (i = 0; i < NTASKS_IN_QUEUE && can_loop; i++) {
+		task = dhq_tasks[i];
+		if (!task)
+			return -EINVAL;
+		barrier_var(task);
+
+		task->pid = i;
+		task->vtime = (i * 5) % NTASKS_IN_QUEUE + 1;
+
+		ret = scx_dhq_insert_vtime(dhq, (u64)task, task->vtime,
+					   (i % 2) ? SCX_DHQ_STRAND_A : SCX_DHQ_STRAND_B);
+		if (ret)
+			return ret;
+	}
+
+	ret = scx_dhq_pop_batch(dhq, batch, NTASKS_IN_QUEUE);
+	if (ret != NTASKS_IN_QUEUE) {
+		bpf_printk("DHQ batch pop returned %d", ret);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < NTASKS_IN_QUEUE && can_loop; i++) {
+		taskc = (task_ctx *)batch[i];
+		if (!taskc || taskc->vtime < last_vtime) {
+			bpf_printk("DHQ batch priority violation at %d", i);
+			return -EINVAL;
+		}
+		last_vtime = taskc->vtime;
+	}
+
+	/* Alternating FIFO mode: each strand stays in FIFO order. */
+	dhq = dhq_fifos[0];
+
+	for (i = 0; i < NTASKS_IN_QUEUE && can_loop; i++) {
+		task = dhq_tasks[i];
+		barrier_var(task);
+
+		task->pid = i + 1;
+
+		ret = scx_dhq_insert(dhq, (u64)task,
+				     (i % 2) ? SCX_DHQ_STRAND_A : SCX_DHQ_STRAND_B);
+		if (ret)
+			return ret;
+	}
+
+	/* Pop in two uneven batches to cross a batch boundary. */
+	ret = scx_dhq_pop_batch(dhq, batch, 3);
+	if (ret != 3)
+		return -EINVAL;
+
+	ret = scx_dhq_pop_batch(dhq, &batch[3], NTASKS_IN_QUEUE);
+	if (ret != NTASKS_IN_QUEUE - 3)
+		return -EINVAL;
+
+	for (i = 0; i < NTASKS_IN_QUEUE && can_loop; i++) {
+		taskc = (task_ctx *)batch[i];
+		if (!taskc)
+			return -EINVAL;
+
+		if (taskc->pid % 2 == 0) {
+			if (taskc->pid < last_even)
+				return -EINVAL;
+			last_even = taskc->pid;
+		} else {
+			if (taskc->pid < last_odd)
+				return -EINVAL;
+			last_odd = taskc->pid;
+		}
+	}
+
+	/* Strand batches only drain their own strand. */
+	ret = scx_dhq_insert(dhq, (u64)dhq_tasks[0], SCX_DHQ_STRAND_A);
+	if (ret)
+		return ret;
+
+	if (scx_dhq_pop_strand_batch(dhq, SCX_DHQ_STRAND_B, batch, NTASKS_IN_QUEUE) != 0)
+		return -EINVAL;
+
+	if (scx_dhq_pop_strand_batch(dhq, SCX_DHQ_STRAND_A, batch, NTASKS_IN_QUEUE) != 1)
+		return -EINVAL;
+
+	if (scx_dhq_nr_queued(dhq) != 0)
+		return -EINVAL;
+
+#undef NTASKS_IN_QUEUE
+	return 0;
+}
+
+/*
+ * Cancel queued tasks through their handles and reprioritize another one,
+ * as ops.dequeue and a weight change would.
+ */
+__weak
+int scx_selftest_dhq_cancel(u64 unused)
+{
+#define NTASKS_IN_QUEUE (8)
+	scx_minheap_handle_t *handles;
+	task_ctx *taskc, *task;
+	u64 last_vtime = 0;
+	scx_dhq_t *dhq;
+	int ret, i;
+
+	handles = scx_static_alloc(NTASKS_IN_QUEUE * sizeof(*handles), 1);
+	if (!handles)
+		return -ENOMEM;
+
+	dhq = dhq_prios[1];
+
+	for (i = 0; i < NTASKS_IN_QUEUE && can_loop; i++) {
+		task = dhq_tasks[i];
+		if (!task)
+			return -EINVAL;
+
+		task->pid = i;
+		task->vtime = (i * 7) % NTASKS_IN_QUEUE;
+
+		ret = scx_dhq_insert_vtime_indexed(dhq, (u64)task, task->vtime,
+						   (i % 2) ? SCX_DHQ_STRAND_A : SCX_DHQ_STRAND_B,
+						   &handles[i]);
+		if (ret)
+			return ret;
+	}
+
+	/* Cancel one task from each strand. */
+	if (scx_dhq_cancel(dhq, &handles[2]) || scx_dhq_cancel(dhq, &handles[5]))
+		return -EINVAL;
+
+	if (scx_dhq_nr_queued(dhq) != NTASKS_IN_QUEUE - 2 ||
+	    scx_dhq_nr_queued_strand(dhq, SCX_DHQ_STRAND_A) != NTASKS_IN_QUEUE / 2 - 1)
+		return -EINVAL;
+
+	/* Cancelling twice reports the task is gone. */
+	if (scx_dhq_cancel(dhq, &handles[2]) != -ENOENT)
+		return -EINVAL;
+
+	/* Move task 7 to the front of the queue. */
+	ret = scx_dhq_update_vtime(dhq, &handles[7], 0);
+	if (ret)
+		return ret;
+	dhq_tasks[7]->vtime = 0;
+
+	taskc = (task_ctx *)scx_dhq_pop(dhq);
+	if (taskc != dhq_tasks[7] && taskc != dhq_tasks[0]) {
+		bpf_printk("DHQ expected a vtime 0 task first");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < NTASKS_IN_QUEUE - 2 && can_loop; i++) {
+		if (i > 0)
+			taskc = (task_ctx *)scx_dhq_pop(dhq);
+
+		if (!taskc)
+			return -EINVAL;
+
+		if (taskc == dhq_tasks[2] || taskc == dhq_tasks[5]) {
+			bpf_printk("DHQ popped cancelled task %ld", taskc->pid);
+			return -EINVAL;
+		}
+
+		if (taskc->vtime < last_vtime)
+			return -EINVAL;
+		last_vtime = taskc->vtime;
+	}
+
+	if (scx_dhq_nr_queued(dhq) != 0)
+		return -EINVAL;
+
+	/* Popped tasks can not be cancelled. */
+	if (scx_dhq_cancel(dhq, &handles[7]) != -ENOENT)
+		return -EINVAL;
+
+#undef NTASKS_IN_QUEUE
+	return 0;
+}
+
+/*
+ * Queues with more than two strands: round-robin, lowest vtime and largest
+ * strand first across all strands, and the imbalance bound against the
+ * mean of the other strands.
+ */
+__weak
+int scx_selftest_dhq_nstrand(u64 unused)
+{
+#define NSTRANDS (4)
+#define NTASKS_IN_QUEUE (8)
+	u64 modes[] = { SCX_DHQ_MODE_ALTERNATING, SCX_DHQ_MODE_PRIORITY,
+			SCX_DHQ_MODE_BALANCED };
+	task_ctx *taskc, *task;
+	u64 last_vtime;
+	scx_dhq_t *dhq;
+	int ret, i, m;
+
+	/* Out of range strand counts are rejected. */
+	if (scx_dhq_create_strands(false, 64, SCX_DHQ_MODE_PRIORITY, 0, 0) ||
+	    scx_dhq_create_strands(false, 64, SCX_DHQ_MODE_PRIORITY, 0,
+				   SCX_DHQ_MAX_STRANDS + 1))
+		return -EINVAL;
+
+	for (m = 0; m < sizeof(modes) / sizeof(modes[0]) && can_loop; m++) {
+		dhq = (scx_dhq_t *)scx_dhq_create_strands(false, 64, modes[m], 0, NSTRANDS);
+		if (!dhq)
+			return -ENOMEM;
+
+		/* Task i goes to strand i % 4, strands 0 and 1 get two tasks. */
+		for (i = 0; i < NTASKS_IN_QUEUE - 2 && can_loop; i++) {
+			task = dhq_tasks[i];
+			if (!task)
+				return -EINVAL;
+
+			task->pid = i;
+			task->vtime = NTASKS_IN_QUEUE - i;
+
+			ret = scx_dhq_insert_vtime(dhq, (u64)task, task->vtime, i % NSTRANDS);
+			if (ret)
+				return ret;
+		}
+
+		if (scx_dhq_insert_vtime(dhq, (u64)dhq_tasks[0], 0, NSTRANDS) != -EINVAL)
+			return -EINVAL;
+
+		if (scx_dhq_nr_queued_strand(dhq, 0) != 2 ||
+		    scx_dhq_nr_queued_strand(dhq, 3) != 1)
+			return -EINVAL;
+
+		switch (modes[m]) {
+		case SCX_DHQ_MODE_ALTERNATING:
+			/* One task per strand in strand order, then the leftovers. */
+			for (i = 0; i < NTASKS_IN_QUEUE - 2 && can_loop; i++) {
+				taskc = (task_ctx *)scx_dhq_pop(dhq);
+				if (!taskc)
+					return -EINVAL;
+
+				if (i < NSTRANDS && taskc->pid % NSTRANDS != i) {
+					bpf_printk("DHQ round-robin pop %d from strand %ld",
+						   i, taskc->pid % NSTRANDS);
+					return -EINVAL;
+				}
+			}
+			break;
+
+		case SCX_DHQ_MODE_PRIORITY:
+			/* Global vtime order regardless of strand. */
+			last_vtime = 0;
+			for (i = 0; i < NTASKS_IN_QUEUE - 2 && can_loop; i++) {
+				taskc = (task_ctx *)scx_dhq_pop(dhq);
+				if (!taskc || taskc->vtime < last_vtime)
+					return -EINVAL;
+				last_vtime = taskc->vtime;
+			}
+			break;
+
+		case SCX_DHQ_MODE_BALANCED:
+			/* The two-task strands drain first. */
+			taskc = (task_ctx *)scx_dhq_pop(dhq);
+			if (!taskc || taskc->pid % NSTRANDS != 0)
+				return -EINVAL;
+
+			taskc = (task_ctx *)scx_dhq_pop(dhq);
+			if (!taskc || taskc->pid % NSTRANDS != 1)
+				return -EINVAL;
+
+			for (i = 2; i < NTASKS_IN_QUEUE - 2 && can_loop; i++) {
+				if (!scx_dhq_pop(dhq))
+					return -EINVAL;
+			}
+			break;
+		}
+
+		if (scx_dhq_nr_queued(dhq) != 0)
+			return -EINVAL;
+	}
+
+	/* A strand can only run max_imbalance ahead of the other strands. */
+	dhq = (scx_dhq_t *)scx_dhq_create_strands(false, 64, SCX_DHQ_MODE_PRIORITY, 2, NSTRANDS);
+	if (!dhq)
+		return -ENOMEM;
+
+	if (scx_dhq_insert_vtime(dhq, (u64)dhq_tasks[0], 1, 0) ||
+	    scx_dhq_insert_vtime(dhq, (u64)dhq_tasks[1], 2, 0))
+		return -EINVAL;
+
+	if (scx_dhq_insert_vtime(dhq, (u64)dhq_tasks[2], 3, 0) != -EAGAIN)
+		return -EINVAL;
+
+	/* Strands 1 and 2 filling up helps even though strand 3 is empty. */
+	if (scx_dhq_insert_vtime(dhq, (u64)dhq_tasks[3], 4, 1) ||
+	    scx_dhq_insert_vtime(dhq, (u64)dhq_tasks[4], 5, 2))
+		return -EINVAL;
+
+	if (scx_dhq_insert_vtime(dhq, (u64)dhq_tasks[2], 3, 0))
+		return -EINVAL;
+
+	if (scx_dhq_insert_vtime(dhq, (u64)dhq_tasks[5], 6, 0) != -EAGAIN)
+		return -EINVAL;
+
+	/* Auto-selection picks the emptiest strand. */
+	if (scx_dhq_insert_vtime(dhq, (u64)dhq_tasks[5], 6, SCX_DHQ_STRAND_AUTO) ||
+	    scx_dhq_nr_queued_strand(dhq, 3) != 1)
+		return -EINVAL;
+
+#undef NTASKS_IN_QUEUE
+#undef NSTRANDS
+	return 0;
+}
+
 #define SCX_DHQ_SELFTEST(suffix) SCX_SELFTEST(scx_selftest_dhq_ ## suffix, (u64)NULL)
 
 __weak
@@ -551,6 +878,9 @@ int scx_selftest_dhq(void)
 	SCX_DHQ_SELFTEST(peek);
 	SCX_DHQ_SELFTEST(peek_strand);
 	SCX_DHQ_SELFTEST(pop_strand);
+	SCX_DHQ_SELFTEST(pop_batch);
+	SCX_DHQ_SELFTEST(cancel);
+	SCX_DHQ_SELFTEST(nstrand);
 	SCX_DHQ_SELFTEST(sized);
 	SCX_DHQ_SELFTEST(fail_fifo_with_vtime);
 	SCX_DHQ_SELFTEST(fail_vtime_with_fifo);
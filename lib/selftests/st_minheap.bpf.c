@@ -233,12 +233,290 @@ int scx_selftest_minheap_read_back(scx_minheap_t *heap)
 
 	return 0;
 }
+
+static scx_minheap_handle_t *minheap_handles;
+
+/* Every queued handle must point at the slot holding it. */
+static
+int scx_selftest_minheap_check_index(scx_minheap_t *heap)
+{
+	scx_minheap_handle_t *handle;
+	int i;
+
+	for (i = 0; i < heap->size && can_loop; i++) {
+		handle = (scx_minheap_handle_t *)heap->handles[i];
+		if (!handle)
+			continue;
+
+		if (handle->heap != (u64)heap || handle->ind != i) {
+			bpf_printk("stale handle at slot %d", i);
+			return -EINVAL;
+		}
+
+		if (i > 0 && heap->helems[(i - 1) >> heap->shift].weight > heap->helems[i].weight) {
+			bpf_printk("heap property violated at slot %d", i);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static
+int scx_selftest_minheap_remove(scx_minheap_t *heap)
+{
+	u64 keys[] = { 97, 79, 88, 2, 51, 75, 71, 59, 12, 7, 37, 64, 18, 90, 33, 41 };
+	const size_t nkeys = sizeof(keys) / sizeof(keys[0]);
+	/* The root, an inner node, a leaf and the last slot. */
+	u64 victims[] = { 3, 8, 0, 15 };
+	const size_t nvictims = sizeof(victims) / sizeof(victims[0]);
+	struct scx_minheap_elem helem;
+	u64 prev = 0;
+	int ret, i, j;
+
+	if (heap->size || nkeys > heap->capacity)
+		return -EINVAL;
+
+	for (i = 0; i < nkeys && can_loop; i++) {
+		ret = scx_minheap_insert_indexed(heap, i, keys[i], &minheap_handles[i]);
+		if (ret)
+			return ret;
+	}
+
+	/* A queued handle can not be inserted twice. */
+	if (scx_minheap_insert_indexed(heap, 0, 0, &minheap_handles[0]) != -EINVAL)
+		return -EINVAL;
+
+	for (i = 0; i < nvictims && can_loop; i++) {
+		ret = scx_minheap_remove(heap, &minheap_handles[victims[i]]);
+		if (ret)
+			return ret;
+
+		if (scx_minheap_handle_queued(&minheap_handles[victims[i]]))
+			return -EINVAL;
+
+		ret = scx_selftest_minheap_check_index(heap);
+		if (ret)
+			return ret;
+	}
+
+	if (heap->size != nkeys - nvictims)
+		return -EINVAL;
+
+	/* Removing twice fails. */
+	if (scx_minheap_remove(heap, &minheap_handles[victims[0]]) != -ENOENT)
+		return -EINVAL;
+
+	for (i = 0; i < nkeys - nvictims && can_loop; i++) {
+		ret = scx_minheap_pop(heap, &helem);
+		if (ret)
+			return ret;
+
+		if (helem.elem >= nkeys || keys[helem.elem] != helem.weight)
+			return -EINVAL;
+
+		for (j = 0; j < nvictims && can_loop; j++) {
+			if (helem.elem == victims[j]) {
+				bpf_printk("popped removed element %ld", helem.elem);
+				return -EINVAL;
+			}
+		}
+
+		if (prev > helem.weight) {
+			bpf_printk("weight inversion %ld %ld", prev, helem.weight);
+			return -EINVAL;
+		}
+
+		/* Popping also releases the handle. */
+		if (scx_minheap_handle_queued(&minheap_handles[helem.elem]))
+			return -EINVAL;
+
+		prev = helem.weight;
+	}
+
+	if (scx_minheap_remove(heap, &minheap_handles[1]) != -ENOENT)
+		return -EINVAL;
+
+	return 0;
+}
+
+static
+int scx_selftest_minheap_update_weight(scx_minheap_t *heap)
+{
+	u64 keys[] = { 23, 12, 55, 42, 67, 3, 15, 8 };
+	const size_t nkeys = sizeof(keys) / sizeof(keys[0]);
+	struct scx_minheap_elem helem;
+	int ret, i;
+
+	if (heap->size || nkeys > heap->capacity)
+		return -EINVAL;
+
+	for (i = 0; i < nkeys && can_loop; i++) {
+		ret = scx_minheap_insert_indexed(heap, i, keys[i], &minheap_handles[i]);
+		if (ret)
+			return ret;
+	}
+
+	/* Sink the minimum (elem 5), then float the maximum (elem 4). */
+	ret = scx_minheap_update_weight(heap, &minheap_handles[5], 100);
+	if (ret)
+		return ret;
+
+	ret = scx_minheap_update_weight(heap, &minheap_handles[4], 1);
+	if (ret)
+		return ret;
+
+	ret = scx_selftest_minheap_check_index(heap);
+	if (ret)
+		return ret;
+
+	ret = scx_minheap_pop(heap, &helem);
+	if (ret)
+		return ret;
+
+	if (helem.elem != 4 || helem.weight != 1) {
+		bpf_printk("expected (4, 1), found (%ld, %ld)", helem.elem, helem.weight);
+		return -EINVAL;
+	}
+
+	/* Elements that were popped can not be updated. */
+	if (scx_minheap_update_weight(heap, &minheap_handles[4], 0) != -ENOENT)
+		return -EINVAL;
+
+	for (i = 0; i < nkeys - 1 && can_loop; i++) {
+		ret = scx_minheap_pop(heap, &helem);
+		if (ret)
+			return ret;
+	}
+
+	if (helem.elem != 5 || helem.weight != 100) {
+		bpf_printk("expected (5, 100), found (%ld, %ld)", helem.elem, helem.weight);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Cheap deterministic weights for the arity tests and the benchmark. */
+static __always_inline u64 minheap_next_weight(u64 *state)
+{
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return *state >> 33;
+}
+
+/*
+ * Fill the heap with @nr pseudorandom weights and pop them all, checking
+ * the order. Returns the time spent popping in ns, or 0 on error.
+ */
+static
+u64 scx_selftest_minheap_fill_drain(scx_minheap_t *heap, u64 nr)
+{
+	struct scx_minheap_elem helem;
+	u64 state = nr;
+	u64 start, prev = 0;
+	u64 i;
+
+	if (heap->size || nr > heap->capacity)
+		return 0;
+
+	for (i = 0; i < nr && can_loop; i++) {
+		if (scx_minheap_insert(heap, i, minheap_next_weight(&state)))
+			return 0;
+	}
+
+	start = bpf_ktime_get_ns();
+
+	for (i = 0; i < nr && can_loop; i++) {
+		if (scx_minheap_pop(heap, &helem))
+			return 0;
+
+		if (prev > helem.weight) {
+			bpf_printk("weight inversion %ld %ld", prev, helem.weight);
+			return 0;
+		}
+
+		prev = helem.weight;
+	}
+
+	if (heap->size)
+		return 0;
+
+	return bpf_ktime_get_ns() - start + 1;
+}
+
+static u64 minheap_arities[] = { 2, 4, 8 };
+#define MINHEAP_NR_ARITIES (sizeof(minheap_arities) / sizeof(minheap_arities[0]))
+
+static
+int scx_selftest_minheap_arity(scx_minheap_t *unused)
+{
+	scx_minheap_t *heap;
+	int i;
+
+	/* Only 2, 4 and 8 are supported. */
+	if (scx_minheap_alloc_arity(HEAP_CAPACITY, 3))
+		return -EINVAL;
+
+	for (i = 0; i < MINHEAP_NR_ARITIES && can_loop; i++) {
+		heap = scx_minheap_alloc_arity(HEAP_CAPACITY, minheap_arities[i]);
+		if (!heap)
+			return -ENOMEM;
+
+		/* Sibling groups must start on a cache line. */
+		if (minheap_arities[i] == 4 &&
+		    ((u64)&heap->helems[1] & (SCX_MINHEAP_CACHELINE - 1)))
+			return -EINVAL;
+
+		/* Odd sizes leave the last node with a partial set of children. */
+		if (!scx_selftest_minheap_fill_drain(heap, HEAP_CAPACITY - 3))
+			return -EINVAL;
+
+		if (!scx_selftest_minheap_fill_drain(heap, HEAP_CAPACITY))
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+#define MINHEAP_BENCH_MAX	(64 * 1024)
+
+/*
+ * Report pops/sec for each arity as the heap grows from 64 to 64K
+ * elements. Each round fills the heap with pseudorandom weights and then
+ * drains it completely.
+ */
+static
+int scx_selftest_minheap_bench(scx_minheap_t *unused)
+{
+	scx_minheap_t *heap;
+	u64 nr, ns;
+	int i;
+
+	for (i = 0; i < MINHEAP_NR_ARITIES && can_loop; i++) {
+		heap = scx_minheap_alloc_arity(MINHEAP_BENCH_MAX, minheap_arities[i]);
+		if (!heap)
+			return -ENOMEM;
+
+		for (nr = 64; nr <= MINHEAP_BENCH_MAX && can_loop; nr *= 4) {
+			ns = scx_selftest_minheap_fill_drain(heap, nr);
+			if (!ns)
+				return -EINVAL;
+
+			bpf_printk("minheap: arity %ld size %ld %ld pops/sec",
+				   minheap_arities[i], nr, nr * 1000 * 1000 * 1000 / ns);
+		}
+	}
+
+	return 0;
+}
+
 #define SCX_MINHEAP_SELFTEST(suffix) SCX_SELFTEST(scx_selftest_minheap_ ## suffix, heap)
+#define SCX_MINHEAP_INDEXED_SELFTEST(suffix) SCX_SELFTEST(scx_selftest_minheap_ ## suffix, iheap)
 
 __weak
 int scx_selftest_minheap(void)
 {
-	scx_minheap_t *heap;
+	scx_minheap_t *heap, *iheap;
 
 	heap = scx_minheap_alloc(HEAP_CAPACITY);
 	if (!heap) {
@@ -246,12 +524,26 @@ int scx_selftest_minheap(void)
 		return -ENOMEM;
 	}
 
+	iheap = scx_minheap_alloc_indexed(HEAP_CAPACITY);
+	if (!iheap) {
+		bpf_printk("Could not allocate indexed heap");
+		return -ENOMEM;
+	}
+
+	minheap_handles = scx_static_alloc(HEAP_CAPACITY * sizeof(*minheap_handles), 1);
+	if (!minheap_handles)
+		return -ENOMEM;
+
 	SCX_MINHEAP_SELFTEST(empty);
 	SCX_MINHEAP_SELFTEST(read_back);
 	SCX_MINHEAP_SELFTEST(ascending);
 	SCX_MINHEAP_SELFTEST(descending);
 	SCX_MINHEAP_SELFTEST(alternating);
 	SCX_MINHEAP_SELFTEST(random);
+	SCX_MINHEAP_INDEXED_SELFTEST(remove);
+	SCX_MINHEAP_INDEXED_SELFTEST(update_weight);
+	SCX_MINHEAP_SELFTEST(arity);
+	SCX_MINHEAP_SELFTEST(bench);
 
 	return 0;
 }
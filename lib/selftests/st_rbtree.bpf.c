@@ -766,12 +766,58 @@ __weak int scx_selftest_rbtree_print(rbtree_t __arg_arena *rbtree)
 	return 0;
 }
 
+/*
+ * Time inserts, lookups and pops on a tree of 100K nodes. The keys are a
+ * multiplicative hash of the index, so they are unique but arrive in no
+ * particular order. Compare the node layouts by running the selftests with
+ * and without SCX_RB_COMPACT ("make test-all" here, or the rb_compact
+ * feature of scx_arena_selftests).
+ */
+__weak int scx_selftest_rbtree_bench(rbtree_t __arg_arena *rbtree)
+{
+	const u32 nodes = 100 * 1000;
+	u64 start, insert_ns, find_ns, pop_ns;
+	u64 key, value;
+	u32 i;
+
+	start = bpf_ktime_get_ns();
+	bpf_for(i, 0, nodes) {
+		key = (i * 2654435761ULL) & 0xffffffff;
+		if (rb_insert(rbtree, key, i))
+			return 1;
+	}
+	insert_ns = bpf_ktime_get_ns() - start;
+
+	start = bpf_ktime_get_ns();
+	bpf_for(i, 0, nodes) {
+		key = (i * 2654435761ULL) & 0xffffffff;
+		if (rb_find(rbtree, key, &value) || value != i)
+			return 2;
+	}
+	find_ns = bpf_ktime_get_ns() - start;
+
+	start = bpf_ktime_get_ns();
+	bpf_for(i, 0, nodes) {
+		if (rb_pop(rbtree, &key, &value))
+			return 3;
+	}
+	pop_ns = bpf_ktime_get_ns() - start;
+
+	if (rbtree->root)
+		return 4;
+
+	bpf_printk("rbtree: %d nodes of %d bytes, insert %ld ns/op, find %ld ns/op, pop %ld ns/op",
+		   nodes, sizeof(struct rbnode), insert_ns / nodes, find_ns / nodes, pop_ns / nodes);
+
+	return 0;
+}
+
 #define SCX_RBTREE_SELFTEST(suffix, rbtree) SCX_SELFTEST(scx_selftest_rbtree_ ## suffix, (rbtree))
 
 __weak
 int scx_selftest_rbtree(void)
 {
-	rbtree_t *standard, *update, *duplicate, *noalloc;
+	rbtree_t *standard, *update, *duplicate, *noalloc, *bench;
 
 	standard = rb_create(RB_ALLOC, RB_DEFAULT);
 	if (!standard)
@@ -789,6 +835,10 @@ int scx_selftest_rbtree(void)
 	if (!standard)
 		return -ENOMEM;
 
+	bench = rb_create(RB_ALLOC, RB_DEFAULT);
+	if (!bench)
+		return -ENOMEM;
+
 	SCX_RBTREE_SELFTEST(find_nonexistent, standard);
 	SCX_RBTREE_SELFTEST(insert_one, update);
 	SCX_RBTREE_SELFTEST(print, update);
@@ -804,6 +854,7 @@ int scx_selftest_rbtree(void)
 	SCX_RBTREE_SELFTEST(add_remove_circular_reverse, update);
 	SCX_RBTREE_SELFTEST(add_remove_circular, update);
 	SCX_RBTREE_SELFTEST(alloc_check, standard);
+	SCX_RBTREE_SELFTEST(bench, bench);
 
 	return 0;
 }
@@ -0,0 +1,209 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ * Copyright (c) 2025 Meta Platforms, Inc. and affiliates.
+ */
+
+#include <scx/common.bpf.h>
+#include <lib/sdt_task.h>
+
+#include <lib/cpumask.h>
+#include <lib/topology.h>
+#include <lib/wsteal.h>
+
+#include "selftest.h"
+
+/*
+ * NOTE: Like the lvqueue tests these run on a single CPU, so contention is
+ * emulated by interleaving the owner's pops with steals issued on behalf of
+ * other CPUs.
+ */
+
+/* Every other CPU must show up exactly once in the victim list. */
+__weak
+int scx_selftest_wsteal_victims(scx_ws_t __arg_arena *ws)
+{
+	scx_ws_cpu_t *wsc;
+	u32 i, j, vcpu;
+	u32 prev = 0;
+	int lvl;
+
+	wsc = ws->cpus[0];
+	if (!wsc)
+		return 1;
+
+	bpf_for(lvl, 0, SCX_WS_NR_LEVELS) {
+		if (wsc->level_end[lvl] < prev)
+			return 2;
+
+		prev = wsc->level_end[lvl];
+	}
+
+	if (prev != nr_cpu_ids - 1)
+		return 3;
+
+	bpf_for(i, 0, prev) {
+		vcpu = wsc->victims[i];
+		if (vcpu == 0 || vcpu >= nr_cpu_ids)
+			return 4;
+
+		bpf_for(j, 0, i) {
+			if (wsc->victims[j] == vcpu)
+				return 5;
+		}
+	}
+
+	return 0;
+}
+
+/* The owner pops in LIFO order, thieves take the oldest entry. */
+__weak
+int scx_selftest_wsteal_order(scx_ws_t __arg_arena *ws)
+{
+	u64 val;
+	int i;
+
+	bpf_for(i, 0, 8) {
+		if (scx_ws_push(ws, 0, i))
+			return 1;
+	}
+
+	if (scx_ws_nr_queued(ws, 0) != 8)
+		return 2;
+
+	if (scx_ws_pop(ws, 0, &val) || val != 7)
+		return 3;
+
+	if (nr_cpu_ids > 1) {
+		if (scx_ws_steal(ws, 1, &val) || val != 0)
+			return 4;
+	} else {
+		if (scx_ws_pop(ws, 0, &val) || val != 0)
+			return 4;
+	}
+
+	/* Drain the rest. */
+	bpf_for(i, 0, 6) {
+		if (scx_ws_pop(ws, 0, &val) || val != 6 - i)
+			return 5;
+	}
+
+	if (scx_ws_pop(ws, 0, &val) != -ENOENT)
+		return 6;
+
+	if (nr_cpu_ids > 1 && scx_ws_steal(ws, 1, &val) != -ENOENT)
+		return 7;
+
+	return 0;
+}
+
+/* The owner can also take its own oldest entry. */
+__weak
+int scx_selftest_wsteal_pop_oldest(scx_ws_t __arg_arena *ws)
+{
+	u64 val;
+	int i;
+
+	bpf_for(i, 0, 4) {
+		if (scx_ws_push(ws, 0, i))
+			return 1;
+	}
+
+	if (scx_ws_pop_oldest(ws, 0, &val) || val != 0)
+		return 2;
+
+	if (scx_ws_pop(ws, 0, &val) || val != 3)
+		return 3;
+
+	bpf_for(i, 1, 3) {
+		if (scx_ws_pop_oldest(ws, 0, &val) || val != i)
+			return 4;
+	}
+
+	if (scx_ws_pop_oldest(ws, 0, &val) != -ENOENT)
+		return 5;
+
+	return 0;
+}
+
+/*
+ * Load CPU 0 with work and have every other CPU steal from it in turn,
+ * with the owner popping every fourth round. Reports the steal success
+ * rate and ns per operation, and checks that every item is taken exactly
+ * once.
+ */
+__weak
+int scx_selftest_wsteal_contention(scx_ws_t __arg_arena *ws)
+{
+	const u32 nitems = 2048;
+	u64 attempts = 0, stolen = 0, popped = 0;
+	u64 start, ns, val, sum = 0;
+	u32 round, thief;
+	int ret;
+	int i;
+
+	if (nr_cpu_ids < 2)
+		return 0;
+
+	bpf_for(i, 0, nitems) {
+		if (scx_ws_push(ws, 0, i + 1))
+			return 1;
+	}
+
+	start = bpf_ktime_get_ns();
+
+	for (round = 0; popped + stolen < nitems && can_loop; round++) {
+		if (!(round % 4)) {
+			ret = scx_ws_pop(ws, 0, &val);
+			if (!ret) {
+				popped += 1;
+				sum += val;
+			}
+		}
+
+		thief = 1 + round % (nr_cpu_ids - 1);
+		attempts += 1;
+
+		ret = scx_ws_steal(ws, thief, &val);
+		if (ret == -ENOENT)
+			continue;
+		if (ret)
+			return 2;
+
+		stolen += 1;
+		sum += val;
+	}
+
+	ns = bpf_ktime_get_ns() - start;
+
+	if (popped + stolen != nitems)
+		return 3;
+
+	/* Everything taken exactly once. */
+	if (sum != (u64)nitems * (nitems + 1) / 2)
+		return 4;
+
+	bpf_printk("wsteal: %ld stolen, %ld popped, steal success %ld%%, %ld ns/op",
+		   stolen, popped, attempts ? stolen * 100 / attempts : 0,
+		   ns / nitems);
+
+	return 0;
+}
+
+#define SCX_WSTEAL_SELFTEST(suffix) SCX_SELFTEST(scx_selftest_wsteal_ ## suffix, ws)
+
+__weak
+int scx_selftest_wsteal(void)
+{
+	scx_ws_t *ws;
+
+	ws = scx_ws_create();
+	if (!ws)
+		return -ENOMEM;
+
+	SCX_WSTEAL_SELFTEST(victims);
+	SCX_WSTEAL_SELFTEST(order);
+	SCX_WSTEAL_SELFTEST(pop_oldest);
+	SCX_WSTEAL_SELFTEST(contention);
+
+	return 0;
+}
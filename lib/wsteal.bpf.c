@@ -0,0 +1,295 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ * Copyright (c) 2025 Meta Platforms, Inc. and affiliates.
+ */
+
+#include <scx/common.bpf.h>
+
+#include <lib/sdt_task.h>
+#include <lib/cpumask.h>
+#include <lib/topology.h>
+#include <lib/wsteal.h>
+
+/* Topology level of the domain the thief shares with victims at each level. */
+static const enum topo_level scx_ws_topo_level[SCX_WS_NR_LEVELS] = {
+	[SCX_WS_LVL_CORE]	= TOPO_CORE,
+	[SCX_WS_LVL_LLC]	= TOPO_LLC,
+	[SCX_WS_LVL_NODE]	= TOPO_NODE,
+	[SCX_WS_LVL_SYSTEM]	= TOPO_TOP,
+};
+
+/*
+ * Find the ancestors of @cpu by descending from the root. We do not use
+ * topo_nodes[] because it depends on the IDs the caller used to build the
+ * topology.
+ */
+static int scx_ws_cpu_ancestors(u32 cpu, topo_ptr *path)
+{
+	topo_ptr topo = topo_all;
+	topo_ptr child;
+	int lvl, i;
+
+	if (!topo)
+		return -ENOENT;
+
+	path[TOPO_TOP] = topo;
+
+	for (lvl = TOPO_NODE; lvl < TOPO_MAX_LEVEL && can_loop; lvl++) {
+		child = NULL;
+
+		for (i = 0; i < topo->nr_children && i < TOPO_MAX_CHILDREN && can_loop; i++) {
+			if (topo_contains(topo->children[i], cpu)) {
+				child = topo->children[i];
+				break;
+			}
+		}
+
+		/* Flat topologies can be missing levels, reuse the parent. */
+		path[lvl] = child ? child : topo;
+		if (child)
+			topo = child;
+	}
+
+	return 0;
+}
+
+/*
+ * Order the other CPUs by distance to @cpu. A victim belongs to the
+ * smallest topology domain it shares with @cpu. Without a topology every
+ * CPU is at system level.
+ */
+static int scx_ws_build_victims(scx_ws_cpu_t *wsc, u32 cpu)
+{
+	topo_ptr path[TOPO_MAX_LEVEL];
+	topo_ptr domain, inner;
+	bool has_topo;
+	u32 nr = 0;
+	int lvl;
+	u32 i;
+
+	has_topo = !scx_ws_cpu_ancestors(cpu, path);
+
+	bpf_for(lvl, 0, SCX_WS_NR_LEVELS) {
+		domain = has_topo ? path[scx_ws_topo_level[lvl]] : NULL;
+		inner = (has_topo && lvl > 0) ? path[scx_ws_topo_level[lvl - 1]] : NULL;
+
+		bpf_for(i, 0, nr_cpu_ids) {
+			if (i == cpu)
+				continue;
+
+			if (!has_topo) {
+				if (lvl != SCX_WS_LVL_SYSTEM)
+					break;
+			} else {
+				if (!topo_contains(domain, i))
+					continue;
+
+				/* Already added at a closer level. */
+				if (inner && topo_contains(inner, i))
+					continue;
+			}
+
+			if (nr >= nr_cpu_ids - 1)
+				return -E2BIG;
+
+			wsc->victims[nr++] = i;
+		}
+
+		wsc->level_end[lvl] = nr;
+	}
+
+	return 0;
+}
+
+__weak
+u64 scx_ws_create_internal(void)
+{
+	scx_ws_cpu_t *wsc;
+	scx_ws_t *ws;
+	u32 cpu;
+	int ret;
+
+	/* XXX Leaked on error, like all static allocations. */
+	ws = scx_static_alloc(sizeof(*ws), 1);
+	if (!ws)
+		return (u64)NULL;
+
+	ws->nr_cpus = nr_cpu_ids;
+	ws->cpus = scx_static_alloc(nr_cpu_ids * sizeof(*ws->cpus), 1);
+	if (!ws->cpus)
+		return (u64)NULL;
+
+	bpf_for(cpu, 0, nr_cpu_ids) {
+		/* Separate cache lines, thieves read each other's queues. */
+		wsc = scx_static_alloc(sizeof(*wsc), 64);
+		if (!wsc)
+			return (u64)NULL;
+
+		wsc->lvq = lvq_create();
+		if (!wsc->lvq)
+			return (u64)NULL;
+
+		wsc->victims = scx_static_alloc(nr_cpu_ids * sizeof(*wsc->victims), 1);
+		if (!wsc->victims)
+			return (u64)NULL;
+
+		ret = scx_ws_build_victims(wsc, cpu);
+		if (ret) {
+			bpf_printk("failed to order victims for cpu %d (%d)", cpu, ret);
+			return (u64)NULL;
+		}
+
+		ws->cpus[cpu] = wsc;
+	}
+
+	return (u64)ws;
+}
+
+static __always_inline
+scx_ws_cpu_t *scx_ws_cpu(scx_ws_t *ws, s32 cpu)
+{
+	if (unlikely(cpu < 0 || cpu >= ws->nr_cpus))
+		return NULL;
+
+	return ws->cpus[cpu];
+}
+
+__weak
+int scx_ws_push(scx_ws_t __arg_arena *ws, s32 cpu, u64 val)
+{
+	scx_ws_cpu_t *wsc = scx_ws_cpu(ws, cpu);
+	int ret;
+
+	if (unlikely(!wsc))
+		return -EINVAL;
+
+	ret = lvq_push(wsc->lvq, val);
+	if (ret)
+		return ret;
+
+	wsc->nr_pushed += 1;
+
+	return 0;
+}
+
+__weak
+int scx_ws_pop(scx_ws_t __arg_arena *ws, s32 cpu, u64 *val)
+{
+	scx_ws_cpu_t *wsc = scx_ws_cpu(ws, cpu);
+	int ret;
+
+	if (unlikely(!wsc || !val))
+		return -EINVAL;
+
+	ret = lvq_pop(wsc->lvq, val);
+	if (ret)
+		return ret;
+
+	wsc->nr_popped += 1;
+
+	return 0;
+}
+
+/*
+ * Pop the oldest entry of @cpu's own deque. The top of the deque is shared
+ * with thieves, so the owner has to race them for it like any other thief.
+ * If it keeps losing, the deque is being drained anyway and it falls back to
+ * the bottom.
+ */
+#define SCX_WS_POP_OLDEST_TRIES	4
+
+__weak
+int scx_ws_pop_oldest(scx_ws_t __arg_arena *ws, s32 cpu, u64 *val)
+{
+	scx_ws_cpu_t *wsc = scx_ws_cpu(ws, cpu);
+	int i, ret;
+
+	if (unlikely(!wsc || !val))
+		return -EINVAL;
+
+	bpf_for(i, 0, SCX_WS_POP_OLDEST_TRIES) {
+		ret = lvq_steal(wsc->lvq, val);
+		if (ret != -EAGAIN)
+			break;
+	}
+
+	if (ret == -EAGAIN)
+		ret = lvq_pop(wsc->lvq, val);
+	if (ret)
+		return ret;
+
+	wsc->nr_popped += 1;
+
+	return 0;
+}
+
+/*
+ * Steal from the closest non-empty victim of @cpu. Within a level the
+ * starting victim rotates so that thieves sharing a domain do not all go
+ * after the same queue. Returns -ENOENT if every queue was empty or all
+ * steal attempts lost their race.
+ */
+__weak
+int scx_ws_steal(scx_ws_t __arg_arena *ws, s32 cpu, u64 *val)
+{
+	scx_ws_cpu_t *wsc = scx_ws_cpu(ws, cpu);
+	u32 begin = 0, end, nr, off;
+	scx_ws_cpu_t *victim;
+	u32 i, vcpu;
+	int lvl, ret;
+
+	if (unlikely(!wsc || !val))
+		return -EINVAL;
+
+	bpf_for(lvl, 0, SCX_WS_NR_LEVELS) {
+		end = wsc->level_end[lvl];
+		nr = end - begin;
+		if (!nr)
+			continue;
+
+		off = wsc->rotor % nr;
+
+		bpf_for(i, 0, nr) {
+			vcpu = wsc->victims[begin + (off + i) % nr];
+
+			victim = scx_ws_cpu(ws, vcpu);
+			if (!victim || lvq_empty(victim->lvq))
+				continue;
+
+			wsc->nr_steal_attempts += 1;
+
+			ret = lvq_steal(victim->lvq, val);
+			if (ret == -EAGAIN) {
+				wsc->nr_steal_contended += 1;
+				continue;
+			}
+
+			if (ret)
+				continue;
+
+			wsc->nr_stolen += 1;
+			wsc->nr_stolen_level[lvl] += 1;
+			wsc->rotor += 1;
+
+			return 0;
+		}
+
+		begin = end;
+	}
+
+	return -ENOENT;
+}
+
+__weak
+u64 scx_ws_nr_queued(scx_ws_t __arg_arena *ws, s32 cpu)
+{
+	scx_ws_cpu_t *wsc = scx_ws_cpu(ws, cpu);
+	s64 sz;
+
+	if (unlikely(!wsc))
+		return 0;
+
+	sz = wsc->lvq->bottom - wsc->lvq->top;
+
+	return sz > 0 ? sz : 0;
+}
@@ -30,6 +30,32 @@ use libbpf_rs::ProgramMut;
 /// Maximum length of CPU mask supported by the library in bits.
 const MAX_CPU_SUPPORTED: usize = 640;
 
+/// Counters of the BPF arena allocator, see struct scx_alloc_stats.
+pub type AllocStats = types::scx_alloc_stats;
+
+fn run_prog_by_name(obj: &Object, name: &str, input: ProgramInput) -> Result<i32> {
+    let c_name = CString::new(name)?;
+    let ptr = unsafe {
+        libbpf_sys::bpf_object__find_program_by_name(
+            obj.as_libbpf_object().as_ptr(),
+            c_name.as_ptr(),
+        )
+    };
+    if ptr as u64 == 0 as u64 {
+        bail!("No program with name {} found in object", name);
+    }
+
+    let bpfprog = unsafe { &mut *ptr };
+    let prog = ProgramMut::new_mut(bpfprog);
+
+    let output = prog.test_run(input)?;
+
+    // Reach into the object and get the fd of the program
+    // Get the fd of the test program to run
+
+    return Ok(output.return_value as i32);
+}
+
 /// Holds state related to BPF arenas in the program.
 #[derive(Debug)]
 pub struct ArenaLib<'a> {
@@ -45,26 +71,7 @@ impl<'a> ArenaLib<'a> {
     const STATIC_ALLOC_PAGES_GRANULARITY: c_ulong = 8;
 
     fn run_prog_by_name(&self, name: &str, input: ProgramInput) -> Result<i32> {
-        let c_name = CString::new(name)?;
-        let ptr = unsafe {
-            libbpf_sys::bpf_object__find_program_by_name(
-                self.obj.as_libbpf_object().as_ptr(),
-                c_name.as_ptr(),
-            )
-        };
-        if ptr as u64 == 0 as u64 {
-            bail!("No program with name {} found in object", name);
-        }
-
-        let bpfprog = unsafe { &mut *ptr };
-        let prog = ProgramMut::new_mut(bpfprog);
-
-        let output = prog.test_run(input)?;
-
-        // Reach into the object and get the fd of the program
-        // Get the fd of the test program to run
-
-        return Ok(output.return_value as i32);
+        run_prog_by_name(self.obj, name, input)
     }
 
     /// Set up basic library state.
@@ -207,4 +214,39 @@ impl<'a> ArenaLib<'a> {
 
         Ok(())
     }
+
+    /// Top up the allocator reserves of the BPF arena library. The reserves
+    /// can only be refilled from a sleepable context, so schedulers should
+    /// call this periodically from their userspace loop once the library is
+    /// set up.
+    pub fn refill(obj: &Object) -> Result<()> {
+        let ret = run_prog_by_name(obj, "scx_alloc_refill_reserves", ProgramInput::default())?;
+        if ret != 0 {
+            bail!("scx_alloc_refill_reserves returned {}", ret);
+        }
+
+        Ok(())
+    }
+
+    /// Read the allocator statistics of the BPF arena library.
+    pub fn alloc_stats(obj: &Object) -> Result<AllocStats> {
+        let mut stats = AllocStats::default();
+
+        let input = ProgramInput {
+            context_in: Some(unsafe {
+                std::slice::from_raw_parts_mut(
+                    &mut stats as *mut _ as *mut u8,
+                    std::mem::size_of_val(&stats),
+                )
+            }),
+            ..Default::default()
+        };
+
+        let ret = run_prog_by_name(obj, "scx_alloc_get_stats", input)?;
+        if ret != 0 {
+            bail!("scx_alloc_get_stats returned {}", ret);
+        }
+
+        Ok(stats)
+    }
 }
@@ -10,4 +10,5 @@
 mod bpf_skel;
 
 mod arenalib;
+pub use arenalib::AllocStats;
 pub use arenalib::ArenaLib;
@@ -4,30 +4,42 @@
 // GNU General Public License version 2.
 
 fn main() {
-    scx_cargo::BpfBuilder::new()
-        .unwrap()
+    let mut builder = scx_cargo::BpfBuilder::new().unwrap();
+
+    // Build the rbtree with 32-bit node links instead of arena pointers.
+    if std::env::var_os("CARGO_FEATURE_RB_COMPACT").is_some() {
+        builder.add_cflag("-DSCX_RB_COMPACT");
+    }
+
+    builder
         .enable_skel("src/bpf/main.bpf.c", "main")
         .add_source("src/bpf/lib/arena.bpf.c")
         .add_source("src/bpf/lib/atq.bpf.c")
         .add_source("src/bpf/lib/dhq.bpf.c")
         .add_source("src/bpf/lib/bitmap.bpf.c")
         .add_source("src/bpf/lib/btree.bpf.c")
+        .add_source("src/bpf/lib/calq.bpf.c")
+        .add_source("src/bpf/lib/cpumask.bpf.c")
         .add_source("src/bpf/lib/lvqueue.bpf.c")
         .add_source("src/bpf/lib/minheap.bpf.c")
         .add_source("src/bpf/lib/rbtree.bpf.c")
         .add_source("src/bpf/lib/sdt_alloc.bpf.c")
         .add_source("src/bpf/lib/sdt_task.bpf.c")
         .add_source("src/bpf/lib/topology.bpf.c")
+        .add_source("src/bpf/lib/wsteal.bpf.c")
         .add_source("src/bpf/lib/selftests/selftest.bpf.c")
         .add_source("src/bpf/lib/selftests/st_arena_topology_timer.bpf.c")
         .add_source("src/bpf/lib/selftests/st_atq.bpf.c")
         .add_source("src/bpf/lib/selftests/st_dhq.bpf.c")
         .add_source("src/bpf/lib/selftests/st_bitmap.bpf.c")
         .add_source("src/bpf/lib/selftests/st_btree.bpf.c")
+        .add_source("src/bpf/lib/selftests/st_calq.bpf.c")
+        .add_source("src/bpf/lib/selftests/st_cpumask.bpf.c")
         .add_source("src/bpf/lib/selftests/st_lvqueue.bpf.c")
         .add_source("src/bpf/lib/selftests/st_minheap.bpf.c")
         .add_source("src/bpf/lib/selftests/st_rbtree.bpf.c")
         .add_source("src/bpf/lib/selftests/st_topology.bpf.c")
+        .add_source("src/bpf/lib/selftests/st_wsteal.bpf.c")
         .compile_link_gen()
         .unwrap();
 }
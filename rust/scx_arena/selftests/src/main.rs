@@ -65,6 +65,9 @@ enum SelfTestId {
     SCX_SELFTEST_ID_MINHEAP = 4,
     SCX_SELFTEST_ID_RBTREE = 5,
     SCX_SELFTEST_ID_TOPOLOGY = 6,
+    SCX_SELFTEST_ID_CALQ = 7,
+    SCX_SELFTEST_ID_WSTEAL = 8,
+    SCX_SELFTEST_ID_CPUMASK = 9,
 }
 
 fn available_tests() -> String {
@@ -82,6 +85,9 @@ const TEST_CASES: &[(&str, u32)] = &[
     ("minheap", SelfTestId::SCX_SELFTEST_ID_MINHEAP as u32),
     ("rbtree", SelfTestId::SCX_SELFTEST_ID_RBTREE as u32),
     ("topology", SelfTestId::SCX_SELFTEST_ID_TOPOLOGY as u32),
+    ("calq", SelfTestId::SCX_SELFTEST_ID_CALQ as u32),
+    ("wsteal", SelfTestId::SCX_SELFTEST_ID_WSTEAL as u32),
+    ("cpumask", SelfTestId::SCX_SELFTEST_ID_CPUMASK as u32),
 ];
 
 #[derive(Debug, Parser)]
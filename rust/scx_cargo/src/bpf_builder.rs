@@ -336,6 +336,13 @@ impl BpfBuilder {
         self
     }
 
+    /// Append `@flag` to the cflags used for both BPF compilation and
+    /// header bindings, e.g. to define a build-time option.
+    pub fn add_cflag(&mut self, flag: &str) -> &mut Self {
+        self.cflags.push(flag.into());
+        self
+    }
+
     pub fn compile_link_gen(&mut self) -> Result<()> {
         let input = match &self.skel_input_name {
             Some((name, _)) => name,
@@ -43,10 +43,40 @@ struct buddy_chunk {
 	buddy_chunk_t	*next;
 };
 
+/*
+ * Optional per-CPU magazines in front of the allocator. Every CPU caches up
+ * to BUDDY_MAG_DEPTH free blocks for each of the smallest size classes, so
+ * most small alloc/free pairs are served locally without taking the lock.
+ * Empty magazines are refilled and full magazines are flushed in batches of
+ * BUDDY_MAG_BATCH blocks under a single lock hold.
+ */
+enum buddy_mag_consts {
+	BUDDY_MAG_NR_CLASSES	= 8,	/* Orders 0-7, i.e., 16 bytes to 2KiB */
+	BUDDY_MAG_DEPTH		= 32,
+	BUDDY_MAG_BATCH		= BUDDY_MAG_DEPTH / 2,
+};
+
+struct buddy_mag_stats {
+	u64 hits;	/* Allocations served from a magazine. */
+	u64 misses;	/* Allocations that found the magazine empty. */
+	u64 frees;	/* Frees absorbed by a magazine. */
+	u64 flushes;	/* Batches returned to the allocator from full magazines. */
+};
+
+struct buddy_mag {
+	u32 nr[BUDDY_MAG_NR_CLASSES];
+	u64 blocks[BUDDY_MAG_NR_CLASSES][BUDDY_MAG_DEPTH];
+	struct buddy_mag_stats stats;
+};
+
+typedef struct buddy_mag __arena buddy_mag_t;
+
 struct buddy {
 	buddy_chunk_t *first_chunk;		/* Pointer to the chunk linked list. */
 	arena_spinlock_t __arena *lock;		/* Allocator lock */
 	u64 vaddr;				/* Allocation into reserved vaddr */
+	buddy_mag_t *mags;			/* Per-CPU magazines, NULL if disabled */
+	u32 nr_mags;
 };
 
 #ifdef __BPF__
@@ -58,5 +88,9 @@ int buddy_free_internal(struct buddy *buddy, u64 free);
 u64 buddy_alloc_internal(struct buddy *buddy, size_t size);
 #define buddy_alloc(alloc, size) ((void __arena *)buddy_alloc_internal((alloc), (size)))
 
+int buddy_mag_init(struct buddy *buddy, u32 nr_cpus);
+int buddy_mag_drain(struct buddy *buddy);
+int buddy_mag_stats(struct buddy *buddy, struct buddy_mag_stats *stats);
+
 
 #endif /* __BPF__  */
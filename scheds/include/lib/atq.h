@@ -10,12 +10,54 @@
 
 #include <bpf_arena_spin_lock.h>
 #include <lib/rbtree.h>
+#include <lib/calq.h>
 
 enum scx_atq_consts {
 	SCX_ATQ_INF_CAPACITY  = ((u64)-1),
 	SCX_ATQ_FIFO = ((u64)-1)
 };
 
+/*
+ * ATQ creation flags.
+ *
+ * SCX_ATQ_F_PERCPU: Inserts do not take the ATQ lock. Instead, each CPU
+ * appends into its own staging ring, and the next locked operation (pop,
+ * peek, remove) drains all rings into the rbtree in a single batch. Falls
+ * back to the locked insert path if the local ring is full.
+ *
+ * SCX_ATQ_F_CALENDAR: Back the queue with a calendar queue (lib/calq.h)
+ * instead of an rbtree. O(1) inserts and near-O(1) pops for keys clustered
+ * near the minimum, at the cost of ordering vtimes only up to the bucket
+ * width (SCX_CALQ_VTIME_SHIFT). FIFO ATQs keep exact ordering.
+ */
+enum scx_atq_flags {
+	SCX_ATQ_F_PERCPU	= 1 << 0,
+	SCX_ATQ_F_CALENDAR	= 1 << 1,
+};
+
+#define SCX_ATQ_PCPU_RING_SIZE (32)
+
+/* Left in a staging ring slot whose task was removed before being drained. */
+#define SCX_ATQ_SLOT_CANCELLED ((u64)1)
+
+struct scx_task_common;
+
+/*
+ * Per-CPU staging ring. Producers on any CPU may claim a slot by bumping
+ * the tail, but in practice only the owning CPU does. The head is only
+ * ever advanced by the consumer while holding the ATQ lock. Keep the
+ * producer and consumer indices on separate cache lines.
+ */
+struct scx_atq_pcpu {
+	volatile u64 head;
+	u64 __pad0[7];
+	volatile u64 tail;
+	u64 __pad1[7];
+	struct scx_task_common __arena *ring[SCX_ATQ_PCPU_RING_SIZE];
+};
+
+typedef struct scx_atq_pcpu __arena scx_atq_pcpu_t;
+
 enum scx_task_throttle {
 	SCX_TSK_CANRUN = 0,
 	SCX_TSK_THROTTLED
@@ -24,11 +66,15 @@ enum scx_task_throttle {
 struct scx_atq {
 	union sdt_id tid;
 	rbtree_t *tree;
+	scx_calq_t *calq;	/* Replaces the tree with SCX_ATQ_F_CALENDAR. */
 	arena_spinlock_t lock;
 	u64 capacity;
 	u64 size;
 	u64 seq;
 	u64 fifo;
+	u64 flags;
+	scx_atq_pcpu_t *pcpu;	/* Staging rings, one per CPU (SCX_ATQ_F_PERCPU). */
+	u64 nr_staged;		/* Tasks in staging rings, not yet in the tree. */
 };
 
 
@@ -39,26 +85,33 @@ int scx_atq_init(void);
 struct scx_task_common {
 	struct rbnode node;	/* rbnode for being inserted into ATQs */
 	scx_atq_t *atq;
+	u64 staged_pos;		/* Staging ring slot, see scx_atq_remove_unlocked() */
+	s32 staged_cpu;
 	enum scx_task_throttle state;
+	u64 throttled_at;	/* when the task was put aside (cgroup_bw) */
 };
 
 typedef struct scx_task_common __arena scx_task_common;
 
 #ifdef __BPF__
-u64 scx_atq_create_internal(bool fifo, size_t capacity);
-#define scx_atq_create(fifo) scx_atq_create_internal((fifo), SCX_ATQ_INF_CAPACITY)
-#define scx_atq_create_size(fifo, capacity) scx_atq_create_internal((fifo), (capacity))
+u64 scx_atq_create_internal(bool fifo, size_t capacity, u64 flags);
+#define scx_atq_create(fifo) scx_atq_create_internal((fifo), SCX_ATQ_INF_CAPACITY, 0)
+#define scx_atq_create_size(fifo, capacity) scx_atq_create_internal((fifo), (capacity), 0)
+#define scx_atq_create_flags(fifo, capacity, flags) scx_atq_create_internal((fifo), (capacity), (flags))
 int scx_atq_destroy(scx_atq_t __arg_arena *atq);
 int scx_atq_insert(scx_atq_t *atq, scx_task_common *taskc);
 int scx_atq_insert_vtime(scx_atq_t __arg_arena *atq, scx_task_common *taskc, u64 vtime);
+int scx_atq_insert_vtime_cpu(scx_atq_t __arg_arena *atq, scx_task_common *taskc, u64 vtime, s32 cpu);
 int scx_atq_remove(scx_atq_t *atq, scx_task_common *taskc);
 int scx_atq_insert_unlocked(scx_atq_t *atq, scx_task_common __arg_arena *taskc);
 int scx_atq_insert_vtime_unlocked(scx_atq_t __arg_arena *atq, scx_task_common __arg_arena *taskc, u64 vtime);
 int scx_atq_remove_unlocked(scx_atq_t *atq, scx_task_common __arg_arena *taskc);
 int scx_atq_nr_queued(scx_atq_t *atq);
 u64 scx_atq_pop(scx_atq_t *atq);
+int scx_atq_pop_batch(scx_atq_t *atq, u64 __arena *out, u32 max);
 u64 scx_atq_peek(scx_atq_t *atq);
 int scx_atq_cancel(scx_task_common *taskc);
+int scx_atq_drain_unlocked(scx_atq_t *atq);
 
 static __always_inline
 int scx_atq_lock(scx_atq_t __arg_arena *atq)
@@ -5,31 +5,51 @@
 #include <bpf_arena_spin_lock.h>
 
 #define BT_MAXLVL_PRINT (10)
-#define BT_LEAFSZ 10
+
+#define BT_CACHELINE (64)
+
+/*
+ * Node arrays are sized for the maximum fanout, the actual fanout of a tree
+ * is chosen at creation time. The default fits all keys of a node in a
+ * single cache line.
+ */
+#define BT_MAXFANOUT (16)
+#define BT_MINFANOUT (4)
+#define BT_DEFAULT_FANOUT (BT_CACHELINE / sizeof(u64))
 
 #define BT_F_LEAF (0x1)
 
 struct bt_node;
 typedef struct bt_node __arena bt_node;
 
+/*
+ * Keep the node header in its own cache line, followed by the keys so that
+ * in-node searches only touch the key array. Values are only read once
+ * the index is known.
+ */
 struct bt_node {
-	u64 keys[BT_LEAFSZ];
-	u64 values[BT_LEAFSZ];
 	u64 flags;
 	u64 numkeys;
 	bt_node *parent;
-};
+	/* Sibling links, only valid for leaves. */
+	bt_node *prev;
+	bt_node *next;
+	u64 keys[BT_MAXFANOUT] __attribute__((aligned(BT_CACHELINE)));
+	u64 values[BT_MAXFANOUT];
+} __attribute__((aligned(BT_CACHELINE)));
 
 struct btree {
 	bt_node *root;
 	bt_node *freelist;
+	u64 fanout;
 	/* XXXETSAL Locking */
 };
 
 typedef struct btree __arena btree_t;
 
-u64 bt_create_internal(void);
-#define bt_create() ((btree_t *)(bt_create_internal()))
+u64 bt_create_internal(u64 fanout);
+#define bt_create() ((btree_t *)(bt_create_internal(BT_DEFAULT_FANOUT)))
+#define bt_create_fanout(fanout) ((btree_t *)(bt_create_internal((fanout))))
 
 int bt_destroy(btree_t *btree);
 int bt_insert(btree_t *btree, u64 key, u64 value, bool update);
@@ -37,4 +57,23 @@ int bt_remove(btree_t *btree, u64 key);
 int bt_find(btree_t *btree, u64 key, u64 *value);
 int bt_print(btree_t *btree);
 
-/* XXXETSAL Iterators */
+/*
+ * Ordered iteration over the pairs of a tree. The cursor walks the leaves
+ * through their sibling links, so stepping is O(1) amortized instead of a
+ * lookup from the root. Any insertion or removal invalidates all cursors
+ * into the tree.
+ */
+struct bt_cursor {
+	bt_node *leaf;
+	u64 ind;
+};
+
+/* Position the cursor at the first key >= @key. */
+int bt_cursor_seek(btree_t *btree, struct bt_cursor *cur, u64 key);
+int bt_cursor_first(btree_t *btree, struct bt_cursor *cur);
+int bt_cursor_get(struct bt_cursor *cur, u64 *key, u64 *value);
+int bt_cursor_next(struct bt_cursor *cur);
+int bt_cursor_prev(struct bt_cursor *cur);
+
+int bt_range_pop(btree_t *btree, u64 start, u64 end, u64 __arena *keys,
+		 u64 __arena *values, u32 max);
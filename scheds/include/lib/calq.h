@@ -0,0 +1,68 @@
+#pragma once
+
+#ifdef __BPF__
+#include <scx/common.bpf.h>
+#include <bpf_arena_common.bpf.h>
+#endif /* __BPF__ */
+
+#include <lib/rbtree.h>
+
+/*
+ * Calendar queue: a bucketed priority queue for keys that cluster within a
+ * bounded window above the current minimum. Each bucket covers 2^shift
+ * consecutive keys and holds a FIFO list of nodes, and a bitmap tracks the
+ * non-empty buckets. Keys past the end of the window spill into an rbtree
+ * and are pulled back into the calendar once it drains.
+ *
+ * Ordering is exact up to the bucket width: nodes in the same bucket pop in
+ * insertion order regardless of their keys. Use a shift of 0 for exact
+ * ordering of distinct keys. Keys below the window are kept sorted at the
+ * front of the first bucket, which is linear in their number, so they are
+ * meant to be rare.
+ *
+ * Nodes are plain struct rbnodes so they can move between the calendar and
+ * the overflow tree without copying. While on the calendar, left/right are
+ * the list prev/next pointers and tid.idx holds the bucket index.
+ *
+ * The queue does no locking of its own.
+ */
+
+enum scx_calq_consts {
+	SCX_CALQ_NR_BUCKETS_SHIFT	= 8,
+	SCX_CALQ_NR_BUCKETS		= 1 << SCX_CALQ_NR_BUCKETS_SHIFT,
+	SCX_CALQ_BUCKET_MASK		= SCX_CALQ_NR_BUCKETS - 1,
+	SCX_CALQ_BITMAP_WORDS		= SCX_CALQ_NR_BUCKETS / 64,
+	SCX_CALQ_IDX_OVERFLOW		= -1,
+	/* ~65us buckets, ~16ms window for nanosecond vtimes. */
+	SCX_CALQ_VTIME_SHIFT		= 16,
+};
+
+struct scx_calq_bucket {
+	rbnode_t *head;
+	rbnode_t *tail;
+};
+
+struct scx_calq {
+	u64 shift;		/* log2 of the bucket width in key units. */
+	u64 base;		/* Slot of the lowest possibly non-empty bucket. */
+	u64 limit;		/* Slots at or past the limit go to the overflow tree. */
+	u64 nr_calendar;
+	u64 nr_overflow;
+	rbtree_t *overflow;
+	u64 bitmap[SCX_CALQ_BITMAP_WORDS];
+	struct scx_calq_bucket buckets[SCX_CALQ_NR_BUCKETS];
+};
+
+typedef struct scx_calq __arena scx_calq_t;
+
+#ifdef __BPF__
+u64 scx_calq_create_internal(u64 shift);
+#define scx_calq_create(shift) ((scx_calq_t *)scx_calq_create_internal((shift)))
+int scx_calq_destroy(scx_calq_t *calq);
+
+int scx_calq_insert_node(scx_calq_t *calq, rbnode_t *node);
+int scx_calq_remove_node(scx_calq_t *calq, rbnode_t *node);
+int scx_calq_pop(scx_calq_t *calq, u64 *key, u64 *value);
+int scx_calq_least(scx_calq_t *calq, u64 *key, u64 *value);
+u64 scx_calq_nr_queued(scx_calq_t *calq);
+#endif /* __BPF__ */
@@ -13,6 +13,63 @@
 struct scx_cgroup_bw_config {
 	/* verbose level */
 	int		verbose;
+	/*
+	 * hand out each period's quota to the LLCs in advance, in proportion
+	 * to how much the cgroup ran on each LLC recently
+	 */
+	bool		predictive;
+	/*
+	 * maximum number of tasks to reenqueue in one dispatch. 0 sizes the
+	 * batch by the backlog, the budget and the free dispatch slots
+	 */
+	u32		reenq_max_batch;
+};
+
+/* Number of log2 buckets of the throttle-to-reenqueue latency histogram */
+#define SCX_CGROUP_BW_LAT_BUCKETS	24
+
+/**
+ * Statistics of the budget replenishment
+ */
+struct scx_cgroup_bw_stats {
+	/* number of replenishments and how many of them walked the whole tree */
+	u64		nr_replenish;
+	u64		nr_full_replenish;
+	/* number of cgroups touched by the last replenishment and by all */
+	u64		nr_touched_last;
+	u64		nr_touched_total;
+	/* time the last and the slowest replenishment took in ns */
+	u64		replenish_ns_last;
+	u64		replenish_ns_max;
+	/* number of cgroups under bandwidth control */
+	u64		nr_cgroups;
+	/* LLC contexts attached to cgroups, left in the reserve, and misses */
+	u64		nr_llcx;
+	u64		nr_llcx_free;
+	u64		nr_llcx_miss;
+	/* size of the cgroup id tables in bytes */
+	u64		table_bytes;
+	/* number of tasks reenqueued after being throttled */
+	u64		nr_reenq;
+	/*
+	 * time from putting a task aside to reenqueuing it. Bucket i counts
+	 * latencies in [2**i, 2**(i+1)) usec, the last one everything above.
+	 */
+	u64		reenq_lat_hist[SCX_CGROUP_BW_LAT_BUCKETS];
+};
+
+/**
+ * Per-cgroup counts of budget transfers
+ */
+struct scx_cgroup_bw_xfer_stats {
+	/* budget moved from the subroot to the cgroup */
+	u64		nr_p2c;
+	/* budget moved from the cgroup to one of its LLCs */
+	u64		nr_c2l;
+	/* budget taken from another LLC of the cgroup that had some left */
+	u64		nr_l2l;
+	/* LLC shares handed out in advance at replenishment (predictive) */
+	u64		nr_predist;
 };
 
 /**
@@ -20,7 +77,9 @@ struct scx_cgroup_bw_config {
  * @config: tunnables, see the struct definition.
  *
  * It should be called for the library initialization before calling any
- * other API.
+ * other API. Afterwards, the scheduler should periodically run the
+ * scx_cgroup_bw_refill syscall program from userspace to top up the library's
+ * reserves, since they cannot be allocated from the scheduling paths.
  *
  * Return 0 for success, -errno for failure.
  */
@@ -177,3 +236,20 @@ int scx_cgroup_bw_is_cgroup_throttled(u64 cgrp_id);
  * Return true if the task is throttled. Otherwise, return false.
  */
 int scx_cgroup_bw_is_task_throttled(u64 taskc);
+
+/**
+ * scx_cgroup_bw_get_stats - Get the replenishment statistics.
+ * @stats: where to copy the statistics, see the struct definition.
+ *
+ * Return 0 for success, -errno for failure.
+ */
+int scx_cgroup_bw_get_stats(struct scx_cgroup_bw_stats *stats);
+
+/**
+ * scx_cgroup_bw_get_xfer_stats - Get the budget transfer counts of a cgroup.
+ * @cgrp_id: cgroup id
+ * @stats: where to copy the counts, see the struct definition.
+ *
+ * Return 0 for success, -errno for failure.
+ */
+int scx_cgroup_bw_get_xfer_stats(u64 cgrp_id, struct scx_cgroup_bw_xfer_stats *stats);
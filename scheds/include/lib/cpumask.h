@@ -5,6 +5,11 @@
 
 #define SCXMASK_NLONG (512 / 8)
 
+/*
+ * Arena bitmaps are allocated with only mask_size words, enough for
+ * nr_cpu_ids, and all operations stop there. The full SCXMASK_NLONG array
+ * is only ever backed for the stack and per-CPU copies.
+ */
 struct scx_bitmap {
 	union sdt_id tid;
 	u64 bits[SCXMASK_NLONG];
@@ -46,6 +51,21 @@ bool scx_bitmap_subset(scx_bitmap_t __arg_arena big, scx_bitmap_t __arg_arena sm
 bool scx_bitmap_subset_cpumask(scx_bitmap_t __arg_arena big, const struct cpumask *small __arg_trusted);
 int scx_bitmap_print(scx_bitmap_t __arg_arena mask);
 
+s32 scx_bitmap_ffs(scx_bitmap_t __arg_arena mask);
+s32 scx_bitmap_ffs_and(scx_bitmap_t __arg_arena arg1, scx_bitmap_t __arg_arena arg2);
+s32 scx_bitmap_find_from(scx_bitmap_t __arg_arena mask, u32 start);
+s32 scx_bitmap_find_and_from(scx_bitmap_t __arg_arena arg1, scx_bitmap_t __arg_arena arg2, u32 start);
+s32 scx_bitmap_claim_and_from(scx_bitmap_t __arg_arena claim, scx_bitmap_t __arg_arena mask, u32 start);
+
+/* Arena-native idle tracking, see lib/cpumask.bpf.c. */
+extern scx_bitmap_t scx_idle_cpumask;
+
+/* Claims that can lose the kernel's idle bit before a pick gives up. */
+#define SCX_IDLE_CLAIM_RETRIES (8)
+
+int scx_bitmap_idle_init(bool builtin_idle);
+int scx_bitmap_idle_update(s32 cpu, bool idle);
+
 s32 scx_bitmap_pick_idle_cpu(scx_bitmap_t mask __arg_arena, int flags);
 s32 scx_bitmap_any_distribute(scx_bitmap_t mask __arg_arena);
 s32 scx_bitmap_any_and_distribute(scx_bitmap_t scx __arg_arena, const struct cpumask *bpf);
@@ -15,54 +15,56 @@
 #define SCX_DHQ_MODE_PRIORITY		1
 #define SCX_DHQ_MODE_BALANCED		2
 
-/* Strand identifiers */
+/* Strand identifiers, any strand below nr_strands is valid */
 #define SCX_DHQ_STRAND_A		0
 #define SCX_DHQ_STRAND_B		1
-#define SCX_DHQ_STRAND_AUTO		2  /* Auto-select based on balancing */
+#define SCX_DHQ_STRAND_AUTO		((u64)-1)  /* Auto-select based on balancing */
+
+#define SCX_DHQ_MAX_STRANDS		64
 
 /**
  * scx_dhq - Double Helix Queue
  *
- * A queue structure inspired by DNA's double helix with two intertwined
- * strands. Tasks can be enqueued to either strand and dequeued according
- * to different strategies (alternating, priority-based, or balanced).
+ * A queue structure inspired by DNA's double helix with intertwined
+ * strands. The classic queue has two strands, but any number up to
+ * SCX_DHQ_MAX_STRANDS is supported. Tasks can be enqueued to any strand
+ * and dequeued according to different strategies (round-robin
+ * alternating, priority-based, or balanced).
  *
- * For cross-LLC task migration, strands typically represent the two LLCs
- * sharing the queue. The max_imbalance constraint applies only to enqueue
- * (based on size) to prevent one LLC from flooding the DHQ. On dequeue,
- * asymmetric consumption is allowed so idle LLCs can freely steal work
- * from busy LLCs without being blocked by imbalance constraints.
+ * For cross-LLC task migration, strands typically represent the LLCs
+ * sharing the queue, e.g. a pair of LLCs or all LLCs of a NUMA node. The
+ * max_imbalance constraint applies only to enqueue (based on size) to
+ * prevent one LLC from flooding the DHQ. On dequeue, asymmetric
+ * consumption is allowed so idle LLCs can freely steal work from busy
+ * LLCs without being blocked by imbalance constraints.
  *
- * @strand_a: Min heap for strand A
- * @strand_b: Min heap for strand B
  * @lock: Arena spinlock for thread-safety
- * @capacity: Total capacity across both strands
- * @size_a: Number of tasks in strand A
- * @size_b: Number of tasks in strand B
- * @seq_a: Sequence number for strand A (FIFO mode)
- * @seq_b: Sequence number for strand B (FIFO mode)
- * @dequeue_count_a: Number of dequeues from strand A (tracking only)
- * @dequeue_count_b: Number of dequeues from strand B (tracking only)
+ * @capacity: Total capacity across all strands
+ * @nr_queued: Number of tasks across all strands
  * @max_imbalance: Maximum size difference on enqueue (0 = no limit)
- * @fifo: FIFO mode flag (1 = FIFO, 0 = priority/vtime)
+ * @nr_strands: Number of strands
  * @last_strand: Last strand dequeued from (for alternating mode)
+ * @fifo: FIFO mode flag (1 = FIFO, 0 = priority/vtime)
  * @mode: Dequeue mode (ALTERNATING, PRIORITY, or BALANCED)
+ * @strands: Min heap of each strand
+ * @seqs: Sequence number of each strand (FIFO mode)
+ * @dequeue_counts: Number of dequeues from each strand (tracking only)
+ *
+ * All strands are indexed minheaps, so tasks inserted with a handle can be
+ * cancelled or have their vtime changed in place while they are queued.
  */
 struct scx_dhq {
-	scx_minheap_t *strand_a;
-	scx_minheap_t *strand_b;
 	arena_spinlock_t lock;
 	u64 capacity;
-	u64 size_a;
-	u64 size_b;
-	u64 seq_a;
-	u64 seq_b;
-	u64 dequeue_count_a;
-	u64 dequeue_count_b;
+	u64 nr_queued;
 	u64 max_imbalance;
+	u32 nr_strands;
+	u32 last_strand;
 	u8 fifo;
-	u8 last_strand;
 	u8 mode;
+	scx_minheap_t *strands[SCX_DHQ_MAX_STRANDS];
+	u64 seqs[SCX_DHQ_MAX_STRANDS];
+	u64 dequeue_counts[SCX_DHQ_MAX_STRANDS];
 };
 
 typedef struct scx_dhq __arena scx_dhq_t;
@@ -71,31 +73,39 @@ typedef struct scx_dhq __arena scx_dhq_t;
 /**
  * scx_dhq_create_internal - Create a double helix queue
  * @fifo: true for FIFO mode, false for vtime/priority mode
- * @capacity: Total capacity (SCX_DHQ_INF_CAPACITY for unlimited)
+ * @capacity: Total capacity (SCX_DHQ_INF_CAPACITY for unlimited), split
+ *            evenly between the strands
  * @mode: Dequeue mode (ALTERNATING, PRIORITY, or BALANCED)
  * @max_imbalance: Maximum size difference allowed on enqueue (0 for unlimited)
  *                 NOTE: Only applies to enqueue, not dequeue. This prevents
  *                 one strand from flooding the queue while allowing asymmetric
  *                 consumption on dequeue for efficient cross-LLC work stealing.
+ *                 A strand may not grow past the mean size of the other
+ *                 strands by more than @max_imbalance tasks.
+ * @nr_strands: Number of strands, 1 to SCX_DHQ_MAX_STRANDS
  *
  * Returns: Pointer to scx_dhq_t or NULL on failure
  */
-u64 scx_dhq_create_internal(bool fifo, size_t capacity, u64 mode, u64 max_imbalance);
+u64 scx_dhq_create_internal(bool fifo, size_t capacity, u64 mode, u64 max_imbalance,
+			    u32 nr_strands);
 
 #define scx_dhq_create(fifo, mode) \
-	scx_dhq_create_internal((fifo), SCX_DHQ_INF_CAPACITY, (mode), 0)
+	scx_dhq_create_internal((fifo), SCX_DHQ_INF_CAPACITY, (mode), 0, 2)
 
 #define scx_dhq_create_size(fifo, capacity, mode) \
-	scx_dhq_create_internal((fifo), (capacity), (mode), 0)
+	scx_dhq_create_internal((fifo), (capacity), (mode), 0, 2)
 
 #define scx_dhq_create_balanced(fifo, capacity, mode, max_imbalance) \
-	scx_dhq_create_internal((fifo), (capacity), (mode), (max_imbalance))
+	scx_dhq_create_internal((fifo), (capacity), (mode), (max_imbalance), 2)
+
+#define scx_dhq_create_strands(fifo, capacity, mode, max_imbalance, nr_strands) \
+	scx_dhq_create_internal((fifo), (capacity), (mode), (max_imbalance), (nr_strands))
 
 /**
  * scx_dhq_insert - Insert task into DHQ in FIFO mode
  * @dhq_ptr: Pointer to double helix queue
  * @taskc_ptr: Pointer to task context
- * @strand: Target strand (STRAND_A, STRAND_B, or STRAND_AUTO)
+ * @strand: Target strand (strand index or STRAND_AUTO)
  *
  * Returns: 0 on success, negative error code on failure
  */
@@ -106,24 +116,81 @@ int scx_dhq_insert(scx_dhq_t *dhq_ptr, u64 taskc_ptr, u64 strand);
  * @dhq: Pointer to double helix queue
  * @taskc_ptr: Pointer to task context
  * @vtime: Virtual time / priority value
- * @strand: Target strand (STRAND_A, STRAND_B, or STRAND_AUTO)
+ * @strand: Target strand (strand index or STRAND_AUTO)
  *
  * Returns: 0 on success, negative error code on failure
  */
 int scx_dhq_insert_vtime(scx_dhq_t *dhq, u64 taskc_ptr, u64 vtime, u64 strand);
 
+/**
+ * scx_dhq_insert_indexed - Insert task into DHQ in FIFO mode with a handle
+ * @dhq: Pointer to double helix queue
+ * @taskc_ptr: Pointer to task context
+ * @strand: Target strand (strand index or STRAND_AUTO)
+ * @handle: Caller-owned handle, must not be queued
+ *
+ * Like scx_dhq_insert(), but the task can later be removed with
+ * scx_dhq_cancel(). Popping the task clears the handle.
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+int scx_dhq_insert_indexed(scx_dhq_t *dhq, u64 taskc_ptr, u64 strand,
+			   scx_minheap_handle_t *handle);
+
+/**
+ * scx_dhq_insert_vtime_indexed - Insert task into DHQ by vtime with a handle
+ * @dhq: Pointer to double helix queue
+ * @taskc_ptr: Pointer to task context
+ * @vtime: Virtual time / priority value
+ * @strand: Target strand (strand index or STRAND_AUTO)
+ * @handle: Caller-owned handle, must not be queued
+ *
+ * Like scx_dhq_insert_vtime(), but the task can later be removed with
+ * scx_dhq_cancel() or requeued with scx_dhq_update_vtime().
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+int scx_dhq_insert_vtime_indexed(scx_dhq_t *dhq, u64 taskc_ptr, u64 vtime, u64 strand,
+				 scx_minheap_handle_t *handle);
+
+/**
+ * scx_dhq_cancel - Remove a task inserted with a handle
+ * @dhq: Pointer to double helix queue the task was inserted into
+ * @handle: Handle passed on insert
+ *
+ * Removes the task in O(log n). Meant for ops.dequeue, so that tasks leaving
+ * the scheduler do not linger in the queue until they are popped.
+ *
+ * Returns: 0 if the task was removed, -ENOENT if it was not queued (e.g.
+ * it raced with a pop), negative error code on failure
+ */
+int scx_dhq_cancel(scx_dhq_t *dhq, scx_minheap_handle_t *handle);
+
+/**
+ * scx_dhq_update_vtime - Change the vtime of a queued task
+ * @dhq: Pointer to double helix queue the task was inserted into
+ * @handle: Handle passed on insert
+ * @vtime: New virtual time / priority value
+ *
+ * The task stays on its strand. Only valid for vtime DHQs.
+ *
+ * Returns: 0 on success, -ENOENT if the task is not queued, negative
+ * error code on failure
+ */
+int scx_dhq_update_vtime(scx_dhq_t *dhq, scx_minheap_handle_t *handle, u64 vtime);
+
 /**
  * scx_dhq_nr_queued - Get total number of queued tasks
  * @dhq: Pointer to double helix queue
  *
- * Returns: Total number of tasks in both strands
+ * Returns: Total number of tasks in all strands
  */
 int scx_dhq_nr_queued(scx_dhq_t *dhq);
 
 /**
  * scx_dhq_nr_queued_strand - Get number of queued tasks in specific strand
  * @dhq: Pointer to double helix queue
- * @strand: Target strand (STRAND_A or STRAND_B)
+ * @strand: Target strand (strand index)
  *
  * Returns: Number of tasks in specified strand
  */
@@ -140,12 +207,36 @@ u64 scx_dhq_pop(scx_dhq_t *dhq);
 /**
  * scx_dhq_pop_strand - Dequeue task from specific strand
  * @dhq: Pointer to double helix queue
- * @strand: Target strand (STRAND_A or STRAND_B)
+ * @strand: Target strand (strand index)
  *
  * Returns: Task context pointer or NULL if strand is empty
  */
 u64 scx_dhq_pop_strand(scx_dhq_t *dhq, u64 strand);
 
+/**
+ * scx_dhq_pop_batch - Dequeue up to @max tasks under a single lock hold
+ * @dhq: Pointer to double helix queue
+ * @out: Arena array with room for at least @max entries
+ * @max: Maximum number of tasks to dequeue
+ *
+ * Tasks are returned in the order repeated scx_dhq_pop() calls would
+ * return them.
+ *
+ * Returns: Number of tasks written to @out, or negative error code
+ */
+int scx_dhq_pop_batch(scx_dhq_t *dhq, u64 __arena *out, u32 max);
+
+/**
+ * scx_dhq_pop_strand_batch - Dequeue up to @max tasks from a specific strand
+ * @dhq: Pointer to double helix queue
+ * @strand: Target strand (strand index)
+ * @out: Arena array with room for at least @max entries
+ * @max: Maximum number of tasks to dequeue
+ *
+ * Returns: Number of tasks written to @out, or negative error code
+ */
+int scx_dhq_pop_strand_batch(scx_dhq_t *dhq, u64 strand, u64 __arena *out, u32 max);
+
 /**
  * scx_dhq_peek - Peek at next task without removing it
  * @dhq: Pointer to double helix queue
@@ -157,7 +248,7 @@ u64 scx_dhq_peek(scx_dhq_t *dhq);
 /**
  * scx_dhq_peek_strand - Peek at next task in specific strand
  * @dhq: Pointer to double helix queue
- * @strand: Target strand (STRAND_A or STRAND_B)
+ * @strand: Target strand (strand index)
  *
  * Returns: Task context pointer or NULL if strand is empty
  */
@@ -21,6 +21,12 @@ struct lv_queue {
 
 typedef struct lv_queue __arena lv_queue_t;
 
+/* Racy emptiness check, cheap enough to skip empty queues when stealing. */
+static inline bool lvq_empty(lv_queue_t *lvq)
+{
+	return (s64)(lvq->bottom - lvq->top) <= 0;
+}
+
 int lvq_push(lv_queue_t *lvq, u64 val);
 int lvq_pop(lv_queue_t *lvq, u64 *val);
 int lvq_steal(lv_queue_t *lvq, u64 *val);
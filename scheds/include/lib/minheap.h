@@ -5,22 +5,72 @@ struct scx_minheap_elem {
 	u64 weight;
 };
 
+/*
+ * Per-element handle for indexed heaps. The caller embeds the handle in its
+ * own arena state and passes it on insert. The heap keeps it pointing to the
+ * element's current slot, so the element can be removed or reweighted in
+ * O(log n) without searching the heap. A zeroed handle is not queued.
+ */
+struct scx_minheap_handle {
+	u64				heap;	/* Heap holding the element, 0 if none. */
+	u64				ind;	/* Slot of the element in the heap. */
+};
+
+typedef struct scx_minheap_handle __arena scx_minheap_handle_t;
+
+/* Track the slot of every element, required for remove/update_weight. */
+#define SCX_MINHEAP_F_INDEXED		(1ULL << 0)
+
+/*
+ * Heaps are d-ary with d = 2, 4 or 8. Wider heaps are shallower, so pops
+ * touch fewer levels, and all children of a node are adjacent in memory.
+ * With 16 byte elements the four children of a 4-ary node fill exactly
+ * one cache line, which is why it is the default.
+ */
+#define SCX_MINHEAP_DEFAULT_ARITY	4
+#define SCX_MINHEAP_CACHELINE		64
+
 struct scx_minheap {
 	u64				size;
 	u64				capacity;
+	u64				arity;
+	u64				shift;	/* log2(arity) */
 	struct scx_minheap_elem		__arena *helems;
+	/* Indexed heaps only: the handle of the element in each slot, or 0. */
+	u64				__arena *handles;
 };
 
 typedef struct scx_minheap __arena scx_minheap_t;
 
 #ifdef __BPF__
 
-u64 scx_minheap_alloc_internal(size_t capacity);
-#define scx_minheap_alloc(capacity) (scx_minheap_t *)scx_minheap_alloc_internal(capacity)
+u64 scx_minheap_alloc_internal(size_t capacity, u64 arity, u64 flags);
+#define scx_minheap_alloc(capacity) \
+	(scx_minheap_t *)scx_minheap_alloc_internal((capacity), SCX_MINHEAP_DEFAULT_ARITY, 0)
+#define scx_minheap_alloc_arity(capacity, arity) \
+	(scx_minheap_t *)scx_minheap_alloc_internal((capacity), (arity), 0)
+#define scx_minheap_alloc_indexed(capacity) \
+	(scx_minheap_t *)scx_minheap_alloc_internal((capacity), SCX_MINHEAP_DEFAULT_ARITY, SCX_MINHEAP_F_INDEXED)
 
 int scx_minheap_balance_top_down(void __arena *heap_ptr __arg_arena);
 int scx_minheap_insert(void __arena *heap_ptr __arg_arena, u64 elem, u64 weight);
 int scx_minheap_dump(scx_minheap_t *heap __arg_arena);
 int scx_minheap_pop(void __arena *heap_ptr __arg_arena, struct scx_minheap_elem *helem __arg_trusted);
 
+/*
+ * Indexed heap operations. @handle must not be queued in any heap on insert.
+ * remove() and update_weight() return -ENOENT if the element behind @handle
+ * is not in @heap, e.g. because it has already been popped.
+ */
+int scx_minheap_insert_indexed(void __arena *heap_ptr __arg_arena, u64 elem, u64 weight,
+			       scx_minheap_handle_t *handle __arg_arena);
+int scx_minheap_remove(void __arena *heap_ptr __arg_arena, scx_minheap_handle_t *handle __arg_arena);
+int scx_minheap_update_weight(void __arena *heap_ptr __arg_arena, scx_minheap_handle_t *handle __arg_arena,
+			      u64 weight);
+
+static inline bool scx_minheap_handle_queued(scx_minheap_handle_t *handle)
+{
+	return handle->heap != 0;
+}
+
 #endif /* __BPF__ */
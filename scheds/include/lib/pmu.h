@@ -1,10 +1,114 @@
 #pragma once
 
+#include <lib/ravg.h>
+
+#ifndef __arena
+#define __arena __attribute__((address_space(1)))
+#endif /* __arena */
+
+/*
+ * Maximum number of events tracked at once. Userspace opens each event as a
+ * separate per-CPU counter, and perf time-multiplexes them when there are
+ * more events than hardware counters. The counts are then scaled up by the
+ * ratio of the time each event was enabled to the time it was actually
+ * running on a hardware counter.
+ */
+#define SCX_MAX_PMU_COUNTERS (8)
+
+/* Fixed-point precision of the enabled/running scaling ratio. */
+#define SCX_PMU_SCALE_SHIFT (10)
+
+/* Fixed-point precision of the derived metrics, 1.0 is 1 << 10. */
+#define SCX_PMU_METRIC_SHIFT (10)
+
+/*
+ * Source events of the derived metrics, see scx_pmu_metrics_init().
+ */
+enum scx_pmu_src {
+	SCX_PMU_SRC_INSNS,
+	SCX_PMU_SRC_CYCLES,
+	SCX_PMU_SRC_LLC_MISSES,
+	SCX_PMU_SRC_STALLS,
+	SCX_PMU_NR_SRCS,
+};
+
+/*
+ * Decayed per-task metrics, in units of 1 << SCX_PMU_METRIC_SHIFT:
+ *
+ * @ipc: instructions per cycle
+ * @mpki: LLC misses per kilo-instruction
+ * @mem_bound: fraction of the cycles stalled in the backend
+ */
+struct scx_pmu_metrics {
+	u64 ipc;
+	u64 mpki;
+	u64 mem_bound;
+};
+
+/*
+ * Per-task PMU counter state, allocated in the arena. The raw counts and the
+ * enabled/running times only cover the intervals the task was running. The
+ * generation is used to lazily invalidate values from uninstalled events.
+ */
+struct scx_pmu_task {
+	u64 start[SCX_MAX_PMU_COUNTERS];
+	u64 start_enabled[SCX_MAX_PMU_COUNTERS];
+	u64 start_running[SCX_MAX_PMU_COUNTERS];
+	u64 raw[SCX_MAX_PMU_COUNTERS];
+	u64 enabled[SCX_MAX_PMU_COUNTERS];
+	u64 running[SCX_MAX_PMU_COUNTERS];
+	u32 started;	/* Bitmask of the counters with a valid start value. */
+	u32 gen;
+
+	/* Running averages behind struct scx_pmu_metrics. */
+	struct ravg_data ipc;
+	struct ravg_data mpki;
+	struct ravg_data mem_bound;
+};
+
+/*
+ * Extrapolate a raw count to the whole time the event was enabled. Events
+ * that were never multiplexed out are returned as is.
+ */
+static inline u64 scx_pmu_scale(u64 raw, u64 enabled, u64 running)
+{
+	if (!running || running >= enabled)
+		return raw;
+
+	/* Keep the fixed-point ratio from overflowing. */
+	if (enabled >> (64 - SCX_PMU_SCALE_SHIFT)) {
+		enabled >>= SCX_PMU_SCALE_SHIFT;
+		running >>= SCX_PMU_SCALE_SHIFT;
+		if (!running)
+			return raw;
+	}
+
+	return (raw * ((enabled << SCX_PMU_SCALE_SHIFT) / running)) >> SCX_PMU_SCALE_SHIFT;
+}
+
+/*
+ * Read the scaled count of counter @idx directly from the task's arena
+ * state, see scx_pmu_task_ctx() and scx_pmu_event_idx().
+ */
+static inline u64 scx_pmu_task_value(struct scx_pmu_task __arena *ctx, int idx)
+{
+	if (!ctx || idx < 0 || idx >= SCX_MAX_PMU_COUNTERS)
+		return 0;
+
+	return scx_pmu_scale(ctx->raw[idx], ctx->enabled[idx], ctx->running[idx]);
+}
+
+int scx_pmu_init(void);
+int scx_pmu_metrics_init(u64 insns, u64 cycles, u64 llc_misses, u64 stalls, u32 half_life);
+
 int scx_pmu_install(u64 event);
 int scx_pmu_uninstall(u64 event);
+int scx_pmu_event_idx(u64 event);
 
 int scx_pmu_task_init(struct task_struct *p);
 int scx_pmu_task_fini(struct task_struct *p);
+struct scx_pmu_task __arena *scx_pmu_task_ctx(struct task_struct *p);
+int scx_pmu_task_metrics(struct scx_pmu_task __arena *ctx, struct scx_pmu_metrics *metrics);
 
 int scx_pmu_event_start(struct task_struct *p, bool update);
 int scx_pmu_event_stop(struct task_struct *p);
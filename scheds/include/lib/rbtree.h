@@ -14,26 +14,107 @@ struct rbnode;
 
 typedef struct rbnode __arena rbnode_t;
 
+/*
+ * With SCX_RB_COMPACT, nodes link to each other through 32-bit arena offsets
+ * instead of full pointers. The arena spans at most 4GiB and starts at a 4GiB
+ * aligned address, so the low 32 bits of a node's address are enough to find
+ * it, and the high bits are taken from the node holding the link. The low bit
+ * of a link is always set so that a node at arena offset 0 is not confused
+ * with NULL. This shrinks struct rbnode, and every struct embedding it, from
+ * 56 to 40 bytes. All objects linked together must agree on the setting.
+ */
+#ifdef SCX_RB_COMPACT
+typedef u32 rbptr_t;
+#else
+typedef rbnode_t *rbptr_t;
+#endif /* SCX_RB_COMPACT */
+
 struct rbnode {
 	union sdt_id tid;
-	rbnode_t *parent;
+	rbptr_t parent;
 	union {
 		struct {
-			rbnode_t *left;
-			rbnode_t *right;
+			rbptr_t left;
+			rbptr_t right;
 		};
 
-		rbnode_t *child[2];
+		rbptr_t child[2];
 	};
+	bool is_red;
 	uint64_t key;
 	/* Used as a linked list or to store KV pairs. */
 	union {
-		rbnode_t *next;
+		rbptr_t next;
 		uint64_t value;
 	};
-	bool is_red;
 };
 
+#ifdef __BPF__
+
+/*
+ * Accessors for the node links, use these instead of the rbptr_t fields
+ * so that the code works with and without SCX_RB_COMPACT.
+ */
+#ifdef SCX_RB_COMPACT
+static __always_inline rbptr_t rbnode_pack(rbnode_t *node)
+{
+	return node ? ((u32)(u64)node | 1) : 0;
+}
+
+static __always_inline rbnode_t *rbnode_unpack(rbnode_t *ref, rbptr_t ptr)
+{
+	if (!ptr)
+		return NULL;
+
+	return (rbnode_t *)(((u64)ref & ~0xffffffffULL) | (ptr & ~1U));
+}
+#else
+#define rbnode_pack(node) (node)
+#define rbnode_unpack(ref, ptr) (ptr)
+#endif /* SCX_RB_COMPACT */
+
+static __always_inline rbnode_t *rbnode_parent(rbnode_t *node)
+{
+	return rbnode_unpack(node, node->parent);
+}
+
+static __always_inline rbnode_t *rbnode_child(rbnode_t *node, int dir)
+{
+	return rbnode_unpack(node, node->child[dir]);
+}
+
+static __always_inline rbnode_t *rbnode_left(rbnode_t *node)
+{
+	return rbnode_unpack(node, node->left);
+}
+
+static __always_inline rbnode_t *rbnode_right(rbnode_t *node)
+{
+	return rbnode_unpack(node, node->right);
+}
+
+static __always_inline void rbnode_set_parent(rbnode_t *node, rbnode_t *parent)
+{
+	node->parent = rbnode_pack(parent);
+}
+
+static __always_inline void rbnode_set_child(rbnode_t *node, int dir, rbnode_t *child)
+{
+	node->child[dir] = rbnode_pack(child);
+}
+
+static __always_inline void rbnode_set_left(rbnode_t *node, rbnode_t *left)
+{
+	node->left = rbnode_pack(left);
+}
+
+static __always_inline void rbnode_set_right(rbnode_t *node, rbnode_t *right)
+{
+	node->right = rbnode_pack(right);
+}
+
+#endif /* __BPF__ */
+
 /* 
  * Does the rbtree allocate is own nodes, or do they get
  * allocated by the caller?
@@ -87,6 +168,8 @@ int rb_find(rbtree_t *rbtree, u64 key, u64 *value);
 int rb_print(rbtree_t *rbtree);
 int rb_least(rbtree_t *rbtree, u64 *key, u64 *value);
 int rb_pop(rbtree_t *rbtree, u64 *key, u64 *value);
+u64 rb_least_node_internal(rbtree_t *rbtree);
+#define rb_least_node(rbtree) ((rbnode_t *)rb_least_node_internal((rbtree)))
 
 int rb_insert_node(rbtree_t *rbtree, rbnode_t *node);
 int rb_remove_node(rbtree_t *rbtree, rbnode_t *node);
@@ -25,6 +25,8 @@ enum sdt_consts {
 	SDT_TASK_ALLOC_STACK_MAX	= SDT_TASK_ALLOC_STACK_MIN * 5,
 	SDT_TASK_MIN_ELEM_PER_ALLOC 	= 8,
 	SDT_TASK_ALLOC_ATTEMPTS		= 32,
+	SDT_POOL_RESERVE_MAX		= 16,
+	SDT_MAX_RESERVES		= 32,
 };
 
 union sdt_id {
@@ -80,11 +82,22 @@ struct scx_alloc_stack {
 	void __arena	*stack[SDT_TASK_ALLOC_STACK_MAX];
 };
 
+/*
+ * Slabs set aside for a pool by scx_alloc_refill(), so that running out of
+ * the current slab does not require allocating arena pages inline.
+ */
+struct sdt_reserve {
+	__u64		nr_pages;	/* Pages per slab. */
+	__u64		idx;		/* Number of reserved slabs. */
+	void __arena	*slabs[SDT_POOL_RESERVE_MAX];
+};
+
 struct sdt_pool {
 	void __arena	*slab;
 	__u64		elem_size;
 	__u64		max_elems;
 	__u64		idx;
+	struct sdt_reserve __arena *reserve;
 };
 
 struct scx_alloc_stats {
@@ -94,6 +107,16 @@ struct scx_alloc_stats {
 	__u64		free_ops;
 	__u64		active_allocs;
 	__u64		arena_pages_used;
+
+	/* Updated atomically, may be modified outside alloc_lock. */
+	__u64		alloc_failures;	/* Allocations that returned NULL. */
+	__u64		reserve_hits;	/* Slabs taken from a reserve. */
+	__u64		reserve_misses;	/* Slabs allocated inline, reserve empty. */
+
+	__u64		refills;
+	__u64		refill_pages;
+	__u64		refill_ns_last;
+	__u64		refill_ns_max;
 };
 
 struct scx_allocator {
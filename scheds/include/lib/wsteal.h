@@ -0,0 +1,74 @@
+#pragma once
+
+#ifdef __BPF__
+#include <scx/common.bpf.h>
+#include <bpf_arena_common.bpf.h>
+#endif /* __BPF__ */
+
+#include <lib/lvqueue.h>
+
+/*
+ * Work-stealing dispatch engine. Every CPU owns a Chase-Lev deque: the
+ * owner pushes and pops at the bottom without contention, and CPUs that run
+ * out of work steal from the top of other CPUs' deques. Victims are tried
+ * topology-first, starting with the SMT siblings of the thief and moving
+ * out to its LLC, its NUMA node and finally the whole system, so stolen work
+ * stays as close to its caches as possible.
+ *
+ * Only the owning CPU may call scx_ws_push(), scx_ws_pop() and
+ * scx_ws_pop_oldest() on its deque. sched_ext callbacks run with preemption
+ * disabled, so pushing from ops.enqueue and popping from ops.dispatch of the
+ * current CPU is safe. Stealing is safe from any CPU.
+ *
+ * scx_ws_pop() takes the newest entry, which is cache-hot but can starve
+ * older entries if the owner keeps pushing. scx_ws_pop_oldest() takes the
+ * oldest one, like a thief would.
+ *
+ * The engine stores opaque u64 values, usually pids.
+ */
+
+enum scx_ws_level {
+	SCX_WS_LVL_CORE		= 0,
+	SCX_WS_LVL_LLC		= 1,
+	SCX_WS_LVL_NODE		= 2,
+	SCX_WS_LVL_SYSTEM	= 3,
+	SCX_WS_NR_LEVELS	= 4,
+};
+
+struct scx_ws_cpu {
+	lv_queue_t *lvq;
+	/* Other CPUs ordered by topological distance, closest first. */
+	u16 __arena *victims;
+	/* victims[level_end[lvl - 1], level_end[lvl]) are the victims at lvl. */
+	u32 level_end[SCX_WS_NR_LEVELS];
+	/* Rotates the first victim tried within a level to spread thieves. */
+	u32 rotor;
+
+	/* Statistics, only written by the owning CPU. */
+	u64 nr_pushed;
+	u64 nr_popped;
+	u64 nr_steal_attempts;
+	u64 nr_steal_contended;
+	u64 nr_stolen;
+	u64 nr_stolen_level[SCX_WS_NR_LEVELS];
+} __attribute__((aligned(64)));
+
+typedef struct scx_ws_cpu __arena scx_ws_cpu_t;
+
+struct scx_ws {
+	u32 nr_cpus;
+	scx_ws_cpu_t **cpus;
+};
+
+typedef struct scx_ws __arena scx_ws_t;
+
+#ifdef __BPF__
+u64 scx_ws_create_internal(void);
+#define scx_ws_create() ((scx_ws_t *)scx_ws_create_internal())
+
+int scx_ws_push(scx_ws_t *ws, s32 cpu, u64 val);
+int scx_ws_pop(scx_ws_t *ws, s32 cpu, u64 *val);
+int scx_ws_pop_oldest(scx_ws_t *ws, s32 cpu, u64 *val);
+int scx_ws_steal(scx_ws_t *ws, s32 cpu, u64 *val);
+u64 scx_ws_nr_queued(scx_ws_t *ws, s32 cpu);
+#endif /* __BPF__ */
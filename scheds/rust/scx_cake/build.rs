@@ -20,6 +20,7 @@ fn main() {
         .add_source("../../../lib/arena.bpf.c")
         .add_source("../../../lib/rbtree.bpf.c")
         .add_source("../../../lib/atq.bpf.c")
+        .add_source("../../../lib/calq.bpf.c")
         .add_source("../../../lib/sdt_alloc.bpf.c")
         .add_source("../../../lib/sdt_task.bpf.c")
         .add_source("../../../lib/bitmap.bpf.c")
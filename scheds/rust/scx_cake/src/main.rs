@@ -554,6 +554,8 @@ impl<'a> Scheduler<'a> {
     }
 
     fn run(&mut self, shutdown: Arc<AtomicBool>) -> Result<()> {
+        use libbpf_rs::skel::Skel;
+
         // Attach the scheduler
         let link = self
             .skel
@@ -614,6 +616,7 @@ impl<'a> Scheduler<'a> {
             let mut elapsed = 0;
             while elapsed < 10 && !shutdown.load(Ordering::Relaxed) {
                 std::thread::sleep(std::time::Duration::from_secs(1));
+                ArenaLib::refill(self.skel.object())?;
                 elapsed += 1;
             }
             let duration = start_time.elapsed().as_secs_f64();
@@ -643,7 +646,8 @@ impl<'a> Scheduler<'a> {
             if self.args.verbose && !std::io::stdout().is_terminal() {
                 warn!("TUI disabled: no terminal detected (headless mode)");
             }
-            // Event-based silent mode - block on signalfd, poll with 60s timeout for UEI check
+            // Event-based silent mode - block on signalfd, poll with 1s timeout to
+            // refill the arena allocator reserves and check UEI
             // Signals are already blocked from main() — just create signalfd to read them
             let mut mask = SigSet::empty();
             mask.add(Signal::SIGINT);
@@ -657,14 +661,14 @@ impl<'a> Scheduler<'a> {
             use std::os::fd::BorrowedFd;
 
             loop {
-                // Block for up to 60 seconds, then check UEI
+                // Block for up to 1 second, then refill and check UEI
                 // poll() returns: >0 = readable, 0 = timeout, -1 = error
                 // SAFETY: sfd is valid for the duration of this loop
                 let poll_fd = unsafe {
                     PollFd::new(BorrowedFd::borrow_raw(sfd.as_raw_fd()), PollFlags::POLLIN)
                 };
                 let mut fds = [poll_fd];
-                let result = poll(&mut fds, nix::poll::PollTimeout::from(60_000u16)); // 60 seconds
+                let result = poll(&mut fds, nix::poll::PollTimeout::from(1_000u16)); // 1 second
 
                 match result {
                     Ok(n) if n > 0 => {
@@ -676,7 +680,11 @@ impl<'a> Scheduler<'a> {
                         break;
                     }
                     Ok(_) => {
-                        // Timeout - check UEI
+                        // Timeout - top up the sdt_alloc page reserves, which
+                        // the allocator cannot do from non-sleepable context.
+                        ArenaLib::refill(self.skel.object())?;
+
+                        // Check UEI
                         if scx_utils::uei_exited!(&self.skel, uei) {
                             match scx_utils::uei_report!(&self.skel, uei) {
                                 Ok(reason) => {
@@ -704,6 +712,14 @@ impl<'a> Scheduler<'a> {
         }
 
         info!("scx_cake scheduler shutting down");
+        if let Ok(st) = ArenaLib::alloc_stats(self.skel.object()) {
+            info!(
+                "arena alloc: {} failures, {} reserve misses, refill max {}us",
+                st.alloc_failures,
+                st.reserve_misses,
+                st.refill_ns_max / 1000
+            );
+        }
 
         // Drop struct_ops link BEFORE uei_report — this triggers the kernel to
         // set UEI kind=SCX_EXIT_UNREG. Matches scx_bpfland/scx_p2dq/scx_lavd
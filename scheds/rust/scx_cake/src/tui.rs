@@ -27,6 +27,8 @@ use sysinfo::{Components, System};
 
 use crate::bpf_skel::types::cake_stats;
 use crate::bpf_skel::BpfSkel;
+use libbpf_rs::skel::Skel;
+use scx_arena::{AllocStats, ArenaLib};
 
 use crate::topology::TopologyInfo;
 
@@ -230,6 +232,7 @@ pub struct TuiApp {
     pub show_all_tasks: bool,                  // false = BPF-tracked only, true = all
     pub arena_active: usize,                   // Arena slots with tid != 0
     pub arena_max: usize,                      // Arena pool max_elems
+    pub alloc_stats: AllocStats,               // sdt_alloc reserve counters
     pub bpf_task_count: usize,                 // Tasks with total_runs > 0
     pub prev_deltas: HashMap<u32, (u32, u16)>, // (total_runs, migration_count) — lightweight delta snapshot
     pub active_pids_buf: std::collections::HashSet<u32>, // Reused per-tick to avoid alloc
@@ -480,6 +483,7 @@ impl TuiApp {
             show_all_tasks: false,
             arena_active: 0,
             arena_max: 0,
+            alloc_stats: AllocStats::default(),
             bpf_task_count: 0,
             prev_deltas: HashMap::new(),
             active_pids_buf: std::collections::HashSet::new(),
@@ -1576,7 +1580,7 @@ fn draw_dashboard_tab(frame: &mut Frame, app: &mut TuiApp, stats: &cake_stats, a
     };
 
     let line2 = format!(
-        " Dispatch: Local:{} Steal:{} Miss:{} HintSkip:{} ({:.0}%)  │  {}  │  EEVDF: Vprot:{} Lag:{} Cap:{}",
+        " Dispatch: Local:{} Steal:{} Miss:{} HintSkip:{} ({:.0}%)  │  {}  │  EEVDF: Vprot:{} Lag:{} Cap:{}  │  Alloc: Fail:{} Miss:{} Refill:{}us",
         stats.nr_local_dispatches,
         stats.nr_stolen_dispatches,
         stats.nr_dispatch_misses,
@@ -1586,6 +1590,9 @@ fn draw_dashboard_tab(frame: &mut Frame, app: &mut TuiApp, stats: &cake_stats, a
         stats.nr_vprot_suppressed,
         stats.nr_lag_applied,
         stats.nr_capacity_scaled,
+        app.alloc_stats.alloc_failures,
+        app.alloc_stats.reserve_misses,
+        app.alloc_stats.refill_ns_max / 1000,
     );
 
     // State label — shown in header for all three operating states
@@ -3935,6 +3942,11 @@ pub fn run_tui(
             app.arena_max = 0; // arena max not tracked via iter path
             app.arena_active = app.active_pids_buf.len();
 
+            // Top up the sdt_alloc page reserves once per tick (sleepable
+            // syscall prog) and pick up the allocator counters.
+            ArenaLib::refill(skel.object())?;
+            app.alloc_stats = ArenaLib::alloc_stats(skel.object()).unwrap_or_default();
+
             /* EXPLICITLY DISABLED: Dead Tasks are no longer removed so users can view
              * the absolute hardware scheduling history of all tasks on the system.
              * app.task_rows.retain(|pid, _| active_pids.contains(pid)); */
@@ -191,6 +191,9 @@ impl Scheduler {
             stats[stat as usize] = sum;
         }
 
+        let alloc_stats =
+            ArenaLib::alloc_stats(self.skel.skel.read().unwrap().object()).unwrap_or_default();
+
         Metrics {
             trait_random_delays: stats
                 [bpf_intf::chaos_stat_idx_CHAOS_STAT_TRAIT_RANDOM_DELAYS as usize],
@@ -202,6 +205,9 @@ impl Scheduler {
             kprobe_random_delays: stats
                 [bpf_intf::chaos_stat_idx_CHAOS_STAT_KPROBE_RANDOM_DELAYS as usize],
             timer_kicks: stats[bpf_intf::chaos_stat_idx_CHAOS_STAT_TIMER_KICKS as usize],
+            alloc_fail: alloc_stats.alloc_failures,
+            alloc_reserve_miss: alloc_stats.reserve_misses,
+            alloc_refill_ns_max: alloc_stats.refill_ns_max,
         }
     }
 
@@ -224,6 +230,10 @@ impl Scheduler {
                     .and_then(|_| Err(anyhow::anyhow!("scheduler exited unexpectedly")));
             }
 
+            // Keep the arena allocator reserves topped up, so allocations
+            // from the scheduling paths do not have to allocate pages inline.
+            ArenaLib::refill(skel.object())?;
+
             match req_ch.recv_timeout(Duration::from_millis(500)) {
                 Ok(()) => {
                     let _ = res_ch.send(self.get_metrics());
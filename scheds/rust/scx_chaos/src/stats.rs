@@ -29,13 +29,19 @@ pub struct Metrics {
     pub timer_kicks: u64,
     #[stat(desc = "Number of times a kprobe caused a random delay to be applied")]
     pub kprobe_random_delays: u64,
+    #[stat(desc = "Number of arena allocations that failed")]
+    pub alloc_fail: u64,
+    #[stat(desc = "Number of arena slabs allocated inline because the reserve was empty")]
+    pub alloc_reserve_miss: u64,
+    #[stat(desc = "Time the slowest arena reserve refill took (ns)")]
+    pub alloc_refill_ns_max: u64,
 }
 
 impl Metrics {
     fn format<W: Write>(&self, w: &mut W) -> Result<()> {
         writeln!(
             w,
-            "chaos traits: random_delays/cpu_freq/degradation {}/{}/{}\n\tchaos excluded/skipped {}/{}\n\tkprobe_random_delays {}\n\ttimer kicks: {}",
+            "chaos traits: random_delays/cpu_freq/degradation {}/{}/{}\n\tchaos excluded/skipped {}/{}\n\tkprobe_random_delays {}\n\ttimer kicks: {}\n\talloc fail/reserve miss {}/{} refill max {}us",
             self.trait_random_delays,
             self.trait_cpu_freq,
             self.trait_degradation,
@@ -43,6 +49,9 @@ impl Metrics {
             self.chaos_skipped,
             self.kprobe_random_delays,
             self.timer_kicks,
+            self.alloc_fail,
+            self.alloc_reserve_miss,
+            self.alloc_refill_ns_max / 1000,
         )?;
         Ok(())
     }
@@ -56,6 +65,9 @@ impl Metrics {
             chaos_skipped: self.chaos_skipped - rhs.chaos_skipped,
             kprobe_random_delays: self.kprobe_random_delays - rhs.kprobe_random_delays,
             timer_kicks: self.timer_kicks - rhs.timer_kicks,
+            alloc_fail: self.alloc_fail - rhs.alloc_fail,
+            alloc_reserve_miss: self.alloc_reserve_miss - rhs.alloc_reserve_miss,
+            alloc_refill_ns_max: self.alloc_refill_ns_max,
         }
     }
 }
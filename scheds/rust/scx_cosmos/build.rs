@@ -9,6 +9,8 @@ fn main() {
         .enable_intf("src/bpf/intf.h", "bpf_intf.rs")
         .enable_skel("src/bpf/main.bpf.c", "bpf")
         .add_source("../../../lib/pmu.bpf.c")
+        .add_source("../../../lib/ravg.bpf.c")
+        .add_source("../../../lib/sdt_alloc.bpf.c")
         .compile_link_gen()
         .unwrap();
 }
@@ -1412,7 +1412,7 @@ s32 BPF_STRUCT_OPS(cosmos_init_task, struct task_struct *p,
 	if (!tctx)
 		return -ENOMEM;
 
-	if ((ret = scx_pmu_task_init(p)))
+	if ((perf_config || perf_sticky) && (ret = scx_pmu_task_init(p)))
 		return ret;
 
 	ret = init_cpumask(&tctx->cpumask);
@@ -1503,6 +1503,12 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(cosmos_init)
 		cctx->perf_events = 0;
 	}
 
+	if (perf_config || perf_sticky) {
+		err = scx_pmu_init();
+		if (err)
+			return err;
+	}
+
 	if (perf_config) {
 		err = scx_pmu_install(perf_config);
 		if (err)
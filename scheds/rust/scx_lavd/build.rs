@@ -19,6 +19,7 @@ fn main() {
         .add_source("src/bpf/util.bpf.c")
         .add_source("src/bpf/lib/arena.bpf.c")
         .add_source("src/bpf/lib/atq.bpf.c")
+        .add_source("src/bpf/lib/calq.bpf.c")
         .add_source("src/bpf/lib/bitmap.bpf.c")
         .add_source("src/bpf/lib/cgroup_bw.bpf.c")
         .add_source("src/bpf/lib/cpumask.bpf.c")
@@ -72,12 +72,20 @@ struct sys_stat {
 
 	u64	nr_sched;	/* total scheduling so far */
 	u64	nr_preempt;	/* total number of preemption operations triggered */
+	u64	nr_victim_tree;	/* number of victims found by the victim tree */
+	u64	nr_victim_sample; /* number of victims found by random sampling */
 	u64	nr_perf_cri;	/* number of performance-critical tasks scheduled */
 	u64	nr_lat_cri;	/* number of latency-critical tasks scheduled */
 	u64	nr_x_migration; /* number of cross domain migration */
 	u64	nr_big;		/* scheduled on big core */
 	u64	nr_pc_on_big;	/* performance-critical tasks scheduled on big core */
 	u64	nr_lc_on_big;	/* latency-critical tasks scheduled on big core */
+
+	u64	nr_cbw_cgroups;	/* number of cgroups under bandwidth control */
+	u64	nr_cbw_replenish; /* number of budget replenishments so far */
+	u64	cbw_replenish_ns_max; /* time the slowest replenishment took */
+	u64	nr_cbw_llcx_miss; /* number of LLC context attach failures */
+	u64	nr_cbw_reenq;	/* number of throttled tasks reenqueued so far */
 };
 
 /*
@@ -111,6 +119,11 @@ struct task_ctx_x {
 	u64	dsq_id;		/* CPU's associated DSQ */
 	u64	dsq_consume_lat; /* DSQ's consume latency */
 	u64	last_slice_used_wall;	/* time(ns) used in last scheduled interval: [last running, last stopping] */
+	u64	cgrp_id;		/* cgroup id of the task */
+	u64	cbw_nr_p2c;		/* budget transfers from the subroot to the cgroup */
+	u64	cbw_nr_c2l;		/* budget transfers from the cgroup to its LLCs */
+	u64	cbw_nr_l2l;		/* budget transfers between the cgroup's LLCs */
+	u64	cbw_nr_predist;		/* LLC shares of the cgroup handed out in advance */
 };
 
 
@@ -13,6 +13,7 @@
 #include <bpf/bpf_core_read.h>
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_tracing.h>
+#include <lib/cgroup.h>
 
 
 /*
@@ -25,6 +26,8 @@ volatile bool is_monitored;
  */
 struct introspec intrspc;
 
+extern const volatile bool	enable_cpu_bw;
+
 struct {
 	__uint(type, BPF_MAP_TYPE_RINGBUF);
 	__uint(max_entries, 16 * 1024 /* 16 KB */);
@@ -33,6 +36,7 @@ struct {
 static __always_inline
 int submit_task_ctx(struct task_struct *p, task_ctx __arg_arena *taskc, u32 cpu_id)
 {
+	struct scx_cgroup_bw_xfer_stats xfer = {};
 	struct cpu_ctx *cpuc;
 	struct cpdom_ctx *cpdomc;
 	struct msg_task_ctx *m;
@@ -46,6 +50,13 @@ int submit_task_ctx(struct task_struct *p, task_ctx __arg_arena *taskc, u32 cpu_
 	if (!cpdomc)
 		return -EINVAL;
 
+	/*
+	 * Report how the budget of the task's cgroup has been moved around
+	 * under CPU bandwidth control.
+	 */
+	if (enable_cpu_bw)
+		scx_cgroup_bw_get_xfer_stats(taskc->cgrp_id, &xfer);
+
 	m = bpf_ringbuf_reserve(&introspec_msg, sizeof(*m), 0);
 	if (!m)
 		return -ENOMEM;
@@ -83,6 +94,11 @@ int submit_task_ctx(struct task_struct *p, task_ctx __arg_arena *taskc, u32 cpu_
 	m->taskc_x.dsq_id = cpdomc->id;
 	m->taskc_x.dsq_consume_lat = cpdomc->dsq_consume_lat;
 	m->taskc_x.last_slice_used_wall = taskc->last_slice_used_wall;
+	m->taskc_x.cgrp_id = taskc->cgrp_id;
+	m->taskc_x.cbw_nr_p2c = xfer.nr_p2c;
+	m->taskc_x.cbw_nr_c2l = xfer.nr_c2l;
+	m->taskc_x.cbw_nr_l2l = xfer.nr_l2l;
+	m->taskc_x.cbw_nr_predist = xfer.nr_predist;
 
 	bpf_ringbuf_submit(m, 0);
 
@@ -314,6 +314,8 @@ struct cpu_ctx {
 	  * Estimated time stolen by steal/irq time on CPU
 	  */
 	volatile u64	stolen_time_wall;
+	volatile u32	nr_victim_tree;	/* victims found by the victim tree */
+	volatile u32	nr_victim_sample; /* victims found by random sampling */
 
 	/*
 	 * --- cacheline 3 boundary (192 bytes) ---
@@ -349,6 +351,7 @@ extern const volatile u8	cpu_turbo[LAVD_CPU_ID_MAX];
 
 extern const volatile bool	no_wake_sync;
 extern const volatile bool	no_slice_boost;
+extern const volatile bool	no_victim_tree;
 extern const volatile u8	verbose;
 
 #define debugln(fmt, ...)						\
@@ -498,6 +501,8 @@ void try_find_and_kick_victim_cpu(struct task_struct *p,
 					 task_ctx *taskc,
 					 s32 preferred_cpu,
 					 u64 dsq_id);
+int init_victim_tree(void);
+void update_victim_tree(struct cpu_ctx *cpuc);
 
 extern volatile bool is_monitored;
 
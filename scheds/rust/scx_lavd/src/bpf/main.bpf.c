@@ -440,6 +440,7 @@ static void update_stat_for_running(struct task_struct *p,
 	cpuc->lat_cri = taskc->lat_cri;
 	cpuc->running_clk = now;
 	cpuc->est_stopping_clk = get_est_stopping_clk(taskc, now);
+	update_victim_tree(cpuc);
 
 	/*
 	 * Update statistics information.
@@ -1454,6 +1455,7 @@ unlock_out:
 	barrier();
 
 	cpuc->is_online = true;
+	update_victim_tree(cpuc);
 }
 
 static void cpu_ctx_init_offline(struct cpu_ctx *cpuc, u32 cpu_id, u64 now)
@@ -1477,6 +1479,7 @@ unlock_out:
 	cpuc->lat_cri = 0;
 	cpuc->running_clk = 0;
 	cpuc->est_stopping_clk = SCX_SLICE_INF;
+	update_victim_tree(cpuc);
 }
 
 void BPF_STRUCT_OPS(lavd_cpu_online, s32 cpu)
@@ -2229,6 +2232,13 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(lavd_init)
 	if (err)
 		return err;
 
+	/*
+	 * Build the victim tree for preemption from the compute domains.
+	 */
+	err = init_victim_tree();
+	if (err)
+		return err;
+
 	/*
 	 * Initialize per-CPU DSQs.
 	 * Per-CPU DSQs are created when per_cpu_dsq is enabled OR when
@@ -2265,6 +2275,8 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(lavd_init)
 	if (enable_cpu_bw) {
 		struct scx_cgroup_bw_config bw_config = {
 			.verbose = verbose > 2,
+			.predictive = cpu_bw_predictive,
+			.reenq_max_batch = cpu_bw_reenq_batch,
 		};
 		err = scx_cgroup_bw_lib_init(&bw_config);
 	}
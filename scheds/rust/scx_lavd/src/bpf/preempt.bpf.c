@@ -64,6 +64,264 @@ static bool can_x_kick_cpu2(struct preemption_info *prm_x,
 	return can_x_kick_y(prm_x, prm_cpu2);
 }
 
+/*
+ * Victim tree
+ *
+ * A tournament tree over all CPUs keyed by the preemption priority of the
+ * task running on each CPU. Each inner node holds the lower-priority one of
+ * its two children, so the root holds the best victim of the whole system.
+ * The leaves of a compute domain are contiguous, so the best victim of a
+ * compute domain is found with a range query in O(log n) instead of
+ * traversing the CPUs of the domain.
+ *
+ * Every running/stopping event replays the path from the CPU's leaf to the
+ * root, but only stores the nodes whose value actually changes, so the
+ * common no-change case keeps the shared cachelines clean. The updates from
+ * different CPUs are not serialized, so an inner node can hold a stale
+ * winner written by a racing update. It is rewritten by the next update of
+ * any leaf below it, which happens at every context switch on those CPUs.
+ * A stale winner is fine because it is validated again against the current
+ * cpu_ctx before being kicked, and we fall back to random sampling when
+ * the validation fails.
+ */
+#define LAVD_VT_HEIGHT		10	/* log2(LAVD_CPU_ID_MAX) + 1 */
+#define LAVD_VT_NO_SLOT		((u16)-1)
+
+struct victim_node {
+	u64		est_stopping_clk;
+	u32		lat_cri;
+	u32		cpu_id;
+};
+
+struct victim_tree {
+	u32			nr_leaves;	/* power of two */
+	u16			cpu_slot[LAVD_CPU_ID_MAX];
+	u16			cpdom_start[LAVD_CPDOM_MAX_NR];
+	u16			cpdom_end[LAVD_CPDOM_MAX_NR];
+	struct victim_node	nodes[2 * LAVD_CPU_ID_MAX]; /* nodes[0] is unused */
+};
+
+static struct victim_tree __arena *victim_tree;
+
+static bool is_lower_prio_node(struct victim_node __arena *x,
+			       struct victim_node __arena *y)
+{
+	/*
+	 * Prefer a less latency-critical task, and among those, the one
+	 * that will run longer.
+	 */
+	if (x->lat_cri != y->lat_cri)
+		return x->lat_cri < y->lat_cri;
+	return x->est_stopping_clk > y->est_stopping_clk;
+}
+
+static void set_unkickable_node(struct victim_node __arena *node)
+{
+	node->lat_cri = (u32)-1;
+	node->est_stopping_clk = 0;
+}
+
+static bool is_same_node(struct victim_node __arena *x,
+			 struct victim_node __arena *y)
+{
+	return x->cpu_id == y->cpu_id && x->lat_cri == y->lat_cri &&
+	       x->est_stopping_clk == y->est_stopping_clk;
+}
+
+__hidden
+void update_victim_tree(struct cpu_ctx *cpuc)
+{
+	struct victim_tree __arena *vt = victim_tree;
+	struct victim_node __arena *node, *left, *right, *winner;
+	u64 est_stopping_clk;
+	u32 i, slot, lat_cri;
+	int lv;
+
+	if (no_victim_tree || !vt || cpuc->cpu_id >= LAVD_CPU_ID_MAX)
+		return;
+
+	slot = vt->cpu_slot[cpuc->cpu_id];
+	if (slot >= vt->nr_leaves)
+		return;
+
+	/*
+	 * An offline CPU has no running task but should never be a victim.
+	 */
+	if (cpuc->is_online) {
+		lat_cri = cpuc->lat_cri;
+		est_stopping_clk = cpuc->est_stopping_clk;
+	} else {
+		lat_cri = (u32)-1;
+		est_stopping_clk = 0;
+	}
+
+	/*
+	 * Most running/stopping events do not change what the tree sees, so
+	 * only store what differs.
+	 */
+	i = vt->nr_leaves + slot;
+	node = &vt->nodes[i];
+	if (node->lat_cri != lat_cri || node->est_stopping_clk != est_stopping_clk) {
+		node->lat_cri = lat_cri;
+		node->est_stopping_clk = est_stopping_clk;
+	}
+
+	/*
+	 * Replay the matches on the path to the root. Always go all the way
+	 * up, even past matches whose winner is unchanged, so that a stale
+	 * node left by a racing update gets repaired.
+	 */
+	bpf_for(lv, 0, LAVD_VT_HEIGHT) {
+		i >>= 1;
+		if (!i)
+			break;
+
+		left = &vt->nodes[2 * i];
+		right = &vt->nodes[2 * i + 1];
+		winner = is_lower_prio_node(right, left) ? right : left;
+		if (!is_same_node(&vt->nodes[i], winner))
+			vt->nodes[i] = *winner;
+	}
+}
+
+__hidden
+int init_victim_tree(void)
+{
+	struct victim_tree __arena *vt;
+	struct cpdom_ctx *cpdomc;
+	struct cpu_ctx *cpuc;
+	u64 cpdom_id, cpumask;
+	u32 nr_slots = 0, nr_leaves = 1;
+	int i, j, k, cpu;
+
+	if (no_victim_tree)
+		return 0;
+
+	vt = scx_static_alloc(sizeof(*vt), 1);
+	if (!vt) {
+		scx_bpf_error("Failed to allocate the victim tree");
+		return -ENOMEM;
+	}
+
+	bpf_for(cpu, 0, LAVD_CPU_ID_MAX)
+		vt->cpu_slot[cpu] = LAVD_VT_NO_SLOT;
+
+	/*
+	 * Lay out the CPUs of each compute domain next to each other.
+	 */
+	bpf_for(cpdom_id, 0, nr_cpdoms) {
+		if (cpdom_id >= LAVD_CPDOM_MAX_NR)
+			break;
+
+		vt->cpdom_start[cpdom_id] = nr_slots;
+		vt->cpdom_end[cpdom_id] = nr_slots;
+
+		cpdomc = MEMBER_VPTR(cpdom_ctxs, [cpdom_id]);
+		if (!cpdomc || !cpdomc->is_valid)
+			continue;
+
+		bpf_for(i, 0, LAVD_CPU_ID_MAX/64) {
+			cpumask = cpdomc->__cpumask[i];
+			bpf_for(k, 0, 64) {
+				j = cpumask_next_set_bit(&cpumask);
+				if (j < 0)
+					break;
+				cpu = (i * 64) + j;
+				if (cpu >= LAVD_CPU_ID_MAX ||
+				    vt->cpu_slot[cpu] != LAVD_VT_NO_SLOT)
+					continue;
+				vt->cpu_slot[cpu] = nr_slots++;
+			}
+		}
+		vt->cpdom_end[cpdom_id] = nr_slots;
+	}
+
+	while (nr_leaves < nr_slots && can_loop)
+		nr_leaves <<= 1;
+	vt->nr_leaves = nr_leaves;
+
+	bpf_for(i, 0, 2 * nr_leaves) {
+		if (i >= 2 * LAVD_CPU_ID_MAX)
+			break;
+		set_unkickable_node(&vt->nodes[i]);
+	}
+
+	bpf_for(cpu, 0, LAVD_CPU_ID_MAX) {
+		if (vt->cpu_slot[cpu] == LAVD_VT_NO_SLOT)
+			continue;
+		vt->nodes[nr_leaves + vt->cpu_slot[cpu]].cpu_id = cpu;
+	}
+
+	/*
+	 * Publish the tree before populating it so the updates below walk
+	 * it like any other update.
+	 */
+	victim_tree = vt;
+
+	bpf_for(cpu, 0, nr_cpu_ids) {
+		cpuc = get_cpu_ctx_id(cpu);
+		if (!cpuc) {
+			scx_bpf_error("Failed to lookup cpu_ctx: %d", cpu);
+			return -ESRCH;
+		}
+		update_victim_tree(cpuc);
+	}
+
+	return 0;
+}
+
+static struct cpu_ctx *find_victim_cpu_tree(const struct cpumask *cpumask,
+					    s32 preferred_cpu, u64 cpdom_id)
+{
+	struct victim_tree __arena *vt = victim_tree;
+	struct cpu_ctx *cpuc;
+	u32 l, r, best = 0;
+	int lv, cpu;
+
+	if (!vt || cpdom_id >= LAVD_CPDOM_MAX_NR)
+		return NULL;
+
+	/*
+	 * Run the range query over the leaves of the compute domain. Node
+	 * zero is never used, so it marks that no winner is chosen yet.
+	 */
+	l = vt->nr_leaves + vt->cpdom_start[cpdom_id];
+	r = vt->nr_leaves + vt->cpdom_end[cpdom_id];
+	bpf_for(lv, 0, LAVD_VT_HEIGHT) {
+		if (l >= r)
+			break;
+		if (l & 1) {
+			if (!best || is_lower_prio_node(&vt->nodes[l], &vt->nodes[best]))
+				best = l;
+			l++;
+		}
+		if (r & 1) {
+			r--;
+			if (!best || is_lower_prio_node(&vt->nodes[r], &vt->nodes[best]))
+				best = r;
+		}
+		l >>= 1;
+		r >>= 1;
+	}
+
+	if (!best || best >= 2 * LAVD_CPU_ID_MAX)
+		return NULL;
+
+	/*
+	 * The tree does not know about the task's affinity, and the preferred
+	 * CPU has already been checked by the caller.
+	 */
+	cpu = vt->nodes[best].cpu_id;
+	if (cpu == preferred_cpu || !bpf_cpumask_test_cpu(cpu, cpumask))
+		return NULL;
+
+	cpuc = get_cpu_ctx_id(cpu);
+	if (!cpuc || !cpuc->is_online)
+		return NULL;
+
+	return cpuc;
+}
+
 static void init_prm_by_task(struct preemption_info *prm_task,
 			     task_ctx *taskc, u64 now)
 {
@@ -83,7 +341,7 @@ static bool is_worth_kick_other_task(task_ctx *taskc)
 }
 
 static struct cpu_ctx *find_victim_cpu(const struct cpumask *cpumask,
-				       s32 preferred_cpu,
+				       s32 preferred_cpu, u64 cpdom_id,
 				       task_ctx *taskc, u64 now)
 {
 	/*
@@ -92,11 +350,14 @@ static struct cpu_ctx *find_victim_cpu(const struct cpumask *cpumask,
 	 * should run on the N CPUs all the time. This is the same as the
 	 * load-balancing problem; the load-balancing problem finds a least
 	 * loaded server, and the preemption problem finds a CPU running a
-	 * least latency critical task. Hence, we use the 'power of two random
-	 * choices' technique.
+	 * least latency critical task. We first ask the victim tree for the
+	 * CPU running the least latency critical task in the compute domain.
+	 * If that CPU does not qualify, we fall back to the 'power of two
+	 * random choices' technique.
 	 */
 	struct cpu_ctx *cpuc;
 	struct preemption_info prm_task, prm_cpus[2], *victim_cpu;
+	bool from_tree = false;
 	int cpu, nr_cpus;
 	int i, v = 0;
 	int ret;
@@ -115,6 +376,18 @@ static struct cpu_ctx *find_victim_cpu(const struct cpumask *cpumask,
 			v++;
 	}
 
+	/*
+	 * Look up the victim tree. Since the tree is racy and oblivious to
+	 * the task's affinity, its winner is checked like a sampled CPU.
+	 */
+	if (!no_victim_tree &&
+	    (cpuc = find_victim_cpu_tree(cpumask, preferred_cpu, cpdom_id)) &&
+	    can_x_kick_cpu2(&prm_task, &prm_cpus[v], cpuc)) {
+		from_tree = true;
+		v++;
+		goto choose_out;
+	}
+
 	/*
 	 * Randomly find _two_ CPUs that run lower-priority tasks than @p. To
 	 * traverse CPUs in a random order, we start from a random CPU ID in a
@@ -163,6 +436,7 @@ static struct cpu_ctx *find_victim_cpu(const struct cpumask *cpumask,
 	/*
 	 * Choose a final victim CPU.
 	 */
+choose_out:
 	switch(v) {
 	case 2:	/* two candidates */
 		victim_cpu = can_x_kick_y(&prm_cpus[0], &prm_cpus[1]) ?
@@ -178,6 +452,17 @@ static struct cpu_ctx *find_victim_cpu(const struct cpumask *cpumask,
 	}
 
 bingo_out:
+	/*
+	 * The preferred CPU is checked before both the tree and sampling, so
+	 * picking it is a hit for neither of them.
+	 */
+	if (victim_cpu->cpuc->cpu_id != preferred_cpu &&
+	    (cpuc = get_cpu_ctx())) {
+		if (from_tree)
+			cpuc->nr_victim_tree++;
+		else
+			cpuc->nr_victim_sample++;
+	}
 	return victim_cpu->cpuc;
 
 null_out:
@@ -234,8 +519,10 @@ static void ask_cpu_yield_after(struct cpu_ctx *victim_cpuc, u64 new_slice)
 		if (new_slice == 1) {
 			bool ret = __sync_bool_compare_and_swap(
 				&victim_cpuc->est_stopping_clk, old, 0);
-			if (ret)
+			if (ret) {
 				WRITE_ONCE(victim_p->scx.slice, new_slice);
+				update_victim_tree(victim_cpuc);
+			}
 		} else {
 			if (victim_p->scx.slice > new_slice)
 				WRITE_ONCE(victim_p->scx.slice, new_slice);
@@ -412,7 +699,8 @@ void try_find_and_kick_victim_cpu(struct task_struct *p,
 	/*
 	 * Find a victim CPU among CPUs that run lower-priority tasks.
 	 */
-	cpuc_victim = find_victim_cpu(cast_mask(cpumask), preferred_cpu, taskc, now);
+	cpuc_victim = find_victim_cpu(cast_mask(cpumask), preferred_cpu,
+				      cpdom_id, taskc, now);
 
 	/*
 	 * If a victim CPU is chosen, preempt the victim by kicking it.
@@ -446,5 +734,7 @@ void reset_cpu_preemption_info(struct cpu_ctx *cpuc, bool released)
 		cpuc->lat_cri = 0;
 		cpuc->est_stopping_clk = SCX_SLICE_INF;
 	}
+
+	update_victim_tree(cpuc);
 }
 
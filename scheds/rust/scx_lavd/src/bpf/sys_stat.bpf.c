@@ -13,6 +13,7 @@
 #include <bpf/bpf_core_read.h>
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_tracing.h>
+#include <lib/cgroup.h>
 
 struct sys_stat		__weak	sys_stat;
 const volatile u8	__weak preempt_shift;
@@ -24,6 +25,7 @@ extern const volatile u64	slice_max_ns;
 extern volatile bool		__weak no_core_compaction;
 extern volatile bool		__weak reinit_cpumask_for_performance;
 const volatile bool	__weak is_autopilot_on;
+extern const volatile bool	enable_cpu_bw;
 
 int do_autopilot(void);
 u32 calc_avg32(u32 old_val, u32 new_val);
@@ -59,6 +61,8 @@ struct sys_stat_ctx {
 	u64		sum_lat_cri;
 	u32		nr_sched;
 	u32		nr_preempt;
+	u32		nr_victim_tree;
+	u32		nr_victim_sample;
 	u32		nr_perf_cri;
 	u32		nr_lat_cri;
 	u32		nr_x_migration;
@@ -75,6 +79,7 @@ struct sys_stat_ctx {
 };
 
 static struct sys_stat_ctx ctx;
+static struct scx_cgroup_bw_stats cbw_stat;
 
 static void init_sys_stat_ctx(void)
 {
@@ -285,6 +290,12 @@ static void collect_sys_stat(void)
 		c->nr_preempt += cpuc->nr_preempt;
 		cpuc->nr_preempt = 0;
 
+		c->nr_victim_tree += cpuc->nr_victim_tree;
+		cpuc->nr_victim_tree = 0;
+
+		c->nr_victim_sample += cpuc->nr_victim_sample;
+		cpuc->nr_victim_sample = 0;
+
 		if (cpuc->max_lat_cri > c->max_lat_cri)
 			c->max_lat_cri = cpuc->max_lat_cri;
 		cpuc->max_lat_cri = 0;
@@ -449,6 +460,8 @@ static void calc_sys_stat(void)
 		cnt = 0;
 		sys_stat.nr_sched >>= 1;
 		sys_stat.nr_preempt >>= 1;
+		sys_stat.nr_victim_tree >>= 1;
+		sys_stat.nr_victim_sample >>= 1;
 		sys_stat.nr_perf_cri >>= 1;
 		sys_stat.nr_lat_cri >>= 1;
 		sys_stat.nr_x_migration >>= 1;
@@ -463,6 +476,8 @@ static void calc_sys_stat(void)
 
 	sys_stat.nr_sched += c->nr_sched;
 	sys_stat.nr_preempt += c->nr_preempt;
+	sys_stat.nr_victim_tree += c->nr_victim_tree;
+	sys_stat.nr_victim_sample += c->nr_victim_sample;
 	sys_stat.nr_perf_cri += c->nr_perf_cri;
 	sys_stat.nr_lat_cri += c->nr_lat_cri;
 	sys_stat.nr_x_migration += c->nr_x_migration;
@@ -493,12 +508,31 @@ static void calc_sys_time_slice(void)
 	sys_stat.slice_wall = calc_avg(sys_stat.slice_wall, slice_wall);
 }
 
+static void collect_cbw_stat(void)
+{
+	/*
+	 * The cgroup bandwidth library keeps its own cumulative counters,
+	 * so take a snapshot of them rather than decaying them.
+	 */
+	if (scx_cgroup_bw_get_stats(&cbw_stat))
+		return;
+
+	sys_stat.nr_cbw_cgroups = cbw_stat.nr_cgroups;
+	sys_stat.nr_cbw_replenish = cbw_stat.nr_replenish;
+	sys_stat.cbw_replenish_ns_max = cbw_stat.replenish_ns_max;
+	sys_stat.nr_cbw_llcx_miss = cbw_stat.nr_llcx_miss;
+	sys_stat.nr_cbw_reenq = cbw_stat.nr_reenq;
+}
+
 static int do_update_sys_stat(void)
 {
 	init_sys_stat_ctx();
 	collect_sys_stat();
 	calc_sys_stat();
 
+	if (enable_cpu_bw)
+		collect_cbw_stat();
+
 	return 0;
 }
 
@@ -41,8 +41,11 @@ volatile bool		no_freq_scaling;
 
 const volatile bool	no_wake_sync;
 const volatile bool	no_slice_boost;
+const volatile bool	no_victim_tree;
 const volatile bool	per_cpu_dsq;
 const volatile bool	enable_cpu_bw;
+const volatile bool	cpu_bw_predictive;
+const volatile u32	cpu_bw_reenq_batch;
 const volatile bool	is_autopilot_on;
 const volatile u8	verbose;
 
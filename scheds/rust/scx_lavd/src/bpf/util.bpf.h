@@ -19,6 +19,8 @@ extern const volatile bool	no_wake_sync;
 extern const volatile bool	no_slice_boost;
 extern const volatile bool	per_cpu_dsq;
 extern const volatile bool	enable_cpu_bw;
+extern const volatile bool	cpu_bw_predictive;
+extern const volatile u32	cpu_bw_reenq_batch;
 extern const volatile bool	is_autopilot_on;
 extern const volatile u8	verbose;
 
@@ -197,6 +197,11 @@ struct Opts {
     #[clap(long = "no-slice-boost", action = clap::ArgAction::SetTrue)]
     no_slice_boost: bool,
 
+    /// Disable the victim tree for preemption and always find a victim CPU
+    /// by random sampling.
+    #[clap(long = "no-victim-tree", action = clap::ArgAction::SetTrue)]
+    no_victim_tree: bool,
+
     /// Enables DSQs per CPU, this enables task queuing and dispatching
     /// from CPU specific DSQs. This generally increases L1/L2 cache
     /// locality for tasks and lowers lock contention compared to shared DSQs,
@@ -210,6 +215,18 @@ struct Opts {
     #[clap(long = "enable-cpu-bw", action = clap::ArgAction::SetTrue)]
     enable_cpu_bw: bool,
 
+    /// With --enable-cpu-bw, hand out each period's cpu.max quota to the
+    /// LLCs in advance, in proportion to each cgroup's recent per-LLC usage.
+    /// This reduces budget transfers between LLCs for busy cgroups.
+    #[clap(long = "cpu-bw-predictive", action = clap::ArgAction::SetTrue)]
+    cpu_bw_predictive: bool,
+
+    /// With --enable-cpu-bw, the maximum number of throttled tasks to
+    /// reenqueue in one dispatch. 0 (default) sizes the batch by the
+    /// backlog, the cgroup's budget, and the free dispatch slots.
+    #[clap(long = "cpu-bw-reenq-batch", default_value = "0")]
+    cpu_bw_reenq_batch: u32,
+
     /// If specified, only tasks which have their scheduling policy set to
     /// SCHED_EXT using sched_setscheduler(2) are switched. Otherwise, all
     /// tasks are switched.
@@ -675,8 +692,11 @@ impl<'a> Scheduler<'a> {
         rodata.no_use_em = opts.no_use_em as u8;
         rodata.no_wake_sync = opts.no_wake_sync;
         rodata.no_slice_boost = opts.no_slice_boost;
+        rodata.no_victim_tree = opts.no_victim_tree;
         rodata.per_cpu_dsq = opts.per_cpu_dsq;
         rodata.enable_cpu_bw = opts.enable_cpu_bw;
+        rodata.cpu_bw_predictive = opts.cpu_bw_predictive;
+        rodata.cpu_bw_reenq_batch = opts.cpu_bw_reenq_batch;
 
         if !ksym_exists("scx_group_set_bandwidth").unwrap() {
             skel.struct_ops.lavd_ops_mut().cgroup_set_bandwidth = std::ptr::null_mut();
@@ -753,6 +773,11 @@ impl<'a> Scheduler<'a> {
             dsq_id: tx.dsq_id,
             dsq_consume_lat: tx.dsq_consume_lat,
             slice_used_wall: tx.last_slice_used_wall,
+            cgrp_id: tx.cgrp_id,
+            cbw_nr_p2c: tx.cbw_nr_p2c,
+            cbw_nr_c2l: tx.cbw_nr_c2l,
+            cbw_nr_l2l: tx.cbw_nr_l2l,
+            cbw_nr_predist: tx.cbw_nr_predist,
         }) {
             Ok(()) | Err(TrySendError::Full(_)) => 0,
             Err(e) => panic!("failed to send on intrspc_tx ({})", e),
@@ -797,6 +822,7 @@ impl<'a> Scheduler<'a> {
                 }
                 self.mseq_id += 1;
 
+                let alloc_stats = ArenaLib::alloc_stats(self.skel.object())?;
                 let bss_data = self.skel.maps.bss_data.as_ref().unwrap();
                 let st = bss_data.sys_stat;
 
@@ -805,6 +831,10 @@ impl<'a> Scheduler<'a> {
                 let nr_active = st.nr_active;
                 let nr_sched = st.nr_sched;
                 let nr_preempt = st.nr_preempt;
+                let pc_victim_tree = Self::get_pc(
+                    st.nr_victim_tree,
+                    st.nr_victim_tree + st.nr_victim_sample,
+                );
                 let pc_pc = Self::get_pc(st.nr_perf_cri, nr_sched);
                 let pc_lc = Self::get_pc(st.nr_lat_cri, nr_sched);
                 let pc_x_migration = Self::get_pc(st.nr_x_migration, nr_sched);
@@ -827,6 +857,7 @@ impl<'a> Scheduler<'a> {
                     nr_active,
                     nr_sched,
                     nr_preempt,
+                    pc_victim_tree,
                     pc_pc,
                     pc_lc,
                     pc_x_migration,
@@ -838,6 +869,14 @@ impl<'a> Scheduler<'a> {
                     pc_performance,
                     pc_balanced,
                     pc_powersave,
+                    nr_cbw_cgroups: st.nr_cbw_cgroups,
+                    nr_cbw_replenish: st.nr_cbw_replenish,
+                    cbw_replenish_ns_max: st.cbw_replenish_ns_max,
+                    nr_cbw_llcx_miss: st.nr_cbw_llcx_miss,
+                    nr_cbw_reenq: st.nr_cbw_reenq,
+                    nr_alloc_fail: alloc_stats.alloc_failures,
+                    nr_alloc_reserve_miss: alloc_stats.reserve_misses,
+                    alloc_refill_ns_max: alloc_stats.refill_ns_max,
                 })
             }
             StatsReq::SchedSamplesNr {
@@ -899,6 +938,19 @@ impl<'a> Scheduler<'a> {
         Ok(())
     }
 
+    fn refill_cgroup_bw(&mut self) -> Result<()> {
+        let prog = &mut self.skel.progs.scx_cgroup_bw_refill;
+        let out = prog.test_run(ProgramInput::default())?;
+        if out.return_value != 0 {
+            warn!(
+                "Failed to refill the cgroup bandwidth reserves: {}",
+                out.return_value as i32
+            );
+        }
+
+        Ok(())
+    }
+
     fn update_power_profile(&mut self, prev_profile: PowerProfile) -> (bool, PowerProfile) {
         let profile = fetch_power_profile(false);
         if profile == prev_profile {
@@ -939,6 +991,17 @@ impl<'a> Scheduler<'a> {
                 (autopower, profile) = self.update_power_profile(profile);
             }
 
+            // Keep the arena allocator reserves topped up, so allocations
+            // from the scheduling paths do not have to allocate pages inline.
+            ArenaLib::refill(self.skel.object())?;
+
+            // The LLC contexts of the cgroup bandwidth control cannot be
+            // allocated from the scheduling paths, so keep their reserve
+            // topped up from here.
+            if opts.enable_cpu_bw {
+                self.refill_cgroup_bw()?;
+            }
+
             match req_ch.recv_timeout(Duration::from_secs(1)) {
                 Ok(req) => {
                     let res = self.stats_req_to_res(&req)?;
@@ -34,6 +34,9 @@ pub struct SysStats {
     #[stat(desc = "Number of task preemption triggered")]
     pub nr_preempt: u64,
 
+    #[stat(desc = "% of preemption victims found by the victim tree rather than random sampling")]
+    pub pc_victim_tree: f64,
+
     #[stat(desc = "% of performance-critical tasks")]
     pub pc_pc: f64,
 
@@ -66,18 +69,43 @@ pub struct SysStats {
 
     #[stat(desc = "% of powersave mode")]
     pub pc_powersave: f64,
+
+    #[stat(desc = "Number of cgroups under CPU bandwidth control")]
+    pub nr_cbw_cgroups: u64,
+
+    #[stat(desc = "Number of CPU bandwidth budget replenishments")]
+    pub nr_cbw_replenish: u64,
+
+    #[stat(desc = "Time the slowest CPU bandwidth replenishment took (ns)")]
+    pub cbw_replenish_ns_max: u64,
+
+    #[stat(desc = "Number of failures to attach a per-LLC CPU bandwidth context")]
+    pub nr_cbw_llcx_miss: u64,
+
+    #[stat(desc = "Number of throttled tasks reenqueued")]
+    pub nr_cbw_reenq: u64,
+
+    #[stat(desc = "Number of arena allocations that failed")]
+    pub nr_alloc_fail: u64,
+
+    #[stat(desc = "Number of arena slabs allocated inline because the reserve was empty")]
+    pub nr_alloc_reserve_miss: u64,
+
+    #[stat(desc = "Time the slowest arena reserve refill took (ns)")]
+    pub alloc_refill_ns_max: u64,
 }
 
 impl SysStats {
     pub fn format_header<W: Write>(w: &mut W) -> Result<()> {
         writeln!(
             w,
-            "\x1b[93m| {:8} | {:9} | {:9} | {:8} | {:9} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:11} | {:12} | {:12} | {:12} |\x1b[0m",
+            "\x1b[93m| {:8} | {:9} | {:9} | {:8} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:11} | {:12} | {:12} | {:12} | {:8} | {:9} | {:12} | {:8} | {:9} | {:8} | {:8} | {:12} |\x1b[0m",
             "MSEQ",
             "# Q TASK",
             "# ACT CPU",
             "# SCHED",
             "# PREEMPT",
+            "VIC-TREE%",
             "PERF-CR%",
             "LAT-CR%",
             "X-MIG%",
@@ -89,6 +117,14 @@ impl SysStats {
             "PERFORMANCE%",
             "BALANCED%",
             "POWERSAVE%",
+            "# CBW CG",
+            "# CBW RPL",
+            "CBW RPL MAX",
+            "# CBW MIS",
+            "# CBW REQ",
+            "# A FAIL",
+            "# A MISS",
+            "A RFL MAX",
         )?;
         Ok(())
     }
@@ -106,12 +142,13 @@ impl SysStats {
 
         writeln!(
             w,
-            "{color}| {:8} | {:9} | {:9} | {:8} | {:9} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:11} | {:12} | {:12} | {:12} |\x1b[0m",
+            "{color}| {:8} | {:9} | {:9} | {:8} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:8} | {:11} | {:12} | {:12} | {:12} | {:8} | {:9} | {:12} | {:8} | {:9} | {:8} | {:8} | {:12} |\x1b[0m",
             self.mseq,
             self.nr_queued_task,
             self.nr_active,
             self.nr_sched,
             self.nr_preempt,
+            GPoint(self.pc_victim_tree),
             GPoint(self.pc_pc),
             GPoint(self.pc_lc),
             GPoint(self.pc_x_migration),
@@ -123,6 +160,14 @@ impl SysStats {
             GPoint(self.pc_performance),
             GPoint(self.pc_balanced),
             GPoint(self.pc_powersave),
+            self.nr_cbw_cgroups,
+            self.nr_cbw_replenish,
+            self.cbw_replenish_ns_max,
+            self.nr_cbw_llcx_miss,
+            self.nr_cbw_reenq,
+            self.nr_alloc_fail,
+            self.nr_alloc_reserve_miss,
+            self.alloc_refill_ns_max,
         )?;
         Ok(())
     }
@@ -190,13 +235,23 @@ pub struct SchedSample {
     pub dsq_id: u64,
     #[stat(desc = "Consume latency of this DSQ (shows how contended the DSQ is)")]
     pub dsq_consume_lat: u64,
+    #[stat(desc = "Cgroup ID of this task")]
+    pub cgrp_id: u64,
+    #[stat(desc = "Number of CPU bandwidth budget transfers from the subroot to the cgroup")]
+    pub cbw_nr_p2c: u64,
+    #[stat(desc = "Number of CPU bandwidth budget transfers from the cgroup to its LLCs")]
+    pub cbw_nr_c2l: u64,
+    #[stat(desc = "Number of CPU bandwidth budget transfers between the cgroup's LLCs")]
+    pub cbw_nr_l2l: u64,
+    #[stat(desc = "Number of per-LLC CPU bandwidth budget shares handed out in advance")]
+    pub cbw_nr_predist: u64,
 }
 
 impl SchedSample {
     pub fn format_header<W: Write>(w: &mut W) -> Result<()> {
         writeln!(
             w,
-            "\x1b[93m| {:6} | {:7} | {:17} | {:5} | {:4} | {:8} | {:8} | {:8} | {:17} | {:8} | {:8} | {:8} | {:7} | {:8} | {:12} | {:12} | {:9} | {:9} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:9} | {:6} | {:6} | {:10} |\x1b[0m",
+            "\x1b[93m| {:6} | {:7} | {:17} | {:5} | {:4} | {:8} | {:8} | {:8} | {:17} | {:8} | {:8} | {:8} | {:7} | {:8} | {:12} | {:12} | {:9} | {:9} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:9} | {:6} | {:6} | {:10} | {:8} | {:8} | {:8} | {:8} | {:8} |\x1b[0m",
             "MSEQ",
             "PID",
             "COMM",
@@ -225,6 +280,11 @@ impl SchedSample {
             "NR_ACT",
             "DSQ_ID",
             "DSQ_LAT_NS",
+            "CGRP_ID",
+            "CBW_P2C",
+            "CBW_C2L",
+            "CBW_L2L",
+            "CBW_PRED",
         )?;
         Ok(())
     }
@@ -236,7 +296,7 @@ impl SchedSample {
 
         writeln!(
             w,
-            "| {:6} | {:7} | {:17} | {:5} | {:4} | {:8} | {:8} | {:8} | {:17} | {:8} | {:8} | {:8} | {:7} | {:8} | {:12} | {:12} | {:9} | {:9} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:9} | {:6} | {:12} | {:12} |",
+            "| {:6} | {:7} | {:17} | {:5} | {:4} | {:8} | {:8} | {:8} | {:17} | {:8} | {:8} | {:8} | {:7} | {:8} | {:12} | {:12} | {:9} | {:9} | {:9} | {:9} | {:8} | {:8} | {:8} | {:8} | {:9} | {:6} | {:12} | {:12} | {:8} | {:8} | {:8} | {:8} | {:8} |",
             self.mseq,
             self.pid,
             self.comm,
@@ -265,6 +325,11 @@ impl SchedSample {
             self.nr_active,
             self.dsq_id,
             self.dsq_consume_lat,
+            self.cgrp_id,
+            self.cbw_nr_p2c,
+            self.cbw_nr_c2l,
+            self.cbw_nr_l2l,
+            self.cbw_nr_predist,
         )?;
         Ok(())
     }
@@ -11,6 +11,8 @@ fn main() {
         .add_source("src/bpf/timer.bpf.c")
         .add_source("src/bpf/util.bpf.c")
         .add_source("src/bpf/lib/pmu.bpf.c")
+        .add_source("src/bpf/lib/ravg.bpf.c")
+        .add_source("src/bpf/lib/sdt_alloc.bpf.c")
         .compile_link_gen()
         .unwrap();
 }
@@ -37,6 +37,8 @@ enum consts {
 	MAX_LAYER_NAME		= 128,
 	MAX_LAYERS		= 16,
 	MAX_CGROUP_REGEXES	= 16,
+	MAX_CGROUP_MATCH_CANDS	= 16384,
+	NR_COMM_BUCKETS		= 256,		/* one per first byte of comm */
 	MAX_LAYER_WEIGHT	= 10000,
 	MIN_LAYER_WEIGHT	= 1,
 	DEFAULT_LAYER_WEIGHT	= 100,
@@ -334,6 +336,29 @@ struct layer_match_ands {
 	int			nr_match_ands;
 };
 
+/*
+ * Bitmask of the OR branches of each layer that can still match a task, see
+ * compute_match_cands(). The cgroup path predicates of the set branches have
+ * already been checked if @cgrp_checked. @cgrp_layer is the layer every task
+ * of the cgroup matches, MAX_LAYERS if none.
+ */
+struct layer_match_cands {
+	u32			ors[MAX_LAYERS];
+	u32			cgrp_layer;
+	bool			cgrp_checked;
+	bool			dry_run;	/* don't touch any scheduler state */
+};
+
+/* Argument of the match_bench syscall program. */
+struct match_bench_arg {
+	u32			pid;
+	u32			nr_iters;
+	u32			linear_layer;
+	u32			index_layer;
+	u64			linear_ns;
+	u64			index_ns;
+};
+
 enum layer_growth_algo {
 	GROWTH_ALGO_STICKY,
 	GROWTH_ALGO_LINEAR,
@@ -67,6 +67,15 @@ const volatile bool enable_antistall = true;
 const volatile bool enable_match_debug = false;
 const volatile bool enable_gpu_support = false;
 const volatile u32 nr_cgroup_regexes = 0;
+const volatile bool enable_match_index = true;
+/* Per first byte of comm, the OR branches whose comm prefixes can match. */
+const volatile u32 match_comm_ors[NR_COMM_BUCKETS][MAX_LAYERS];
+/* The OR branches with predicates other than on the cgroup path. */
+const volatile u32 match_task_ors[MAX_LAYERS];
+/* The OR branches with a UsedGpuTid/Pid predicate. */
+const volatile u32 match_gpu_ors[MAX_LAYERS];
+/* Bumped to invalidate cgroup_match_cands. */
+volatile u64 match_index_gen;
 /* Delay permitted, in seconds, before antistall activates */
 const volatile u64 antistall_sec = 3;
 const u32 zero_u32 = 0;
@@ -279,6 +288,24 @@ struct {
 	__uint(map_flags, BPF_F_NO_PREALLOC);
 } cgroup_match_bitmap SEC(".maps");
 
+struct cgroup_match_cands {
+	u64			gen;
+	u32			ors[MAX_LAYERS];
+	u32			layer;
+};
+
+/*
+ * Cgroup ID to the OR branches whose cgroup path predicates all match the
+ * cgroup, and to the first layer all of the cgroup's tasks match. Filled on
+ * first use, see compute_match_cands().
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_LRU_HASH);
+	__type(key, u64);
+	__type(value, struct cgroup_match_cands);
+	__uint(max_entries, MAX_CGROUP_MATCH_CANDS);
+} cgroup_match_cands SEC(".maps");
+
 // XXX - Converting this to bss array triggers verifier bugs. See
 // BpfStats::read(). Should also be cacheline aligned which doesn't work with
 // the array map.
@@ -987,6 +1014,17 @@ static int handle_cmd(struct task_ctx *taskc, struct scx_cmd *cmd)
 }
 
 
+/*
+ * Renaming a cgroup changes the path of all its descendants. This is rare
+ * enough to just invalidate all cached match candidates.
+ */
+SEC("tp_btf/cgroup_rename")
+int BPF_PROG(tp_cgroup_rename, struct cgroup *cgrp, const char *path)
+{
+	__sync_fetch_and_add(&match_index_gen, 1);
+	return 0;
+}
+
 SEC("tp_btf/task_rename")
 int BPF_PROG(tp_task_rename, struct task_struct *p, const char *buf)
 {
@@ -3145,32 +3183,156 @@ static __noinline bool match_one(struct layer *layer, struct layer_match *match,
 	}
 }
 
+static bool is_cgroup_path_match(int kind)
+{
+	return kind == MATCH_CGROUP_PREFIX || kind == MATCH_CGROUP_SUFFIX ||
+		kind == MATCH_CGROUP_CONTAINS;
+}
+
+/*
+ * Evaluate only the cgroup path predicates of every OR branch. Branches
+ * without any are always candidates. A set branch with only cgroup path
+ * predicates matches every task of the cgroup, so the first layer with one
+ * is the layer of all the tasks that don't match an earlier layer through
+ * per-task predicates.
+ */
+static __noinline void fill_cgroup_match_cands(struct task_struct *p, const char *cgrp_path,
+					       struct cgroup_match_cands *cc)
+{
+	struct layer *layer;
+	u64 layer_id, or_id, and_id;
+
+	bpf_for(layer_id, 0, nr_layers) {
+		if (layer_id >= MAX_LAYERS)
+			break;
+
+		layer = &layers[layer_id];
+		cc->ors[layer_id] = 0;
+
+		bpf_for(or_id, 0, layer->nr_match_ors) {
+			struct layer_match_ands *ands;
+			bool matched = true;
+
+			barrier_var(or_id);
+			if (or_id >= MAX_LAYER_MATCH_ORS)
+				break;
+
+			ands = &layer->matches[or_id];
+
+			bpf_for(and_id, 0, ands->nr_match_ands) {
+				struct layer_match *match;
+
+				barrier_var(and_id);
+				if (and_id >= NR_LAYER_MATCH_KINDS)
+					break;
+
+				match = &ands->matches[and_id];
+				if (!is_cgroup_path_match(match->kind))
+					continue;
+
+				if (match_one(layer, match, NULL, p, cgrp_path) == match->exclude) {
+					matched = false;
+					break;
+				}
+			}
+
+			if (matched)
+				cc->ors[layer_id] |= 1U << or_id;
+		}
+
+		if (cc->layer == MAX_LAYERS && (cc->ors[layer_id] & ~match_task_ors[layer_id]))
+			cc->layer = layer_id;
+	}
+}
+
+/*
+ * Narrow down the OR branches that can match @p with the compiled match
+ * index. The cgroup path predicates are evaluated once per cgroup and cached,
+ * and the comm prefixes are looked up by the first byte of the comm in a
+ * table built by userspace, see comm_match_index() in config.rs.
+ * match_layer() then skips the branches that are not set. Without
+ * @use_index, all branches are set. With @dry_run, a missing cache entry is
+ * computed but not stored.
+ */
+static __noinline void compute_match_cands(struct task_struct *p, const char *cgrp_path,
+					   bool use_index, bool dry_run,
+					   struct layer_match_cands *cands)
+{
+	struct cgroup_match_cands *cc, new_cc;
+	u64 cgroup_id, gen = match_index_gen;
+	u32 layer_id;
+	u8 first;
+
+	cands->dry_run = dry_run;
+
+	if (!use_index) {
+		bpf_for(layer_id, 0, MAX_LAYERS)
+			cands->ors[layer_id] = (u32)-1;
+		cands->cgrp_checked = false;
+		cands->cgrp_layer = MAX_LAYERS;
+		return;
+	}
+
+	cgroup_id = p->cgroups->dfl_cgrp->kn->id;
+	cc = bpf_map_lookup_elem(&cgroup_match_cands, &cgroup_id);
+	if (!cc || cc->gen != gen) {
+		__builtin_memset(&new_cc, 0, sizeof(new_cc));
+		new_cc.gen = gen;
+		new_cc.layer = MAX_LAYERS;
+		fill_cgroup_match_cands(p, cgrp_path, &new_cc);
+		if (!dry_run)
+			bpf_map_update_elem(&cgroup_match_cands, &cgroup_id, &new_cc, BPF_ANY);
+		cc = &new_cc;
+	}
+
+	first = p->comm[0];
+	bpf_for(layer_id, 0, MAX_LAYERS)
+		cands->ors[layer_id] = cc->ors[layer_id] & match_comm_ors[first][layer_id];
+	cands->cgrp_checked = true;
+	cands->cgrp_layer = cc->layer;
+}
+
 __hidden
 int match_layer(u32 layer_id, struct task_ctx *taskc,
-		struct task_struct *p __arg_trusted, const char *cgrp_path)
+		struct task_struct *p __arg_trusted, const char *cgrp_path,
+		struct layer_match_cands *cands)
 {
 	bool matched_gpu = false;
 	struct layer *layer;
-	u32 nr_match_ors, pid;
+	u32 nr_match_ors, or_mask, pid;
 	u64 or_id, and_id;
 
-	if (layer_id >= nr_layers)
+	if (layer_id >= nr_layers || layer_id >= MAX_LAYERS || !cands)
 		return -EINVAL;
 
+	/* Without a task context, match_one() can't expire the membership. */
+	if (cands->dry_run)
+		taskc = NULL;
+
 	layer = &layers[layer_id];
 	nr_match_ors = layer->nr_match_ors;
+	or_mask = cands->ors[layer_id];
 
 	if (nr_match_ors > MAX_LAYER_MATCH_ORS)
 		return -EINVAL;
 
 	bpf_for(or_id, 0, nr_match_ors) {
 		struct layer_match_ands *ands;
-		bool matched = true;
+		bool matched = true, filtered;
 
 		barrier_var(or_id);
 		if (or_id >= MAX_LAYER_MATCH_ORS)
 			return -EINVAL;
 
+		/*
+		 * A branch ruled out by the index can't match, but one with a
+		 * GPU predicate still has to be evaluated like the linear path
+		 * does, so that it gets marked MEMBER_CANTMATCH below.
+		 */
+		filtered = !(or_mask & (1U << or_id));
+		if (filtered && !(match_gpu_ors[layer_id] & (1U << or_id)))
+			continue;
+
 		ands = &layer->matches[or_id];
 
 		if (ands->nr_match_ands > NR_LAYER_MATCH_KINDS)
@@ -3185,6 +3347,12 @@ int match_layer(u32 layer_id, struct task_ctx *taskc,
 				return -EINVAL;
 
 			match = &ands->matches[and_id];
+
+			/* Already checked by compute_match_cands(). */
+			if (!filtered && cands->cgrp_checked &&
+			    is_cgroup_path_match(match->kind))
+				continue;
+
 			if (!(match_one(layer, match, taskc, p, cgrp_path) == !match->exclude)) {
 				matched = false;
 				break;
@@ -3199,7 +3367,7 @@ int match_layer(u32 layer_id, struct task_ctx *taskc,
 		 * and should mark ourselves as such to avoid being forced to rematch
 		 * every time we touch the GPU.
 		 */
-		if (!matched && matched_gpu) {
+		if (!matched && matched_gpu && !cands->dry_run) {
 			if ((taskc = lookup_task_ctx_may_fail(p)) && taskc) {
 				taskc->recheck_layer_membership = MEMBER_CANTMATCH;
 			}
@@ -3207,7 +3375,7 @@ int match_layer(u32 layer_id, struct task_ctx *taskc,
 
 		if (matched) {
 			trace("MATCH %s-%d -> %s", p->comm, p->pid, layer->name);
-			if (enable_match_debug && (pid = p->pid))
+			if (enable_match_debug && !cands->dry_run && (pid = p->pid))
 				bpf_map_update_elem(&layer_match_dbg, &pid, &layer_id, BPF_ANY);
 
 			return 0;
@@ -3217,6 +3385,47 @@ int match_layer(u32 layer_id, struct task_ctx *taskc,
 	return -ENOENT;
 }
 
+/*
+ * Returns the first layer matching @p, or MAX_LAYERS if none does. With
+ * @dry_run, @p's membership, the match debug map and the cgroup match cache
+ * are left alone, so the result has no effect on scheduling.
+ */
+static __always_inline u64 find_task_layer(struct task_struct *p, struct task_ctx *taskc,
+					   const char *cgrp_path, bool use_index,
+					   bool dry_run)
+{
+	struct layer_match_cands cands;
+	u64 layer_id;
+	u32 pid, lid;
+
+	compute_match_cands(p, cgrp_path, use_index, dry_run, &cands);
+
+	bpf_for(layer_id, 0, nr_layers) {
+		if (layer_id >= MAX_LAYERS)
+			break;
+
+		/*
+		 * The whole cgroup lands here, only the per-task predicates of
+		 * the layers before it had to be checked. Layers with GPU
+		 * predicates go through match_layer() for MEMBER_CANTMATCH.
+		 */
+		if (layer_id == cands.cgrp_layer && !match_gpu_ors[layer_id]) {
+			lid = layer_id;
+			if (enable_match_debug && !dry_run && (pid = p->pid))
+				bpf_map_update_elem(&layer_match_dbg, &pid, &lid, BPF_ANY);
+			return layer_id;
+		}
+
+		if (!cands.ors[layer_id] && !match_gpu_ors[layer_id])
+			continue;
+
+		if (match_layer(layer_id, taskc, p, cgrp_path, &cands) == 0)
+			return layer_id;
+	}
+
+	return MAX_LAYERS;
+}
+
 static void switch_to_layer(struct task_struct *p, struct task_ctx *taskc, u64 layer_id, u64 now)
 {
 	struct cpu_ctx *cpuc;
@@ -3276,7 +3485,6 @@ static void switch_to_layer(struct task_struct *p, struct task_ctx *taskc, u64 l
 static void maybe_refresh_layer(struct task_struct *p __arg_trusted, struct task_ctx *taskc, u64 now)
 {
 	const char *cgrp_path;
-	bool matched = false;
 	u64 layer_id;	// XXX - int makes verifier unhappy
 
 	if (!taskc->refresh_layer)
@@ -3308,14 +3516,9 @@ static void maybe_refresh_layer(struct task_struct *p __arg_trusted, struct task
 	if (!(cgrp_path = format_cgrp_path(p->cgroups->dfl_cgrp)))
 		return;
 
-	bpf_for(layer_id, 0, nr_layers) {
-		if (match_layer(layer_id, taskc, p, cgrp_path) == 0) {
-			matched = true;
-			break;
-		}
-	}
+	layer_id = find_task_layer(p, taskc, cgrp_path, enable_match_index, false);
 
-	if (matched) {
+	if (layer_id < nr_layers) {
 		switch_to_layer(p, taskc, layer_id, now);
 	} else {
 		scx_bpf_error("[%s]%d didn't match any layer", p->comm, p->pid);
@@ -3326,6 +3529,48 @@ static void maybe_refresh_layer(struct task_struct *p __arg_trusted, struct task
 		      taskc->layer_id, p->comm, p->pid, cgrp_path);
 }
 
+/*
+ * Match the task @arg->pid against the layers @arg->nr_iters times, both
+ * with and without the match index, and report the time each took and the
+ * layers they picked. Run by userspace with --bench-match. The matches are
+ * dry runs, so benchmarking a live task doesn't change how it is scheduled.
+ * An uncached cgroup stays uncached and is recomputed on every iteration.
+ */
+SEC("syscall")
+int match_bench(struct match_bench_arg *arg)
+{
+	struct task_struct *p;
+	struct task_ctx *taskc;
+	const char *cgrp_path;
+	u64 start, layer_id = MAX_LAYERS;
+	u32 i;
+	int ret = 0;
+
+	if (!(p = bpf_task_from_pid(arg->pid)))
+		return -ESRCH;
+
+	if (!(taskc = lookup_task_ctx_may_fail(p)) ||
+	    !(cgrp_path = format_cgrp_path(p->cgroups->dfl_cgrp))) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	start = bpf_ktime_get_ns();
+	bpf_for(i, 0, arg->nr_iters)
+		layer_id = find_task_layer(p, taskc, cgrp_path, false, true);
+	arg->linear_ns = bpf_ktime_get_ns() - start;
+	arg->linear_layer = layer_id;
+
+	start = bpf_ktime_get_ns();
+	bpf_for(i, 0, arg->nr_iters)
+		layer_id = find_task_layer(p, taskc, cgrp_path, true, true);
+	arg->index_ns = bpf_ktime_get_ns() - start;
+	arg->index_layer = layer_id;
+out:
+	bpf_task_release(p);
+	return ret;
+}
+
 static s32 create_save_cpumask(struct bpf_cpumask **kptr)
 {
 	struct bpf_cpumask *cpumask;
@@ -4642,6 +4887,10 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(layered_init)
 		return ret;
 
 	if (membw_event) {
+		ret = scx_pmu_init();
+		if (ret)
+			return ret;
+
 		ret = scx_pmu_install(membw_event);
 		if (ret)
 			return ret;
@@ -14,6 +14,9 @@ use crate::LayerGrowthAlgo;
 
 use scx_utils::Cpumask;
 
+const MAX_LAYERS: usize = bpf_intf::consts_MAX_LAYERS as usize;
+const NR_COMM_BUCKETS: usize = bpf_intf::consts_NR_COMM_BUCKETS as usize;
+
 #[derive(Clone, Debug, Serialize, Deserialize)]
 #[serde(transparent)]
 pub struct LayerConfig {
@@ -103,6 +106,125 @@ pub enum LayerMatch {
     NumaNode(u32),
 }
 
+impl LayerMatch {
+    /// Rough cost of evaluating the match in BPF. The matches of each AND
+    /// list are evaluated cheapest first so that a failing cheap predicate
+    /// skips the string compares. GPU matches go first: an AND list that
+    /// matched its GPU predicate but not the rest is marked as never matching,
+    /// which only works if the GPU predicate gets evaluated.
+    pub fn eval_cost(&self) -> u32 {
+        match self {
+            LayerMatch::UsedGpuTid(_) | LayerMatch::UsedGpuPid(_) => 0,
+            LayerMatch::NiceAbove(_)
+            | LayerMatch::NiceBelow(_)
+            | LayerMatch::NiceEquals(_)
+            | LayerMatch::PIDEquals(_)
+            | LayerMatch::PPIDEquals(_)
+            | LayerMatch::TGIDEquals(_)
+            | LayerMatch::IsGroupLeader(_)
+            | LayerMatch::IsKthread(_)
+            | LayerMatch::AvgRuntime(_, _) => 1,
+            LayerMatch::UIDEquals(_)
+            | LayerMatch::GIDEquals(_)
+            | LayerMatch::NSPIDEquals(_, _)
+            | LayerMatch::NSEquals(_)
+            | LayerMatch::HintEquals(_)
+            | LayerMatch::SystemCpuUtilBelow(_)
+            | LayerMatch::DsqInsertBelow(_)
+            | LayerMatch::CgroupRegex(_)
+            | LayerMatch::NumaNode(_) => 2,
+            LayerMatch::CommPrefix(_)
+            | LayerMatch::CommPrefixExclude(_)
+            | LayerMatch::PcommPrefix(_)
+            | LayerMatch::PcommPrefixExclude(_)
+            | LayerMatch::CmdJoin(_) => 3,
+            LayerMatch::CgroupPrefix(_)
+            | LayerMatch::CgroupSuffix(_)
+            | LayerMatch::CgroupContains(_) => 4,
+        }
+    }
+
+    /// Whether the match can differ between tasks of the same cgroup. Cgroup
+    /// regex matches count as per-task as their results are filled in
+    /// asynchronously by userspace.
+    pub fn is_per_task(&self) -> bool {
+        !matches!(
+            self,
+            LayerMatch::CgroupPrefix(_)
+                | LayerMatch::CgroupSuffix(_)
+                | LayerMatch::CgroupContains(_)
+        )
+    }
+}
+
+/// Compile the comm prefix matches of `specs` into a table indexed by the
+/// first byte of the task comm. Entry `[byte][layer]` has the bits of the OR
+/// branches of the layer that can match a comm starting with `byte`, which is
+/// all of them except those requiring a CommPrefix starting with another byte.
+/// BPF only evaluates the branches set for the task's comm, see
+/// compute_match_cands() in main.bpf.c.
+pub fn comm_match_index(specs: &[LayerSpec]) -> Vec<[u32; MAX_LAYERS]> {
+    let mut index = vec![[0u32; MAX_LAYERS]; NR_COMM_BUCKETS];
+
+    for (layer_i, spec) in specs.iter().enumerate().take(MAX_LAYERS) {
+        for (or_i, or) in spec.matches.iter().enumerate() {
+            let first_bytes: Vec<u8> = or
+                .iter()
+                .filter_map(|m| match m {
+                    LayerMatch::CommPrefix(prefix) => prefix.as_bytes().first().copied(),
+                    _ => None,
+                })
+                .collect();
+
+            for (byte, ors) in index.iter_mut().enumerate() {
+                if first_bytes.iter().all(|&b| b as usize == byte) {
+                    ors[layer_i] |= 1 << or_i;
+                }
+            }
+        }
+    }
+
+    index
+}
+
+/// The OR branches of each layer with per-task matches. The other branches
+/// match either all or none of the tasks of a cgroup, which lets BPF cache the
+/// layer of the cgroup's tasks, see fill_cgroup_match_cands() in main.bpf.c.
+pub fn task_match_ors(specs: &[LayerSpec]) -> [u32; MAX_LAYERS] {
+    let mut ors = [0u32; MAX_LAYERS];
+
+    for (layer_i, spec) in specs.iter().enumerate().take(MAX_LAYERS) {
+        for (or_i, or) in spec.matches.iter().enumerate() {
+            if or.iter().any(|m| m.is_per_task()) {
+                ors[layer_i] |= 1 << or_i;
+            }
+        }
+    }
+
+    ors
+}
+
+/// The OR branches of each layer with a UsedGpuTid or UsedGpuPid match. BPF
+/// evaluates them even when the match index rules them out, since a branch
+/// that matches its GPU predicate but not the rest marks the task as never
+/// matching, see match_layer() in main.bpf.c.
+pub fn gpu_match_ors(specs: &[LayerSpec]) -> [u32; MAX_LAYERS] {
+    let mut ors = [0u32; MAX_LAYERS];
+
+    for (layer_i, spec) in specs.iter().enumerate().take(MAX_LAYERS) {
+        for (or_i, or) in spec.matches.iter().enumerate() {
+            if or
+                .iter()
+                .any(|m| matches!(m, LayerMatch::UsedGpuTid(_) | LayerMatch::UsedGpuPid(_)))
+            {
+                ors[layer_i] |= 1 << or_i;
+            }
+        }
+    }
+
+    ors
+}
+
 #[derive(Clone, Debug, Serialize, Deserialize)]
 pub struct LayerCommon {
     #[serde(default)]
@@ -251,3 +373,108 @@ impl LayerKind {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn spec(name: &str, matches: Vec<Vec<LayerMatch>>) -> LayerSpec {
+        LayerSpec {
+            name: name.into(),
+            cpuset: None,
+            comment: None,
+            template: None,
+            matches,
+            kind: serde_json::from_str(r#"{"Open": {}}"#).unwrap(),
+        }
+    }
+
+    #[test]
+    fn test_comm_match_index() {
+        let specs = vec![
+            spec(
+                "a",
+                vec![
+                    vec![LayerMatch::CommPrefix("java".into())],
+                    vec![
+                        LayerMatch::CgroupPrefix("system.slice/".into()),
+                        LayerMatch::CommPrefix("python".into()),
+                    ],
+                ],
+            ),
+            spec(
+                "b",
+                vec![vec![LayerMatch::CommPrefixExclude("java".into())]],
+            ),
+            spec("c", vec![vec![LayerMatch::CommPrefix("".into())], vec![]]),
+        ];
+        let index = comm_match_index(&specs);
+
+        assert_eq!(index[b'j' as usize][0], 0b01);
+        assert_eq!(index[b'p' as usize][0], 0b10);
+        assert_eq!(index[b'x' as usize][0], 0);
+
+        // Excluded and empty prefixes don't narrow anything down.
+        for ors in index.iter() {
+            assert_eq!(ors[1], 0b1);
+            assert_eq!(ors[2], 0b11);
+        }
+    }
+
+    #[test]
+    fn test_comm_match_index_conflicting_prefixes() {
+        let specs = vec![spec(
+            "a",
+            vec![vec![
+                LayerMatch::CommPrefix("java".into()),
+                LayerMatch::CommPrefix("python".into()),
+            ]],
+        )];
+
+        assert!(comm_match_index(&specs).iter().all(|ors| ors[0] == 0));
+    }
+
+    #[test]
+    fn test_task_match_ors() {
+        let specs = vec![
+            spec(
+                "a",
+                vec![
+                    vec![LayerMatch::CgroupPrefix("system.slice/".into())],
+                    vec![
+                        LayerMatch::CgroupSuffix("/foo.service".into()),
+                        LayerMatch::NiceBelow(0),
+                    ],
+                    vec![LayerMatch::CgroupRegex(".*".into())],
+                ],
+            ),
+            spec("b", vec![vec![]]),
+        ];
+        let ors = task_match_ors(&specs);
+
+        assert_eq!(ors[0], 0b110);
+        assert_eq!(ors[1], 0);
+    }
+
+    #[test]
+    fn test_gpu_match_ors() {
+        let specs = vec![
+            spec(
+                "a",
+                vec![
+                    vec![LayerMatch::CommPrefix("java".into())],
+                    vec![
+                        LayerMatch::UsedGpuTid(true),
+                        LayerMatch::CgroupPrefix("system.slice/".into()),
+                    ],
+                    vec![LayerMatch::UsedGpuPid(false)],
+                ],
+            ),
+            spec("b", vec![vec![LayerMatch::NiceBelow(0)]]),
+        ];
+        let ors = gpu_match_ors(&specs);
+
+        assert_eq!(ors[0], 0b110);
+        assert_eq!(ors[1], 0);
+    }
+}
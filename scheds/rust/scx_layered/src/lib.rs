@@ -14,11 +14,15 @@ unsafe impl Plain for bpf_intf::cpu_ctx {}
 unsafe impl Plain for bpf_intf::llc_ctx {}
 unsafe impl Plain for bpf_intf::node_ctx {}
 unsafe impl Plain for bpf_intf::refresh_node_ctx_arg {}
+unsafe impl Plain for bpf_intf::match_bench_arg {}
 
 use std::collections::BTreeMap;
 
 use anyhow::bail;
 use anyhow::Result;
+pub use config::comm_match_index;
+pub use config::gpu_match_ors;
+pub use config::task_match_ors;
 pub use config::LayerCommon;
 pub use config::LayerConfig;
 pub use config::LayerKind;
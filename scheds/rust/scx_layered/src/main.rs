@@ -577,6 +577,19 @@ struct Opts {
     #[clap(long, default_value = "false")]
     enable_match_debug: bool,
 
+    /// Disable the compiled layer match index. By default, the cgroup path
+    /// matches are cached per cgroup and the comm prefix matches are looked
+    /// up by the first byte of the comm, so that only the OR branches that
+    /// can still match are evaluated for each task.
+    #[clap(long, default_value = "false")]
+    disable_match_index: bool,
+
+    /// Benchmark the layer matching after attaching by replaying every task
+    /// in the system through both the linear and the indexed match paths
+    /// this many times. 0 disables.
+    #[clap(long, default_value = "0")]
+    bench_match: u32,
+
     /// Maximum task runnable_at delay (in seconds) before antistall turns on
     #[clap(long, default_value = "3")]
     antistall_sec: u64,
@@ -1824,6 +1837,11 @@ impl<'a> Scheduler<'a> {
         topo: &Topology,
     ) -> Result<HashMap<u32, Regex>> {
         skel.maps.rodata_data.as_mut().unwrap().nr_layers = specs.len() as u32;
+        skel.maps.rodata_data.as_mut().unwrap().match_comm_ors = comm_match_index(specs)
+            .try_into()
+            .unwrap();
+        skel.maps.rodata_data.as_mut().unwrap().match_task_ors = task_match_ors(specs);
+        skel.maps.rodata_data.as_mut().unwrap().match_gpu_ors = gpu_match_ors(specs);
         let mut perf_set = false;
 
         let mut layer_iteration_order = (0..specs.len()).collect::<Vec<_>>();
@@ -1835,7 +1853,11 @@ impl<'a> Scheduler<'a> {
             let layer = &mut skel.maps.bss_data.as_mut().unwrap().layers[spec_i];
 
             for (or_i, or) in spec.matches.iter().enumerate() {
-                for (and_i, and) in or.iter().enumerate() {
+                // Evaluate the cheap matches first, see LayerMatch::eval_cost().
+                let mut ands: Vec<&LayerMatch> = or.iter().collect();
+                ands.sort_by_key(|m| m.eval_cost());
+
+                for (and_i, and) in ands.into_iter().enumerate() {
                     let mt = &mut layer.matches[or_i].matches[and_i];
 
                     // Rules are allowlist-based by default
@@ -2710,6 +2732,7 @@ impl<'a> Scheduler<'a> {
         rodata.lo_fb_share_ppk = ((opts.lo_fb_share * 1024.0) as u32).clamp(1, 1024);
         rodata.enable_antistall = !opts.disable_antistall;
         rodata.enable_match_debug = opts.enable_match_debug;
+        rodata.enable_match_index = !opts.disable_match_index;
         rodata.enable_gpu_support = opts.enable_gpu_support;
         rodata.kfuncs_supported_in_syscall = kfuncs_in_syscall;
 
@@ -2901,7 +2924,7 @@ impl<'a> Scheduler<'a> {
             GpuTaskAffinitizer::new(opts.gpu_affinitize_secs, opts.enable_gpu_affinitize);
         gpu_task_handler.init(topo.clone());
 
-        let sched = Self {
+        let mut sched = Self {
             struct_ops: Some(struct_ops),
             layer_specs,
 
@@ -2931,9 +2954,75 @@ impl<'a> Scheduler<'a> {
 
         info!("Layered Scheduler Attached. Run `scx_layered --monitor` for metrics.");
 
+        if opts.bench_match > 0 {
+            sched.bench_match(opts.bench_match)?;
+        }
+
         Ok(sched)
     }
 
+    /// Run every task in the system through both the linear and the indexed
+    /// layer match paths and report the time per match. See match_bench in
+    /// main.bpf.c.
+    fn bench_match(&mut self, nr_iters: u32) -> Result<()> {
+        let (mut nr_tasks, mut nr_mismatches) = (0u64, 0u64);
+        let (mut linear_ns, mut index_ns) = (0u64, 0u64);
+
+        for proc_entry in fs::read_dir("/proc")?.flatten() {
+            let Ok(tgid) = proc_entry.file_name().to_string_lossy().parse::<u32>() else {
+                continue;
+            };
+            let Ok(tasks) = fs::read_dir(format!("/proc/{}/task", tgid)) else {
+                continue;
+            };
+
+            for task_entry in tasks.flatten() {
+                let Ok(pid) = task_entry.file_name().to_string_lossy().parse::<u32>() else {
+                    continue;
+                };
+
+                let mut arg: bpf_intf::match_bench_arg =
+                    unsafe { MaybeUninit::zeroed().assume_init() };
+                arg.pid = pid;
+                arg.nr_iters = nr_iters;
+
+                let input = ProgramInput {
+                    context_in: Some(unsafe { plain::as_mut_bytes(&mut arg) }),
+                    ..Default::default()
+                };
+                let out = self.skel.progs.match_bench.test_run(input)?;
+                if out.return_value != 0 {
+                    // The task exited or isn't on scx yet.
+                    continue;
+                }
+
+                nr_tasks += 1;
+                linear_ns += arg.linear_ns;
+                index_ns += arg.index_ns;
+
+                if arg.linear_layer != arg.index_layer {
+                    nr_mismatches += 1;
+                    warn!(
+                        "match index picked layer {} instead of {} for pid {}",
+                        arg.index_layer, arg.linear_layer, pid
+                    );
+                }
+            }
+        }
+
+        let nr_matches = (nr_tasks * nr_iters as u64).max(1);
+        info!(
+            "Match bench: {} tasks x {}, linear {} ns/match, indexed {} ns/match, {} mismatches",
+            nr_tasks,
+            nr_iters,
+            linear_ns / nr_matches,
+            index_ns / nr_matches,
+            nr_mismatches
+        );
+
+        Ok(())
+    }
+
     fn update_cpumask(mask: &Cpumask, bpfmask: &mut [u8]) {
         for cpu in 0..mask.len() {
             if mask.test_cpu(cpu) {
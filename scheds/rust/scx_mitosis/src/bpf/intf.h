@@ -73,6 +73,7 @@ enum cell_stat_idx {
 	CSTAT_AFFN_VIOL,
 	CSTAT_BORROWED,
 	CSTAT_STEAL,
+	CSTAT_REFRESH,
 	NR_CSTATS,
 };
 
@@ -88,6 +89,8 @@ struct cpu_ctx {
 struct cgrp_ctx {
 	u32  cell;
 	bool cell_owner;
+	/* Bumped whenever the cgroup is moved to another cell */
+	u32  gen;
 };
 
 /*
@@ -138,6 +141,11 @@ struct cell {
 	// Number of LLCs with at least one CPU in this cell
 	u32 llc_present_cnt;
 
+	// Bumped whenever the cell's cpumask or borrowable cpumask changes
+	u32 gen;
+	// Bumped whenever a cgroup is moved out of this cell
+	u32 assign_gen;
+
 	// Per-LLC data (cacheline-aligned)
 	struct cell_llc llcs[MAX_LLCS];
 };
@@ -54,6 +54,29 @@ static inline const struct cpumask *lookup_llc_cpumask(u32 llc)
 	return (const struct cpumask *)&llc_to_cpus[llc];
 }
 
+/* Bitmask of LLCs for recalc_cell_llc_counts() covering every LLC */
+#define ALL_LLCS ((u32)~0u)
+
+/*
+ * Return the bitmask of LLCs that @mask has CPUs in.
+ */
+static __always_inline u32 cpumask_llcs(const struct cpumask *mask)
+{
+	u32 llc, llcs = 0;
+
+	bpf_for(llc, 0, nr_llc)
+	{
+		const struct cpumask *llc_mask = lookup_llc_cpumask(llc);
+		if (!llc_mask)
+			return ALL_LLCS;
+
+		if (bpf_cpumask_intersects(mask, llc_mask))
+			llcs |= 1u << llc;
+	}
+
+	return llcs;
+}
+
 /*
  * Recompute cell->llc_cpu_cnt[] for a cell cpumask.
  *
@@ -61,9 +84,11 @@ static inline const struct cpumask *lookup_llc_cpumask(u32 llc)
  * @explicit_mask: If non-NULL, use this cpumask instead of looking up current
  *                 cell cpumask. This allows pre-calculating counts for a new
  *                 cpumask BEFORE swapping it in, avoiding race conditions.
+ * @dirty_llcs: Bitmask of the LLCs whose counts may have changed, the others
+ *              keep their current count. ALL_LLCS recomputes all of them.
  */
-static __always_inline int
-recalc_cell_llc_counts(u32 cell_idx, const struct cpumask *explicit_mask)
+static __always_inline int recalc_cell_llc_counts(
+	u32 cell_idx, const struct cpumask *explicit_mask, u32 dirty_llcs)
 {
 	struct cell *cell = lookup_cell(cell_idx);
 	if (!cell)
@@ -91,29 +116,35 @@ recalc_cell_llc_counts(u32 cell_idx, const struct cpumask *explicit_mask)
 
 	bpf_for(llc, 0, nr_llc)
 	{
+		if (!(dirty_llcs & (1u << llc)))
+			continue;
+
 		const struct cpumask *llc_mask = lookup_llc_cpumask(llc);
 		if (!llc_mask)
 			return -ENOENT;
 
 		bpf_cpumask_and(tmp_mask, cell_mask, llc_mask);
 
-		u32 cnt = bpf_cpumask_weight((const struct cpumask *)tmp_mask);
-
-		llc_cpu_cnt_tmp[llc] = cnt;
-
-		// These are counted across the whole cell
-		total_cpus += cnt;
-
-		// Number of non-empty LLCs in this cell
-		if (cnt)
-			llcs_present++;
+		llc_cpu_cnt_tmp[llc] =
+			bpf_cpumask_weight((const struct cpumask *)tmp_mask);
 	}
 
 	// Write to cell
 	scoped_guard(spin_lock, &cell->lock)
 	{
 		for (u32 llc_idx = 0; llc_idx < nr_llc; llc_idx++) {
-			cell->llcs[llc_idx].cpu_cnt = llc_cpu_cnt_tmp[llc_idx];
+			if (dirty_llcs & (1u << llc_idx))
+				cell->llcs[llc_idx].cpu_cnt =
+					llc_cpu_cnt_tmp[llc_idx];
+
+			u32 cnt = cell->llcs[llc_idx].cpu_cnt;
+
+			// These are counted across the whole cell
+			total_cpus += cnt;
+
+			// Number of non-empty LLCs in this cell
+			if (cnt)
+				llcs_present++;
 		}
 
 		cell->llc_present_cnt = llcs_present;
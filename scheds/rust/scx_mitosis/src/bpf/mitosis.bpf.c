@@ -256,6 +256,46 @@ static inline int free_cell(int cell_idx)
 	return 0;
 }
 
+/*
+ * Tasks only redo their cell assignment when the generation of their cell or
+ * cgroup moved, see refresh_task_cell_gen(). These must be bumped after the
+ * new state is published and before applied_configuration_seq.
+ */
+static inline int bump_cell_gen(int cell_idx)
+{
+	struct cell *c;
+
+	if (!(c = lookup_cell(cell_idx)))
+		return -1;
+
+	__sync_fetch_and_add(&c->gen, 1);
+	return 0;
+}
+
+/*
+ * Move a cgroup to another cell. The cgroup's generation is bumped for its
+ * own tasks, and the assignment generation of the cell it leaves so that
+ * the other tasks of that cell can tell their cgroup did not move.
+ */
+static inline int set_cgrp_cell(struct cgrp_ctx *cgc, u32 cell_idx)
+{
+	u32	     old_idx = READ_ONCE(cgc->cell);
+	struct cell *old;
+
+	if (old_idx == cell_idx)
+		return 0;
+
+	if (!(old = lookup_cell(old_idx)))
+		return -1;
+
+	WRITE_ONCE(cgc->cell, cell_idx);
+	barrier();
+	WRITE_ONCE(cgc->gen, cgc->gen + 1);
+	barrier();
+	__sync_fetch_and_add(&old->assign_gen, 1);
+	return 0;
+}
+
 /*
  * Record debug events to the circular buffer
  */
@@ -487,6 +527,7 @@ static inline int update_task_cell(struct task_struct *p, struct task_ctx *tctx,
 				   struct cgroup *cg)
 {
 	struct cgrp_ctx *cgc;
+	struct cell	*cell;
 
 	cgc = lookup_cgrp_ctx_fallible(cg);
 
@@ -526,9 +567,29 @@ static inline int update_task_cell(struct task_struct *p, struct task_ctx *tctx,
 	 */
 	tctx->configuration_seq = READ_ONCE(applied_configuration_seq);
 	barrier();
-	tctx->cell = cgc->cell;
+	tctx->cgrp_gen = READ_ONCE(cgc->gen);
+	barrier();
+	tctx->cell = READ_ONCE(cgc->cell);
 	tctx->cgid = cg->kn->id;
 
+	/*
+	 * Same for the generations of the cell, which are bumped after the
+	 * cell's cpumasks are published.
+	 */
+	if (!(cell = lookup_cell(tctx->cell)))
+		return -ENOENT;
+	tctx->cell_gen = READ_ONCE(cell->gen);
+	tctx->cell_assign_gen = READ_ONCE(cell->assign_gen);
+	barrier();
+
+	/*
+	 * If the cgroup was moved out of the cell in the meantime, the
+	 * assignment generation we read may already account for the move.
+	 * Make sure the next check looks at the cgroup again.
+	 */
+	if (READ_ONCE(cgc->cell) != tctx->cell)
+		tctx->cell_assign_gen--;
+
 	return update_task_cpumask(p, tctx);
 }
 
@@ -573,12 +634,65 @@ static s32 pick_idle_cpu_from(struct task_struct   *p,
 	return scx_bpf_pick_idle_cpu(cand_cpumask, 0);
 }
 
+/*
+ * A reconfiguration was applied since the task's last refresh. Only redo the
+ * cell and cpumask work if the reconfiguration changed the cpumasks of the
+ * task's cell or moved the task's cgroup to another cell. Otherwise, just
+ * catch up with applied_configuration_seq.
+ */
+static int refresh_task_cell_gen(struct task_struct *p, struct task_ctx *tctx,
+				 struct cpu_ctx *cctx)
+{
+	struct cgrp_ctx *cgc;
+	struct cell	*cell;
+	u32		 seq, assign_gen;
+
+	seq = READ_ONCE(applied_configuration_seq);
+	barrier();
+
+	if (!(cell = lookup_cell(tctx->cell)))
+		return -ENOENT;
+
+	if (READ_ONCE(cell->gen) != tctx->cell_gen) {
+		cstat_inc(CSTAT_REFRESH, tctx->cell, cctx);
+		return refresh_task_cell(p, tctx);
+	}
+
+	/*
+	 * Some cgroup left the cell, check whether it was the task's. The
+	 * cgroup generation is bumped before the cell's assignment
+	 * generation, so it cannot be stale here.
+	 */
+	assign_gen = READ_ONCE(cell->assign_gen);
+	if (assign_gen != tctx->cell_assign_gen) {
+		struct cgroup *cgrp __free(cgroup) = task_cgroup(p);
+		if (!cgrp)
+			return -1;
+
+		barrier();
+		cgc = lookup_cgrp_ctx_fallible(cgrp);
+		if (!cgc || cgrp->kn->id != tctx->cgid ||
+		    READ_ONCE(cgc->gen) != tctx->cgrp_gen) {
+			cstat_inc(CSTAT_REFRESH, tctx->cell, cctx);
+			return update_task_cell(p, tctx, cgrp);
+		}
+		tctx->cell_assign_gen = assign_gen;
+	}
+
+	tctx->configuration_seq = seq;
+	return 0;
+}
+
 /* Check if we need to update the cell/cpumask mapping */
 static __always_inline int maybe_refresh_cell(struct task_struct *p,
-					      struct task_ctx	 *tctx)
+					      struct task_ctx	 *tctx,
+					      struct cpu_ctx	 *cctx)
 {
-	if (tctx->configuration_seq != READ_ONCE(applied_configuration_seq))
-		return refresh_task_cell(p, tctx);
+	int ret;
+
+	if (tctx->configuration_seq != READ_ONCE(applied_configuration_seq) &&
+	    (ret = refresh_task_cell_gen(p, tctx, cctx)))
+		return ret;
 
 	/*
 	 * When not using CPU controller, check if task's cgroup changed.
@@ -695,7 +809,7 @@ s32 BPF_STRUCT_OPS(mitosis_select_cpu, struct task_struct *p, s32 prev_cpu,
 	if (!(cctx = lookup_cpu_ctx(-1)) || !(tctx = lookup_task_ctx(p)))
 		return prev_cpu;
 
-	if (maybe_refresh_cell(p, tctx) < 0)
+	if (maybe_refresh_cell(p, tctx, cctx) < 0)
 		return prev_cpu;
 
 	if (!tctx->all_cell_cpus_allowed) {
@@ -742,7 +856,7 @@ void BPF_STRUCT_OPS(mitosis_enqueue, struct task_struct *p, u64 enq_flags)
 	if (!(tctx = lookup_task_ctx(p)) || !(cctx = lookup_cpu_ctx(-1)))
 		return;
 
-	if (maybe_refresh_cell(p, tctx) < 0)
+	if (maybe_refresh_cell(p, tctx, cctx) < 0)
 		return;
 
 	/* Ensure this is done *AFTER* refreshing cell which might manipulate vtime */
@@ -1049,7 +1163,173 @@ static inline int get_cgroup_cpumask(struct cgroup	  *cgrp,
 u32 level_cells[MAX_CG_DEPTH];
 
 /*
- * On tick, we identify new cells and apply CPU assignment
+ * The cpuset cells in the order update_timer_cb() walked them, see
+ * assign_moved_cpus().
+ */
+u32 walked_cells[MAX_CELLS];
+
+/*
+ * Add the CPUs that joined or left a cell to @moved and return the LLCs whose
+ * CPU counts in the cell need to be recomputed. A NULL @old_mask stands for a
+ * cell that had no CPUs.
+ */
+static __always_inline u32 diff_cell_cpumask(const struct cpumask *old_mask,
+					     const struct cpumask *new_mask,
+					     struct bpf_cpumask	  *diff,
+					     struct bpf_cpumask	  *moved)
+{
+	if (old_mask)
+		bpf_cpumask_xor(diff, old_mask, new_mask);
+	else
+		bpf_cpumask_copy(diff, new_mask);
+
+	bpf_cpumask_or(moved, (const struct cpumask *)moved,
+		       (const struct cpumask *)diff);
+
+	if (!enable_llc_awareness)
+		return 0;
+
+	return cpumask_llcs((const struct cpumask *)diff);
+}
+
+/*
+ * Swap @new_mask in as the cpumask of @cell_idx and bump the cell generation.
+ * Only the counts of @dirty_llcs are recomputed.
+ */
+static __always_inline int
+publish_cell_cpumask(struct cell_cpumask_wrapper *cpumaskw, int cell_idx,
+		     const struct cpumask *new_mask, u32 dirty_llcs)
+{
+	struct bpf_cpumask *bpf_cpumask __free(bpf_cpumask) =
+		bpf_kptr_xchg(&cpumaskw->tmp_cpumask, NULL);
+	if (!bpf_cpumask) {
+		scx_bpf_error("tmp_cpumask should never be null");
+		return -EINVAL;
+	}
+	bpf_cpumask_copy(bpf_cpumask, new_mask);
+
+	/*
+	 * Recalc LLC counts BEFORE making cpumask visible.
+	 * Pass the new mask explicitly to avoid race
+	 * if recalc did a lookup_cell_cpumask()
+	 */
+	if (enable_llc_awareness) {
+		if (recalc_cell_llc_counts(cell_idx,
+					   (const struct cpumask *)bpf_cpumask,
+					   dirty_llcs))
+			return -EINVAL;
+	}
+
+	bpf_cpumask =
+		bpf_kptr_xchg(&cpumaskw->cpumask, no_free_ptr(bpf_cpumask));
+	if (!bpf_cpumask) {
+		scx_bpf_error("cpumask should never be null");
+		return -EINVAL;
+	}
+
+	/* bpf_cpumask now holds the old cpumask, put it back as tmp */
+	struct bpf_cpumask *stale __free(bpf_cpumask) = bpf_kptr_xchg(
+		&cpumaskw->tmp_cpumask, no_free_ptr(bpf_cpumask));
+	if (stale) {
+		scx_bpf_error("tmp_cpumask should be null");
+		return -EINVAL;
+	}
+
+	barrier();
+	return bump_cell_gen(cell_idx);
+}
+
+/*
+ * Empty the cpumasks of the cells freed since the last update, so that their
+ * CPUs get moved to their new owners and a reallocated cell starts afresh.
+ */
+static __always_inline int sweep_freed_cells(struct bpf_cpumask *moved)
+{
+	struct cell_cpumask_wrapper *cpumaskw;
+	struct bpf_cpumask	    *cpumask;
+	struct cell		    *cell;
+	u32			     cell_idx;
+
+	bpf_for(cell_idx, 1, MAX_CELLS)
+	{
+		if (!(cell = lookup_cell(cell_idx)))
+			return -ENOENT;
+
+		if (READ_ONCE(cell->in_use))
+			continue;
+
+		if (!(cpumaskw = bpf_map_lookup_elem(&cell_cpumasks,
+						     &cell_idx))) {
+			scx_bpf_error("Failed to find cell cpumask: %d",
+				      cell_idx);
+			return -ENOENT;
+		}
+
+		cpumask = cpumaskw->cpumask;
+		if (!cpumask ||
+		    bpf_cpumask_empty((const struct cpumask *)cpumask))
+			continue;
+
+		bpf_cpumask_or(moved, (const struct cpumask *)moved,
+			       (const struct cpumask *)cpumask);
+		bpf_cpumask_clear(cpumask);
+	}
+
+	return 0;
+}
+
+/*
+ * Point the CPUs in @moved to the cell that owns them now. The root cell owns
+ * the CPUs no cpuset cell claims. As the cgroups are walked in pre-order, a
+ * nested cell overrides its ancestors for the CPUs they share, so any other CPU
+ * belongs to the last walked cell that contains it.
+ */
+static __always_inline int assign_moved_cpus(const struct cpumask *moved,
+					      u32		    nr_walked)
+{
+	const struct cpumask *root_mask, *cell_mask;
+	struct cpu_ctx	     *cpu_ctx;
+	u32		      cpu, i, idx, owner;
+
+	if (!(root_mask = lookup_cell_cpumask(ROOT_CELL_ID)))
+		return -ENOENT;
+
+	bpf_for(cpu, 0, nr_possible_cpus)
+	{
+		if (!bpf_cpumask_test_cpu(cpu, moved))
+			continue;
+
+		owner = ROOT_CELL_ID;
+		if (!bpf_cpumask_test_cpu(cpu, root_mask)) {
+			bpf_for(i, 0, nr_walked)
+			{
+				idx = nr_walked - 1 - i;
+				if (idx >= MAX_CELLS)
+					break;
+
+				if (!(cell_mask = lookup_cell_cpumask(
+					      walked_cells[idx])))
+					return -ENOENT;
+
+				if (bpf_cpumask_test_cpu(cpu, cell_mask)) {
+					owner = walked_cells[idx];
+					break;
+				}
+			}
+		}
+
+		if (!(cpu_ctx = lookup_cpu_ctx(cpu)))
+			return -ENOENT;
+		cpu_ctx->cell = owner;
+	}
+
+	return 0;
+}
+
+/*
+ * On tick, we identify new cells and apply CPU assignment. Only the cells whose
+ * cpumask changed are republished, and only the CPUs that moved between cells
+ * and the LLCs they belong to are updated.
  */
 static int update_timer_cb(void *map, int *key, struct bpf_timer *timer)
 {
@@ -1068,6 +1348,22 @@ static int update_timer_cb(void *map, int *key, struct bpf_timer *timer)
 	if (!entry)
 		return 0;
 
+	/*
+	 * Scratch cpumasks: the CPUs claimed by cpuset cells, the CPUs that
+	 * moved between cells, and the CPUs that joined or left the cell being
+	 * updated.
+	 */
+	struct bpf_cpumask *cells_cpumask __free(bpf_cpumask) =
+		bpf_cpumask_create();
+	struct bpf_cpumask *moved_cpumask __free(bpf_cpumask) =
+		bpf_cpumask_create();
+	struct bpf_cpumask *diff_cpumask __free(bpf_cpumask) =
+		bpf_cpumask_create();
+	if (!cells_cpumask || !moved_cpumask || !diff_cpumask) {
+		scx_bpf_error("Failed to create scratch cpumasks");
+		return 0;
+	}
+
 	/* Get the root cell (cell 0) and its cpumask */
 	int			     zero = 0;
 	struct cell_cpumask_wrapper *root_cell_cpumaskw;
@@ -1077,31 +1373,18 @@ static int update_timer_cb(void *map, int *key, struct bpf_timer *timer)
 		return 0;
 	}
 
-	struct bpf_cpumask *root_bpf_cpumask __free(bpf_cpumask) =
-		bpf_kptr_xchg(&root_cell_cpumaskw->tmp_cpumask, NULL);
-	if (!root_bpf_cpumask) {
-		scx_bpf_error("tmp_cpumask should never be null");
-		return 0;
-	}
-	if (!root_cell_cpumaskw->cpumask) {
-		scx_bpf_error("root cpumasks should never be null");
-		return 0;
-	}
-
 	guard(rcu)();
 	if (!all_cpumask) {
 		scx_bpf_error("NULL all_cpumask");
 		return 0;
 	}
 
-	/*
-	 * Initialize root cell cpumask to all cpus, and then remove from it as we
-	 * go
-	 */
-	bpf_cpumask_copy(root_bpf_cpumask, (const struct cpumask *)all_cpumask);
+	if (sweep_freed_cells(moved_cpumask))
+		return 0;
 
 	struct cgroup_subsys_state *root_css, *pos;
 	struct cgroup		   *cur_cgrp;
+	u32			    nr_walked = 0;
 
 	if (!root_cgrp) {
 		scx_bpf_error("root_cgrp should not be null");
@@ -1171,7 +1454,8 @@ static int update_timer_cb(void *map, int *key, struct bpf_timer *timer)
 				 * cgroup's ancestor's cells in level_cells.
 				 */
 				u32 parent_cell = level_cells[level - 1];
-				WRITE_ONCE(cgrp_ctx->cell, parent_cell);
+				if (set_cgrp_cell(cgrp_ctx, parent_cell))
+					return 0;
 				level_cells[level] = parent_cell;
 			}
 			continue;
@@ -1181,13 +1465,24 @@ static int update_timer_cb(void *map, int *key, struct bpf_timer *timer)
 		/*
 		 * cgroup has a cpumask, allocate a new cell if needed, and assign cpus
 		 */
-		int cell_idx = READ_ONCE(cgrp_ctx->cell);
+		int  cell_idx = READ_ONCE(cgrp_ctx->cell);
+		bool new_cell = false;
 		if (!cgrp_ctx->cell_owner) {
 			cell_idx = allocate_cell();
 			if (cell_idx < 0)
 				return 0;
 			cgrp_ctx->cell_owner = true;
+			new_cell	     = true;
+		}
+
+		if (nr_walked >= MAX_CELLS) {
+			scx_bpf_error("Too many cpuset cells");
+			return 0;
 		}
+		walked_cells[nr_walked++] = cell_idx;
+		bpf_cpumask_or(cells_cpumask,
+			       (const struct cpumask *)cells_cpumask,
+			       (const struct cpumask *)&entry->cpumask);
 
 		struct cell_cpumask_wrapper *cell_cpumaskw;
 		if (!(cell_cpumaskw =
@@ -1197,58 +1492,31 @@ static int update_timer_cb(void *map, int *key, struct bpf_timer *timer)
 			return 0;
 		}
 
-		struct bpf_cpumask *bpf_cpumask __free(bpf_cpumask) =
-			bpf_kptr_xchg(&cell_cpumaskw->tmp_cpumask, NULL);
-		if (!bpf_cpumask) {
-			scx_bpf_error("tmp_cpumask should never be null");
-			return 0;
-		}
-		bpf_cpumask_copy(bpf_cpumask,
-				 (const struct cpumask *)&entry->cpumask);
-		int cpu_idx;
-		bpf_for(cpu_idx, 0, nr_possible_cpus)
-		{
-			if (bpf_cpumask_test_cpu(
-				    cpu_idx,
-				    (const struct cpumask *)&entry->cpumask)) {
-				struct cpu_ctx *cpu_ctx;
-				if (!(cpu_ctx = lookup_cpu_ctx(cpu_idx)))
-					return 0;
-				cpu_ctx->cell = cell_idx;
-				bpf_cpumask_clear_cpu(cpu_idx,
-						      root_bpf_cpumask);
-			}
-		}
-
 		/*
-		 * Recalc LLC counts BEFORE making cpumask visible.
-		 * Pass the new mask explicitly to avoid race
-		 * if recalc did a lookup_cell_cpumask()
+		 * Cells whose cpuset didn't change are left alone. A new cell
+		 * may inherit stale LLC counts, so recompute all of them.
 		 */
-		if (enable_llc_awareness) {
-			if (recalc_cell_llc_counts(
-				    cell_idx,
-				    (const struct cpumask *)bpf_cpumask))
+		struct bpf_cpumask *cur_cpumask = cell_cpumaskw->cpumask;
+		if (new_cell || !cur_cpumask ||
+		    !bpf_cpumask_equal((const struct cpumask *)&entry->cpumask,
+				       (const struct cpumask *)cur_cpumask)) {
+			u32 dirty_llcs = diff_cell_cpumask(
+				new_cell ? NULL :
+					   (const struct cpumask *)cur_cpumask,
+				(const struct cpumask *)&entry->cpumask,
+				diff_cpumask, moved_cpumask);
+			if (new_cell)
+				dirty_llcs = ALL_LLCS;
+
+			if (publish_cell_cpumask(
+				    cell_cpumaskw, cell_idx,
+				    (const struct cpumask *)&entry->cpumask,
+				    dirty_llcs))
 				return 0;
 		}
 
-		bpf_cpumask = bpf_kptr_xchg(&cell_cpumaskw->cpumask,
-					    no_free_ptr(bpf_cpumask));
-		if (!bpf_cpumask) {
-			scx_bpf_error("cpumask should never be null");
+		if (set_cgrp_cell(cgrp_ctx, cell_idx))
 			return 0;
-		}
-
-		/* bpf_cpumask now holds the old cpumask, put it back as tmp */
-		struct bpf_cpumask *stale __free(bpf_cpumask) = bpf_kptr_xchg(
-			&cell_cpumaskw->tmp_cpumask, no_free_ptr(bpf_cpumask));
-		if (stale) {
-			scx_bpf_error("tmp_cpumask should be null");
-			return 0;
-		}
-
-		barrier();
-		WRITE_ONCE(cgrp_ctx->cell, cell_idx);
 		u32 level = cur_cgrp->level;
 		if (level <= 0 || level >= MAX_CG_DEPTH) {
 			scx_bpf_error("Cgroup hierarchy is too deep: %d",
@@ -1259,50 +1527,36 @@ static int update_timer_cb(void *map, int *key, struct bpf_timer *timer)
 	}
 
 	/*
-	 * assign root cell cpus that are left over
+	 * The root cell gets the cpus that are left over. cells_cpumask is no
+	 * longer needed after this, so reuse it for the new root cpumask.
 	 */
-	int cpu_idx;
-	bpf_for(cpu_idx, 0, nr_possible_cpus)
-	{
-		if (bpf_cpumask_test_cpu(cpu_idx, (const struct cpumask *)
-							  root_bpf_cpumask)) {
-			struct cpu_ctx *cpu_ctx;
-			if (!(cpu_ctx = lookup_cpu_ctx(cpu_idx)))
-				return 0;
-			cpu_ctx->cell = 0;
-		}
+	bpf_cpumask_and(diff_cpumask, (const struct cpumask *)all_cpumask,
+			(const struct cpumask *)cells_cpumask);
+	bpf_cpumask_xor(cells_cpumask, (const struct cpumask *)all_cpumask,
+			(const struct cpumask *)diff_cpumask);
+
+	struct bpf_cpumask *root_cur_cpumask = root_cell_cpumaskw->cpumask;
+	if (!root_cur_cpumask) {
+		scx_bpf_error("root cpumasks should never be null");
+		return 0;
 	}
 
-	/*
-	 * Recalc LLC counts for root cell BEFORE making cpumask visible.
-	 * Pass the new mask explicitly to avoid race if recalc did a
-	 * lookup_cell_cpumask()
-	 */
-	if (enable_llc_awareness)
-		if (recalc_cell_llc_counts(
-			    ROOT_CELL_ID,
-			    (const struct cpumask *)root_bpf_cpumask))
-			return 0;
+	if (!bpf_cpumask_equal((const struct cpumask *)cells_cpumask,
+			       (const struct cpumask *)root_cur_cpumask)) {
+		u32 dirty_llcs = diff_cell_cpumask(
+			(const struct cpumask *)root_cur_cpumask,
+			(const struct cpumask *)cells_cpumask, diff_cpumask,
+			moved_cpumask);
 
-	/*
-	 * Publish: swap new cpumask in, get old one back.
-	 * After this point, all CPUs see the new mask.
-	 */
-	root_bpf_cpumask = bpf_kptr_xchg(&root_cell_cpumaskw->cpumask,
-					 no_free_ptr(root_bpf_cpumask));
-	if (!root_bpf_cpumask) {
-		scx_bpf_error("root cpumask should never be null");
-		return 0;
+		if (publish_cell_cpumask(root_cell_cpumaskw, ROOT_CELL_ID,
+					 (const struct cpumask *)cells_cpumask,
+					 dirty_llcs))
+			return 0;
 	}
 
-	/* root_bpf_cpumask now holds the old mask, put it back as tmp */
-	struct bpf_cpumask *root_stale __free(bpf_cpumask) =
-		bpf_kptr_xchg(&root_cell_cpumaskw->tmp_cpumask,
-			      no_free_ptr(root_bpf_cpumask));
-	if (root_stale) {
-		scx_bpf_error("root tmp_cpumask should be null");
+	if (assign_moved_cpus((const struct cpumask *)moved_cpumask,
+			      nr_walked))
 		return 0;
-	}
 
 	barrier();
 	WRITE_ONCE(applied_configuration_seq, local_configuration_seq);
@@ -2116,7 +2370,8 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(mitosis_init)
 	if (enable_llc_awareness) {
 		{
 			guard(rcu)();
-			if (recalc_cell_llc_counts(ROOT_CELL_ID, NULL))
+			if (recalc_cell_llc_counts(ROOT_CELL_ID, NULL,
+						   ALL_LLCS))
 				return -EINVAL;
 		}
 	}
@@ -2296,6 +2551,17 @@ int apply_cell_config(void *ctx)
 			}
 		}
 
+		/* Only tasks of cells whose cpumasks changed need a refresh */
+		bool cpumask_changed = true;
+		scoped_guard(rcu)
+		{
+			struct bpf_cpumask *cur_cpumask = cpumaskw->cpumask;
+			if (cur_cpumask)
+				cpumask_changed = !bpf_cpumask_equal(
+					(const struct cpumask *)new_cpumask,
+					(const struct cpumask *)cur_cpumask);
+		}
+
 		/* Swap the new cpumask into place */
 		new_cpumask = bpf_kptr_xchg(&cpumaskw->cpumask,
 					    no_free_ptr(new_cpumask));
@@ -2356,6 +2622,17 @@ int apply_cell_config(void *ctx)
 					bpf_cpumask_set_cpu(bcpu, bmask);
 			}
 
+			scoped_guard(rcu)
+			{
+				struct bpf_cpumask *cur_bmask =
+					cpumaskw->borrowable_cpumask;
+				if (!cur_bmask ||
+				    !bpf_cpumask_equal(
+					    (const struct cpumask *)bmask,
+					    (const struct cpumask *)cur_bmask))
+					cpumask_changed = true;
+			}
+
 			bmask = bpf_kptr_xchg(&cpumaskw->borrowable_cpumask,
 					      no_free_ptr(bmask));
 			if (!bmask) {
@@ -2373,6 +2650,9 @@ int apply_cell_config(void *ctx)
 				return -EINVAL;
 			}
 		}
+
+		if (cpumask_changed && bump_cell_gen(cell_id))
+			return -EINVAL;
 	}
 
 	/* Phase 3: Apply cell-to-cgroup assignments for owner cgroups */
@@ -2415,8 +2695,9 @@ int apply_cell_config(void *ctx)
 		cell->in_use	 = 1;
 		cell->owner_cgid = cgid;
 
-		cgc->cell	 = cell_id;
-		cgc->cell_owner	 = true;
+		if (set_cgrp_cell(cgc, cell_id))
+			return -EINVAL;
+		cgc->cell_owner = true;
 	}
 
 	/*
@@ -2497,7 +2778,8 @@ int apply_cell_config(void *ctx)
 			else
 				parent_cell = 0;
 
-			WRITE_ONCE(cgrp_ctx->cell, parent_cell);
+			if (set_cgrp_cell(cgrp_ctx, parent_cell))
+				return -EINVAL;
 			level_cells[level] = parent_cell;
 		}
 	}
@@ -73,6 +73,10 @@ struct task_ctx {
 	/* latest configuration that was applied for this task */
 	/* (to know if it has to be re-applied) */
 	u32 configuration_seq;
+	/* generations of the task's cgroup and cell at the last refresh */
+	u32 cgrp_gen;
+	u32 cell_gen;
+	u32 cell_assign_gen;
 	/* Is this task allowed on all cores of its cell? */
 	bool all_cell_cpus_allowed;
 	/* Set when task is dispatched to a borrowed CPU from another cell.
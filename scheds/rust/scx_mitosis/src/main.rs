@@ -217,6 +217,8 @@ struct Scheduler<'a> {
     metrics: Metrics,
     stats_server: Option<StatsServer<(), Metrics>>,
     last_configuration_seq: Option<u32>,
+    /// applied_configuration_seq at the last metrics collection
+    metrics_configuration_seq: u32,
     /// Last observed cpuset_seq for cpuset change detection
     last_cpuset_seq: u32,
     /// Optional cell manager for --cell-parent-cgroup mode
@@ -412,6 +414,7 @@ impl<'a> Scheduler<'a> {
             metrics: Metrics::default(),
             stats_server: Some(stats_server),
             last_configuration_seq: None,
+            metrics_configuration_seq: 0,
             last_cpuset_seq: 0,
             cell_manager,
             enable_borrowing: opts.enable_borrowing,
@@ -1000,6 +1003,8 @@ impl<'a> Scheduler<'a> {
 
         self.log_all_queue_stats(&cell_stats_delta)?;
 
+        self.collect_refresh_metrics(&cell_stats_delta);
+
         if self.cell_manager.is_some() {
             self.collect_demand_metrics(&cpu_ctxs)?;
         }
@@ -1020,6 +1025,38 @@ impl<'a> Scheduler<'a> {
         Ok(())
     }
 
+    /// Count the task cell refreshes triggered by the reconfigurations applied since
+    /// the last collection.
+    fn collect_refresh_metrics(&mut self, cell_stats_delta: &[[u64; NR_CSTATS]; MAX_CELLS]) {
+        let seq = self.last_configuration_seq.unwrap_or(0);
+        let reconfig_count = seq.wrapping_sub(self.metrics_configuration_seq) as u64;
+        self.metrics_configuration_seq = seq;
+
+        let mut refresh_count = 0;
+        for (cell, stats) in cell_stats_delta.iter().enumerate() {
+            let refreshes = stats[bpf_intf::cell_stat_idx_CSTAT_REFRESH as usize];
+            refresh_count += refreshes;
+            if let Some(cell_metrics) = self.metrics.cells.get_mut(&(cell as u32)) {
+                cell_metrics.refresh_count = refreshes;
+            }
+        }
+
+        self.metrics.reconfig_count = reconfig_count;
+        self.metrics.refresh_count = refresh_count;
+        self.metrics.refreshes_per_reconfig = if reconfig_count > 0 {
+            refresh_count as f64 / reconfig_count as f64
+        } else {
+            0.0
+        };
+
+        if reconfig_count > 0 {
+            debug!(
+                "{} reconfigurations triggered {} task cell refreshes",
+                reconfig_count, refresh_count
+            );
+        }
+    }
+
     /// Compute per-cell demand metrics (utilization, borrowed, lent) from BPF running_ns counters.
     fn collect_demand_metrics(&mut self, cpu_ctxs: &[bpf_intf::cpu_ctx]) -> Result<()> {
         // Per-cell cumulative counters derived from BPF per-CPU running_ns:
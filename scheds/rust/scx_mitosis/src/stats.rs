@@ -46,6 +46,8 @@ pub struct CellMetrics {
     pub lent_pct: f64,
     #[stat(desc = "EWMA-smoothed utilization %")]
     pub smoothed_util_pct: f64,
+    #[stat(desc = "Task cell refreshes triggered by reconfigurations")]
+    pub refresh_count: u64,
 }
 
 impl CellMetrics {
@@ -97,6 +99,12 @@ pub struct Metrics {
     pub lent_pct: f64,
     #[stat(desc = "Number of rebalancing events")]
     pub rebalance_count: u64,
+    #[stat(desc = "Number of applied cell reconfigurations")]
+    pub reconfig_count: u64,
+    #[stat(desc = "Task cell refreshes triggered by reconfigurations")]
+    pub refresh_count: u64,
+    #[stat(desc = "Task cell refreshes per reconfiguration")]
+    pub refreshes_per_reconfig: f64,
     #[stat(desc = "Per-cell metrics")] // TODO: cell names
     pub cells: BTreeMap<u32, CellMetrics>,
 }
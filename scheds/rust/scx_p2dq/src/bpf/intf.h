@@ -28,6 +28,7 @@ enum consts {
 	MAX_LLC_SHARDS		= 32,
 	MAX_TASK_PRIO		= 39,
 	MAX_TOPO_NODES		= 1024,
+	MAX_POP_BATCH		= 8,
 
 	NSEC_PER_USEC		= 1000ULL,
 	NSEC_PER_MSEC		= (1000ULL * NSEC_PER_USEC),
@@ -127,6 +127,7 @@ const volatile struct {
 	u64 dhq_max_imbalance;
 
 	bool atq_enabled;
+	bool atq_percpu;
 	bool dhq_enabled;
 	bool cpu_priority;
 	bool task_slice;
@@ -152,6 +153,7 @@ const volatile struct {
 	.dhq_max_imbalance = 3,
 
 	.atq_enabled = false,
+	.atq_percpu = false,
 	.dhq_enabled = false,
 	.cpu_priority = false,
 	.task_slice = true,
@@ -199,12 +201,10 @@ u64 dsq_time_slices[MAX_DSQS_PER_LLC];
 u16 cpu_energy_cost[MAX_CPUS];  // Energy cost coefficient (0-65535)
 u16 cpu_capacity[MAX_CPUS];     // CPU capacity (0-1024)
 
-/* DHQ per LLC pair for migration (MAX_LLCS / 2 DHQs) */
-scx_dhq_t *llc_pair_dhqs[MAX_LLCS / 2];
+/* DHQ per NUMA node for migration, with one strand per LLC of the node */
+scx_dhq_t *node_dhqs[MAX_NUMA_NODES];
 /* Track number of LLCs per NUMA node for strand assignment */
 u32 llcs_per_node[MAX_NUMA_NODES];
-/* Global DHQ counter for unique indexing */
-u32 global_dhq_count = 0;
 
 u64 min_slice_ns = 500;
 
@@ -498,7 +498,8 @@ static u64 llc_nr_queued(struct llc_ctx *llcx)
 
 	if (topo_config.nr_llcs > 1) {
 		if (p2dq_config.dhq_enabled)
-			nr_queued += scx_dhq_nr_queued(llcx->mig_dhq);
+			nr_queued += scx_dhq_nr_queued_strand(llcx->mig_dhq,
+							      llcx->dhq_strand);
 		else if (p2dq_config.atq_enabled)
 			nr_queued += scx_atq_nr_queued(llcx->mig_atq);
 		else
@@ -514,8 +515,9 @@ static int llc_create_atqs(struct llc_ctx *llcx)
 		return 0;
 
 	if (topo_config.nr_llcs > 1) {
-		llcx->mig_atq = (scx_atq_t *)scx_atq_create_size(false,
-								 topo_config.nr_cpus);
+		llcx->mig_atq = (scx_atq_t *)scx_atq_create_flags(false,
+					topo_config.nr_cpus,
+					p2dq_config.atq_percpu ? SCX_ATQ_F_PERCPU : 0);
 		if (!llcx->mig_atq) {
 			scx_bpf_error("ATQ failed to create ATQ for LLC %u",
 				      llcx->id);
@@ -529,16 +531,50 @@ static int llc_create_atqs(struct llc_ctx *llcx)
 }
 
 /*
- * Create DHQ for LLC pair migration.
- * DHQs are shared between pairs of LLCs in the same NUMA node.
- * Each LLC is assigned to a strand (A or B) based on its order in the node.
- * Number of DHQs = number of LLCs per node / 2
+ * Node of @llc_id. llc_ctx->node_id is only filled in by init_cpu(), which
+ * runs after the LLCs are initialized, so look it up in the CPU topology.
+ */
+static s32 llc_node_id(u64 llc_id)
+{
+	u32 cpu;
+
+	bpf_for(cpu, 0, topo_config.nr_cpus) {
+		if (cpu >= MAX_CPUS)
+			break;
+
+		if (cpu_llc_ids[cpu] == llc_id)
+			return cpu_node_ids[cpu];
+	}
+
+	return -ENOENT;
+}
+
+static u32 node_nr_llcs(u32 node_id)
+{
+	u32 i, nr = 0;
+
+	bpf_for(i, 0, topo_config.nr_llcs) {
+		if (i >= MAX_LLCS)
+			break;
+
+		if (llc_node_id(llc_ids[i]) == node_id)
+			nr++;
+	}
+
+	return nr;
+}
+
+/*
+ * Create DHQ for LLC migration.
+ * Every NUMA node has one DHQ, and each LLC of the node is assigned its own
+ * strand based on its order in the node. A dispatching CPU only has to
+ * probe its node's DHQ instead of one queue per LLC pair.
  */
 static int llc_create_dhqs(struct llc_ctx *llcx)
 {
-	u32 node_id = llcx->node_id;
-	u32 node_llc_count;
-	u32 dhq_index;
+	u32 nr_strands;
+	u64 dhq_capacity;
+	s32 node_id;
 	u64 strand;
 
 	if (!p2dq_config.dhq_enabled)
@@ -547,71 +583,61 @@ static int llc_create_dhqs(struct llc_ctx *llcx)
 	if (topo_config.nr_llcs <= 1)
 		return 0;
 
-	if (node_id >= MAX_NUMA_NODES) {
-		scx_bpf_error("DHQ: node_id %u >= MAX_NUMA_NODES", node_id);
+	node_id = llc_node_id(llcx->id);
+	if (node_id < 0 || node_id >= MAX_NUMA_NODES) {
+		scx_bpf_error("DHQ: invalid node %d for LLC %u", node_id, llcx->id);
 		return -EINVAL;
 	}
 
-	/* Get current LLC count for this NUMA node */
-	node_llc_count = llcs_per_node[node_id];
-
-	/* Strand: A for first LLC in pair, B for second */
-	strand = (node_llc_count % 2 == 0) ? SCX_DHQ_STRAND_A : SCX_DHQ_STRAND_B;
-
-	/* First LLC in a pair: create a new DHQ */
-	if (strand == SCX_DHQ_STRAND_A) {
-		dhq_index = global_dhq_count;
-		if (dhq_index >= (MAX_LLCS / 2)) {
-			scx_bpf_error("DHQ: dhq_index %u >= MAX_LLCS/2", dhq_index);
+	/* First LLC of the node: create the node's DHQ */
+	if (!node_dhqs[node_id]) {
+		nr_strands = node_nr_llcs(node_id);
+		if (!nr_strands || nr_strands > SCX_DHQ_MAX_STRANDS) {
+			scx_bpf_error("DHQ: node %d has %u LLCs, max %u",
+				      node_id, nr_strands, SCX_DHQ_MAX_STRANDS);
 			return -EINVAL;
 		}
 
 		/* Create fixed-size DHQ with priority mode for lowest vtime selection.
-		 * Capacity scales with system size: 4x CPUs ensures enough headroom
-		 * for queued tasks under load without excessive memory usage.
+		 * Capacity scales with system size: 2x CPUs per strand ensures enough
+		 * headroom for queued tasks under load without excessive memory usage.
 		 * Max imbalance controls strand balance for cross-LLC load balancing.
 		 */
-		u64 dhq_capacity = topo_config.nr_cpus * 4;
-		llc_pair_dhqs[dhq_index] = (scx_dhq_t *)scx_dhq_create_balanced(
+		dhq_capacity = topo_config.nr_cpus * 2 * nr_strands;
+		node_dhqs[node_id] = (scx_dhq_t *)scx_dhq_create_strands(
 			false,                          /* vtime mode */
 			dhq_capacity,                   /* fixed capacity */
 			SCX_DHQ_MODE_PRIORITY,          /* lowest vtime wins */
-			p2dq_config.dhq_max_imbalance   /* max_imbalance from config */
+			p2dq_config.dhq_max_imbalance,  /* max_imbalance from config */
+			nr_strands                      /* one strand per LLC */
 		);
-		if (!llc_pair_dhqs[dhq_index]) {
-			scx_bpf_error("DHQ failed to create DHQ %u for node %u",
-				      dhq_index, node_id);
+		if (!node_dhqs[node_id]) {
+			scx_bpf_error("DHQ failed to create DHQ for node %d", node_id);
 			return -ENOMEM;
 		}
-		trace("DHQ %u created for node %u (LLC %u, strand A) capacity=%llu",
-		      dhq_index, node_id, llcx->id, dhq_capacity);
-
-		/* Assign DHQ and strand to this LLC */
-		llcx->mig_dhq = llc_pair_dhqs[dhq_index];
-		llcx->dhq_strand = strand;
-		global_dhq_count++;
-	} else {
-		/* Second LLC in pair: use the most recently created DHQ */
-		dhq_index = global_dhq_count - 1;
-		if (dhq_index >= (MAX_LLCS / 2) || !llc_pair_dhqs[dhq_index]) {
-			scx_bpf_error("DHQ: DHQ %u not available for second LLC %u",
-				      dhq_index, llcx->id);
-			return -EINVAL;
-		}
-		trace("DHQ %u assigned to LLC %u (node %u, strand B)",
-		      dhq_index, llcx->id, node_id);
+		trace("DHQ created for node %d with %u strands capacity=%llu",
+		      node_id, nr_strands, dhq_capacity);
+	}
 
-		/* Assign DHQ and strand to this LLC */
-		llcx->mig_dhq = llc_pair_dhqs[dhq_index];
-		llcx->dhq_strand = strand;
+	strand = llcs_per_node[node_id];
+	if (strand >= node_dhqs[node_id]->nr_strands) {
+		scx_bpf_error("DHQ: no strand left for LLC %u in node %d",
+			      llcx->id, node_id);
+		return -EINVAL;
 	}
 
+	trace("DHQ of node %d assigned to LLC %u (strand %llu)",
+	      node_id, llcx->id, strand);
+
+	/* Assign DHQ and strand to this LLC */
+	llcx->mig_dhq = node_dhqs[node_id];
+	llcx->dhq_strand = strand;
+
 	llcs_per_node[node_id]++;
 
 	return 0;
 }
 
-
 struct p2dq_timer p2dq_timers[MAX_TIMERS] = {
 	{lb_timer_intvl_ns,
 	     CLOCK_BOOTTIME, 0},
@@ -2182,10 +2208,17 @@ static void complete_p2dq_enqueue(struct enqueue_promise *pro, struct task_struc
 			scx_bpf_error("invalid DHQ");
 			break;
 		}
-		ret = scx_dhq_insert_vtime(pro->dhq.dhq,
-					   (u64)p->pid,
-					   pro->dhq.vtime,
-					   pro->dhq.strand);
+		if (!(taskc = lookup_task_ctx(p))) {
+			scx_bpf_error("invalid task ctx for DHQ enqueue");
+			break;
+		}
+		ret = scx_dhq_insert_vtime_indexed(pro->dhq.dhq,
+						   (u64)p->pid,
+						   pro->dhq.vtime,
+						   pro->dhq.strand,
+						   &taskc->dhq_handle);
+		if (!ret)
+			taskc->dhq = pro->dhq.dhq;
 		if (ret) {
 			// The DHQ insert failed (EAGAIN if imbalanced, ENOSPC if full)
 			// Fallback to the DSQ
@@ -2412,6 +2445,80 @@ void BPF_STRUCT_OPS(p2dq_stopping, struct task_struct *p, bool runnable)
 	}
 }
 
+/*
+ * Whether the migration DHQ of @llcx is worth popping from @cpuc. The DHQ is
+ * shared by all LLCs of a node and popped in its dequeue mode, so the
+ * dispatching CPU has already tried its own node's DHQ.
+ */
+static bool llc_dhq_pending(struct llc_ctx *llcx, struct cpu_ctx *cpuc)
+{
+	return llcx->mig_dhq && llcx->mig_dhq != cpuc->mig_dhq &&
+	       scx_dhq_nr_queued(llcx->mig_dhq) > 0;
+}
+
+/*
+ * Moves a batch of tasks from the LLC's migration ATQ/DHQ to the LLC DSQ
+ * while taking the queue lock only once. Used when the LLC is overloaded
+ * and one task per lock round-trip can't keep up.
+ */
+static bool consume_llc_batch(struct llc_ctx *llcx, struct cpu_ctx *cpuc)
+{
+	struct task_struct *p;
+	task_ctx *taskc;
+	u64 __arena *batch = cpuc->pop_batch;
+	int i, nr;
+
+	if (p2dq_config.dhq_enabled && !llc_dhq_pending(llcx, cpuc))
+		return false;
+
+	if (!p2dq_config.dhq_enabled &&
+	    (!llcx->mig_atq || !scx_atq_nr_queued(llcx->mig_atq)))
+		return false;
+
+	if (p2dq_config.dhq_enabled)
+		nr = scx_dhq_pop_batch(llcx->mig_dhq, batch, MAX_POP_BATCH);
+	else
+		nr = scx_atq_pop_batch(llcx->mig_atq, batch, MAX_POP_BATCH);
+
+	if (nr <= 0)
+		return false;
+
+	bpf_for(i, 0, nr) {
+		if (i >= MAX_POP_BATCH)
+			break;
+
+		if (p2dq_config.dhq_enabled) {
+			p = bpf_task_from_pid((s32)batch[i]);
+			if (!p) {
+				trace("DHQ failed to get pid %llu", batch[i]);
+				continue;
+			}
+			if (!(taskc = lookup_task_ctx(p))) {
+				bpf_task_release(p);
+				continue;
+			}
+		} else {
+			taskc = (task_ctx *)batch[i];
+			p = bpf_task_from_pid((s32)taskc->pid);
+			if (!p) {
+				trace("ATQ failed to get pid %llu", taskc->pid);
+				continue;
+			}
+		}
+
+		scx_bpf_dsq_insert_vtime(p,
+					 cpuc->llc_dsq,
+					 taskc->slice_ns,
+					 p->scx.dsq_vtime,
+					 taskc->enq_flags);
+		bpf_task_release(p);
+	}
+
+	trace("LLC %u batch moved %d tasks to LLC DSQ", llcx->id, nr);
+
+	return scx_bpf_dsq_move_to_local(cpuc->llc_dsq);
+}
+
 static bool consume_llc(struct llc_ctx *llcx)
 {
 	struct task_struct *p;
@@ -2427,9 +2534,19 @@ static bool consume_llc(struct llc_ctx *llcx)
 	if (!(cpuc = lookup_cpu_ctx(cpu)))
 		return false;
 
-	if (p2dq_config.dhq_enabled &&
-	    scx_dhq_nr_queued(llcx->mig_dhq) > 0) {
-		pid = scx_dhq_pop_strand(llcx->mig_dhq, llcx->dhq_strand);
+	/*
+	 * Only batch from our own LLC. The batch lands in this LLC's DSQ,
+	 * so batching on a steal would drag a whole batch across LLCs to
+	 * run one task, where the single pop below moves one at a time.
+	 */
+	if ((p2dq_config.dhq_enabled || p2dq_config.atq_enabled) &&
+	    cpuc->pop_batch && llcx->id == cpuc->llc_id &&
+	    (overloaded || llc_ctx_test_flag(llcx, LLC_CTX_F_SATURATED)) &&
+	    consume_llc_batch(llcx, cpuc))
+		return true;
+
+	if (p2dq_config.dhq_enabled && llc_dhq_pending(llcx, cpuc)) {
+		pid = scx_dhq_pop(llcx->mig_dhq);
 		if (!pid) {
 			trace("DHQ pop returned NULL");
 			goto try_dsq;
@@ -2462,6 +2579,9 @@ static bool consume_llc(struct llc_ctx *llcx)
 	} else if (p2dq_config.atq_enabled &&
 	    scx_atq_nr_queued(llcx->mig_atq) > 0) {
 		taskc = (task_ctx *)scx_atq_pop(llcx->mig_atq);
+		if (!taskc)
+			goto try_dsq;
+
 		p = bpf_task_from_pid((s32)taskc->pid);
 		if (!p) {
 			trace("ATQ failed to get pid %llu", taskc->pid);
@@ -2729,7 +2849,8 @@ check_llc_dsq:
 	// Migration eligible vtime
 	if (topo_config.nr_llcs > 1) {
 		if (p2dq_config.dhq_enabled) {
-			pid = scx_dhq_peek_strand(cpuc->mig_dhq, cpuc->dhq_strand);
+			/* Lowest vtime across all LLCs of the node */
+			pid = scx_dhq_peek(cpuc->mig_dhq);
 			if (pid && (p = bpf_task_from_pid((s32)pid))) {
 				if (likely(bpf_cpumask_test_cpu(cpu, p->cpus_ptr)) &&
 				    (p->scx.dsq_vtime < min_vtime || min_vtime == 0)) {
@@ -2775,7 +2896,7 @@ check_llc_dsq:
 	// First try the DHQ/ATQ with the lowest vtime for fairness.
 	if (unlikely(min_dhq)) {
 		trace("DHQ dispatching %llu with min vtime %llu", min_dhq, min_vtime);
-		pid = scx_dhq_pop_strand(min_dhq, cpuc->dhq_strand);
+		pid = scx_dhq_pop(min_dhq);
 		if (likely(pid && (p = bpf_task_from_pid((s32)pid)))) {
 			if (unlikely(!(taskc = lookup_task_ctx(p)))) {
 				bpf_task_release(p);
@@ -2853,7 +2974,7 @@ check_llc_dsq:
 	}
 
 	if (unlikely(p2dq_config.dhq_enabled)) {
-		pid = scx_dhq_pop_strand(cpuc->mig_dhq, cpuc->dhq_strand);
+		pid = scx_dhq_pop(cpuc->mig_dhq);
 		if (likely(pid && (p = bpf_task_from_pid((s32)pid)))) {
 			if (unlikely(!(taskc = lookup_task_ctx(p)))) {
 				bpf_task_release(p);
@@ -3276,6 +3397,15 @@ static s32 init_cpu(int cpu)
 	cpuc->mig_dhq = llcx->mig_dhq;
 	cpuc->dhq_strand = llcx->dhq_strand;
 
+	if ((p2dq_config.atq_enabled || p2dq_config.dhq_enabled) &&
+	    !cpuc->pop_batch) {
+		cpuc->pop_batch = scx_static_alloc(MAX_POP_BATCH * sizeof(u64), 1);
+		if (!cpuc->pop_batch) {
+			scx_bpf_error("failed to allocate pop batch for cpu %u", cpu);
+			return -ENOMEM;
+		}
+	}
+
 	if (cpu_ctx_test_flag(cpuc, CPU_CTX_F_IS_BIG)) {
 		trace("CPU[%d] is big", cpu);
 		bpf_rcu_read_lock();
@@ -3683,6 +3813,22 @@ void BPF_STRUCT_OPS(p2dq_dequeue, struct task_struct *p __arg_trusted, u64 deq_f
 	task_ctx *taskc;
 	int ret;
 
+	if (p2dq_config.dhq_enabled) {
+		if (!(taskc = lookup_task_ctx(p)) || !taskc->dhq)
+			return;
+
+		/*
+		 * Drop the task from the migration DHQ so that it does not
+		 * linger there until another CPU pops its stale pid. -ENOENT
+		 * means it was already popped.
+		 */
+		ret = scx_dhq_cancel(taskc->dhq, &taskc->dhq_handle);
+		if (ret && ret != -ENOENT)
+			scx_bpf_error("scx_dhq_cancel returned %d", ret);
+
+		return;
+	}
+
 	if (!p2dq_config.atq_enabled)
 		return;
 
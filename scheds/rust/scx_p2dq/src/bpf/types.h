@@ -58,6 +58,7 @@ struct cpu_ctx {
 	scx_atq_t			*mig_atq;
 	scx_dhq_t			*mig_dhq;
 	u64				dhq_strand;  /* Which DHQ strand (A or B) for this CPU's LLC */
+	u64 __arena			*pop_batch;  /* Scratch for batched ATQ/DHQ pops */
 };
 
 /* llc_ctx state flag bits */
@@ -184,6 +185,10 @@ struct task_p2dq {
 
 	/* Fork/exec balancing fields */
 	u32			target_llc_hint; /* Target LLC for initial placement (MAX_LLCS = none) */
+
+	/* Migration DHQ the task was last queued on, for ops.dequeue. */
+	scx_dhq_t		*dhq;
+	struct scx_minheap_handle dhq_handle;
 };
 
 typedef struct task_p2dq __arena task_ctx;
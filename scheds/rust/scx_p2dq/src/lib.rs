@@ -202,13 +202,18 @@ pub struct SchedulerOpts {
     #[clap(long, default_value_t = false, action = clap::ArgAction::Set)]
     pub atq_enabled: bool,
 
-    /// Use a double helix queue (DHQ) for LLC migration. DHQ provides two-strand
-    /// queue structure for cache-aware task migration between LLCs.
+    /// Stage ATQ inserts in per-CPU rings instead of taking the ATQ lock on
+    /// every enqueue. Only has an effect with --atq-enabled.
+    #[clap(long, default_value_t = false, action = clap::ArgAction::Set)]
+    pub atq_percpu: bool,
+
+    /// Use a double helix queue (DHQ) for LLC migration. Each NUMA node gets one
+    /// DHQ with a strand per LLC for cache-aware task migration between LLCs.
     #[clap(long, default_value_t = false, action = clap::ArgAction::Set)]
     pub dhq_enabled: bool,
 
     /// Maximum imbalance allowed between DHQ strands. Controls how far one strand
-    /// can dequeue ahead of the other. Lower values maintain tighter balance,
+    /// can grow past the mean of the other strands of its node. Lower values maintain tighter balance,
     /// higher values allow more asymmetric cross-LLC migration (0 = unlimited).
     #[clap(long, default_value = "3", value_parser = clap::value_parser!(u64).range(0..=100))]
     pub dhq_max_imbalance: u64,
@@ -467,6 +472,8 @@ macro_rules! init_open_skel {
                 opts.atq_enabled && compat::ksym_exists("bpf_spin_unlock").unwrap_or(false),
             );
 
+            rodata.p2dq_config.atq_percpu = MaybeUninit::new(opts.atq_percpu);
+
             rodata.p2dq_config.dhq_enabled = MaybeUninit::new(
                 opts.dhq_enabled && compat::ksym_exists("bpf_spin_unlock").unwrap_or(false),
             );
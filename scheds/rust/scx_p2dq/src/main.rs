@@ -265,6 +265,7 @@ impl<'a> Scheduler<'a> {
                 .sum();
             stats[stat as usize] = sum;
         }
+        let alloc_stats = ArenaLib::alloc_stats(self.skel.object()).unwrap_or_default();
         Metrics {
             atq_enq: stats[stat_idx_P2DQ_STAT_ATQ_ENQ as usize],
             atq_reenq: stats[stat_idx_P2DQ_STAT_ATQ_REENQ as usize],
@@ -293,6 +294,9 @@ impl<'a> Scheduler<'a> {
             eas_little_select: stats[stat_idx_P2DQ_STAT_EAS_LITTLE_SELECT as usize],
             eas_big_select: stats[stat_idx_P2DQ_STAT_EAS_BIG_SELECT as usize],
             eas_fallback: stats[stat_idx_P2DQ_STAT_EAS_FALLBACK as usize],
+            alloc_fail: alloc_stats.alloc_failures,
+            alloc_reserve_miss: alloc_stats.reserve_misses,
+            alloc_refill_ns_max: alloc_stats.refill_ns_max,
         }
     }
 
@@ -300,6 +304,10 @@ impl<'a> Scheduler<'a> {
         let (res_ch, req_ch) = self.stats_server.channels();
 
         while !shutdown.load(Ordering::Relaxed) && !uei_exited!(&self.skel, uei) {
+            // Keep the arena allocator reserves topped up, so allocations
+            // from the scheduling paths do not have to allocate pages inline.
+            ArenaLib::refill(self.skel.object())?;
+
             match req_ch.recv_timeout(Duration::from_secs(1)) {
                 Ok(()) => res_ch.send(self.get_metrics())?,
                 Err(RecvTimeoutError::Timeout) => {}
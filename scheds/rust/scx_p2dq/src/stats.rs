@@ -102,6 +102,12 @@ pub struct Metrics {
     pub eas_big_select: u64,
     #[stat(desc = "Number of times EAS fell back to non-preferred core type")]
     pub eas_fallback: u64,
+    #[stat(desc = "Number of arena allocations that failed")]
+    pub alloc_fail: u64,
+    #[stat(desc = "Number of arena slabs allocated inline because the reserve was empty")]
+    pub alloc_reserve_miss: u64,
+    #[stat(desc = "Time the slowest arena reserve refill took (ns)")]
+    pub alloc_refill_ns_max: u64,
 }
 
 impl Metrics {
@@ -165,6 +171,13 @@ impl Metrics {
             ));
         }
 
+        stats_line.push_str(&format!(
+            "\n\talloc fail/reserve miss {}/{} refill max {}us",
+            self.alloc_fail,
+            self.alloc_reserve_miss,
+            self.alloc_refill_ns_max / 1000,
+        ));
+
         writeln!(w, "{}", stats_line)?;
         Ok(())
     }
@@ -198,6 +211,9 @@ impl Metrics {
             eas_little_select: self.eas_little_select - rhs.eas_little_select,
             eas_big_select: self.eas_big_select - rhs.eas_big_select,
             eas_fallback: self.eas_fallback - rhs.eas_fallback,
+            alloc_fail: self.alloc_fail - rhs.alloc_fail,
+            alloc_reserve_miss: self.alloc_reserve_miss - rhs.alloc_reserve_miss,
+            alloc_refill_ns_max: self.alloc_refill_ns_max,
         }
     }
 }
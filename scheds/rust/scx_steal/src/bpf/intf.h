@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This software may be used and distributed according to the terms of the GNU
+ * General Public License version 2.
+ */
+#ifndef __INTF_H
+#define __INTF_H
+
+#ifndef __VMLINUX_H__
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+typedef unsigned long u64;
+
+typedef signed char s8;
+typedef signed short s16;
+typedef signed int s32;
+typedef signed long s64;
+#endif /* __VMLINUX_H__ */
+
+enum consts {
+	FALLBACK_DSQ		= 0,
+	/* Bounds the number of stale pids skipped per dispatch. */
+	MAX_DISPATCH_TRIES	= 8,
+};
+
+enum stat_idx {
+	STAT_DIRECT,
+	STAT_LOCAL,
+	STAT_STOLEN,
+	STAT_STEAL_FAIL,
+	STAT_FALLBACK,
+	STAT_STALE,
+	NR_STATS,
+};
+
+#endif /* __INTF_H */
@@ -0,0 +1,164 @@
+/* Copyright (c) Meta Platforms, Inc. and affiliates. */
+/*
+ * This software may be used and distributed according to the terms of the
+ * GNU General Public License version 2.
+ *
+ * scx_steal is a sample scheduler for the arena library's work-stealing
+ * engine (lib/wsteal.bpf.c).
+ *
+ * Every CPU owns a deque of runnable tasks. ops.enqueue pushes the task to
+ * the deque of the CPU it runs on, which for wakeups is the waker's CPU, and
+ * kicks an idle CPU if there is one. ops.dispatch pops the oldest task from
+ * the local deque and, once it is empty, steals the oldest task from the
+ * closest non-empty deque: SMT siblings first, then the LLC,
+ * the NUMA node and the rest of the system.
+ *
+ * Tasks that cannot run on every CPU bypass the deques and go to a shared
+ * fallback DSQ, since a thief could not run them.
+ *
+ * The deques hold pids. A task can be pushed more than once if it is
+ * dequeued and enqueued again before it runs, but once it has been
+ * dispatched the kernel drops the stale copies.
+ */
+
+#include <scx/common.bpf.h>
+
+#include <bpf_arena_common.bpf.h>
+
+#include <lib/arena.h>
+#include <lib/cpumask.h>
+#include <lib/sdt_task.h>
+#include <lib/topology.h>
+#include <lib/wsteal.h>
+
+#include "intf.h"
+
+char _license[] SEC("license") = "GPL";
+
+UEI_DEFINE(uei);
+
+const volatile u64 slice_ns = 5ULL * 1000 * 1000;
+const volatile u32 nr_online_cpus;
+
+static scx_ws_t *steal_ws;
+
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, u32);
+	__type(value, u64);
+	__uint(max_entries, NR_STATS);
+} stats SEC(".maps");
+
+static inline void stat_inc(enum stat_idx idx)
+{
+	u32 idx_v = idx;
+	u64 *cnt_p = bpf_map_lookup_elem(&stats, &idx_v);
+	if (cnt_p)
+		(*cnt_p)++;
+}
+
+s32 BPF_STRUCT_OPS(steal_select_cpu, struct task_struct *p, s32 prev_cpu, u64 wake_flags)
+{
+	bool is_idle = false;
+	s32 cpu;
+
+	cpu = scx_bpf_select_cpu_dfl(p, prev_cpu, wake_flags, &is_idle);
+	if (is_idle) {
+		stat_inc(STAT_DIRECT);
+		scx_bpf_dsq_insert(p, SCX_DSQ_LOCAL, slice_ns, 0);
+	}
+
+	return cpu;
+}
+
+void BPF_STRUCT_OPS(steal_enqueue, struct task_struct *p, u64 enq_flags)
+{
+	s32 cpu = bpf_get_smp_processor_id();
+	s32 idle;
+
+	if (p->nr_cpus_allowed < nr_online_cpus ||
+	    scx_ws_push(steal_ws, cpu, p->pid)) {
+		stat_inc(STAT_FALLBACK);
+		scx_bpf_dsq_insert(p, FALLBACK_DSQ, slice_ns, enq_flags);
+		return;
+	}
+
+	/* Wake up an idle CPU so it can come and steal the task. */
+	idle = scx_bpf_pick_idle_cpu(p->cpus_ptr, 0);
+	if (idle >= 0)
+		scx_bpf_kick_cpu(idle, SCX_KICK_IDLE);
+}
+
+void BPF_STRUCT_OPS(steal_dispatch, s32 cpu, struct task_struct *prev)
+{
+	struct task_struct *p;
+	u64 pid;
+	int i;
+
+	bpf_for(i, 0, MAX_DISPATCH_TRIES) {
+		/*
+		 * Tasks whose slice expired are pushed back at the bottom, so
+		 * popping from there would run them again right away and
+		 * leave the older tasks to thieves or the watchdog.
+		 */
+		if (!scx_ws_pop_oldest(steal_ws, cpu, &pid)) {
+			stat_inc(STAT_LOCAL);
+		} else if (scx_bpf_dsq_move_to_local(FALLBACK_DSQ)) {
+			return;
+		} else if (!scx_ws_steal(steal_ws, cpu, &pid)) {
+			stat_inc(STAT_STOLEN);
+		} else {
+			stat_inc(STAT_STEAL_FAIL);
+			return;
+		}
+
+		p = bpf_task_from_pid(pid);
+		if (!p) {
+			stat_inc(STAT_STALE);
+			continue;
+		}
+
+		scx_bpf_dsq_insert(p, SCX_DSQ_LOCAL, slice_ns, 0);
+		bpf_task_release(p);
+
+		return;
+	}
+}
+
+s32 BPF_STRUCT_OPS_SLEEPABLE(steal_init)
+{
+	if (!steal_ws) {
+		scx_bpf_error("work-stealing engine not initialized");
+		return -EINVAL;
+	}
+
+	return scx_bpf_create_dsq(FALLBACK_DSQ, -1);
+}
+
+void BPF_STRUCT_OPS(steal_exit, struct scx_exit_info *ei)
+{
+	UEI_RECORD(uei, ei);
+}
+
+/*
+ * Called by userspace after the arena library and the topology are set up,
+ * since the victim order of every CPU is derived from the topology.
+ */
+SEC("syscall")
+int steal_setup(void)
+{
+	steal_ws = scx_ws_create();
+	if (!steal_ws)
+		return -ENOMEM;
+
+	return 0;
+}
+
+SCX_OPS_DEFINE(steal_ops,
+	       .select_cpu		= (void *)steal_select_cpu,
+	       .enqueue			= (void *)steal_enqueue,
+	       .dispatch		= (void *)steal_dispatch,
+	       .init			= (void *)steal_init,
+	       .exit			= (void *)steal_exit,
+	       .timeout_ms		= 5000,
+	       .name			= "steal");
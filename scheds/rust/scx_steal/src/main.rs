@@ -0,0 +1,265 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+
+// This software may be used and distributed according to the terms of the
+// GNU General Public License version 2.
+mod bpf_skel;
+pub use bpf_skel::*;
+pub mod bpf_intf;
+pub use bpf_intf::*;
+
+use std::mem::MaybeUninit;
+use std::sync::atomic::AtomicBool;
+use std::sync::atomic::Ordering;
+use std::sync::Arc;
+use std::time::Duration;
+use std::time::Instant;
+
+use anyhow::bail;
+use anyhow::Context;
+use anyhow::Result;
+use clap::Parser;
+use libbpf_rs::skel::Skel;
+use libbpf_rs::MapCore as _;
+use libbpf_rs::OpenObject;
+use libbpf_rs::ProgramInput;
+use log::info;
+use scx_arena::ArenaLib;
+use scx_utils::build_id;
+use scx_utils::init_libbpf_logging;
+use scx_utils::libbpf_clap_opts::LibbpfOpts;
+use scx_utils::scx_ops_attach;
+use scx_utils::scx_ops_load;
+use scx_utils::scx_ops_open;
+use scx_utils::uei_exited;
+use scx_utils::uei_report;
+use scx_utils::Topology;
+use scx_utils::UserExitInfo;
+use scx_utils::NR_CPU_IDS;
+
+const SCHEDULER_NAME: &str = "scx_steal";
+
+/// scx_steal: a sample work-stealing scheduler.
+///
+/// Every CPU queues the tasks it wakes up on its own deque and runs them in
+/// FIFO order. CPUs that run out of work steal the oldest task of the
+/// topologically closest busy CPU: SMT siblings first, then the LLC, the
+/// NUMA node and finally the whole system.
+///
+/// The scheduler exists to exercise the work-stealing engine of the arena
+/// library and is not tuned for production use.
+#[derive(Debug, Parser)]
+struct Opts {
+    /// Scheduling slice duration in microseconds.
+    #[clap(short = 's', long, default_value = "5000")]
+    slice_us: u64,
+
+    /// Interval in seconds between statistics reports, 0 disables them.
+    #[clap(long, default_value = "2.0")]
+    stats: f64,
+
+    /// Exit debug dump buffer length. 0 indicates default.
+    #[clap(long, default_value = "0")]
+    exit_dump_len: u32,
+
+    /// Enable verbose output, including libbpf details.
+    #[clap(short = 'v', long, action = clap::ArgAction::SetTrue)]
+    verbose: bool,
+
+    /// Print scheduler version and exit.
+    #[clap(short = 'V', long, action = clap::ArgAction::SetTrue)]
+    version: bool,
+
+    #[clap(flatten, next_help_heading = "Libbpf Options")]
+    pub libbpf: LibbpfOpts,
+}
+
+struct Scheduler<'a> {
+    skel: BpfSkel<'a>,
+    struct_ops: Option<libbpf_rs::Link>,
+}
+
+impl<'a> Scheduler<'a> {
+    fn setup_arenas(skel: &mut BpfSkel<'a>) -> Result<()> {
+        // The scheduler keeps no per-task arena state.
+        let task_size = std::mem::size_of::<u64>();
+        let arenalib = ArenaLib::init(skel.object_mut(), task_size, *NR_CPU_IDS)?;
+        arenalib.setup()?;
+
+        // The victim order of each CPU depends on the topology, so the engine
+        // can only be created once ArenaLib has set it up.
+        let input = ProgramInput {
+            ..Default::default()
+        };
+        let output = skel.progs.steal_setup.test_run(input)?;
+        if output.return_value != 0 {
+            bail!(
+                "Could not initialize the work-stealing engine, steal_setup returned {}",
+                output.return_value as i32
+            );
+        }
+
+        Ok(())
+    }
+
+    fn init(opts: &Opts, open_object: &'a mut MaybeUninit<OpenObject>) -> Result<Self> {
+        let topo = Topology::new()?;
+
+        let mut skel_builder = BpfSkelBuilder::default();
+        skel_builder.obj_builder.debug(opts.verbose);
+        init_libbpf_logging(None);
+        info!(
+            "{} {}",
+            SCHEDULER_NAME,
+            build_id::full_version(env!("CARGO_PKG_VERSION"))
+        );
+
+        let open_opts = opts.libbpf.clone().into_bpf_open_opts();
+        let mut skel = scx_ops_open!(skel_builder, open_object, steal_ops, open_opts)?;
+        skel.struct_ops.steal_ops_mut().exit_dump_len = opts.exit_dump_len;
+
+        let rodata = skel.maps.rodata_data.as_mut().unwrap();
+        rodata.nr_cpu_ids = *NR_CPU_IDS as u32;
+        rodata.nr_online_cpus = topo.all_cpus.len() as u32;
+        rodata.slice_ns = opts.slice_us * 1000;
+
+        let mut skel = scx_ops_load!(skel, steal_ops, uei)?;
+
+        Self::setup_arenas(&mut skel)?;
+
+        let struct_ops = Some(scx_ops_attach!(skel, steal_ops)?);
+        info!("{} scheduler started", SCHEDULER_NAME);
+
+        Ok(Self { skel, struct_ops })
+    }
+
+    fn read_stats(&self) -> Result<Vec<u64>> {
+        let mut stats = vec![0u64; stat_idx_NR_STATS as usize];
+
+        for stat in 0..stat_idx_NR_STATS {
+            let cpu_stat_vec: Vec<Vec<u8>> = self
+                .skel
+                .maps
+                .stats
+                .lookup_percpu(&stat.to_ne_bytes(), libbpf_rs::MapFlags::ANY)?
+                .context("missing stats entry")?;
+            stats[stat as usize] = cpu_stat_vec
+                .iter()
+                .map(|val| u64::from_ne_bytes(val.as_slice().try_into().unwrap()))
+                .sum();
+        }
+
+        Ok(stats)
+    }
+
+    fn report(&self, prev: &mut Vec<u64>) -> Result<()> {
+        let cur = self.read_stats()?;
+        let delta: Vec<u64> = cur.iter().zip(prev.iter()).map(|(c, p)| c - p).collect();
+        let stat = |idx: stat_idx| delta[idx as usize];
+
+        let stolen = stat(stat_idx_STAT_STOLEN);
+        let steal_tries = stolen + stat(stat_idx_STAT_STEAL_FAIL);
+
+        let alloc_stats = ArenaLib::alloc_stats(self.skel.object())?;
+
+        info!(
+            "direct={} local={} stolen={} steal_fail={} steal_success={:.1}% fallback={} stale={} \
+             alloc_fail={} reserve_miss={} refill_max={}us",
+            stat(stat_idx_STAT_DIRECT),
+            stat(stat_idx_STAT_LOCAL),
+            stolen,
+            stat(stat_idx_STAT_STEAL_FAIL),
+            if steal_tries > 0 {
+                stolen as f64 * 100.0 / steal_tries as f64
+            } else {
+                0.0
+            },
+            stat(stat_idx_STAT_FALLBACK),
+            stat(stat_idx_STAT_STALE),
+            alloc_stats.alloc_failures,
+            alloc_stats.reserve_misses,
+            alloc_stats.refill_ns_max / 1000,
+        );
+
+        *prev = cur;
+
+        Ok(())
+    }
+
+    fn exited(&mut self) -> bool {
+        uei_exited!(&self.skel, uei)
+    }
+
+    fn run(&mut self, opts: &Opts, shutdown: Arc<AtomicBool>) -> Result<UserExitInfo> {
+        let interval = Duration::from_secs_f64(opts.stats);
+        let mut prev = vec![0u64; stat_idx_NR_STATS as usize];
+        let mut last_report = Instant::now();
+
+        while !shutdown.load(Ordering::Relaxed) && !self.exited() {
+            std::thread::sleep(Duration::from_millis(100));
+
+            // Keep the allocator reserves above the watermark, so that
+            // allocations from non-sleepable contexts do not fail.
+            ArenaLib::refill(self.skel.object())?;
+
+            if opts.stats > 0.0 && last_report.elapsed() >= interval {
+                self.report(&mut prev)?;
+                last_report = Instant::now();
+            }
+        }
+
+        let _ = self.struct_ops.take();
+        uei_report!(&self.skel, uei)
+    }
+}
+
+impl Drop for Scheduler<'_> {
+    fn drop(&mut self) {
+        info!("Unregister {SCHEDULER_NAME} scheduler");
+    }
+}
+
+fn main() -> Result<()> {
+    let opts = Opts::parse();
+
+    if opts.version {
+        println!(
+            "{} {}",
+            SCHEDULER_NAME,
+            build_id::full_version(env!("CARGO_PKG_VERSION"))
+        );
+        return Ok(());
+    }
+
+    let loglevel = simplelog::LevelFilter::Info;
+
+    let mut lcfg = simplelog::ConfigBuilder::new();
+    lcfg.set_time_offset_to_local()
+        .expect("Failed to set local time offset")
+        .set_time_level(simplelog::LevelFilter::Error)
+        .set_location_level(simplelog::LevelFilter::Off)
+        .set_target_level(simplelog::LevelFilter::Off)
+        .set_thread_level(simplelog::LevelFilter::Off);
+    simplelog::TermLogger::init(
+        loglevel,
+        lcfg.build(),
+        simplelog::TerminalMode::Stderr,
+        simplelog::ColorChoice::Auto,
+    )?;
+
+    let shutdown = Arc::new(AtomicBool::new(false));
+    let shutdown_clone = shutdown.clone();
+    ctrlc::set_handler(move || {
+        shutdown_clone.store(true, Ordering::Relaxed);
+    })
+    .context("Error setting Ctrl-C handler")?;
+
+    let mut open_object = MaybeUninit::uninit();
+    loop {
+        let mut sched = Scheduler::init(&opts, &mut open_object)?;
+        if !sched.run(&opts, shutdown.clone())?.should_restart() {
+            break;
+        }
+    }
+
+    Ok(())
+}
@@ -23,6 +23,7 @@ fn main() {
         .add_source("../../../lib/topology.bpf.c")
         .add_source("../../../lib/rbtree.bpf.c")
         .add_source("../../../lib/atq.bpf.c")
+        .add_source("../../../lib/calq.bpf.c")
         .compile_link_gen()
         .unwrap();
 }
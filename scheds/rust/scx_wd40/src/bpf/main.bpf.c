@@ -687,6 +687,12 @@ void BPF_STRUCT_OPS(wd40_stopping, struct task_struct *p, bool runnable)
 	stopping_update_vtime(p);
 }
 
+void BPF_STRUCT_OPS(wd40_update_idle, s32 cpu, bool idle)
+{
+	/* Keep the arena idle mask behind scx_bitmap_pick_idle_cpu() current. */
+	scx_bitmap_idle_update(cpu, idle);
+}
+
 void BPF_STRUCT_OPS(wd40_quiescent, struct task_struct *p, u64 deq_flags)
 {
 	u64 now = scx_bpf_now(), interval;
@@ -877,6 +883,14 @@ s32 BPF_STRUCT_OPS_SLEEPABLE(wd40_init)
 
 	scx_bitmap_or(all_cpumask, all_cpumask, topo_all->mask);
 
+	/*
+	 * Idle CPUs are picked from the arena idle mask. We still use the
+	 * kernel's idle tracking for whole cores and @prev_cpu.
+	 */
+	ret = scx_bitmap_idle_init(true);
+	if (ret)
+		return ret;
+
 	bpf_for(i, 0, nr_cpu_ids) {
 
 		if (is_offline_cpu(i))
@@ -903,6 +917,7 @@ SCX_OPS_DEFINE(wd40,
 	       .running			= (void *)wd40_running,
 	       .stopping		= (void *)wd40_stopping,
 	       .quiescent		= (void *)wd40_quiescent,
+	       .update_idle		= (void *)wd40_update_idle,
 	       .set_weight		= (void *)wd40_set_weight,
 	       .set_cpumask		= (void *)wd40_set_cpumask,
 	       .init_task		= (void *)wd40_init_task,
@@ -910,4 +925,5 @@ SCX_OPS_DEFINE(wd40,
 	       .init			= (void *)wd40_init,
 	       .exit			= (void *)wd40_exit,
 	       .timeout_ms		= 10000,
+	       .flags			= SCX_OPS_KEEP_BUILTIN_IDLE,
 	       .name			= "wd40");
@@ -551,6 +551,7 @@ impl<'a> Scheduler<'a> {
             + stat(bpf_intf::stat_idx_RUSTY_STAT_GREEDY_LOCAL)
             + stat(bpf_intf::stat_idx_RUSTY_STAT_GREEDY_XNUMA);
         let stat_pct = |idx| stat(idx) as f64 / total as f64 * 100.0;
+        let alloc_stats = ArenaLib::alloc_stats(self.skel.object()).unwrap_or_default();
 
         let cpu_busy = if sc.cpu_total != 0 {
             (sc.cpu_busy as f64 / sc.cpu_total as f64) * 100.0
@@ -598,6 +599,10 @@ impl<'a> Scheduler<'a> {
             dl_clamp: stat_pct(bpf_intf::stat_idx_RUSTY_STAT_DL_CLAMP),
             dl_preset: stat_pct(bpf_intf::stat_idx_RUSTY_STAT_DL_PRESET),
 
+            alloc_fail: alloc_stats.alloc_failures,
+            alloc_reserve_miss: alloc_stats.reserve_misses,
+            alloc_refill_ns_max: alloc_stats.refill_ns_max,
+
             direct_greedy_cpus: self.tuner.direct_greedy_mask.as_raw_slice().to_owned(),
             kick_greedy_cpus: self.tuner.kick_greedy_mask.as_raw_slice().to_owned(),
 
@@ -632,6 +637,10 @@ impl<'a> Scheduler<'a> {
         while !shutdown.load(Ordering::Relaxed) && !uei_exited!(&self.skel, uei) {
             let now = Instant::now();
 
+            // Keep the arena allocator reserves topped up, so allocations
+            // from the scheduling paths do not have to allocate pages inline.
+            ArenaLib::refill(self.skel.object())?;
+
             if now >= next_tune_at {
                 self.tuner.step(&mut self.skel)?;
                 next_tune_at += self.tune_interval;
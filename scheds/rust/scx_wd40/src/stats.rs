@@ -154,6 +154,13 @@ pub struct ClusterStats {
     #[stat(desc = "% accumulated vtime budget used as-is")]
     pub dl_preset: f64,
 
+    #[stat(desc = "# of arena allocations that failed so far")]
+    pub alloc_fail: u64,
+    #[stat(desc = "# of arena slabs allocated inline because the reserve was empty so far")]
+    pub alloc_reserve_miss: u64,
+    #[stat(desc = "time the slowest arena reserve refill took in nsecs")]
+    pub alloc_refill_ns_max: u64,
+
     #[stat(_om_skip)]
     pub direct_greedy_cpus: Vec<u64>,
     #[stat(_om_skip)]
@@ -208,6 +215,14 @@ impl ClusterStats {
             self.dl_clamp, self.dl_preset,
         )?;
 
+        writeln!(
+            w,
+            "alloc_fail={} alloc_reserve_miss={} alloc_refill_max={}us",
+            self.alloc_fail,
+            self.alloc_reserve_miss,
+            self.alloc_refill_ns_max / 1000,
+        )?;
+
         writeln!(w, "slice={}us", self.slice_us)?;
         writeln!(
             w,
@@ -0,0 +1,215 @@
+#!/bin/bash
+
+# SPDX-License-Identifier: GPL-2.0
+# Copyright (c) 2026 Meta Platforms, Inc. and affiliates.
+#
+# Measure how the cgroup bandwidth library scales with the number of cgroups.
+
+usage() {
+    cat <<EOF
+Usage: $(basename "$0") [OPTIONS]
+
+Measure how the cgroup bandwidth library (lib/cgroup_bw) scales with the
+number of cgroups.
+
+The test:
+  1. Creates NR cgroups under PARENT/PREFIX, each with cpu.max set to
+     "QUOTA 100000", spread over subroots of FANOUT cgroups each
+  2. Runs a busy loop in BUSY of the cgroups
+  3. Samples the library statistics every INTERVAL seconds for DURATION
+  4. Reports the replenish time, the number of cgroups touched per
+     replenishment, the number of LLC contexts, the size of the cgroup
+     tables, and the change in used memory
+  5. Deletes all created cgroups
+
+OPTIONS:
+  -p, --parent PATH    Parent cgroupv2 path (default: /sys/fs/cgroup)
+  -n, --prefix NAME    Cgroup name prefix (default: cg_scale)
+  -c, --count NR       Number of cgroups to create (default: 20000)
+  -f, --fanout N       Number of cgroups per subroot (default: 1000)
+  -q, --quota US       cpu.max quota in us per 100 ms period (default: 50000)
+  -b, --busy N         Number of cgroups running a busy loop (default: 8)
+  -t, --time SEC       How long to sample the statistics (default: 10)
+  -i, --interval SEC   Sampling interval in seconds (default: 1)
+  -h, --help           Show this help and exit
+
+EXAMPLES:
+  sudo $(basename "$0")
+  sudo $(basename "$0") --count 5000 --busy 32
+  sudo $(basename "$0") --count 20000 --fanout 100 --time 30
+
+NOTES:
+  Requires a kernel with cgroupv2 and the cpu controller available, and a
+  running scheduler that uses the cgroup bandwidth library, for example:
+
+    sudo scx_lavd --enable-cpu-bw
+
+  The statistics are read from the scheduler's .bss map with bpftool and jq.
+EOF
+}
+
+PARENT="/sys/fs/cgroup"
+PREFIX="cg_scale"
+NR=20000
+FANOUT=1000
+QUOTA=50000
+BUSY=8
+DURATION=10
+INTERVAL=1
+
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        -p|--parent)   PARENT="$2"; shift 2 ;;
+        -n|--prefix)   PREFIX="$2"; shift 2 ;;
+        -c|--count)    NR="$2"; shift 2 ;;
+        -f|--fanout)   FANOUT="$2"; shift 2 ;;
+        -q|--quota)    QUOTA="$2"; shift 2 ;;
+        -b|--busy)     BUSY="$2"; shift 2 ;;
+        -t|--time)     DURATION="$2"; shift 2 ;;
+        -i|--interval) INTERVAL="$2"; shift 2 ;;
+        -h|--help)     usage; exit 0 ;;
+        *) echo "Unknown option: $1" >&2; usage >&2; exit 1 ;;
+    esac
+done
+
+ROOT="${PARENT}/${PREFIX}"
+BUSY_PIDS=()
+
+get_mem_used_kb() {
+    awk '/^MemTotal:/{t=$2} /^MemAvailable:/{a=$2} END{print t-a}' /proc/meminfo
+}
+
+# Find the .bss map holding the library statistics (cbw_stats).
+find_stats_map() {
+    local id
+    for id in $(bpftool -j map show | jq -r '.[] | select(.name | endswith(".bss")) | .id'); do
+        if bpftool -j map dump id "$id" 2>/dev/null |
+           jq -e '[.. | objects | select(has("cbw_stats"))] | length > 0' >/dev/null; then
+            echo "$id"
+            return 0
+        fi
+    done
+    return 1
+}
+
+read_stats() {
+    bpftool -j map dump id "$STATS_MAP" |
+        jq -c 'first(.. | objects | select(has("cbw_stats")) | .cbw_stats)'
+}
+
+cleanup() {
+    local pid s c
+
+    echo "Cleaning up..."
+    for pid in "${BUSY_PIDS[@]}"; do
+        kill "$pid" 2>/dev/null
+    done
+    wait 2>/dev/null
+
+    for s in "${ROOT}"/s_*; do
+        [[ -d "$s" ]] || continue
+        for c in "${s}"/c_*; do
+            [[ -d "$c" ]] && rmdir "$c" 2>/dev/null
+        done
+        rmdir "$s" 2>/dev/null
+    done
+    rmdir "$ROOT" 2>/dev/null
+}
+
+trap 'cleanup; exit 1' INT TERM
+
+for cmd in bpftool jq; do
+    if ! command -v "$cmd" >/dev/null; then
+        echo "Error: '$cmd' is required" >&2
+        exit 1
+    fi
+done
+
+if [[ ! -f "${PARENT}/cgroup.controllers" ]]; then
+    echo "Error: '${PARENT}' is not a cgroupv2 mount (no cgroup.controllers)" >&2
+    exit 1
+fi
+
+STATS_MAP=$(find_stats_map) || {
+    echo "Error: no running scheduler with cgroup bandwidth control (cbw_stats not found)" >&2
+    exit 1
+}
+
+echo "Configuration:"
+echo "  root     : ${ROOT}"
+echo "  cgroups  : ${NR} (${FANOUT} per subroot)"
+echo "  cpu.max  : ${QUOTA} 100000"
+echo "  busy     : ${BUSY} cgroups"
+echo "  time     : ${DURATION}s every ${INTERVAL}s"
+echo "  stats map: ${STATS_MAP}"
+echo ""
+
+echo "+cpu" > "${PARENT}/cgroup.subtree_control" || exit 1
+mkdir "$ROOT" || exit 1
+echo "+cpu" > "${ROOT}/cgroup.subtree_control" || { cleanup; exit 1; }
+
+BEFORE_STATS=$(read_stats)
+START_MEM_KB=$(get_mem_used_kb)
+START_MS=$(date +%s%3N)
+
+# Create the cgroups, FANOUT of them under each subroot.
+for (( i=0; i<NR; i++ )); do
+    SUBROOT="${ROOT}/s_$(( i / FANOUT ))"
+    if (( i % FANOUT == 0 )); then
+        mkdir "$SUBROOT" || { cleanup; exit 1; }
+        echo "+cpu" > "${SUBROOT}/cgroup.subtree_control" || { cleanup; exit 1; }
+    fi
+
+    CGPATH="${SUBROOT}/c_${i}"
+    mkdir "$CGPATH" || { echo "mkdir failed for $CGPATH" >&2; cleanup; exit 1; }
+    echo "${QUOTA} 100000" > "${CGPATH}/cpu.max" || { cleanup; exit 1; }
+
+    if (( i % 1000 == 999 )); then
+        printf "\r  created %d cgroups" "$(( i + 1 ))"
+    fi
+done
+printf "\r  created %d cgroups in %d ms\n" "$NR" "$(( $(date +%s%3N) - START_MS ))"
+
+# Spread the busy loops over the whole range of cgroups.
+for (( b=0; b<BUSY && b<NR; b++ )); do
+    i=$(( b * NR / BUSY ))
+    CGPATH="${ROOT}/s_$(( i / FANOUT ))/c_${i}"
+    bash -c "echo \$\$ > '${CGPATH}/cgroup.procs'; while :; do :; done" &
+    BUSY_PIDS+=($!)
+done
+
+echo ""
+printf "  %6s  %12s  %12s  %10s  %8s  %8s  %10s  %12s\n" \
+    "time" "repl_ns" "repl_ns_max" "touched" "nr_llcx" "llcx_free" "tables_kB" "Δmem_kB"
+
+for (( t=INTERVAL; t<=DURATION; t+=INTERVAL )); do
+    sleep "$INTERVAL"
+    STATS=$(read_stats)
+    printf "  %5ds  %12d  %12d  %10d  %8d  %8d  %10d  %+12d\n" "$t" \
+        "$(jq '.replenish_ns_last' <<<"$STATS")" \
+        "$(jq '.replenish_ns_max' <<<"$STATS")" \
+        "$(jq '.nr_touched_last' <<<"$STATS")" \
+        "$(jq '.nr_llcx' <<<"$STATS")" \
+        "$(jq '.nr_llcx_free' <<<"$STATS")" \
+        "$(( $(jq '.table_bytes' <<<"$STATS") / 1024 ))" \
+        "$(( $(get_mem_used_kb) - START_MEM_KB ))"
+done
+
+AFTER_STATS=$(read_stats)
+NR_REPL=$(( $(jq '.nr_replenish' <<<"$AFTER_STATS") - $(jq '.nr_replenish' <<<"$BEFORE_STATS") ))
+NR_FULL=$(( $(jq '.nr_full_replenish' <<<"$AFTER_STATS") - $(jq '.nr_full_replenish' <<<"$BEFORE_STATS") ))
+NR_TOUCHED=$(( $(jq '.nr_touched_total' <<<"$AFTER_STATS") - $(jq '.nr_touched_total' <<<"$BEFORE_STATS") ))
+
+echo ""
+echo "Summary:"
+echo "  replenishments   : ${NR_REPL} (${NR_FULL} full)"
+if (( NR_REPL > 0 )); then
+    echo "  touched/replenish: $(( NR_TOUCHED / NR_REPL ))"
+fi
+echo "  replenish_ns_max : $(jq '.replenish_ns_max' <<<"$AFTER_STATS")"
+echo "  cgroups          : $(jq '.nr_cgroups' <<<"$AFTER_STATS")"
+echo "  LLC contexts     : $(jq '.nr_llcx' <<<"$AFTER_STATS") attached, $(jq '.nr_llcx_free' <<<"$AFTER_STATS") free, $(jq '.nr_llcx_miss' <<<"$AFTER_STATS") misses"
+echo "  cgroup tables    : $(( $(jq '.table_bytes' <<<"$AFTER_STATS") / 1024 )) kB"
+echo "  memory change    : $(( $(get_mem_used_kb) - START_MEM_KB )) kB"
+
+cleanup
@@ -0,0 +1,166 @@
+#!/bin/bash
+
+# SPDX-License-Identifier: GPL-2.0
+# Copyright (c) 2026 Meta Platforms, Inc. and affiliates.
+#
+# Measure the throttle-to-reenqueue latency of the cgroup bandwidth library.
+
+usage() {
+    cat <<EOF
+Usage: $(basename "$0") [OPTIONS]
+
+Measure the throttle-to-reenqueue latency of the cgroup bandwidth library
+(lib/cgroup_bw): the time from a task of a throttled cgroup being put aside
+to it being reenqueued once the cgroup has budget again.
+
+The test:
+  1. Creates NR cgroups under PARENT/PREFIX, each with cpu.max set to
+     "QUOTA 100000", so that all of them get throttled
+  2. Starts TASKS busy loops in each cgroup, so that many tasks are parked
+     at a time
+  3. Runs for DURATION seconds and reports the latency percentiles from the
+     library's latency histogram
+  4. Deletes all created cgroups
+
+To compare batch sizes, run it once under each configuration, e.g.:
+
+  sudo scx_lavd --enable-cpu-bw --cpu-bw-reenq-batch 2   # fixed batch of 2
+  sudo scx_lavd --enable-cpu-bw                          # adaptive batch
+
+OPTIONS:
+  -p, --parent PATH    Parent cgroupv2 path (default: /sys/fs/cgroup)
+  -n, --prefix NAME    Cgroup name prefix (default: cg_lat)
+  -c, --count NR       Number of cgroups (default: 8)
+  -k, --tasks N        Busy loops per cgroup (default: 128)
+  -q, --quota US       cpu.max quota in us per 100 ms period (default: 20000)
+  -t, --time SEC       How long to run (default: 10)
+  -h, --help           Show this help and exit
+
+NOTES:
+  Requires a kernel with cgroupv2 and the cpu controller available, a
+  running scheduler that uses the cgroup bandwidth library, bpftool, and jq.
+  The latency histogram has log2 buckets in usec, so the percentiles are
+  reported as the upper bound of the bucket they fall into.
+EOF
+}
+
+PARENT="/sys/fs/cgroup"
+PREFIX="cg_lat"
+NR=8
+TASKS=128
+QUOTA=20000
+DURATION=10
+
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        -p|--parent) PARENT="$2"; shift 2 ;;
+        -n|--prefix) PREFIX="$2"; shift 2 ;;
+        -c|--count)  NR="$2"; shift 2 ;;
+        -k|--tasks)  TASKS="$2"; shift 2 ;;
+        -q|--quota)  QUOTA="$2"; shift 2 ;;
+        -t|--time)   DURATION="$2"; shift 2 ;;
+        -h|--help)   usage; exit 0 ;;
+        *) echo "Unknown option: $1" >&2; usage >&2; exit 1 ;;
+    esac
+done
+
+ROOT="${PARENT}/${PREFIX}"
+BUSY_PIDS=()
+
+# Find the .bss map holding the library statistics (cbw_stats).
+find_stats_map() {
+    local id
+    for id in $(bpftool -j map show | jq -r '.[] | select(.name | endswith(".bss")) | .id'); do
+        if bpftool -j map dump id "$id" 2>/dev/null |
+           jq -e '[.. | objects | select(has("cbw_stats"))] | length > 0' >/dev/null; then
+            echo "$id"
+            return 0
+        fi
+    done
+    return 1
+}
+
+read_stats() {
+    bpftool -j map dump id "$STATS_MAP" |
+        jq -c 'first(.. | objects | select(has("cbw_stats")) | .cbw_stats)'
+}
+
+cleanup() {
+    local pid c
+
+    for pid in "${BUSY_PIDS[@]}"; do
+        kill "$pid" 2>/dev/null
+    done
+    wait 2>/dev/null
+
+    for c in "${ROOT}"/c_*; do
+        [[ -d "$c" ]] && rmdir "$c" 2>/dev/null
+    done
+    rmdir "$ROOT" 2>/dev/null
+}
+
+trap 'cleanup; exit 1' INT TERM
+
+for cmd in bpftool jq; do
+    if ! command -v "$cmd" >/dev/null; then
+        echo "Error: '$cmd' is required" >&2
+        exit 1
+    fi
+done
+
+if [[ ! -f "${PARENT}/cgroup.controllers" ]]; then
+    echo "Error: '${PARENT}' is not a cgroupv2 mount (no cgroup.controllers)" >&2
+    exit 1
+fi
+
+STATS_MAP=$(find_stats_map) || {
+    echo "Error: no running scheduler with cgroup bandwidth control (cbw_stats not found)" >&2
+    exit 1
+}
+
+echo "Configuration:"
+echo "  root   : ${ROOT}"
+echo "  cgroups: ${NR} x ${TASKS} busy loops"
+echo "  cpu.max: ${QUOTA} 100000"
+echo "  time   : ${DURATION}s"
+echo ""
+
+echo "+cpu" > "${PARENT}/cgroup.subtree_control" || exit 1
+mkdir "$ROOT" || exit 1
+echo "+cpu" > "${ROOT}/cgroup.subtree_control" || { cleanup; exit 1; }
+
+for (( i=0; i<NR; i++ )); do
+    CGPATH="${ROOT}/c_${i}"
+    mkdir "$CGPATH" || { cleanup; exit 1; }
+    echo "${QUOTA} 100000" > "${CGPATH}/cpu.max" || { cleanup; exit 1; }
+
+    for (( k=0; k<TASKS; k++ )); do
+        bash -c "echo \$\$ > '${CGPATH}/cgroup.procs'; while :; do :; done" &
+        BUSY_PIDS+=($!)
+    done
+done
+
+# Let the cgroups settle into being throttled before taking the baseline.
+sleep 1
+BEFORE=$(read_stats)
+sleep "$DURATION"
+AFTER=$(read_stats)
+
+cleanup
+
+# Percentiles of the histogram delta. Bucket i holds [2**i, 2**(i+1)) usec.
+jq -rn --argjson a "$AFTER" --argjson b "$BEFORE" '
+    [range(0; $a.reenq_lat_hist | length) | $a.reenq_lat_hist[.] - $b.reenq_lat_hist[.]] as $h |
+    ($h | add) as $total |
+    def pct(p):
+        (p * $total / 100) as $want |
+        first(foreach range(0; $h | length) as $i (0; . + $h[$i];
+              if . >= $want then pow(2; $i + 1) else empty end)) // "-";
+    "reenqueued : \($total) tasks",
+    (if $total > 0 then
+        "p50        : < \(pct(50)) us",
+        "p90        : < \(pct(90)) us",
+        "p99        : < \(pct(99)) us",
+        "p99.9      : < \(pct(99.9)) us",
+        "max        : < \(pow(2; ([range(0; $h | length) | select($h[.] > 0)] | max) + 1)) us"
+     else empty end)'